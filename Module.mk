@@ -1,10 +1,26 @@
 json_headers += JsonWriter.h \
    JsonReader.h \
-   JsonValue.h
+   JsonValue.h \
+   JsonScan.h \
+   JsonStreamReader.h \
+   Cbor.h \
+   JsonPath.h \
+   JsonLines.h \
+   JsonBind.h \
+   JsonSnapshot.h \
+   JsonMergePatch.h
 
 json_sources += JsonWriter.cpp \
     JsonReader.cpp \
-    JsonValue.cpp
+    JsonValue.cpp \
+    JsonScan.cpp \
+    JsonStreamReader.cpp \
+    Cbor.cpp \
+    JsonPath.cpp \
+    JsonLines.cpp \
+    JsonBind.cpp \
+    JsonSnapshot.cpp \
+    JsonMergePatch.cpp
 
 json_dir = json
 
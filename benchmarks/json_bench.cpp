@@ -0,0 +1,374 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+#include "JsonReader.h"
+#include "JsonScan.h"
+#include "Cbor.h"
+#include "JsonLines.h"
+#include "JsonBind.h"
+#include "DurationTimer.h"
+#include "Util.h"
+
+/*****************************************************************************/
+/**
+ * @brief Generate a telemetry-like document (array of small records)
+ * @param targetSize approximate size of the document, in bytes
+ */
+static std::string MakeTelemetry(std::size_t targetSize)
+{
+    std::string doc = "[";
+    std::uint32_t id = 0U;
+
+    while (doc.size() < targetSize)
+    {
+        if (id > 0U)
+        {
+            doc += ",\n";
+        }
+        doc += "{\"id\":" + std::to_string(id) +
+               ",\"ts\":" + std::to_string(1546300800LL + id) +
+               ",\"name\":\"sensor-" + std::to_string(id % 512U) + "\"" +
+               ",\"unit\":\"degC\",\"ok\":" + ((id % 7U) ? "true" : "false") +
+               ",\"values\":[" + std::to_string(id % 100U) + ".25,-" + std::to_string(id % 13U) + ".5,1.0e3]" +
+               ",\"meta\":{\"site\":\"lab \\\"A\\\"\",\"tag\":null}}";
+        id++;
+    }
+    doc += "]";
+    return doc;
+}
+/*****************************************************************************/
+/**
+ * @brief Generate a string-heavy document (pretty printed form posts with text fields)
+ */
+static std::string MakeStrings(std::size_t targetSize)
+{
+    static const std::string text = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod "
+                                    "tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, "
+                                    "quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat.";
+    std::string doc = "[";
+    std::uint32_t id = 0U;
+
+    while (doc.size() < targetSize)
+    {
+        if (id > 0U)
+        {
+            doc += ",";
+        }
+        doc += "\n    {\n        \"title\": \"Message number " + std::to_string(id) + "\",\n"
+               "        \"body\": \"" + text + "\\n" + text + "\",\n"
+               "        \"signature\": \"" + text.substr(id % 64U, 80U) + "\"\n    }";
+        id++;
+    }
+    doc += "\n]";
+    return doc;
+}
+/*****************************************************************************/
+static const char *LevelName(JsonScan::Level level)
+{
+    switch (level)
+    {
+    case JsonScan::AVX2:
+        return "avx2";
+    case JsonScan::SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+/*****************************************************************************/
+enum Storage
+{
+    HEAP,
+    ARENA,
+    INTERNED    // arena with key interning
+};
+/*****************************************************************************/
+/**
+ * @brief Measure the parsing throughput, the time includes the destruction of the tree
+ */
+static void Measure(const std::string &name, const std::string &doc, std::uint32_t iterations, Storage storage)
+{
+    double best = 0.0;
+
+    for (std::uint32_t i = 0U; i < iterations; i++)
+    {
+        DurationTimer timer;
+        bool ok = false;
+        if (storage != HEAP)
+        {
+            JsonArena arena;
+            arena.SetKeyInterning(storage == INTERNED);
+            JsonValue json(arena.GetAllocator());
+            ok = JsonReader::ParseString(json, doc);
+        }
+        else
+        {
+            JsonValue json;
+            ok = JsonReader::ParseString(json, doc);
+        }
+        double elapsed = timer.elapsed();
+
+        if (!ok)
+        {
+            std::cerr << name << ": parse failure" << std::endl;
+            return;
+        }
+        if ((best == 0.0) || (elapsed < best))
+        {
+            best = elapsed;
+        }
+    }
+
+    double mb = static_cast<double>(doc.size()) / (1024.0 * 1024.0);
+    std::cout << std::left << std::setw(20) << name
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << mb << " MB"
+              << std::setw(12) << (mb / best) << " MB/s" << std::endl;
+}
+/*****************************************************************************/
+/**
+ * @brief Measure the serialization throughput of a parsed document
+ */
+static void MeasureWrite(const std::string &name, const std::string &doc, std::uint32_t iterations)
+{
+    JsonValue json;
+    double best = 0.0;
+    std::size_t size = 0U;
+
+    if (!JsonReader::ParseString(json, doc))
+    {
+        std::cerr << name << ": parse failure" << std::endl;
+        return;
+    }
+
+    for (std::uint32_t i = 0U; i < iterations; i++)
+    {
+        DurationTimer timer;
+        size = json.ToString().size();
+        double elapsed = timer.elapsed();
+
+        if ((best == 0.0) || (elapsed < best))
+        {
+            best = elapsed;
+        }
+    }
+
+    double mb = static_cast<double>(size) / (1024.0 * 1024.0);
+    std::cout << std::left << std::setw(20) << name
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << mb << " MB"
+              << std::setw(12) << (mb / best) << " MB/s" << std::endl;
+}
+/*****************************************************************************/
+template <typename Function>
+static double BestOf(std::uint32_t iterations, Function function)
+{
+    double best = 0.0;
+    for (std::uint32_t i = 0U; i < iterations; i++)
+    {
+        DurationTimer timer;
+        function();
+        double elapsed = timer.elapsed();
+        if ((best == 0.0) || (elapsed < best))
+        {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+/*****************************************************************************/
+/**
+ * @brief Compare the size and the encoding/decoding time of the text and CBOR forms
+ */
+static void MeasureCbor(const std::string &name, const std::string &doc, std::uint32_t iterations)
+{
+    JsonValue json;
+    if (!JsonReader::ParseString(json, doc))
+    {
+        std::cerr << name << ": parse failure" << std::endl;
+        return;
+    }
+
+    std::string text = json.ToString();
+    std::string cbor = json.ToCBor();
+
+    double textEncode = BestOf(iterations, [&json]() { json.ToString(); });
+    double cborEncode = BestOf(iterations, [&json]() { json.ToCBor(); });
+    double textDecode = BestOf(iterations, [&text]() { JsonValue value; JsonReader::ParseString(value, text); });
+    double cborDecode = BestOf(iterations, [&cbor]() { JsonValue value; CBor::Decoder::Decode(cbor, value); });
+
+    std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(2)
+              << " text " << (static_cast<double>(text.size()) / (1024.0 * 1024.0)) << " MB"
+              << ", cbor " << (static_cast<double>(cbor.size()) / (1024.0 * 1024.0)) << " MB ("
+              << (100.0 * static_cast<double>(cbor.size()) / static_cast<double>(text.size())) << " %)" << std::endl;
+    std::cout << std::left << std::setw(20) << "" << std::right
+              << " encode text " << (textEncode * 1000.0) << " ms, cbor " << (cborEncode * 1000.0) << " ms" << std::endl;
+    std::cout << std::left << std::setw(20) << "" << std::right
+              << " decode text " << (textDecode * 1000.0) << " ms, cbor " << (cborDecode * 1000.0) << " ms" << std::endl;
+}
+/*****************************************************************************/
+struct Meta
+{
+    std::string site;
+    std::optional<std::string> tag;
+};
+JSON_BIND(Meta, site, tag)
+
+struct Record
+{
+    std::int64_t id = 0;
+    std::int64_t ts = 0;
+    std::string name;
+    std::string unit;
+    bool ok = false;
+    std::vector<double> values;
+    Meta meta;
+};
+JSON_BIND(Record, id, ts, name, unit, ok, values, meta)
+/*****************************************************************************/
+/**
+ * @brief Telemetry records into structures: tree then GetValue() per field, or direct binding
+ */
+static void MeasureBind(const std::string &name, const std::string &doc, std::uint32_t iterations)
+{
+    double size = static_cast<double>(doc.size()) / (1024.0 * 1024.0);
+    double tree = BestOf(iterations, [&doc]() {
+        JsonValue json;
+        JsonReader::ParseString(json, doc);
+        std::vector<Record> records(json.GetArray().Size());
+        std::size_t i = 0U;
+        for (JsonArray::const_iterator it = json.GetArray().begin(); it != json.GetArray().end(); ++it, ++i)
+        {
+            Record &r = records[i];
+            r.id = it->FindValue("id").GetInteger64();
+            r.ts = it->FindValue("ts").GetInteger64();
+            it->GetValue("name", r.name);
+            it->GetValue("unit", r.unit);
+            it->GetValue("ok", r.ok);
+            for (JsonArray::const_iterator v = it->Find("values")->GetArray().begin(); v != it->Find("values")->GetArray().end(); ++v)
+            {
+                r.values.push_back(v->IsDouble() ? v->GetDouble() : static_cast<double>(v->GetInteger64()));
+            }
+            it->GetValue("meta:site", r.meta.site);
+        }
+    });
+    double bound = BestOf(iterations, [&doc]() {
+        std::vector<Record> records;
+        JsonBind::Decode(doc, records);
+    });
+
+    std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(6) << size << " MB, tree + GetValue " << (size / tree) << " MB/s, bound "
+              << (size / bound) << " MB/s" << std::endl;
+}
+/*****************************************************************************/
+class LineCounter : public JsonLinesReader::IHandler
+{
+public:
+    std::uint64_t count = 0U;
+
+    bool Line(std::uint64_t line, JsonValue &value) override
+    {
+        (void) line;
+        (void) value;
+        count++;
+        return true;
+    }
+};
+/*****************************************************************************/
+/**
+ * @brief Newline delimited records: one parse per line on a single thread, then the parallel reader
+ */
+static void MeasureLines(const std::string &name, const std::string &doc, std::uint32_t iterations)
+{
+    JsonValue json;
+    if (!JsonReader::ParseString(json, doc))
+    {
+        std::cerr << name << ": parse failure" << std::endl;
+        return;
+    }
+
+    std::string text;
+    JsonLinesWriter writer(text);
+    for (JsonArray::const_iterator it = json.GetArray().begin(); it != json.GetArray().end(); ++it)
+    {
+        writer.Write(*it);
+    }
+
+    double size = static_cast<double>(text.size()) / (1024.0 * 1024.0);
+    double single = BestOf(iterations, [&text]() {
+        std::size_t start = 0U;
+        while (start < text.size())
+        {
+            std::size_t end = text.find('\n', start);
+            std::size_t offset;
+            JsonValue value;
+            JsonReader::Parse(std::string_view(text).substr(start, end - start), value, offset);
+            start = end + 1U;
+        }
+    });
+    double parallel = BestOf(iterations, [&text]() {
+        LineCounter counter;
+        JsonLinesReader reader(counter);
+        reader.ParseBuffer(text);
+    });
+
+    std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(6) << size << " MB " << std::setw(10) << (size / single) << " MB/s, "
+              << std::thread::hardware_concurrency() << " threads " << (size / parallel) << " MB/s" << std::endl;
+}
+/*****************************************************************************/
+int main(int argc, char *argv[])
+{
+    std::uint32_t iterations = 5U;
+    std::size_t size = 20U * 1024U * 1024U;
+
+    if (argc > 1)
+    {
+        // Optional: parse a user-provided document instead of the generated one
+        std::string doc = Util::FileToString(argv[1]);
+        Measure(Util::GetFileName(argv[1]), doc, iterations, HEAP);
+        Measure(Util::GetFileName(argv[1]) + " (arena)", doc, iterations, ARENA);
+        Measure(Util::GetFileName(argv[1]) + " (interned)", doc, iterations, INTERNED);
+        return 0;
+    }
+
+    std::string telemetry = MakeTelemetry(size);
+    Measure("telemetry", telemetry, iterations, HEAP);
+    Measure("telemetry (arena)", telemetry, iterations, ARENA);
+    Measure("telemetry (interned)", telemetry, iterations, INTERNED);
+
+    // String scanning, for each implementation supported by this CPU
+    std::string strings = MakeStrings(size);
+    const JsonScan::Level levels[] = { JsonScan::SCALAR, JsonScan::SSE2, JsonScan::AVX2 };
+    for (JsonScan::Level level : levels)
+    {
+        if (JsonScan::SetLevel(level))
+        {
+            Measure(std::string("strings (") + LevelName(level) + ")", strings, iterations, ARENA);
+        }
+    }
+    JsonScan::SetLevel(JsonScan::GetBestLevel());
+
+    MeasureWrite("write telemetry", telemetry, iterations);
+    MeasureWrite("write strings", strings, iterations);
+
+    MeasureCbor("cbor telemetry", telemetry, iterations);
+    MeasureCbor("cbor strings", strings, iterations);
+
+    MeasureLines("ndjson telemetry", telemetry, iterations);
+    MeasureBind("bind telemetry", telemetry, iterations);
+    return 0;
+}
+
+//=============================================================================
+// End of file json_bench.cpp
+//=============================================================================
@@ -0,0 +1,452 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+/**
+ * Regression benchmark of the json/ subsystem
+ *
+ * Every operation (parse, write, lookups) is run on four corpora: deeply nested
+ * documents, number-heavy, string-heavy and large arrays of small records. For
+ * each pair, one line of Json is printed with the throughput, the latency
+ * percentiles and the heap allocations per operation:
+ *
+ *     json_perf [--size <MiB>] [--iterations <n>] [--filter <text>] [--csv]
+ *
+ * The allocations are counted by replacing the global operator new, so they
+ * include the default memory resource used by JsonValue.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef USE_WINDOWS_OS
+#include <malloc.h>
+#endif
+
+#include "JsonReader.h"
+#include "JsonWriter.h"
+#include "JsonPath.h"
+#include "DurationTimer.h"
+#include "GetOptions.h"
+
+/*****************************************************************************/
+static std::atomic<std::uint64_t> gAllocations(0U);
+static std::atomic<std::uint64_t> gAllocatedBytes(0U);
+
+static void *CountedAlloc(std::size_t size)
+{
+    gAllocations.fetch_add(1U, std::memory_order_relaxed);
+    gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    void *ptr = std::malloc((size > 0U) ? size : 1U);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new(std::size_t size) { return CountedAlloc(size); }
+void *operator new[](std::size_t size) { return CountedAlloc(size); }
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+// Used by the default memory resource of std::pmr
+static void *CountedAlignedAlloc(std::size_t size, std::align_val_t alignment)
+{
+    std::size_t align = static_cast<std::size_t>(alignment);
+    gAllocations.fetch_add(1U, std::memory_order_relaxed);
+    gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+#ifdef USE_WINDOWS_OS
+    void *ptr = _aligned_malloc((size > 0U) ? size : 1U, align);
+#else
+    std::size_t rounded = ((size + align - 1U) / align) * align; // multiple of the alignment
+    void *ptr = std::aligned_alloc(align, (rounded > 0U) ? rounded : align);
+#endif
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+static void AlignedFree(void *ptr)
+{
+#ifdef USE_WINDOWS_OS
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) { return CountedAlignedAlloc(size, alignment); }
+void *operator new[](std::size_t size, std::align_val_t alignment) { return CountedAlignedAlloc(size, alignment); }
+void operator delete(void *ptr, std::align_val_t) noexcept { AlignedFree(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { AlignedFree(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { AlignedFree(ptr); }
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept { AlignedFree(ptr); }
+/*****************************************************************************/
+struct Corpus
+{
+    std::string name;
+    std::string text;
+    JsonValue tree;
+    std::vector<std::string> paths;    // key paths used by the lookup benchmarks
+};
+/*****************************************************************************/
+struct Result
+{
+    std::string corpus;
+    std::string operation;
+    std::uint64_t bytes;        // processed per operation
+    std::uint64_t ops;
+    double total;               // seconds
+    double p50;
+    double p90;
+    double p99;
+    double max;
+    double allocations;         // per operation
+    double allocatedBytes;      // per operation
+};
+/*****************************************************************************/
+/**
+ * @brief Nested objects and arrays, 64 levels per record
+ */
+static void MakeDeep(Corpus &corpus, std::size_t targetSize)
+{
+    static const std::uint32_t cDepth = 64U;
+    std::string record;
+    std::string path;
+
+    for (std::uint32_t level = 0U; level < cDepth; level++)
+    {
+        record += (level % 2U) ? "[" : "{\"level" + std::to_string(level) + "\":";
+        path += (level % 2U) ? ":0" : ":level" + std::to_string(level);
+    }
+    record += "{\"leaf\":true,\"value\":42}";
+    path += ":value";
+    for (std::uint32_t level = cDepth; level > 0U; level--)
+    {
+        record += ((level - 1U) % 2U) ? "]" : "}";
+    }
+
+    corpus.name = "deep";
+    corpus.text = "[";
+    std::uint32_t count = 0U;
+    while (corpus.text.size() < targetSize)
+    {
+        corpus.text += (count > 0U) ? ",\n" : "";
+        corpus.text += record;
+        count++;
+    }
+    corpus.text += "]";
+
+    for (std::uint32_t i = 0U; i < 16U; i++)
+    {
+        corpus.paths.push_back(std::to_string((i * 7919U) % count) + path);
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief Rows of integers, negative numbers, decimals and exponents
+ */
+static void MakeNumbers(Corpus &corpus, std::size_t targetSize)
+{
+    std::uint32_t row = 0U;
+
+    corpus.name = "numbers";
+    corpus.text = "[";
+    while (corpus.text.size() < targetSize)
+    {
+        corpus.text += (row > 0U) ? ",\n[" : "\n[";
+        for (std::uint32_t i = 0U; i < 16U; i++)
+        {
+            std::uint64_t x = (static_cast<std::uint64_t>(row) * 2654435761U + i * 40503U) % 100000007U;
+            switch (i % 4U)
+            {
+            case 0U: corpus.text += std::to_string(x); break;
+            case 1U: corpus.text += "-" + std::to_string(x % 1000U); break;
+            case 2U: corpus.text += std::to_string(x / 1000U) + "." + std::to_string(x % 1000U); break;
+            default: corpus.text += std::to_string(x % 10U) + "." + std::to_string(x % 97U) + "e-" + std::to_string(x % 12U); break;
+            }
+            corpus.text += (i < 15U) ? "," : "]";
+        }
+        row++;
+    }
+    corpus.text += "]";
+
+    for (std::uint32_t i = 0U; i < 64U; i++)
+    {
+        corpus.paths.push_back(std::to_string((i * 7919U) % row) + ":" + std::to_string(i % 16U));
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief Long texts with escapes and non-ASCII characters
+ */
+static void MakeStrings(Corpus &corpus, std::size_t targetSize)
+{
+    static const std::string text = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod "
+                                    "tempor incididunt ut labore et dolore magna aliqua. \\\"Ut enim\\\" ad minim "
+                                    "veniam, quis nostrud exercitation \\u00e9t\\u00e9 ullamco laboris nisi \xc3\xa0 la "
+                                    "plage.\\n";
+    static const std::string plain = "Sed ut perspiciatis unde omnis iste natus error sit voluptatem accusantium "
+                                     "doloremque laudantium, totam rem aperiam, eaque ipsa quae ab illo inventore.";
+    std::uint32_t id = 0U;
+
+    corpus.name = "strings";
+    corpus.text = "[";
+    while (corpus.text.size() < targetSize)
+    {
+        corpus.text += (id > 0U) ? ",\n" : "\n";
+        corpus.text += "{\"title\":\"Message " + std::to_string(id) + "\",\"body\":\"" + text + text + text +
+                       "\",\"signature\":\"" + plain.substr(id % 64U, 64U) + "\"}";
+        id++;
+    }
+    corpus.text += "]";
+
+    for (std::uint32_t i = 0U; i < 64U; i++)
+    {
+        corpus.paths.push_back(std::to_string((i * 7919U) % id) + ((i % 2U) ? ":title" : ":body"));
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief One large array of small records
+ */
+static void MakeArray(Corpus &corpus, std::size_t targetSize)
+{
+    std::uint32_t id = 0U;
+
+    corpus.name = "array";
+    corpus.text = "[";
+    while (corpus.text.size() < targetSize)
+    {
+        corpus.text += (id > 0U) ? "," : "";
+        corpus.text += "{\"id\":" + std::to_string(id) + ",\"ok\":" + ((id % 3U) ? "true" : "false") +
+                       ",\"name\":\"n" + std::to_string(id % 512U) + "\",\"tags\":[\"a\",\"b\"],\"meta\":{\"v\":null}}";
+        id++;
+    }
+    corpus.text += "]";
+
+    for (std::uint32_t i = 0U; i < 64U; i++)
+    {
+        corpus.paths.push_back(std::to_string((i * 7919U) % id) + ((i % 2U) ? ":name" : ":meta:v"));
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief Run an operation several times and collect the statistics
+ * @param batch number of operations timed together (for the very short ones)
+ */
+static Result Run(const std::string &corpus, const std::string &operation, std::uint64_t bytes,
+                  std::uint32_t iterations, std::uint32_t batch, const std::function<void()> &function)
+{
+    Result result;
+    std::vector<double> samples;
+
+    function(); // warm up
+
+    std::uint64_t allocations = gAllocations.load();
+    std::uint64_t allocated = gAllocatedBytes.load();
+    DurationTimer total;
+    for (std::uint32_t i = 0U; i < iterations; i++)
+    {
+        DurationTimer timer;
+        for (std::uint32_t j = 0U; j < batch; j++)
+        {
+            function();
+        }
+        samples.push_back(timer.elapsed() / batch);
+    }
+
+    result.corpus = corpus;
+    result.operation = operation;
+    result.bytes = bytes;
+    result.ops = static_cast<std::uint64_t>(iterations) * batch;
+    result.total = total.elapsed();
+    result.allocations = static_cast<double>(gAllocations.load() - allocations) / static_cast<double>(result.ops);
+    result.allocatedBytes = static_cast<double>(gAllocatedBytes.load() - allocated) / static_cast<double>(result.ops);
+
+    std::sort(samples.begin(), samples.end());
+    std::size_t last = samples.size() - 1U;
+    result.p50 = samples[(last * 50U) / 100U];
+    result.p90 = samples[(last * 90U) / 100U];
+    result.p99 = samples[(last * 99U) / 100U];
+    result.max = samples[last];
+    return result;
+}
+/*****************************************************************************/
+static void Print(const Result &result, bool csv)
+{
+    double mb = static_cast<double>(result.bytes * result.ops) / (1024.0 * 1024.0);
+    double opsPerSecond = static_cast<double>(result.ops) / result.total;
+
+    if (csv)
+    {
+        char line[512];
+        std::snprintf(line, sizeof(line), "%s,%s,%llu,%llu,%.3f,%.1f,%.3f,%.3f,%.3f,%.3f,%.2f,%.1f",
+                      result.corpus.c_str(), result.operation.c_str(),
+                      static_cast<unsigned long long>(result.bytes), static_cast<unsigned long long>(result.ops),
+                      mb / result.total, opsPerSecond,
+                      result.p50 * 1e6, result.p90 * 1e6, result.p99 * 1e6, result.max * 1e6,
+                      result.allocations, result.allocatedBytes);
+        std::cout << line << std::endl;
+        return;
+    }
+
+    std::string line;
+    JsonWriter writer(line);
+    writer.StartObject();
+    writer.Key("corpus");
+    writer.String(result.corpus);
+    writer.Key("operation");
+    writer.String(result.operation);
+    writer.Key("bytes");
+    writer.Unsigned(result.bytes);
+    writer.Key("ops");
+    writer.Unsigned(result.ops);
+    writer.Key("mb_per_s");
+    writer.Double(mb / result.total);
+    writer.Key("ops_per_s");
+    writer.Double(opsPerSecond);
+    writer.Key("p50_us");
+    writer.Double(result.p50 * 1e6);
+    writer.Key("p90_us");
+    writer.Double(result.p90 * 1e6);
+    writer.Key("p99_us");
+    writer.Double(result.p99 * 1e6);
+    writer.Key("max_us");
+    writer.Double(result.max * 1e6);
+    writer.Key("allocs_per_op");
+    writer.Double(result.allocations);
+    writer.Key("alloc_bytes_per_op");
+    writer.Double(result.allocatedBytes);
+    writer.EndObject();
+    std::cout << line << std::endl;
+}
+/*****************************************************************************/
+int main(int argc, char *argv[])
+{
+    CommandLine args(argc, argv);
+    std::size_t size = 4U * 1024U * 1024U;
+    std::uint32_t iterations = 20U;
+    std::string filter = args.GetOption("--filter");
+    bool csv = args.Exists("--csv");
+
+    if (!args.GetOption("--size").empty())
+    {
+        size = std::strtoul(args.GetOption("--size").c_str(), nullptr, 10) * 1024U * 1024U;
+    }
+    if (!args.GetOption("--iterations").empty())
+    {
+        iterations = static_cast<std::uint32_t>(std::strtoul(args.GetOption("--iterations").c_str(), nullptr, 10));
+    }
+    if ((size == 0U) || (iterations == 0U))
+    {
+        std::cerr << "Usage: json_perf [--size <MiB>] [--iterations <n>] [--filter <text>] [--csv]" << std::endl;
+        return 1;
+    }
+
+    std::vector<Corpus> corpora(4U);
+    MakeDeep(corpora[0], size);
+    MakeNumbers(corpora[1], size);
+    MakeStrings(corpora[2], size);
+    MakeArray(corpora[3], size);
+
+    if (csv)
+    {
+        std::cout << "corpus,operation,bytes,ops,mb_per_s,ops_per_s,p50_us,p90_us,p99_us,max_us,allocs_per_op,alloc_bytes_per_op" << std::endl;
+    }
+
+    bool success = true;
+    for (Corpus &corpus : corpora)
+    {
+        if (!JsonReader::ParseString(corpus.tree, corpus.text))
+        {
+            std::cerr << corpus.name << ": parse failure" << std::endl;
+            success = false;
+            continue;
+        }
+
+        std::string written;
+        std::vector<JsonPath> compiled(corpus.paths.begin(), corpus.paths.end());
+        std::uint32_t batch = 1000U;
+
+        std::vector<Result> results;
+        auto selected = [&filter, &corpus](const char *operation) {
+            return filter.empty() || ((corpus.name + "/" + operation).find(filter) != std::string::npos);
+        };
+
+        if (selected("parse"))
+        {
+            results.push_back(Run(corpus.name, "parse", corpus.text.size(), iterations, 1U, [&corpus]() {
+                JsonValue json;
+                JsonReader::ParseString(json, corpus.text);
+            }));
+        }
+        if (selected("parse_arena"))
+        {
+            results.push_back(Run(corpus.name, "parse_arena", corpus.text.size(), iterations, 1U, [&corpus]() {
+                JsonArena arena;
+                JsonValue json(arena.GetAllocator());
+                JsonReader::ParseString(json, corpus.text);
+            }));
+        }
+        if (selected("write"))
+        {
+            written.reserve(corpus.text.size() * 2U);
+            results.push_back(Run(corpus.name, "write", corpus.text.size(), iterations, 1U, [&corpus, &written]() {
+                written.clear();
+                JsonWriter writer(written);
+                writer.Write(corpus.tree);
+            }));
+        }
+        if (selected("find_value"))
+        {
+            std::size_t next = 0U;
+            results.push_back(Run(corpus.name, "find_value", 0U, iterations, batch, [&corpus, &next]() {
+                JsonValue value = corpus.tree.FindValue(corpus.paths[next]);
+                next = (next + 1U) % corpus.paths.size();
+            }));
+        }
+        if (selected("find_key"))
+        {
+            std::size_t next = 0U;
+            results.push_back(Run(corpus.name, "find_key", 0U, iterations, batch, [&corpus, &next]() {
+                const JsonValue *value = corpus.tree.Find(corpus.paths[next]);
+                (void) value;
+                next = (next + 1U) % corpus.paths.size();
+            }));
+        }
+        if (selected("find_path"))
+        {
+            std::size_t next = 0U;
+            results.push_back(Run(corpus.name, "find_path", 0U, iterations, batch, [&corpus, &compiled, &next]() {
+                const JsonValue *value = corpus.tree.Find(compiled[next]);
+                (void) value;
+                next = (next + 1U) % compiled.size();
+            }));
+        }
+
+        for (const Result &result : results)
+        {
+            Print(result, csv);
+        }
+    }
+    return success ? 0 : 1;
+}
+
+//=============================================================================
+// End of file json_perf.cpp
+//=============================================================================
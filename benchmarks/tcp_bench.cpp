@@ -0,0 +1,203 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "TcpServer.h"
+#include "DurationTimer.h"
+
+/*****************************************************************************/
+/**
+ * @brief Echo through the non-blocking output queues of the server
+ */
+class EchoHandler : public tcp::TcpServer::IEvent
+{
+public:
+    tcp::TcpServer *server = nullptr;
+
+    virtual void NewConnection(const tcp::ConnPtr &conn) { (void) conn; }
+    virtual void ReadData(const tcp::ConnPtr &conn, std::string &&payload) { server->Send(conn, payload); }
+    virtual void ClientClosed(const tcp::ConnPtr &conn) { (void) conn; }
+    virtual void ServerTerminated(tcp::TcpServer::IEvent::CloseType type) { (void) type; }
+};
+
+/*****************************************************************************/
+/**
+ * @brief Blocking client socket, as light as possible not to measure the client side
+ */
+static int Connect(std::uint16_t port)
+{
+    int s = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (s >= 0)
+    {
+        int one = 1;
+        ::setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(s, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            ::close(s);
+            s = -1;
+        }
+    }
+    return s;
+}
+/*****************************************************************************/
+static const char *BackendName(tcp::TcpServer::Backend backend)
+{
+    return (backend == tcp::TcpServer::BACKEND_IO_URING) ? "io_uring" : "epoll";
+}
+/*****************************************************************************/
+/**
+ * @brief Ping-pong: each client sends a message and waits for the whole echo before the next one
+ */
+static void Measure(tcp::TcpServer::Backend backend, std::uint32_t reactors, std::uint32_t clients,
+                    std::uint32_t messages, std::size_t size, std::uint16_t port)
+{
+    EchoHandler handler;
+    tcp::TcpServer server(handler);
+    handler.server = &server;
+
+    server.SetReactors(reactors);
+    server.SetBackend(backend);
+    if (!server.Start(static_cast<std::int32_t>(clients) + 16, true, port))
+    {
+        std::cerr << "Server start failure on port " << port << std::endl;
+        return;
+    }
+
+    if ((backend == tcp::TcpServer::BACKEND_IO_URING) && (server.GetBackend() != backend))
+    {
+        std::cout << "io_uring not available, skipped" << std::endl;
+        server.Stop();
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<std::vector<double>> latencies(clients);
+    std::atomic<std::uint32_t> failures(0U);
+    std::string message(size, 'x');
+
+    DurationTimer total;
+    for (std::uint32_t c = 0U; c < clients; c++)
+    {
+        threads.push_back(std::thread([&, c]() {
+            int s = Connect(port);
+            if (s < 0)
+            {
+                failures++;
+                return;
+            }
+
+            latencies[c].reserve(messages);
+            std::vector<char> buff(size);
+            for (std::uint32_t i = 0U; i < messages; i++)
+            {
+                DurationTimer rtt;
+                std::size_t received = 0U;
+                if (::send(s, message.data(), size, MSG_NOSIGNAL) != static_cast<ssize_t>(size))
+                {
+                    failures++;
+                    break;
+                }
+                while (received < size)
+                {
+                    ssize_t n = ::recv(s, buff.data(), size - received, 0);
+                    if (n <= 0)
+                    {
+                        break;
+                    }
+                    received += static_cast<std::size_t>(n);
+                }
+                if (received < size)
+                {
+                    failures++;
+                    break;
+                }
+                latencies[c].push_back(rtt.elapsed() * 1e6);
+            }
+            ::close(s);
+        }));
+    }
+
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double elapsed = total.elapsed();
+    server.Stop();
+
+    std::vector<double> all;
+    for (auto &l : latencies)
+    {
+        all.insert(all.end(), l.begin(), l.end());
+    }
+    std::sort(all.begin(), all.end());
+    double p50 = all.empty() ? 0.0 : all[all.size() / 2U];
+    double p99 = all.empty() ? 0.0 : all[(all.size() * 99U) / 100U];
+
+    std::cout << std::left << std::setw(9) << BackendName(server.GetBackend()) << std::right
+              << std::setw(3) << reactors << " reactors " << std::setw(4) << clients << " clients "
+              << std::setw(6) << size << " B  " << std::fixed << std::setprecision(0)
+              << std::setw(9) << (static_cast<double>(all.size()) / elapsed) << " msg/s  "
+              << std::setprecision(1) << "p50 " << std::setw(7) << p50 << " us  p99 " << std::setw(7) << p99 << " us";
+    if (failures > 0U)
+    {
+        std::cout << "  (" << failures << " failures)";
+    }
+    std::cout << std::endl;
+}
+/*****************************************************************************/
+int main(int argc, char *argv[])
+{
+    std::uint32_t messages = 20000U;
+    std::uint16_t port = 61700U;
+
+    if (argc > 1)
+    {
+        messages = static_cast<std::uint32_t>(std::strtoul(argv[1], nullptr, 10));
+    }
+
+    tcp::TcpSocket::Initialize();
+
+    const tcp::TcpServer::Backend backends[2] = { tcp::TcpServer::BACKEND_EPOLL, tcp::TcpServer::BACKEND_IO_URING };
+    const std::uint32_t clientCounts[3] = { 1U, 16U, 64U };
+    const std::size_t sizes[2] = { 64U, 8192U };
+
+    for (auto clients : clientCounts)
+    {
+        for (auto size : sizes)
+        {
+            for (auto backend : backends)
+            {
+                Measure(backend, 2U, clients, messages / clients, size, port++);
+            }
+        }
+    }
+    return 0;
+}
+
+//=============================================================================
+// End of file tcp_bench.cpp
+//=============================================================================
@@ -16,6 +16,7 @@ HEADERS += Log.h \
     EventLoop.h \
     DurationTimer.h \
     Pool.h \
+    Strand.h \
     SharedLibrary.h \
     libutil.h
 
@@ -60,10 +61,12 @@ HEADERS += TcpSocket.h \
     TcpClient.h \
     UdpSocket.h \
     TlsClient.h \
-    TcpServerBase.h
+    TcpServerBase.h \
+    TimerWheel.h
 
 SOURCES += TcpSocket.cpp \
     TcpServerBase.cpp \
+    TimerWheel.cpp \
     TcpClient.cpp \
     TlsClient.cpp \
     UdpSocket.cpp
@@ -72,6 +75,7 @@ DEFINES += ASIO_STANDALONE
 
 linux {
     SOURCES += TcpServerEpoll.cpp
+    SOURCES += TcpServerUring.cpp
 }
 
 windows {
@@ -129,11 +133,27 @@ SOURCES += Zip.cpp miniz.c
 # ------------------------------------------------------------------------------
 HEADERS += JsonWriter.h \
    JsonReader.h \
-   JsonValue.h
+   JsonValue.h \
+   JsonScan.h \
+   JsonStreamReader.h \
+   Cbor.h \
+   JsonPath.h \
+   JsonLines.h \
+   JsonBind.h \
+   JsonSnapshot.h \
+   JsonMergePatch.h
 
 SOURCES += JsonWriter.cpp \
     JsonReader.cpp \
-    JsonValue.cpp
+    JsonValue.cpp \
+    JsonScan.cpp \
+    JsonStreamReader.cpp \
+    Cbor.cpp \
+    JsonPath.cpp \
+    JsonLines.cpp \
+    JsonBind.cpp \
+    JsonSnapshot.cpp \
+    JsonMergePatch.cpp
 
 
 # ------------------------------------------------------------------------------
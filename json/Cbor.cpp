@@ -0,0 +1,697 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+#include "Cbor.h"
+
+namespace CBor {
+
+/*****************************************************************************/
+// Encode a byte string into a Json string, RFC 8949 section 6.1
+static void Base64Url(std::string_view data, std::string &output)
+{
+    static const char cAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    const std::uint8_t *p = reinterpret_cast<const std::uint8_t *>(data.data());
+    std::size_t size = data.size();
+
+    output.clear();
+    output.reserve(((size + 2U) / 3U) * 4U);
+    while (size >= 3U)
+    {
+        std::uint32_t bits = (static_cast<std::uint32_t>(p[0]) << 16U) | (static_cast<std::uint32_t>(p[1]) << 8U) | p[2];
+        output.push_back(cAlphabet[(bits >> 18U) & 0x3FU]);
+        output.push_back(cAlphabet[(bits >> 12U) & 0x3FU]);
+        output.push_back(cAlphabet[(bits >> 6U) & 0x3FU]);
+        output.push_back(cAlphabet[bits & 0x3FU]);
+        p += 3;
+        size -= 3U;
+    }
+
+    // No padding
+    if (size > 0U)
+    {
+        std::uint32_t bits = static_cast<std::uint32_t>(p[0]) << 16U;
+        if (size == 2U)
+        {
+            bits |= static_cast<std::uint32_t>(p[1]) << 8U;
+        }
+        output.push_back(cAlphabet[(bits >> 18U) & 0x3FU]);
+        output.push_back(cAlphabet[(bits >> 12U) & 0x3FU]);
+        if (size == 2U)
+        {
+            output.push_back(cAlphabet[(bits >> 6U) & 0x3FU]);
+        }
+    }
+}
+/*****************************************************************************/
+static bool FloatToHalf(float value, std::uint16_t &half)
+{
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    std::uint16_t sign = static_cast<std::uint16_t>((bits >> 16U) & 0x8000U);
+    std::int32_t exponent = static_cast<std::int32_t>((bits >> 23U) & 0xFFU);
+    std::uint32_t mantissa = bits & 0x7FFFFFU;
+
+    if ((exponent == 0) && (mantissa == 0U))
+    {
+        half = sign; // zero
+        return true;
+    }
+    if (exponent == 0xFF)
+    {
+        half = static_cast<std::uint16_t>(sign | 0x7C00U); // infinity (NaN is handled by the caller)
+        return mantissa == 0U;
+    }
+
+    exponent -= 127;
+    if ((exponent >= -14) && (exponent <= 15))
+    {
+        // Normal half precision number
+        half = static_cast<std::uint16_t>(sign | (static_cast<std::uint32_t>(exponent + 15) << 10U) | (mantissa >> 13U));
+        return (mantissa & 0x1FFFU) == 0U;
+    }
+    if ((exponent >= -24) && (exponent < -14))
+    {
+        // Subnormal half precision number
+        std::uint32_t full = mantissa | 0x800000U;
+        std::uint32_t shift = static_cast<std::uint32_t>(-exponent - 1);
+        half = static_cast<std::uint16_t>(sign | (full >> shift));
+        return (full & ((1U << shift) - 1U)) == 0U;
+    }
+    return false;
+}
+/*****************************************************************************/
+static double HalfToDouble(std::uint16_t half)
+{
+    int exponent = (half >> 10U) & 0x1F;
+    int mantissa = half & 0x3FF;
+    double value;
+
+    if (exponent == 0)
+    {
+        value = std::ldexp(mantissa, -24);
+    }
+    else if (exponent != 31)
+    {
+        value = std::ldexp(mantissa + 1024, exponent - 25);
+    }
+    else
+    {
+        value = (mantissa == 0) ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+    }
+    return (half & 0x8000U) ? -value : value;
+}
+
+//          *                          *                                  *
+
+/*****************************************************************************/
+Encoder::Encoder(std::string &output)
+    : mOut(output)
+{
+
+}
+/*****************************************************************************/
+void Encoder::Head(Major major, std::uint64_t value)
+{
+    char head[9];
+    std::size_t size;
+    std::uint8_t type = static_cast<std::uint8_t>(major << 5U);
+
+    if (value < 24U)
+    {
+        head[0] = static_cast<char>(type | value);
+        size = 1U;
+    }
+    else if (value <= 0xFFU)
+    {
+        head[0] = static_cast<char>(type | 24U);
+        size = 2U;
+    }
+    else if (value <= 0xFFFFU)
+    {
+        head[0] = static_cast<char>(type | 25U);
+        size = 3U;
+    }
+    else if (value <= 0xFFFFFFFFU)
+    {
+        head[0] = static_cast<char>(type | 26U);
+        size = 5U;
+    }
+    else
+    {
+        head[0] = static_cast<char>(type | 27U);
+        size = 9U;
+    }
+
+    // Argument in network byte order
+    for (std::size_t i = size - 1U; i > 0U; i--)
+    {
+        head[i] = static_cast<char>(value & 0xFFU);
+        value >>= 8U;
+    }
+    mOut.append(head, size);
+}
+/*****************************************************************************/
+void Encoder::Write(const JsonValue &value)
+{
+    switch (value.GetTag())
+    {
+    case JsonValue::OBJECT:
+        Write(value.GetObj());
+        break;
+    case JsonValue::ARRAY:
+        Write(value.GetArray());
+        break;
+    case JsonValue::STRING:
+        String(value.GetStringView());
+        break;
+    case JsonValue::INTEGER:
+        Integer(value.GetInteger64());
+        break;
+    case JsonValue::UINTEGER:
+        Unsigned(value.GetUnsigned64());
+        break;
+    case JsonValue::DOUBLE:
+        Double(value.GetDouble());
+        break;
+    case JsonValue::BOOLEAN:
+        Bool(value.GetBool());
+        break;
+    case JsonValue::NULL_VAL:
+        Null();
+        break;
+    default:
+        mOut.push_back(static_cast<char>(0xF7U)); // undefined
+        break;
+    }
+}
+/*****************************************************************************/
+void Encoder::Write(const JsonObject &obj)
+{
+    StartMap(obj.GetSize());
+    for (JsonObject::const_iterator it = obj.begin(); it != obj.end(); ++it)
+    {
+        String(it->first);
+        Write(it->second);
+    }
+}
+/*****************************************************************************/
+void Encoder::Write(const JsonArray &array)
+{
+    StartArray(array.Size());
+    for (JsonArray::const_iterator it = array.begin(); it != array.end(); ++it)
+    {
+        Write(*it);
+    }
+}
+/*****************************************************************************/
+void Encoder::StartArray(std::uint64_t size)
+{
+    Head(ArrayType, size);
+}
+/*****************************************************************************/
+void Encoder::StartMap(std::uint64_t size)
+{
+    Head(MapType, size);
+}
+/*****************************************************************************/
+void Encoder::Integer(std::int64_t value)
+{
+    if (value >= 0)
+    {
+        Head(UnsignedIntegerType, static_cast<std::uint64_t>(value));
+    }
+    else
+    {
+        // -1 - n, computed without overflow
+        Head(NegativeIntegerType, static_cast<std::uint64_t>(-(value + 1)));
+    }
+}
+/*****************************************************************************/
+void Encoder::Unsigned(std::uint64_t value)
+{
+    Head(UnsignedIntegerType, value);
+}
+/*****************************************************************************/
+void Encoder::Double(double value)
+{
+    char data[9];
+    std::size_t size;
+    float single = 0.0F;
+    std::uint16_t half;
+
+    // Out of range conversions to float are undefined
+    if (std::isinf(value) || (std::fabs(value) <= std::numeric_limits<float>::max()))
+    {
+        single = static_cast<float>(value);
+    }
+
+    if (std::isnan(value))
+    {
+        data[0] = static_cast<char>(0xF9U);
+        data[1] = static_cast<char>(0x7EU);
+        data[2] = 0;
+        size = 3U;
+    }
+    else if ((static_cast<double>(single) == value) && FloatToHalf(single, half))
+    {
+        data[0] = static_cast<char>(0xF9U);
+        data[1] = static_cast<char>(half >> 8U);
+        data[2] = static_cast<char>(half & 0xFFU);
+        size = 3U;
+    }
+    else if (static_cast<double>(single) == value)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &single, sizeof(bits));
+        data[0] = static_cast<char>(0xFAU);
+        for (std::size_t i = 4U; i > 0U; i--)
+        {
+            data[i] = static_cast<char>(bits & 0xFFU);
+            bits >>= 8U;
+        }
+        size = 5U;
+    }
+    else
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        data[0] = static_cast<char>(0xFBU);
+        for (std::size_t i = 8U; i > 0U; i--)
+        {
+            data[i] = static_cast<char>(bits & 0xFFU);
+            bits >>= 8U;
+        }
+        size = 9U;
+    }
+    mOut.append(data, size);
+}
+/*****************************************************************************/
+void Encoder::Bool(bool value)
+{
+    mOut.push_back(static_cast<char>(value ? 0xF5U : 0xF4U));
+}
+/*****************************************************************************/
+void Encoder::Null()
+{
+    mOut.push_back(static_cast<char>(0xF6U));
+}
+/*****************************************************************************/
+void Encoder::String(std::string_view text)
+{
+    Head(TextStringType, text.size());
+    mOut.append(text.data(), text.size());
+}
+/*****************************************************************************/
+void Encoder::Bytes(const void *data, std::size_t size)
+{
+    Head(ByteStringType, size);
+    mOut.append(static_cast<const char *>(data), size);
+}
+
+//          *                          *                                  *
+
+/*****************************************************************************/
+Decoder::Decoder(IHandler &handler)
+    : mHandler(handler)
+    , mDepth(0U)
+    , mChunksMajor(-1)
+    , mMaxTokenSize(cDefaultMaxTokenSize)
+    , mStatus(CBOR_OK)
+{
+
+}
+/*****************************************************************************/
+void Decoder::Reset()
+{
+    mRoot = JsonValue();
+    mDepth = 0U;
+    mBuffer.clear();
+    mChunks.clear();
+    mChunksMajor = -1;
+    mStatus = CBOR_OK;
+}
+/*****************************************************************************/
+Decoder::Status Decoder::Decode(std::string_view data, JsonValue &value)
+{
+    class SingleItem : public IHandler
+    {
+    public:
+        SingleItem(JsonValue &value) : mValue(value), mCount(0U) {}
+        std::uint32_t GetCount() const { return mCount; }
+
+        bool Item(JsonValue &value)
+        {
+            mCount++;
+            mValue = std::move(value);
+            return mCount == 1U;
+        }
+
+    private:
+        JsonValue &mValue;
+        std::uint32_t mCount;
+    };
+
+    SingleItem handler(value);
+    Decoder decoder(handler);
+    decoder.SetMaxTokenSize(data.size());
+
+    Status status = decoder.Feed(data.data(), data.size());
+    if (status == CBOR_OK)
+    {
+        status = decoder.Finish();
+    }
+    if (status == CBOR_ABORTED)
+    {
+        status = CBOR_BAD_ITEM; // trailing data after the item
+    }
+    else if ((status == CBOR_OK) && (handler.GetCount() == 0U))
+    {
+        status = CBOR_INCOMPLETE;
+    }
+
+    if (status != CBOR_OK)
+    {
+        value.Clear();
+    }
+    return status;
+}
+/*****************************************************************************/
+Decoder::Status Decoder::Feed(const void *data, std::size_t size)
+{
+    if (mStatus != CBOR_OK)
+    {
+        return mStatus;
+    }
+
+    const std::uint8_t *begin = static_cast<const std::uint8_t *>(data);
+    if (mBuffer.empty())
+    {
+        // Fast path: decode directly from the caller's chunk
+        const std::uint8_t *s = begin;
+        mStatus = Parse(s, begin + size);
+        if (mStatus == CBOR_OK)
+        {
+            mBuffer.assign(reinterpret_cast<const char *>(s), static_cast<std::size_t>((begin + size) - s));
+        }
+    }
+    else
+    {
+        // An item head or a string is split between the chunks
+        mBuffer.append(static_cast<const char *>(data), size);
+        const std::uint8_t *start = reinterpret_cast<const std::uint8_t *>(mBuffer.data());
+        const std::uint8_t *s = start;
+        mStatus = Parse(s, start + mBuffer.size());
+        mBuffer.erase(0U, static_cast<std::size_t>(s - start));
+    }
+    return mStatus;
+}
+/*****************************************************************************/
+Decoder::Status Decoder::Finish()
+{
+    if ((mStatus == CBOR_OK) && (!mBuffer.empty() || (mDepth > 0U) || (mChunksMajor >= 0)))
+    {
+        mStatus = CBOR_INCOMPLETE;
+    }
+    return mStatus;
+}
+/*****************************************************************************/
+/**
+ * @brief Decode as many items as possible
+ *
+ * When an item is not complete, s points to its first byte and the function
+ * returns CBOR_OK, waiting for more data.
+ */
+Decoder::Status Decoder::Parse(const std::uint8_t *&s, const std::uint8_t *end)
+{
+    Status status = CBOR_OK;
+
+    while ((s < end) && (status == CBOR_OK))
+    {
+        std::uint8_t initial = *s;
+        int major = initial >> 5U;
+        std::uint8_t info = initial & 0x1FU;
+        std::uint64_t argument = info;
+        std::size_t headSize = 1U;
+
+        if (initial == 0xFFU)
+        {
+            // Break: end of an indefinite length string or container
+            ++s;
+            if (mChunksMajor >= 0)
+            {
+                major = mChunksMajor;
+                mChunksMajor = -1;
+                status = OnString(major, mChunks);
+            }
+            else if ((mDepth > 0U) && mStack[mDepth - 1U].indefinite &&
+                     (mStack[mDepth - 1U].container->IsArray() || mStack[mDepth - 1U].expectKey))
+            {
+                mDepth--;
+                status = ItemDone();
+            }
+            else
+            {
+                status = CBOR_UNEXPECTED_BREAK;
+            }
+            continue;
+        }
+
+        if ((info >= 24U) && (info <= 27U))
+        {
+            headSize += static_cast<std::size_t>(1U) << (info - 24U);
+            if (static_cast<std::size_t>(end - s) < headSize)
+            {
+                break; // wait for the rest of the head
+            }
+            argument = 0U;
+            for (std::size_t i = 1U; i < headSize; i++)
+            {
+                argument = (argument << 8U) | s[i];
+            }
+        }
+        else if ((info > 27U) && ((info != 31U) || (major < ByteStringType) || (major > MapType)))
+        {
+            status = CBOR_BAD_ITEM; // reserved values, or indefinite length not allowed for this type
+            break;
+        }
+
+        if ((mChunksMajor >= 0) && ((major != mChunksMajor) || (info == 31U)))
+        {
+            status = CBOR_BAD_ITEM; // the chunks of a string must be definite strings of the same type
+            break;
+        }
+
+        switch (major)
+        {
+        case UnsignedIntegerType:
+            s += headSize;
+            status = OnScalar(JsonValue(argument));
+            break;
+        case NegativeIntegerType:
+            s += headSize;
+            if (argument <= static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max()))
+            {
+                status = OnScalar(JsonValue(-1 - static_cast<std::int64_t>(argument)));
+            }
+            else
+            {
+                status = OnScalar(JsonValue(-1.0 - static_cast<double>(argument)));
+            }
+            break;
+        case ByteStringType:
+        case TextStringType:
+            if (info == 31U)
+            {
+                s += headSize;
+                mChunksMajor = major;
+                mChunks.clear();
+            }
+            else if (argument > mMaxTokenSize)
+            {
+                status = CBOR_TOO_LARGE;
+            }
+            else if (static_cast<std::uint64_t>(end - s) < (headSize + argument))
+            {
+                return status; // wait for the whole string
+            }
+            else
+            {
+                std::string_view data(reinterpret_cast<const char *>(s + headSize), static_cast<std::size_t>(argument));
+                s += headSize + argument;
+                if (mChunksMajor >= 0)
+                {
+                    mChunks.append(data.data(), data.size());
+                    if (mChunks.size() > mMaxTokenSize)
+                    {
+                        status = CBOR_TOO_LARGE;
+                    }
+                }
+                else
+                {
+                    status = OnString(major, data);
+                }
+            }
+            break;
+        case ArrayType:
+        case MapType:
+            s += headSize;
+            status = OnContainer(major == MapType, info == 31U, argument);
+            break;
+        case TagType:
+            s += headSize; // the semantic is ignored, the next item is the tagged value
+            break;
+        default:
+            s += headSize;
+            if ((info == 20U) || (info == 21U))
+            {
+                status = OnScalar(JsonValue(info == 21U));
+            }
+            else if (info == 25U)
+            {
+                status = OnScalar(JsonValue(HalfToDouble(static_cast<std::uint16_t>(argument))));
+            }
+            else if (info == 26U)
+            {
+                std::uint32_t bits = static_cast<std::uint32_t>(argument);
+                float value;
+                std::memcpy(&value, &bits, sizeof(value));
+                status = OnScalar(JsonValue(static_cast<double>(value)));
+            }
+            else if (info == 27U)
+            {
+                double value;
+                std::memcpy(&value, &argument, sizeof(value));
+                status = OnScalar(JsonValue(value));
+            }
+            else
+            {
+                // null, undefined and the other simple values
+                JsonValue null;
+                null.SetNull();
+                status = OnScalar(null);
+            }
+            break;
+        }
+    }
+
+    return status;
+}
+/*****************************************************************************/
+Decoder::Status Decoder::OnString(int major, std::string_view data)
+{
+    std::string encoded;
+    if (major == ByteStringType)
+    {
+        Base64Url(data, encoded);
+        data = encoded;
+    }
+
+    if ((mDepth > 0U) && mStack[mDepth - 1U].expectKey)
+    {
+        Frame &frame = mStack[mDepth - 1U];
+        frame.key.assign(data.data(), data.size());
+        frame.expectKey = false;
+        return CBOR_OK;
+    }
+
+    NextSlot()->StringRef().assign(data.data(), data.size());
+    return ItemDone();
+}
+/*****************************************************************************/
+Decoder::Status Decoder::OnScalar(const JsonValue &value)
+{
+    if ((mDepth > 0U) && mStack[mDepth - 1U].expectKey)
+    {
+        if (!value.IsInteger() && !value.IsUnsigned())
+        {
+            return CBOR_BAD_KEY;
+        }
+        Frame &frame = mStack[mDepth - 1U];
+        frame.key = value.IsUnsigned() ? std::to_string(value.GetUnsigned64()) : std::to_string(value.GetInteger64());
+        frame.expectKey = false;
+        return CBOR_OK;
+    }
+
+    *NextSlot() = value;
+    return ItemDone();
+}
+/*****************************************************************************/
+Decoder::Status Decoder::OnContainer(bool isMap, bool indefinite, std::uint64_t count)
+{
+    if ((mDepth > 0U) && mStack[mDepth - 1U].expectKey)
+    {
+        return CBOR_BAD_KEY;
+    }
+
+    JsonValue *slot = NextSlot();
+    slot->Reset(isMap ? JsonValue::OBJECT : JsonValue::ARRAY);
+    if (!indefinite && (count == 0U))
+    {
+        return ItemDone(); // empty container
+    }
+
+    if (mDepth == mStack.size())
+    {
+        mStack.emplace_back();
+    }
+    Frame &frame = mStack[mDepth++];
+    frame.container = slot;
+    frame.remaining = count;
+    frame.indefinite = indefinite;
+    frame.expectKey = isMap;
+    frame.key.clear();
+    return CBOR_OK;
+}
+/*****************************************************************************/
+/**
+ * @brief A value is complete, update the enclosing containers
+ */
+Decoder::Status Decoder::ItemDone()
+{
+    while (mDepth > 0U)
+    {
+        Frame &frame = mStack[mDepth - 1U];
+        frame.expectKey = frame.container->IsObject();
+        if (frame.indefinite || (--frame.remaining > 0U))
+        {
+            return CBOR_OK;
+        }
+        mDepth--; // the container is complete, it is a value of its parent
+    }
+
+    // Top level item
+    bool ok = mHandler.Item(mRoot);
+    mRoot = JsonValue();
+    return ok ? CBOR_OK : CBOR_ABORTED;
+}
+/*****************************************************************************/
+/**
+ * @brief Slot of the next value: root, array entry or map member
+ */
+JsonValue *Decoder::NextSlot()
+{
+    if (mDepth == 0U)
+    {
+        return &mRoot;
+    }
+
+    Frame &frame = mStack[mDepth - 1U];
+    if (frame.container->IsArray())
+    {
+        return &frame.container->mArray->Emplace();
+    }
+    return &frame.container->mObject->Emplace(frame.key);
+}
+
+} // namespace CBor
+
+//=============================================================================
+// End of file Cbor.cpp
+//=============================================================================
@@ -0,0 +1,145 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "JsonValue.h"
+
+namespace CBor {
+
+/*****************************************************************************/
+/**
+ * @brief CBOR encoder (RFC 8949), preferred serialization
+ *
+ * Integers and lengths use the shortest head, doubles are written as single
+ * precision floats when this is lossless. A tree can be encoded in one call, or
+ * the items can be generated one by one (definite lengths):
+ *
+ *     std::string data;
+ *     CBor::Encoder encoder(data);
+ *     encoder.StartMap(1U);
+ *     encoder.String("id");
+ *     encoder.Integer(42);
+ */
+class Encoder
+{
+public:
+    explicit Encoder(std::string &output);
+
+    void Write(const JsonValue &value);
+    void Write(const JsonObject &obj);
+    void Write(const JsonArray &array);
+
+    void StartArray(std::uint64_t size);
+    void StartMap(std::uint64_t size);  // followed by size pairs of key and value
+    void Integer(std::int64_t value);
+    void Unsigned(std::uint64_t value);
+    void Double(double value);
+    void Bool(bool value);
+    void Null();
+    void String(std::string_view text);
+    void Bytes(const void *data, std::size_t size);
+
+private:
+    std::string &mOut;
+
+    void Head(Major major, std::uint64_t value);
+};
+
+/*****************************************************************************/
+/**
+ * @brief Streaming CBOR decoder
+ *
+ * The data is pushed in chunks of any size; each complete top level item is
+ * delivered as a JsonValue (a stream can contain a sequence of items, RFC 8742).
+ * Only the bytes of an item head or string split between two chunks are kept.
+ *
+ * Conversion to the Json model (RFC 8949 section 6.1):
+ *   - byte strings become base64url encoded strings
+ *   - integer map keys become decimal strings
+ *   - undefined becomes null, tags are ignored (the tagged item is kept)
+ *   - negative integers below INT64_MIN become doubles
+ */
+class Decoder
+{
+public:
+    enum Status
+    {
+        CBOR_OK,
+        CBOR_INCOMPLETE,        // the data ends in the middle of an item
+        CBOR_BAD_ITEM,          // reserved or unsupported encoding
+        CBOR_BAD_KEY,           // map keys must be strings or integers
+        CBOR_UNEXPECTED_BREAK,
+        CBOR_TOO_LARGE,
+        CBOR_ABORTED            // stopped by the handler
+    };
+
+    class IHandler
+    {
+    public:
+        virtual ~IHandler() {}
+
+        /**
+         * @brief Complete top level item, it can be moved; return false to stop the decoding
+         */
+        virtual bool Item(JsonValue &value) = 0;
+    };
+
+    static const std::size_t cDefaultMaxTokenSize = 16U * 1024U * 1024U;
+
+    explicit Decoder(IHandler &handler);
+
+    Status Feed(const void *data, std::size_t size);
+    Status Finish(); // end of the stream, checks that the last item is complete
+    void Reset();
+
+    void SetMaxTokenSize(std::size_t size) { mMaxTokenSize = size; }
+
+    /**
+     * @brief Decode one item from a buffer
+     * @return CBOR_OK if the whole buffer is exactly one item
+     */
+    static Status Decode(std::string_view data, JsonValue &value);
+
+private:
+    struct Frame
+    {
+        JsonValue *container;
+        std::uint64_t remaining;    // entries left in a definite length container
+        bool indefinite;
+        bool expectKey;
+        std::string key;
+    };
+
+    IHandler &mHandler;
+    JsonValue mRoot;
+    std::vector<Frame> mStack;
+    std::size_t mDepth;
+    std::string mBuffer;        // incomplete token, waiting for the next chunk
+    std::string mChunks;        // indefinite length string being assembled
+    int mChunksMajor;           // -1 if no indefinite string in progress
+    std::size_t mMaxTokenSize;
+    Status mStatus;
+
+    Status Parse(const std::uint8_t *&s, const std::uint8_t *end);
+    Status OnString(int major, std::string_view data);
+    Status OnScalar(const JsonValue &value);
+    Status OnContainer(bool isMap, bool indefinite, std::uint64_t count);
+    Status ItemDone();
+    JsonValue *NextSlot();
+};
+
+} // namespace CBor
+
+#endif // CBOR_H
+
+//=============================================================================
+// End of file Cbor.h
+//=============================================================================
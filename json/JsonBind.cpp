@@ -0,0 +1,363 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#include "JsonBind.h"
+
+namespace JsonBind {
+
+/*****************************************************************************/
+Cursor::Cursor(std::string_view data)
+    : mBegin(data.data())
+    , mS(data.data())
+    , mEnd(data.data() + data.size())
+    , mStatus(JsonReader::JSON_PARSE_OK)
+    , mFirst(true)
+{
+
+}
+/*****************************************************************************/
+bool Cursor::Fail(JsonReader::ParseStatus status)
+{
+    if (mStatus == JsonReader::JSON_PARSE_OK)
+    {
+        mStatus = status;
+    }
+    return false;
+}
+/*****************************************************************************/
+/**
+ * @brief Go to the next token
+ * @return false on error or at the end of the data
+ */
+bool Cursor::Next()
+{
+    if (mStatus != JsonReader::JSON_PARSE_OK)
+    {
+        return false;
+    }
+
+    mS = JsonReader::SkipWhitespace(mS, mEnd);
+    return (mS < mEnd) || Fail(JsonReader::JSON_PARSE_BREAKING_BAD);
+}
+/*****************************************************************************/
+/**
+ * @brief The next token is not of the expected type: valid Json of another type, or garbage
+ */
+bool Cursor::Mismatch()
+{
+    char c = *mS;
+    bool value = (c == '{') || (c == '[') || (c == '"') || (c == 't') || (c == 'f') || (c == 'n') ||
+                 (c == '-') || JsonReader::IsDigit(c);
+    return Fail(value ? JsonReader::JSON_PARSE_TYPE_MISMATCH : JsonReader::JSON_PARSE_UNEXPECTED_CHARACTER);
+}
+/*****************************************************************************/
+bool Cursor::StartObject()
+{
+    if (!Next())
+    {
+        return false;
+    }
+    if (*mS != '{')
+    {
+        return Mismatch();
+    }
+    ++mS;
+    mFirst = true;
+    return true;
+}
+/*****************************************************************************/
+bool Cursor::NextMember(std::string &key)
+{
+    if (!Next())
+    {
+        return false;
+    }
+
+    if (*mS == '}')
+    {
+        ++mS;
+        mFirst = false; // the object is a value of its parent
+        return false;
+    }
+
+    if (!mFirst)
+    {
+        if (*mS != ',')
+        {
+            return Fail(JsonReader::JSON_PARSE_UNEXPECTED_CHARACTER);
+        }
+        ++mS;
+        if (!Next())
+        {
+            return false;
+        }
+    }
+    mFirst = false;
+
+    JsonReader::ParseStatus status = JsonReader::ParseKey(mS, mEnd, key);
+    return (status == JsonReader::JSON_PARSE_OK) || Fail(status);
+}
+/*****************************************************************************/
+bool Cursor::StartArray()
+{
+    if (!Next())
+    {
+        return false;
+    }
+    if (*mS != '[')
+    {
+        return Mismatch();
+    }
+    ++mS;
+    mFirst = true;
+    return true;
+}
+/*****************************************************************************/
+bool Cursor::NextElement()
+{
+    if (!Next())
+    {
+        return false;
+    }
+
+    if (*mS == ']')
+    {
+        ++mS;
+        mFirst = false;
+        return false;
+    }
+
+    if (!mFirst)
+    {
+        if (*mS != ',')
+        {
+            return Fail(JsonReader::JSON_PARSE_UNEXPECTED_CHARACTER);
+        }
+        ++mS;
+    }
+    mFirst = false;
+    return true;
+}
+/*****************************************************************************/
+bool Cursor::String(std::string &value)
+{
+    if (!Next())
+    {
+        return false;
+    }
+    if (*mS != '"')
+    {
+        return Mismatch();
+    }
+
+    JsonReader::ParseStatus status = JsonReader::ParseStringToken(mS, mEnd, value);
+    return (status == JsonReader::JSON_PARSE_OK) || Fail(status);
+}
+/*****************************************************************************/
+bool Cursor::Number(JsonValue &number)
+{
+    if (!Next())
+    {
+        return false;
+    }
+    if ((*mS != '-') && !JsonReader::IsDigit(*mS))
+    {
+        return Mismatch();
+    }
+
+    const char *start = mS;
+    number = JsonReader::StringToNumber(mS, mEnd, &mS);
+    if (!number.IsValid() || !JsonReader::IsDelim(mS, mEnd))
+    {
+        mS = start;
+        return Fail(JsonReader::JSON_PARSE_BAD_NUMBER);
+    }
+    return true;
+}
+/*****************************************************************************/
+bool Cursor::Integer(std::int64_t &value)
+{
+    JsonValue number;
+    if (!Number(number))
+    {
+        return false;
+    }
+    if (!number.IsInteger())
+    {
+        return Fail(JsonReader::JSON_PARSE_TYPE_MISMATCH);
+    }
+    value = number.GetInteger64();
+    return true;
+}
+/*****************************************************************************/
+bool Cursor::Unsigned(std::uint64_t &value)
+{
+    JsonValue number;
+    if (!Number(number))
+    {
+        return false;
+    }
+    if (!number.IsUnsigned() && !(number.IsInteger() && (number.GetInteger64() >= 0)))
+    {
+        return Fail(JsonReader::JSON_PARSE_TYPE_MISMATCH);
+    }
+    value = number.GetUnsigned64();
+    return true;
+}
+/*****************************************************************************/
+bool Cursor::Double(double &value)
+{
+    JsonValue number;
+    if (!Number(number))
+    {
+        return false;
+    }
+
+    if (number.IsInteger())
+    {
+        value = static_cast<double>(number.GetInteger64());
+    }
+    else if (number.IsUnsigned())
+    {
+        value = static_cast<double>(number.GetUnsigned64());
+    }
+    else
+    {
+        value = number.GetDouble();
+    }
+    return true;
+}
+/*****************************************************************************/
+bool Cursor::Bool(bool &value)
+{
+    if (!Next())
+    {
+        return false;
+    }
+
+    if (*mS == 't')
+    {
+        value = true;
+        return JsonReader::ParseLiteral(mS, mEnd, "true", 4U) || Fail(JsonReader::JSON_PARSE_BAD_IDENTIFIER);
+    }
+    else if (*mS == 'f')
+    {
+        value = false;
+        return JsonReader::ParseLiteral(mS, mEnd, "false", 5U) || Fail(JsonReader::JSON_PARSE_BAD_IDENTIFIER);
+    }
+    return Mismatch();
+}
+/*****************************************************************************/
+bool Cursor::IsNull()
+{
+    if (!Next() || (*mS != 'n'))
+    {
+        return false;
+    }
+    return JsonReader::ParseLiteral(mS, mEnd, "null", 4U) || Fail(JsonReader::JSON_PARSE_BAD_IDENTIFIER);
+}
+/*****************************************************************************/
+bool Cursor::Value(JsonValue &value)
+{
+    if (!Next())
+    {
+        return false;
+    }
+
+    const char *start = mS;
+    if (!Skip())
+    {
+        return false;
+    }
+
+    std::size_t offset = 0U;
+    JsonReader::ParseStatus status = JsonReader::Parse(std::string_view(start, static_cast<std::size_t>(mS - start)), value, offset);
+    return (status == JsonReader::JSON_PARSE_OK) || Fail(status);
+}
+/*****************************************************************************/
+/**
+ * @brief Skip a value; nested containers are tracked with a stack of closing characters (no recursion)
+ */
+bool Cursor::Skip()
+{
+    std::string closers;
+
+    do
+    {
+        if (!Next())
+        {
+            return false;
+        }
+
+        bool ok = true;
+        bool dummy = false;
+        switch (*mS)
+        {
+        case '{':
+            ok = StartObject();
+            closers.push_back('}');
+            break;
+        case '[':
+            ok = StartArray();
+            closers.push_back(']');
+            break;
+        case '"':
+            ok = String(mScratch);
+            break;
+        case 't':
+        case 'f':
+            ok = Bool(dummy);
+            break;
+        case 'n':
+            ok = IsNull();
+            break;
+        default:
+        {
+            JsonValue number;
+            ok = Number(number);
+            break;
+        }
+        }
+
+        if (!ok)
+        {
+            return false;
+        }
+
+        // Move to the next value: member, element, or end of the enclosing containers
+        while (!closers.empty())
+        {
+            bool more = (closers.back() == '}') ? NextMember(mScratch) : NextElement();
+            if (more)
+            {
+                break;
+            }
+            if (!IsOk())
+            {
+                return false;
+            }
+            closers.pop_back();
+        }
+    } while (!closers.empty());
+
+    return true;
+}
+/*****************************************************************************/
+bool Cursor::Finish()
+{
+    if (!IsOk())
+    {
+        return false;
+    }
+
+    mS = JsonReader::SkipWhitespace(mS, mEnd);
+    return (mS == mEnd) || Fail(JsonReader::JSON_PARSE_UNEXPECTED_CHARACTER);
+}
+
+} // namespace JsonBind
+
+//=============================================================================
+// End of file JsonBind.cpp
+//=============================================================================
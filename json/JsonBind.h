@@ -0,0 +1,438 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#ifndef JSON_BIND_H
+#define JSON_BIND_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <tuple>
+#include <limits>
+#include <type_traits>
+#include <cstdint>
+#include "JsonReader.h"
+#include "JsonWriter.h"
+
+/*****************************************************************************/
+/**
+ * @brief Direct binding between Json text and C++ structures
+ *
+ * The fields of a structure are described once, at global scope:
+ *
+ *     struct Sensor
+ *     {
+ *         std::string name;
+ *         double value = 0.0;
+ *         std::optional<std::string> unit;
+ *         std::vector<std::int32_t> samples;
+ *     };
+ *     JSON_BIND(Sensor, name, value, unit, samples)
+ *
+ *     Sensor sensor;
+ *     JsonBind::Decode(text, sensor);
+ *     std::string out = JsonBind::ToString(sensor);
+ *
+ * The text is decoded straight into the structure and encoded straight from it,
+ * no JsonValue tree is built. Supported field types: bool, integers, floating
+ * point numbers, std::string, std::vector, std::optional, JsonValue (kept as a
+ * tree) and other bound structures.
+ *
+ * Decoding rules: unknown keys are skipped, missing members keep their current
+ * value, null is only accepted by std::optional (it becomes empty). Empty optional
+ * members are not written. A value that does not fit the C++ type (string for an
+ * integer, 300 for a std::uint8_t...) stops the decoding with JSON_PARSE_TYPE_MISMATCH.
+ *
+ * The Json key can differ from the member name by specializing JsonBind::Fields
+ * directly with JsonBind::MakeField("key", &Class::member).
+ */
+namespace JsonBind {
+
+/*****************************************************************************/
+/**
+ * @brief Pull parser used by the decoders, one call per token
+ *
+ * On error, the cursor keeps the first error and all the following calls fail.
+ */
+class Cursor
+{
+public:
+    explicit Cursor(std::string_view data);
+
+    bool StartObject();
+    bool NextMember(std::string &key); // false at the end of the object, or on error
+    bool StartArray();
+    bool NextElement();                // false at the end of the array, or on error
+    bool String(std::string &value);
+    bool Integer(std::int64_t &value);
+    bool Unsigned(std::uint64_t &value);
+    bool Double(double &value);
+    bool Bool(bool &value);
+    bool IsNull();                     // consumes the next value if it is null
+    bool Value(JsonValue &value);      // next value as a tree
+    bool Skip();                       // ignores the next value, whatever its type
+    bool Finish();                     // only whitespace can follow
+
+    bool Fail(JsonReader::ParseStatus status);
+    bool IsOk() const { return mStatus == JsonReader::JSON_PARSE_OK; }
+    JsonReader::ParseStatus GetStatus() const { return mStatus; }
+    std::size_t GetOffset() const { return static_cast<std::size_t>(mS - mBegin); }
+
+private:
+    const char *mBegin;
+    const char *mS;
+    const char *mEnd;
+    JsonReader::ParseStatus mStatus;
+    bool mFirst; // no member or element read yet in the current container
+    std::string mScratch;
+
+    bool Next();
+    bool Number(JsonValue &number);
+    bool Mismatch();
+};
+
+/*****************************************************************************/
+template <typename Class, typename T>
+struct Field
+{
+    std::string_view name;
+    T Class::*member;
+};
+
+template <typename Class, typename T>
+constexpr Field<Class, T> MakeField(std::string_view name, T Class::*member)
+{
+    return Field<Class, T>{ name, member };
+}
+
+/**
+ * @brief Description of a bound structure: static constexpr tuple of fields named value
+ */
+template <typename T>
+struct Fields;
+
+template <typename T, typename = void>
+struct IsBound : std::false_type {};
+
+template <typename T>
+struct IsBound<T, std::void_t<decltype(Fields<T>::value)>> : std::true_type {};
+
+template <typename T>
+bool Read(Cursor &cursor, T &value);
+template <typename T>
+bool Read(Cursor &cursor, std::vector<T> &value);
+template <typename T>
+bool Read(Cursor &cursor, std::optional<T> &value);
+
+template <typename T>
+void Write(JsonWriter &writer, const T &value);
+template <typename T>
+void Write(JsonWriter &writer, const std::vector<T> &value);
+template <typename T>
+void Write(JsonWriter &writer, const std::optional<T> &value);
+
+/*****************************************************************************/
+template <typename T>
+bool ReadObject(Cursor &cursor, T &object)
+{
+    std::string key;
+
+    if (!cursor.StartObject())
+    {
+        return false;
+    }
+
+    while (cursor.NextMember(key))
+    {
+        bool ok = true;
+        bool found = std::apply([&](const auto &... field) {
+            return (((field.name == key) ? (ok = Read(cursor, object.*(field.member)), true) : false) || ...);
+        }, Fields<T>::value);
+
+        if (!found)
+        {
+            ok = cursor.Skip();
+        }
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    return cursor.IsOk();
+}
+/*****************************************************************************/
+template <typename T>
+bool Read(Cursor &cursor, T &value)
+{
+    if constexpr (std::is_same<T, bool>::value)
+    {
+        return cursor.Bool(value);
+    }
+    else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value)
+    {
+        std::int64_t number = 0;
+        if (!cursor.Integer(number))
+        {
+            return false;
+        }
+        if constexpr (sizeof(T) < sizeof(std::int64_t))
+        {
+            if ((number < std::numeric_limits<T>::min()) || (number > std::numeric_limits<T>::max()))
+            {
+                return cursor.Fail(JsonReader::JSON_PARSE_TYPE_MISMATCH);
+            }
+        }
+        value = static_cast<T>(number);
+        return true;
+    }
+    else if constexpr (std::is_integral<T>::value)
+    {
+        std::uint64_t number = 0U;
+        if (!cursor.Unsigned(number))
+        {
+            return false;
+        }
+        if constexpr (sizeof(T) < sizeof(std::uint64_t))
+        {
+            if (number > std::numeric_limits<T>::max())
+            {
+                return cursor.Fail(JsonReader::JSON_PARSE_TYPE_MISMATCH);
+            }
+        }
+        value = static_cast<T>(number);
+        return true;
+    }
+    else if constexpr (std::is_floating_point<T>::value)
+    {
+        double number = 0.0;
+        if (!cursor.Double(number))
+        {
+            return false;
+        }
+        value = static_cast<T>(number);
+        return true;
+    }
+    else if constexpr (std::is_same<T, std::string>::value)
+    {
+        return cursor.String(value);
+    }
+    else if constexpr (std::is_same<T, JsonValue>::value)
+    {
+        return cursor.Value(value);
+    }
+    else
+    {
+        static_assert(IsBound<T>::value, "Unsupported type: describe the structure with JSON_BIND");
+        return ReadObject(cursor, value);
+    }
+}
+/*****************************************************************************/
+template <typename T>
+bool Read(Cursor &cursor, std::vector<T> &value)
+{
+    value.clear();
+    if (!cursor.StartArray())
+    {
+        return false;
+    }
+
+    while (cursor.NextElement())
+    {
+        if constexpr (std::is_same<T, bool>::value)
+        {
+            bool element = false;
+            if (!Read(cursor, element))
+            {
+                return false;
+            }
+            value.push_back(element);
+        }
+        else
+        {
+            value.emplace_back();
+            if (!Read(cursor, value.back()))
+            {
+                return false;
+            }
+        }
+    }
+    return cursor.IsOk();
+}
+/*****************************************************************************/
+template <typename T>
+bool Read(Cursor &cursor, std::optional<T> &value)
+{
+    if (cursor.IsNull())
+    {
+        value.reset();
+        return true;
+    }
+    return cursor.IsOk() && Read(cursor, value.emplace());
+}
+/*****************************************************************************/
+template <typename T>
+void WriteMember(JsonWriter &writer, std::string_view name, const T &value)
+{
+    writer.Key(name);
+    Write(writer, value);
+}
+/*****************************************************************************/
+template <typename T>
+void WriteMember(JsonWriter &writer, std::string_view name, const std::optional<T> &value)
+{
+    if (value.has_value())
+    {
+        writer.Key(name);
+        Write(writer, *value);
+    }
+}
+/*****************************************************************************/
+template <typename T>
+void Write(JsonWriter &writer, const T &value)
+{
+    if constexpr (std::is_same<T, bool>::value)
+    {
+        writer.Bool(value);
+    }
+    else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value)
+    {
+        writer.Integer(static_cast<std::int64_t>(value));
+    }
+    else if constexpr (std::is_integral<T>::value)
+    {
+        writer.Unsigned(static_cast<std::uint64_t>(value));
+    }
+    else if constexpr (std::is_floating_point<T>::value)
+    {
+        writer.Double(static_cast<double>(value));
+    }
+    else if constexpr (std::is_same<T, std::string>::value)
+    {
+        writer.String(value);
+    }
+    else if constexpr (std::is_same<T, JsonValue>::value)
+    {
+        writer.Write(value);
+    }
+    else
+    {
+        static_assert(IsBound<T>::value, "Unsupported type: describe the structure with JSON_BIND");
+        writer.StartObject();
+        std::apply([&](const auto &... field) {
+            (WriteMember(writer, field.name, value.*(field.member)), ...);
+        }, Fields<T>::value);
+        writer.EndObject();
+    }
+}
+/*****************************************************************************/
+template <typename T>
+void Write(JsonWriter &writer, const std::vector<T> &value)
+{
+    writer.StartArray();
+    for (const auto &element : value)
+    {
+        Write(writer, static_cast<const T &>(element));
+    }
+    writer.EndArray();
+}
+/*****************************************************************************/
+template <typename T>
+void Write(JsonWriter &writer, const std::optional<T> &value)
+{
+    if (value.has_value())
+    {
+        Write(writer, *value);
+    }
+    else
+    {
+        writer.Null();
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief Decode a whole document into a bound value
+ * @param offset position where the decoding stopped (error location)
+ */
+template <typename T>
+JsonReader::ParseStatus Decode(std::string_view data, T &value, std::size_t &offset)
+{
+    Cursor cursor(data);
+    if (Read(cursor, value))
+    {
+        cursor.Finish();
+    }
+    offset = cursor.GetOffset();
+    return cursor.GetStatus();
+}
+/*****************************************************************************/
+template <typename T>
+JsonReader::ParseStatus Decode(std::string_view data, T &value)
+{
+    std::size_t offset = 0U;
+    return Decode(data, value, offset);
+}
+/*****************************************************************************/
+template <typename T>
+void Encode(JsonWriter &writer, const T &value)
+{
+    Write(writer, value);
+}
+/*****************************************************************************/
+template <typename T>
+std::string ToString(const T &value)
+{
+    std::string text;
+    JsonWriter writer(text);
+    Write(writer, value);
+    return text;
+}
+
+} // namespace JsonBind
+
+/*****************************************************************************/
+// JSON_BIND(Class, member1, member2...): up to 24 members, the Json keys are the member names
+#define JSON_BIND(Class, ...) \
+    template <> \
+    struct JsonBind::Fields<Class> \
+    { \
+        static constexpr auto value = std::make_tuple(JSON_BIND_EXPAND(JSON_BIND_CAT(JSON_BIND_FIELD_, JSON_BIND_COUNT(__VA_ARGS__))(Class, __VA_ARGS__))); \
+    };
+
+#define JSON_BIND_EXPAND(x) x
+#define JSON_BIND_CAT(a, b) JSON_BIND_CAT_(a, b)
+#define JSON_BIND_CAT_(a, b) a##b
+#define JSON_BIND_FIELD_1(Class, m) JsonBind::MakeField(#m, &Class::m)
+#define JSON_BIND_FIELD_2(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_1(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_3(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_2(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_4(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_3(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_5(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_4(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_6(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_5(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_7(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_6(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_8(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_7(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_9(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_8(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_10(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_9(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_11(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_10(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_12(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_11(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_13(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_12(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_14(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_13(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_15(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_14(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_16(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_15(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_17(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_16(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_18(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_17(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_19(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_18(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_20(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_19(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_21(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_20(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_22(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_21(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_23(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_22(Class, __VA_ARGS__))
+#define JSON_BIND_FIELD_24(Class, m, ...) JSON_BIND_FIELD_1(Class, m), JSON_BIND_EXPAND(JSON_BIND_FIELD_23(Class, __VA_ARGS__))
+#define JSON_BIND_COUNT(...) JSON_BIND_EXPAND(JSON_BIND_NTH(__VA_ARGS__, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1))
+#define JSON_BIND_NTH(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, N, ...) N
+
+#endif // JSON_BIND_H
+
+//=============================================================================
+// End of file JsonBind.h
+//=============================================================================
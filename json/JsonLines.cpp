@@ -0,0 +1,366 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#ifdef USE_WINDOWS_OS
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#include "JsonLines.h"
+#include "JsonScan.h"
+
+/*****************************************************************************/
+/**
+ * @brief Length of the next chunk: it ends with a line feed, as close as possible to chunkSize
+ * @return 0 if the text contains no line feed
+ */
+static std::size_t Cut(std::string_view text, std::size_t chunkSize)
+{
+    std::size_t pos = std::string_view::npos;
+
+    if (text.size() > chunkSize)
+    {
+        pos = text.rfind('\n', chunkSize - 1U);
+    }
+    if (pos == std::string_view::npos)
+    {
+        // Line longer than a chunk, or short text
+        pos = text.find('\n', (text.size() > chunkSize) ? chunkSize : 0U);
+    }
+    return (pos != std::string_view::npos) ? (pos + 1U) : 0U;
+}
+/*****************************************************************************/
+JsonLinesReader::JsonLinesReader(IHandler &handler, std::size_t threads)
+    : mHandler(handler)
+    , mOwnedPool(new thread_pool(1U, (threads > 0U) ? threads : std::max(1U, std::thread::hardware_concurrency())))
+    , mPool(*mOwnedPool)
+    , mMaxInFlight(2U * ((threads > 0U) ? threads : std::max(1U, std::thread::hardware_concurrency())))
+    , mChunkSize(cDefaultChunkSize)
+    , mLineBase(0U)
+    , mStatus(JsonReader::JSON_PARSE_OK)
+{
+
+}
+/*****************************************************************************/
+JsonLinesReader::JsonLinesReader(IHandler &handler, thread_pool &pool)
+    : mHandler(handler)
+    , mPool(pool)
+    , mMaxInFlight(2U * std::max(1U, std::thread::hardware_concurrency()))
+    , mChunkSize(cDefaultChunkSize)
+    , mLineBase(0U)
+    , mStatus(JsonReader::JSON_PARSE_OK)
+{
+
+}
+/*****************************************************************************/
+JsonLinesReader::~JsonLinesReader()
+{
+    // The workers may still use the batches (and the caller's buffer)
+    for (std::future<BatchPtr> &result : mInFlight)
+    {
+        result.wait();
+    }
+}
+/*****************************************************************************/
+void JsonLinesReader::Reset()
+{
+    mStatus = JsonReader::JSON_PARSE_ABORTED;
+    Drain();
+    mPending.clear();
+    mLineBase = 0U;
+    mStatus = JsonReader::JSON_PARSE_OK;
+}
+/*****************************************************************************/
+JsonReader::ParseStatus JsonLinesReader::Feed(const void *data, std::size_t size)
+{
+    if (mStatus != JsonReader::JSON_PARSE_OK)
+    {
+        return mStatus;
+    }
+
+    mPending.append(static_cast<const char *>(data), size);
+
+    std::size_t start = 0U;
+    while (((mPending.size() - start) >= mChunkSize) && (mStatus == JsonReader::JSON_PARSE_OK))
+    {
+        std::size_t length = Cut(std::string_view(mPending).substr(start), mChunkSize);
+        if (length == 0U)
+        {
+            break; // wait for the end of the line
+        }
+
+        BatchPtr batch = std::make_shared<Batch>(2U * length);
+        batch->owned.assign(mPending, start, length);
+        batch->text = batch->owned;
+        Submit(batch);
+        start += length;
+    }
+    mPending.erase(0U, start);
+    return mStatus;
+}
+/*****************************************************************************/
+JsonReader::ParseStatus JsonLinesReader::Finish()
+{
+    if ((mStatus == JsonReader::JSON_PARSE_OK) && !mPending.empty())
+    {
+        // Last line without line feed
+        BatchPtr batch = std::make_shared<Batch>(2U * mPending.size());
+        batch->owned.swap(mPending);
+        batch->text = batch->owned;
+        Submit(batch);
+    }
+    mPending.clear();
+    Drain();
+    return mStatus;
+}
+/*****************************************************************************/
+JsonReader::ParseStatus JsonLinesReader::ParseBuffer(std::string_view data)
+{
+    if (!mPending.empty())
+    {
+        Feed(data.data(), data.size());
+        return Finish();
+    }
+
+    while (!data.empty() && (mStatus == JsonReader::JSON_PARSE_OK))
+    {
+        std::size_t length = Cut(data, mChunkSize);
+        if (length == 0U)
+        {
+            length = data.size();
+        }
+
+        BatchPtr batch = std::make_shared<Batch>(2U * length);
+        batch->text = data.substr(0U, length);
+        Submit(batch);
+        data.remove_prefix(length);
+    }
+    return Finish(); // the batches point to the caller's buffer, wait for all of them
+}
+/*****************************************************************************/
+JsonReader::ParseStatus JsonLinesReader::ParseFd(int fd)
+{
+    std::vector<char> chunk(mChunkSize);
+
+    while (mStatus == JsonReader::JSON_PARSE_OK)
+    {
+#ifdef USE_WINDOWS_OS
+        int n = _read(fd, chunk.data(), static_cast<unsigned int>(chunk.size()));
+#else
+        ssize_t n = read(fd, chunk.data(), chunk.size());
+#endif
+        if (n > 0)
+        {
+            Feed(chunk.data(), static_cast<std::size_t>(n));
+        }
+        else if (n == 0)
+        {
+            break;
+        }
+        else if (errno != EINTR)
+        {
+            Drain();
+            mStatus = JsonReader::JSON_PARSE_IO_ERROR;
+        }
+    }
+    return Finish();
+}
+/*****************************************************************************/
+JsonReader::ParseStatus JsonLinesReader::ParseFile(const std::string &fileName)
+{
+#ifdef USE_UNIX_OS
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return JsonReader::JSON_PARSE_IO_ERROR;
+    }
+
+    JsonReader::ParseStatus status;
+    struct stat info;
+    void *map = MAP_FAILED;
+    if ((fstat(fd, &info) == 0) && (info.st_size > 0))
+    {
+        map = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    if (map != MAP_FAILED)
+    {
+        madvise(map, static_cast<std::size_t>(info.st_size), MADV_SEQUENTIAL);
+        status = ParseBuffer(std::string_view(static_cast<const char *>(map), static_cast<std::size_t>(info.st_size)));
+        munmap(map, static_cast<std::size_t>(info.st_size));
+    }
+    else
+    {
+        status = ParseFd(fd); // pipes, special files
+    }
+    close(fd);
+    return status;
+#else
+    std::ifstream f(fileName, std::ios_base::in | std::ios_base::binary);
+    if (!f.is_open())
+    {
+        return JsonReader::JSON_PARSE_IO_ERROR;
+    }
+
+    std::vector<char> chunk(mChunkSize);
+    while ((mStatus == JsonReader::JSON_PARSE_OK) && f)
+    {
+        f.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        if (f.gcount() > 0)
+        {
+            Feed(chunk.data(), static_cast<std::size_t>(f.gcount()));
+        }
+    }
+    if ((mStatus == JsonReader::JSON_PARSE_OK) && !f.eof())
+    {
+        Drain();
+        mStatus = JsonReader::JSON_PARSE_IO_ERROR;
+    }
+    return Finish();
+#endif
+}
+/*****************************************************************************/
+/**
+ * @brief Queue a chunk to the workers; when too many are in flight, the oldest ones are delivered first
+ */
+void JsonLinesReader::Submit(const BatchPtr &batch)
+{
+    while ((mInFlight.size() >= mMaxInFlight) && (mStatus == JsonReader::JSON_PARSE_OK))
+    {
+        BatchPtr done = mInFlight.front().get();
+        mInFlight.pop_front();
+        Deliver(*done);
+    }
+
+    if (mStatus == JsonReader::JSON_PARSE_OK)
+    {
+        mInFlight.push_back(mPool.enqueue_task([batch]() {
+            Parse(*batch);
+            return batch;
+        }));
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief Wait for all the chunks in flight, deliver them in order unless the parsing has stopped
+ */
+void JsonLinesReader::Drain()
+{
+    while (!mInFlight.empty())
+    {
+        BatchPtr done = mInFlight.front().get();
+        mInFlight.pop_front();
+        if (mStatus == JsonReader::JSON_PARSE_OK)
+        {
+            Deliver(*done);
+        }
+    }
+}
+/*****************************************************************************/
+void JsonLinesReader::Deliver(Batch &batch)
+{
+    for (std::size_t i = 0U; i < batch.records.size(); i++)
+    {
+        const Record &record = batch.records[i];
+        std::uint64_t line = mLineBase + record.line + 1U;
+
+        if (record.status == JsonReader::JSON_PARSE_OK)
+        {
+            if (!mHandler.Line(line, batch.values[i]))
+            {
+                mStatus = JsonReader::JSON_PARSE_ABORTED;
+                break;
+            }
+        }
+        else if (!mHandler.Error(line, record.status))
+        {
+            mStatus = record.status;
+            break;
+        }
+    }
+    mLineBase += batch.lines;
+}
+/*****************************************************************************/
+/**
+ * @brief Worker side: parse all the lines of a chunk into its arena
+ */
+void JsonLinesReader::Parse(Batch &batch)
+{
+    const char *s = batch.text.data();
+    const char *end = s + batch.text.size();
+    std::uint32_t line = 0U;
+
+    while (s < end)
+    {
+        const char *eol = static_cast<const char *>(std::memchr(s, '\n', static_cast<std::size_t>(end - s)));
+        const char *stop = (eol != nullptr) ? eol : end;
+
+        if (JsonScan::SkipWhitespace(s, stop) != stop)
+        {
+            std::size_t offset = 0U;
+            Record record;
+            batch.values.emplace_back(batch.arena.GetAllocator());
+            record.line = line;
+            record.status = JsonReader::Parse(std::string_view(s, static_cast<std::size_t>(stop - s)), batch.values.back(), offset);
+            batch.records.push_back(record);
+        }
+        line++;
+        s = (eol != nullptr) ? (eol + 1) : end;
+    }
+    batch.lines = line;
+}
+/*****************************************************************************/
+JsonLinesWriter::JsonLinesWriter(std::string &output)
+    : mWriter(output)
+    , mLines(0U)
+{
+
+}
+/*****************************************************************************/
+JsonLinesWriter::JsonLinesWriter(std::ostream &output)
+    : mWriter(output)
+    , mLines(0U)
+{
+
+}
+/*****************************************************************************/
+JsonLinesWriter::JsonLinesWriter(int fd)
+    : mWriter(fd)
+    , mLines(0U)
+{
+
+}
+/*****************************************************************************/
+void JsonLinesWriter::Write(const JsonValue &value)
+{
+    mWriter.Write(value);
+    mWriter.EndLine();
+    mLines++;
+}
+/*****************************************************************************/
+void JsonLinesWriter::Write(const JsonObject &obj)
+{
+    mWriter.Write(obj);
+    mWriter.EndLine();
+    mLines++;
+}
+/*****************************************************************************/
+bool JsonLinesWriter::Flush()
+{
+    return mWriter.Flush();
+}
+
+//=============================================================================
+// End of file JsonLines.cpp
+//=============================================================================
@@ -0,0 +1,145 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#ifndef JSON_LINES_H
+#define JSON_LINES_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <future>
+#include <cstdint>
+#include "JsonReader.h"
+#include "JsonWriter.h"
+#include "Pool.h"
+
+/*****************************************************************************/
+/**
+ * @brief Parallel reader of newline delimited Json (NDJSON / Json Lines)
+ *
+ * The input is cut at line boundaries into chunks that are parsed by a pool of
+ * workers; the lines are delivered to the handler in the input order, from the
+ * calling thread. Each chunk is parsed in its own arena, the values are released
+ * once delivered. At most a few chunks per worker are in flight, so the memory
+ * usage does not depend on the input size.
+ *
+ * Blank lines are ignored, line numbers start at 1.
+ */
+class JsonLinesReader
+{
+public:
+    class IHandler
+    {
+    public:
+        virtual ~IHandler() {}
+
+        /**
+         * @brief Parsed line, the value lives in the arena of its batch, which is released after the call
+         *
+         * To keep the value, copy it or move it to the heap with the allocator-extended constructor:
+         * JsonValue(std::move(value), JsonValue::allocator_type()). A plain move keeps the arena.
+         * @return false to stop the parsing
+         */
+        virtual bool Line(std::uint64_t line, JsonValue &value) = 0;
+
+        /**
+         * @brief Invalid line
+         * @return true to skip the line and continue
+         */
+        virtual bool Error(std::uint64_t line, JsonReader::ParseStatus status) { (void) line; (void) status; return false; }
+    };
+
+    static const std::size_t cDefaultChunkSize = 1024U * 1024U;
+
+    // Uses an internal pool, 0 means one thread per core
+    explicit JsonLinesReader(IHandler &handler, std::size_t threads = 0U);
+    JsonLinesReader(IHandler &handler, thread_pool &pool);
+    ~JsonLinesReader();
+
+    void SetChunkSize(std::size_t size) { mChunkSize = size; }
+
+    // Data pushed in pieces of any size, the lines can be split between two calls
+    JsonReader::ParseStatus Feed(const void *data, std::size_t size);
+    JsonReader::ParseStatus Finish(); // end of input, waits for all the lines to be delivered
+    void Reset();
+
+    /**
+     * @brief Whole input in memory, parsed without copy
+     */
+    JsonReader::ParseStatus ParseBuffer(std::string_view data);
+    JsonReader::ParseStatus ParseFd(int fd);
+    JsonReader::ParseStatus ParseFile(const std::string &fileName); // memory mapped when possible
+
+    std::uint64_t GetLineCount() const { return mLineBase; }
+
+private:
+    struct Record
+    {
+        std::uint32_t line;             // position in the chunk
+        JsonReader::ParseStatus status;
+    };
+
+    struct Batch
+    {
+        std::string owned;              // copy of the text when it comes from Feed()
+        std::string_view text;
+        JsonArena arena;
+        std::vector<JsonValue> values;  // one per record
+        std::vector<Record> records;    // non blank lines
+        std::uint32_t lines;
+
+        explicit Batch(std::size_t arenaSize) : arena(arenaSize), lines(0U)
+        {
+            arena.SetKeyInterning(true); // records usually repeat the same keys
+        }
+    };
+
+    typedef std::shared_ptr<Batch> BatchPtr;
+
+    IHandler &mHandler;
+    std::unique_ptr<thread_pool> mOwnedPool;
+    thread_pool &mPool;
+    std::size_t mMaxInFlight;
+    std::size_t mChunkSize;
+    std::string mPending;               // incomplete chunk
+    std::deque<std::future<BatchPtr>> mInFlight;
+    std::uint64_t mLineBase;
+    JsonReader::ParseStatus mStatus;
+
+    void Submit(const BatchPtr &batch);
+    void Deliver(Batch &batch);
+    void Drain();
+    static void Parse(Batch &batch);
+};
+
+/*****************************************************************************/
+/**
+ * @brief Buffered writer of newline delimited Json, one compact document per line
+ */
+class JsonLinesWriter
+{
+public:
+    explicit JsonLinesWriter(std::string &output);
+    explicit JsonLinesWriter(std::ostream &output);
+    explicit JsonLinesWriter(int fd);
+
+    void Write(const JsonValue &value);
+    void Write(const JsonObject &obj);
+    bool Flush();
+
+    std::uint64_t GetLineCount() const { return mLines; }
+
+private:
+    JsonWriter mWriter;
+    std::uint64_t mLines;
+};
+
+#endif // JSON_LINES_H
+
+//=============================================================================
+// End of file JsonLines.h
+//=============================================================================
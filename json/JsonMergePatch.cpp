@@ -0,0 +1,100 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#include "JsonMergePatch.h"
+
+/*****************************************************************************/
+void JsonMergePatch::Apply(JsonValue &target, const JsonValue &patch)
+{
+    if (!patch.IsObject())
+    {
+        target = patch;
+        return;
+    }
+
+    JsonObject &obj = target.GetObj(); // a non-object target is replaced by an empty object
+    const JsonObject &members = patch.GetObj();
+    for (JsonObject::const_iterator it = members.begin(); it != members.end(); ++it)
+    {
+        std::string_view name = it->first;
+        const JsonValue &value = it->second;
+
+        if (value.IsNull())
+        {
+            obj.DeleteMember(name);
+        }
+        else
+        {
+            JsonValue *member = obj.FindMember(name);
+            if (member == nullptr)
+            {
+                obj.AddValue(std::string(name), JsonValue());
+                member = obj.FindMember(name);
+            }
+            Apply(*member, value);
+        }
+    }
+}
+/*****************************************************************************/
+bool JsonMergePatch::Diff(const JsonValue &source, const JsonValue &target, JsonValue &patch)
+{
+    bool changed = false;
+
+    if (source.IsObject() && target.IsObject())
+    {
+        patch.GetObj().Clear();
+        changed = DiffObjects(source.GetObj(), target.GetObj(), patch.GetObj());
+    }
+    else if (source != target)
+    {
+        patch = target;
+        changed = true;
+    }
+    else
+    {
+        patch.GetObj().Clear();
+    }
+    return changed;
+}
+/*****************************************************************************/
+/**
+ * @brief Recursive diff of two objects, the members are compared only once
+ */
+bool JsonMergePatch::DiffObjects(const JsonObject &source, const JsonObject &target, JsonObject &patch)
+{
+    for (JsonObject::const_iterator it = source.begin(); it != source.end(); ++it)
+    {
+        if (target.FindMember(it->first) == nullptr)
+        {
+            JsonValue removed;
+            removed.SetNull();
+            patch.AddValue(std::string(std::string_view(it->first)), std::move(removed));
+        }
+    }
+
+    for (JsonObject::const_iterator it = target.begin(); it != target.end(); ++it)
+    {
+        const JsonValue *before = source.FindMember(it->first);
+        const JsonValue &after = it->second;
+
+        if ((before != nullptr) && before->IsObject() && after.IsObject())
+        {
+            JsonValue nested;
+            if (DiffObjects(before->GetObj(), after.GetObj(), nested.GetObj()))
+            {
+                patch.AddValue(std::string(std::string_view(it->first)), std::move(nested));
+            }
+        }
+        else if ((before == nullptr) ? !after.IsNull() : (*before != after))
+        {
+            patch.AddValue(std::string(std::string_view(it->first)), after);
+        }
+    }
+    return patch.GetSize() > 0U;
+}
+
+//=============================================================================
+// End of file JsonMergePatch.cpp
+//=============================================================================
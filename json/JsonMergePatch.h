@@ -0,0 +1,52 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#ifndef JSON_MERGE_PATCH_H
+#define JSON_MERGE_PATCH_H
+
+#include "JsonValue.h"
+
+/*****************************************************************************/
+/**
+ * @brief JSON Merge Patch (RFC 7386)
+ *
+ * A patch looks like the document it modifies: objects are merged member by
+ * member, a null member removes the target member and any other value replaces
+ * the target value (arrays are replaced as a whole).
+ *
+ * Diff() computes the patch between two versions of a document, so that only
+ * the changes are serialized and sent:
+ *
+ *     JsonValue patch;
+ *     if (JsonMergePatch::Diff(previous, current, patch))
+ *     {
+ *         server.SendToAllClients(patch.ToString(), true);
+ *     }
+ *     // client side
+ *     JsonMergePatch::Apply(document, patch);
+ *
+ * A member whose value is null cannot be expressed in a merge patch (null means
+ * "remove"): such a member is removed on the other side.
+ */
+class JsonMergePatch
+{
+public:
+    static void Apply(JsonValue &target, const JsonValue &patch);
+
+    /**
+     * @brief Smallest patch that turns source into target
+     * @return false if both documents are equal (the patch is then an empty object)
+     */
+    static bool Diff(const JsonValue &source, const JsonValue &target, JsonValue &patch);
+
+private:
+    static bool DiffObjects(const JsonObject &source, const JsonObject &target, JsonObject &patch);
+};
+
+#endif // JSON_MERGE_PATCH_H
+
+//=============================================================================
+// End of file JsonMergePatch.h
+//=============================================================================
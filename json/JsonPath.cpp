@@ -0,0 +1,259 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#include <charconv>
+#include "JsonPath.h"
+
+/*****************************************************************************/
+JsonPath::JsonPath(std::string_view keyPath)
+{
+    std::size_t start = 0U;
+    bool last = false;
+
+    while (!last)
+    {
+        std::size_t end = keyPath.find(':', start);
+        last = (end == std::string_view::npos);
+        if (last)
+        {
+            end = keyPath.size();
+        }
+
+        Segment segment;
+        segment.key.assign(keyPath.data() + start, end - start);
+        segment.isIndex = ParseIndex(segment.key, segment.index);
+        mSegments.push_back(std::move(segment));
+        start = end + 1U;
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief A segment made of digits only is an index in arrays
+ */
+bool JsonPath::ParseIndex(std::string_view key, std::uint32_t &index)
+{
+    index = 0U;
+    bool isIndex = !key.empty() && (key.find_first_not_of("0123456789") == std::string_view::npos);
+    if (isIndex)
+    {
+        if (std::from_chars(key.data(), key.data() + key.size(), index).ec != std::errc())
+        {
+            index = UINT32_MAX; // too big, always out of range
+        }
+    }
+    return isIndex;
+}
+/*****************************************************************************/
+std::string JsonPath::ToString() const
+{
+    std::string path;
+    for (std::size_t i = 0U; i < mSegments.size(); i++)
+    {
+        if (i > 0U)
+        {
+            path.push_back(':');
+        }
+        path += mSegments[i].key;
+    }
+    return path;
+}
+/*****************************************************************************/
+/**
+ * @brief Find one level deeper: a member of an object, an entry of an array
+ *
+ * For arrays, the segment is either an index or the key of the first object
+ * entry that owns such a key.
+ */
+const JsonValue *JsonPath::Child(const JsonValue &node, const Segment &segment)
+{
+    return Child(node, segment.key, segment.isIndex, segment.index);
+}
+/*****************************************************************************/
+const JsonValue *JsonPath::Child(const JsonValue &node, std::string_view key, bool isIndex, std::uint32_t index)
+{
+    const JsonValue *child = nullptr;
+
+    if (node.IsObject())
+    {
+        child = node.GetObj().FindMember(key);
+    }
+    else if (node.IsArray())
+    {
+        const JsonArray &array = node.GetArray();
+        if (isIndex)
+        {
+            child = array.Find(index);
+        }
+        else
+        {
+            for (JsonArray::const_iterator iter = array.begin(); iter != array.end(); ++iter)
+            {
+                if (iter->IsObject())
+                {
+                    child = iter->GetObj().FindMember(key);
+                    if (child != nullptr)
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return child;
+}
+/*****************************************************************************/
+const JsonValue *JsonPath::Walk(const JsonValue *node, std::size_t first) const
+{
+    for (std::size_t i = first; (i < mSegments.size()) && (node != nullptr); i++)
+    {
+        node = Child(*node, mSegments[i]);
+    }
+    return node;
+}
+/*****************************************************************************/
+const JsonValue *JsonPath::Find(const JsonObject &root) const
+{
+    return mSegments.empty() ? nullptr : Walk(root.FindMember(mSegments[0].key), 1U);
+}
+/*****************************************************************************/
+JsonValue *JsonPath::Find(JsonObject &root) const
+{
+    return const_cast<JsonValue *>(Find(static_cast<const JsonObject &>(root)));
+}
+/*****************************************************************************/
+const JsonValue *JsonPath::Find(const JsonArray &root) const
+{
+    const JsonValue *value = nullptr;
+
+    if (!mSegments.empty() && mSegments[0].isIndex)
+    {
+        value = Walk(root.Find(mSegments[0].index), 1U);
+    }
+    return value;
+}
+/*****************************************************************************/
+JsonValue *JsonPath::Find(JsonArray &root) const
+{
+    return const_cast<JsonValue *>(Find(static_cast<const JsonArray &>(root)));
+}
+/*****************************************************************************/
+/**
+ * @brief Segment of a string key path beginning at start
+ * @return beginning of the next segment, npos after the last one
+ */
+std::size_t JsonPath::NextSegment(std::string_view keyPath, std::size_t start, std::string_view &key)
+{
+    std::size_t end = keyPath.find(':', start);
+    if (end == std::string_view::npos)
+    {
+        key = keyPath.substr(start);
+        return std::string_view::npos;
+    }
+    key = keyPath.substr(start, end - start);
+    return end + 1U;
+}
+/*****************************************************************************/
+const JsonValue *JsonPath::Walk(const JsonValue *node, std::string_view keyPath, std::size_t start)
+{
+    while ((start != std::string_view::npos) && (node != nullptr))
+    {
+        std::string_view key;
+        std::uint32_t index;
+        start = NextSegment(keyPath, start, key);
+        bool isIndex = ParseIndex(key, index);
+        node = Child(*node, key, isIndex, index);
+    }
+    return node;
+}
+/*****************************************************************************/
+const JsonValue *JsonPath::Resolve(const JsonValue &root, std::string_view keyPath)
+{
+    return Walk(&root, keyPath, 0U);
+}
+/*****************************************************************************/
+const JsonValue *JsonPath::Resolve(const JsonObject &root, std::string_view keyPath)
+{
+    std::string_view key;
+    std::size_t next = NextSegment(keyPath, 0U, key);
+    return Walk(root.FindMember(key), keyPath, next);
+}
+/*****************************************************************************/
+const JsonValue *JsonPath::Resolve(const JsonArray &root, std::string_view keyPath)
+{
+    std::string_view key;
+    std::uint32_t index;
+    std::size_t next = NextSegment(keyPath, 0U, key);
+    return ParseIndex(key, index) ? Walk(root.Find(index), keyPath, next) : nullptr;
+}
+/*****************************************************************************/
+JsonQuery::JsonQuery()
+    : mNodes(1U)
+    , mCount(0U)
+{
+
+}
+/*****************************************************************************/
+std::size_t JsonQuery::Add(const JsonPath &path)
+{
+    std::size_t node = 0U;
+
+    for (std::size_t i = 0U; i < path.Size(); i++)
+    {
+        const JsonPath::Segment &segment = path[i];
+        std::size_t next = 0U;
+
+        for (std::size_t child : mNodes[node].children)
+        {
+            if (mNodes[child].segment.key == segment.key)
+            {
+                next = child;
+                break;
+            }
+        }
+
+        if (next == 0U)
+        {
+            next = mNodes.size();
+            mNodes.emplace_back();
+            mNodes[next].segment = segment;
+            mNodes[node].children.push_back(next);
+        }
+        node = next;
+    }
+
+    mNodes[node].slots.push_back(mCount);
+    return mCount++;
+}
+/*****************************************************************************/
+std::size_t JsonQuery::Extract(const JsonValue &root, std::vector<const JsonValue *> &results) const
+{
+    results.assign(mCount, nullptr);
+    return Visit(0U, root, results);
+}
+/*****************************************************************************/
+std::size_t JsonQuery::Visit(std::size_t node, const JsonValue &value, std::vector<const JsonValue *> &results) const
+{
+    const Node &n = mNodes[node];
+    std::size_t found = n.slots.size();
+
+    for (std::size_t slot : n.slots)
+    {
+        results[slot] = &value;
+    }
+
+    for (std::size_t child : n.children)
+    {
+        const JsonValue *next = JsonPath::Child(value, mNodes[child].segment);
+        if (next != nullptr)
+        {
+            found += Visit(child, *next, results);
+        }
+    }
+    return found;
+}
+
+//=============================================================================
+// End of file JsonPath.cpp
+//=============================================================================
@@ -0,0 +1,132 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#ifndef JSON_PATH_H
+#define JSON_PATH_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "JsonValue.h"
+
+/*****************************************************************************/
+/**
+ * @brief Compiled key path
+ *
+ * The path ("test2:name", "records:3:id") is parsed once into segments; the
+ * object can then be kept and used for any number of lookups. Same rules as the
+ * string key paths: in an array, a segment is either an index or the key of the
+ * first object entry that owns such a key.
+ *
+ *     static const JsonPath cName("test2:name");
+ *     const JsonValue *name = doc.Find(cName);
+ */
+class JsonPath
+{
+public:
+    struct Segment
+    {
+        std::string key;
+        std::uint32_t index;
+        bool isIndex;   // only digits, used as an index in arrays
+    };
+
+    JsonPath() {}
+    explicit JsonPath(std::string_view keyPath);
+
+    std::size_t Size() const { return mSegments.size(); }
+    const Segment &operator [] (std::size_t i) const { return mSegments[i]; }
+    std::string ToString() const;
+
+    /**
+     * @brief Walk the path from a root value
+     * @return nullptr if not found; an empty path returns the root itself
+     */
+    const JsonValue *Find(const JsonValue &root) const { return Walk(&root, 0U); }
+    JsonValue *Find(JsonValue &root) const { return const_cast<JsonValue *>(Walk(&root, 0U)); }
+
+    // The first segment is a member of the object
+    const JsonValue *Find(const JsonObject &root) const;
+    JsonValue *Find(JsonObject &root) const;
+
+    // The first segment is an index of the array
+    const JsonValue *Find(const JsonArray &root) const;
+    JsonValue *Find(JsonArray &root) const;
+
+    /**
+     * @brief One level deeper: a member of an object, an entry of an array
+     */
+    static const JsonValue *Child(const JsonValue &node, const Segment &segment);
+
+    /**
+     * @brief One-shot lookups of a string key path, parsed in place: nothing is allocated
+     */
+    static const JsonValue *Resolve(const JsonValue &root, std::string_view keyPath);
+    static const JsonValue *Resolve(const JsonObject &root, std::string_view keyPath);
+    static const JsonValue *Resolve(const JsonArray &root, std::string_view keyPath);
+
+private:
+    std::vector<Segment> mSegments;
+
+    const JsonValue *Walk(const JsonValue *node, std::size_t first) const;
+    static const JsonValue *Walk(const JsonValue *node, std::string_view keyPath, std::size_t start);
+    static std::size_t NextSegment(std::string_view keyPath, std::size_t start, std::string_view &key);
+    static bool ParseIndex(std::string_view key, std::uint32_t &index);
+    static const JsonValue *Child(const JsonValue &node, std::string_view key, bool isIndex, std::uint32_t index);
+};
+
+/*****************************************************************************/
+/**
+ * @brief Extract many values from one document in a single traversal
+ *
+ * The paths are merged in a prefix tree, so a common prefix is resolved only
+ * once whatever the number of paths that share it:
+ *
+ *     JsonQuery query;
+ *     std::size_t id = query.Add("device:id");
+ *     std::size_t temp = query.Add("device:sensors:temperature");
+ *     std::vector<const JsonValue *> values;
+ *     query.Extract(doc, values);     // values[id], values[temp]
+ */
+class JsonQuery
+{
+public:
+    JsonQuery();
+
+    /**
+     * @brief Add a path to extract
+     * @return position of the value in the results of Extract()
+     */
+    std::size_t Add(const JsonPath &path);
+    std::size_t Add(std::string_view keyPath) { return Add(JsonPath(keyPath)); }
+
+    std::size_t Size() const { return mCount; }
+
+    /**
+     * @brief Resolve all the paths, results[i] is nullptr if path i is not found
+     * @return number of paths found
+     */
+    std::size_t Extract(const JsonValue &root, std::vector<const JsonValue *> &results) const;
+
+private:
+    struct Node
+    {
+        JsonPath::Segment segment;
+        std::vector<std::size_t> children;  // indexes in mNodes
+        std::vector<std::size_t> slots;     // paths ending here
+    };
+
+    std::vector<Node> mNodes;   // mNodes[0] is the root
+    std::size_t mCount;
+
+    std::size_t Visit(std::size_t node, const JsonValue &value, std::vector<const JsonValue *> &results) const;
+};
+
+#endif // JSON_PATH_H
+
+//=============================================================================
+// End of file JsonPath.h
+//=============================================================================
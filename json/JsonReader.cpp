@@ -3,16 +3,14 @@
  * Copyright (c) 2019 Anthony Rabine
  */
 
-#include <cctype>
-#include <map>
-#include <iostream>
-#include <string.h>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <charconv>
+#include <vector>
 
 #include "JsonReader.h"
 
-// Uncomment this line to enable JSON parsing traces
-//#define JSON_READER_D
-
 /*****************************************************************************/
 /**
  * @brief Open a JSON file for parsing
@@ -27,498 +25,512 @@ bool JsonReader::ParseFile(JsonValue &json, const std::string &fileName)
     std::ifstream f;
     bool valid = false;
 
-    f.open(fileName, std::ios_base::in | std::ios_base::binary);
+    f.open(fileName, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
     if (f.is_open())
     {
-        std::ostringstream contents;
-        contents << f.rdbuf();
+        // Read the file in one shot into a buffer of the right size
+        std::string contents(static_cast<std::size_t>(f.tellg()), '\0');
+        f.seekg(0, std::ios_base::beg);
+        f.read(&contents[0], static_cast<std::streamsize>(contents.size()));
         f.close();
-        valid = ParseString(json, contents.str());
+        valid = ParseString(json, contents);
     }
 
     return valid;
 }
 /*****************************************************************************/
-bool JsonReader::ParseString(JsonValue &json, const std::string &data)
+bool JsonReader::ParseString(JsonValue &json, std::string_view data)
 {
-    char *endptr;
-    bool valid = false;
-
-#ifdef USE_WINDOWS_OS
-    char *source = _strdup(data.c_str());
-#else
-    char *source = strdup(data.c_str());
-#endif
-
-    JsonReader::ParseStatus status = Parse(source, &endptr, json);
-    if (status == JSON_PARSE_OK)
-    {
-        valid = true;
-    }
-    free(source);
-    return valid;
+    std::size_t offset = 0U;
+    return Parse(data, json, offset) == JSON_PARSE_OK;
 }
 /*****************************************************************************/
-JsonReader::ParseStatus JsonReader::Parse(char *s, char **endptr, JsonValue &json)
+JsonReader::ParseStatus JsonReader::Parse(std::string_view data, JsonValue &json, std::size_t &offset)
 {
-    int pos = -1;
-    int prev = -1;
-    std::map<int, JsonValue::Tag> tags; // keep a trace of tags (open tag/close tag)
-    std::map<int, std::string> keys; // keep a trace of keys inside an object (multiple keys are forbidden)
-    std::map<int, JsonValue> nodes; // keep a link of previous nodes
+    const char *s = data.data();
+    const char *end = s + data.size();
+    ParseStatus status = JSON_PARSE_OK;
+    std::vector<JsonValue *> stack; // currently opened containers, innermost at the back
+    std::string key;
+    JsonValue *target = &json; // slot where the next value is created
+    bool done = false;
+    JsonArena *interning = dynamic_cast<JsonArena *>(json.mResource);
+
+    if ((interning != nullptr) && !interning->IsKeyInterning())
+    {
+        interning = nullptr;
+    }
 
-    bool separator = true;
-    *endptr = s;
+    stack.reserve(32U);
 
-    while (*s)
+    while (!done && (status == JSON_PARSE_OK))
     {
-        JsonValue o;
-        while (*s && isspace(*s))
+        // Parse one value into the target slot
+        bool complete = true;
+        s = SkipWhitespace(s, end);
+        if (s == end)
         {
-            ++s;
+            status = JSON_PARSE_BREAKING_BAD;
+            break;
         }
 
-        *endptr = s++;
-        switch (**endptr)
+        switch (*s)
         {
-            case '\0':
-                continue;
-                break;
-            case '-':
-                if (!isdigit(*s) && *s != '.')
+            case '{':
+                target->Reset(JsonValue::OBJECT);
+                s = SkipWhitespace(s + 1, end);
+                if ((s < end) && (*s == '}'))
                 {
-                    *endptr = s;
-                    return JSON_PARSE_BAD_NUMBER;
+                    ++s; // empty object
                 }
-                /* fallthrough */
-            case '0':
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-            case '8':
-            case '9':
-                o = JsonValue(StringToNumber(*endptr, &s));
-                if (!IsDelim(*s))
+                else
                 {
-                    *endptr = s;
-                    return JSON_PARSE_BAD_NUMBER;
+                    status = ParseKey(s, end, key);
+                    if (status == JSON_PARSE_OK)
+                    {
+                        stack.push_back(target);
+                        target = &target->mObject->Emplace(key, interning);
+                        complete = false;
+                    }
                 }
                 break;
-            case '"':
-            {
-                std::string temp;
-#ifdef JSON_READER_D
-                std::cout << "JSON_TAG_STRING" << std::endl;
-#endif
-                while (*s)
+            case '[':
+                target->Reset(JsonValue::ARRAY);
+                s = SkipWhitespace(s + 1, end);
+                if ((s < end) && (*s == ']'))
                 {
-                    //int c = *it = *s;
-                    int c = *s;
-                    if (c == '\\')
-                    {
-                        c = *++s;
-                        switch (c)
-                        {
-                            case '\\':
-                            case '"':
-                            case '/':
-                                temp.push_back(c);
-                                break;
-                            case 'b':
-                                temp.push_back('\b');
-                                break;
-                            case 'f':
-                                temp.push_back('\f');
-                                break;
-                            case 'n':
-                                temp.push_back('\n');
-                                break;
-                            case 'r':
-                                temp.push_back('\r');
-                                break;
-                            case 't':
-                                temp.push_back('\t');
-                                break;
-                            case 'u':
-                                // Manage unicode encoding
-                                c = 0;
-                                for (int i = 0; i < 4; ++i)
-                                {
-                                    if (!isxdigit(*++s))
-                                    {
-                                        *endptr = s;
-                                        return JSON_PARSE_BAD_STRING;
-                                    }
-                                    c = c * 16 + CharToInt(*s);
-                                }
-                                if (c < 0x80)
-                                {
-                                    //*it = c;
-                                    temp.push_back(c);
-                                }
-                                else if (c < 0x800)
-                                {
-                                    temp.push_back(0xC0 | (c >> 6));
-                                    temp.push_back(0x80 | (c & 0x3F));
-                                }
-                                else
-                                {
-                                    temp.push_back(0xE0 | (c >> 12));
-                                    temp.push_back(0x80 | ((c >> 6) & 0x3F));
-                                    temp.push_back(0x80 | (c & 0x3F));
-                                }
-                                break;
-                            default:
-                                *endptr = s;
-                                return JSON_PARSE_BAD_STRING;
-                        }
-                    }
-                    else if (iscntrl(c))
-                    {
-                        *endptr = s;
-                        return JSON_PARSE_BAD_STRING;
-                    }
-                    else if (c == '"')
-                    {
-                        ++s;
-                        break;
-                    }
-                    else
-                    {
-                        temp.push_back(c);
-                    }
-                    s++;
+                    ++s; // empty array
                 }
-
-                // Save the string into the JsonValue
-                o = JsonValue(temp);
-
-#ifdef JSON_READER_D
-                std::cout << "Found string: "  << temp << std::endl;
-#endif
-
-                // There must be a ':' after the key or a coma "," after a value
-                if (!IsDelim(*s))
+                else
                 {
-                    *endptr = s;
-                    return JSON_PARSE_BAD_STRING;
+                    stack.push_back(target);
+                    target = &target->mArray->Emplace();
+                    complete = false;
                 }
                 break;
-            }
+            case '"':
+                status = ParseStringToken(s, end, target->StringRef());
+                break;
             case 't':
-                for (const char *it = "rue"; *it; ++it, ++s)
+                if (ParseLiteral(s, end, "true", 4U))
                 {
-                    if (*it != *s)
-                    {
-                        return JSON_PARSE_BAD_IDENTIFIER;
-                    }
+                    *target = JsonValue(true);
                 }
-                if (!IsDelim(*s))
+                else
                 {
-                    return JSON_PARSE_BAD_IDENTIFIER;
+                    status = JSON_PARSE_BAD_IDENTIFIER;
                 }
-
-                o = JsonValue(true);
-#ifdef JSON_READER_D
-                std::cout << "JSON_TAG_BOOL" << std::endl;
-#endif
                 break;
             case 'f':
-                for (const char *it = "alse"; *it; ++it, ++s)
+                if (ParseLiteral(s, end, "false", 5U))
                 {
-                    if (*it != *s)
-                    {
-                        return JSON_PARSE_BAD_IDENTIFIER;
-                    }
+                    *target = JsonValue(false);
                 }
-                if (!IsDelim(*s))
+                else
                 {
-                    return JSON_PARSE_BAD_IDENTIFIER;
+                    status = JSON_PARSE_BAD_IDENTIFIER;
                 }
-                o = JsonValue(false);
-#ifdef JSON_READER_D
-                std::cout << "JSON_TAG_BOOL" << std::endl;
-#endif
-
                 break;
             case 'n':
-                for (const char *it = "ull"; *it; ++it, ++s)
+                if (ParseLiteral(s, end, "null", 4U))
                 {
-                    if (*it != *s)
-                    {
-                        return JSON_PARSE_BAD_IDENTIFIER;
-                    }
+                    target->SetNull();
                 }
-                if (!IsDelim(*s))
+                else
                 {
-                    return JSON_PARSE_BAD_IDENTIFIER;
+                    status = JSON_PARSE_BAD_IDENTIFIER;
                 }
-                o.SetNull();
-#ifdef JSON_READER_D
-                std::cout << "JSON_TAG_BOOL" << std::endl;
-#endif
-
                 break;
-            case ']':
-                if (pos == -1)
-                {
-                    return JSON_PARSE_STACK_UNDERFLOW;
-                }
-                if (tags[pos] != JsonValue::ARRAY)
-                {
-                    return JSON_PARSE_MISMATCH_BRACKET;
-                }
-
-                if (pos > 0)
+            case '-':
+                if (((s + 1) == end) || !IsDigit(s[1]))
                 {
-                    // We have finished with this object, add it to the previous node and delete it
-                    prev = pos - 1;
-                    if (tags[prev] == JsonValue::OBJECT)
-                    {
-                        // if previous node was an object, then we create a new object
-                        nodes[prev].GetObj().AddValue(keys[prev], nodes[pos]);
-                    }
-                    else
-                    {
-                        // Object in an array? ==> no tag
-                        nodes[prev].GetArray().AddValue(nodes[pos]);
-                    }
-
-                    nodes.erase(pos);
-                    pos--;
-                    keys[pos] = ""; // key has been used to create the array
-                    separator = false;
+                    status = JSON_PARSE_BAD_NUMBER;
+                    break;
                 }
-                else
+                /* fallthrough */
+            case '0':
+            case '1':
+            case '2':
+            case '3':
+            case '4':
+            case '5':
+            case '6':
+            case '7':
+            case '8':
+            case '9':
+                *target = StringToNumber(s, end, &s);
+                if (!IsDelim(s, end))
                 {
-                    // End of document
-                    json = nodes[0];
-                    *endptr = s;
-                    return JSON_PARSE_OK;
+                    status = JSON_PARSE_BAD_NUMBER;
                 }
-                continue;
-
-#ifdef JSON_READER_D
-                std::cout << "TAG_ARRAY_END" << std::endl;
-#endif
-
                 break;
+            case ']':
             case '}':
-                if (pos == -1)
-                {
-                    return JSON_PARSE_STACK_UNDERFLOW;
-                }
-                if (tags[pos] != JsonValue::OBJECT)
-                {
-                    return JSON_PARSE_MISMATCH_BRACKET;
-                }
-                if (keys[pos] != "")
-                {
-                    return JSON_PARSE_UNEXPECTED_CHARACTER;
-                }
-
-                if (pos > 0)
-                {
-                    // We have finished with this object, add it to the previous node and delete it
-                    prev = pos - 1;
-                    if (tags[prev] == JsonValue::OBJECT)
-                    {
-                        // if previous node was an object, then we create a new object
-                        nodes[prev].GetObj().AddValue(keys[prev], nodes[pos]);
-                    }
-                    else
-                    {
-                        // Object in an array? ==> no tag
-                        nodes[prev].GetArray().AddValue(nodes[pos]);
-                    }
+                status = stack.empty() ? JSON_PARSE_STACK_UNDERFLOW : JSON_PARSE_UNEXPECTED_CHARACTER;
+                break;
+            default:
+                status = JSON_PARSE_UNEXPECTED_CHARACTER;
+                break;
+        }
 
-                    nodes.erase(pos);
-                    pos--;
-                    keys[pos] = ""; // key has been used to create the object
-                    separator = false;
-                }
-                else
+        // The value is finished: close the containers until we find the next slot
+        while (complete && (status == JSON_PARSE_OK))
+        {
+            if (stack.empty())
+            {
+                // End of document, only whitespaces are allowed after the root value
+                s = SkipWhitespace(s, end);
+                if (s != end)
                 {
-                    // End of document
-                    json = nodes[0];
-                    *endptr = s;
-                    return JSON_PARSE_OK;
+                    status = JSON_PARSE_UNEXPECTED_CHARACTER;
                 }
-                continue;
-
-#ifdef JSON_READER_D
-                std::cout << "TAG_OBJECT_END" << std::endl;
-#endif
+                done = true;
                 break;
-            case '[':
+            }
 
-#ifdef JSON_READER_D
-                std::cout << "TAG_ARRAY_BEGIN" << std::endl;
-#endif
-                ++pos;
-                nodes[pos] = JsonValue(JsonArray());
-                tags[pos] = JsonValue::ARRAY;
-                keys[pos] = "";
-                separator = true;
-                continue;
-            case '{':
+            s = SkipWhitespace(s, end);
+            if (s == end)
+            {
+                status = JSON_PARSE_BREAKING_BAD;
+                break;
+            }
 
-#ifdef JSON_READER_D
-                std::cout << "TAG_OBJECT_BEGIN" << std::endl;
-#endif
-                ++pos;
-                nodes[pos] = JsonValue(JsonObject());
-                tags[pos] = JsonValue::OBJECT;
-                keys[pos] = "";
-                separator = true;
-                continue;
-            case ':':
-                if (separator || keys[pos] == "")
+            JsonValue *parent = stack.back();
+            if (*s == ',')
+            {
+                ++s;
+                if (parent->IsArray())
                 {
-                    return JSON_PARSE_UNEXPECTED_CHARACTER;
+                    target = &parent->mArray->Emplace();
                 }
-                separator = true;
-                continue;
-            case ',':
-                if (separator || keys[pos] != "")
+                else
                 {
-                    return JSON_PARSE_UNEXPECTED_CHARACTER;
+                    s = SkipWhitespace(s, end);
+                    status = ParseKey(s, end, key);
+                    if (status == JSON_PARSE_OK)
+                    {
+                        target = &parent->mObject->Emplace(key, interning);
+                    }
                 }
-                separator = true;
-                continue;
-            default:
-                return JSON_PARSE_UNEXPECTED_CHARACTER;
-        }
-        separator = false;
-
-        // We are here because we are in an object
-        if (tags[pos] == JsonValue::OBJECT)
-        {
-            if (keys[pos] == "")
+                complete = false;
+            }
+            else if (*s == ']')
             {
-                // Key found!
-                if (o.GetTag() != JsonValue::STRING)
+                if (!parent->IsArray())
                 {
-                    return JSON_PARSE_UNQUOTED_KEY;
+                    status = JSON_PARSE_MISMATCH_BRACKET;
                 }
-                keys[pos] = o.GetString();
-                continue; // Let's continue to find the value ...
+                ++s;
+                stack.pop_back();
             }
-
-            // Use our own type management, event if the RTTI thing would also work...
-            if (nodes[pos].IsObject())
+            else if (*s == '}')
             {
-                nodes[pos].GetObj().AddValue(keys[pos], o);
-                keys[pos] = "";
+                if (!parent->IsObject())
+                {
+                    status = JSON_PARSE_MISMATCH_BRACKET;
+                }
+                ++s;
+                stack.pop_back();
             }
             else
             {
-                return JSON_PARSE_ALLOC_ERROR;
+                status = JSON_PARSE_UNEXPECTED_CHARACTER;
             }
         }
+    }
+
+    offset = static_cast<std::size_t>(s - data.data());
+    if (status != JSON_PARSE_OK)
+    {
+        json.Clear();
+    }
+    return status;
+}
+/*****************************************************************************/
+/**
+ * @brief Parse an object key and the following ':' separator
+ * @param s points to the opening quote of the key, points after the ':' on success
+ */
+JsonReader::ParseStatus JsonReader::ParseKey(const char *&s, const char *end, std::string &key)
+{
+    if ((s == end) || (*s != '"'))
+    {
+        return JSON_PARSE_UNQUOTED_KEY;
+    }
+
+    ParseStatus status = ParseStringToken(s, end, key);
+    if (status == JSON_PARSE_OK)
+    {
+        s = SkipWhitespace(s, end);
+        if ((s < end) && (*s == ':'))
+        {
+            ++s;
+        }
         else
         {
-            // We are in an Array
-            // Use our own type management, event if the RTTI thing would also work...
-            if (nodes[pos].IsArray())
-            {
-                nodes[pos].GetArray().AddValue(o);
-                keys[pos] = "";
-            }
-            else
-            {
-                return JSON_PARSE_ALLOC_ERROR;
-            }
+            status = JSON_PARSE_UNEXPECTED_CHARACTER;
         }
     }
-    return JSON_PARSE_BREAKING_BAD;
+    return status;
 }
 /*****************************************************************************/
-JsonValue JsonReader::StringToNumber(char *s, char **endptr)
+/**
+ * @brief Decode a Json string
+ *
+ * Runs of characters that do not need any decoding are located using the
+ * vectorized scanner and appended in one go.
+ *
+ * @param s points to the opening quote, points after the closing quote on success
+ * @param output decoded string
+ */
+template <typename String>
+JsonReader::ParseStatus JsonReader::ParseStringToken(const char *&s, const char *end, String &output)
 {
-    char ch = *s;
-    if (ch == '+' || ch == '-')
+    output.clear();
+    ++s; // skip the opening quote
+
+    while (s < end)
     {
+        const char *run = s;
+        s = JsonScan::FindStringSpecial(s, end);
+        output.append(run, static_cast<std::size_t>(s - run));
+
+        if (s == end)
+        {
+            break;
+        }
+        else if (*s == '"')
+        {
+            ++s;
+            return JSON_PARSE_OK;
+        }
+        else if (*s != '\\')
+        {
+            // Control characters must be escaped
+            return JSON_PARSE_BAD_STRING;
+        }
+
+        if (++s == end)
+        {
+            break;
+        }
+
+        switch (*s)
+        {
+            case '\\':
+            case '"':
+            case '/':
+                output.push_back(*s);
+                break;
+            case 'b':
+                output.push_back('\b');
+                break;
+            case 'f':
+                output.push_back('\f');
+                break;
+            case 'n':
+                output.push_back('\n');
+                break;
+            case 'r':
+                output.push_back('\r');
+                break;
+            case 't':
+                output.push_back('\t');
+                break;
+            case 'u':
+            {
+                // Manage unicode encoding, including UTF-16 surrogate pairs
+                std::uint32_t codePoint = 0U;
+                for (int pair = 0; pair < 2; pair++)
+                {
+                    if ((end - s) < 5)
+                    {
+                        return JSON_PARSE_BAD_STRING;
+                    }
+
+                    std::uint32_t c = 0U;
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        if (!isxdigit(static_cast<unsigned char>(*++s)))
+                        {
+                            return JSON_PARSE_BAD_STRING;
+                        }
+                        c = c * 16U + static_cast<std::uint32_t>(CharToInt(*s));
+                    }
+
+                    if (pair == 0)
+                    {
+                        codePoint = c;
+                        if ((c < 0xD800U) || (c > 0xDBFFU) || ((end - s) < 7) || (s[1] != '\\') || (s[2] != 'u'))
+                        {
+                            break; // not a high surrogate followed by another escape
+                        }
+                        s += 2;
+                    }
+                    else if ((c >= 0xDC00U) && (c <= 0xDFFFU))
+                    {
+                        codePoint = 0x10000U + ((codePoint - 0xD800U) << 10U) + (c - 0xDC00U);
+                    }
+                    else
+                    {
+                        // Lone high surrogate, keep both values as they are
+                        AppendUtf8(output, codePoint);
+                        codePoint = c;
+                    }
+                }
+                AppendUtf8(output, codePoint);
+                break;
+            }
+            default:
+                return JSON_PARSE_BAD_STRING;
+        }
         ++s;
     }
 
-    double result = 0;
-    bool doubleValue = false;
-    JsonValue retVal;
-
-    while (isdigit(*s))
+    return JSON_PARSE_BAD_STRING; // missing closing quote
+}
+/*****************************************************************************/
+template <typename String>
+void JsonReader::AppendUtf8(String &output, std::uint32_t codePoint)
+{
+    if (codePoint < 0x80U)
+    {
+        output.push_back(static_cast<char>(codePoint));
+    }
+    else if (codePoint < 0x800U)
+    {
+        output.push_back(static_cast<char>(0xC0U | (codePoint >> 6U)));
+        output.push_back(static_cast<char>(0x80U | (codePoint & 0x3FU)));
+    }
+    else if (codePoint < 0x10000U)
+    {
+        output.push_back(static_cast<char>(0xE0U | (codePoint >> 12U)));
+        output.push_back(static_cast<char>(0x80U | ((codePoint >> 6U) & 0x3FU)));
+        output.push_back(static_cast<char>(0x80U | (codePoint & 0x3FU)));
+    }
+    else
+    {
+        output.push_back(static_cast<char>(0xF0U | (codePoint >> 18U)));
+        output.push_back(static_cast<char>(0x80U | ((codePoint >> 12U) & 0x3FU)));
+        output.push_back(static_cast<char>(0x80U | ((codePoint >> 6U) & 0x3FU)));
+        output.push_back(static_cast<char>(0x80U | (codePoint & 0x3FU)));
+    }
+}
+/*****************************************************************************/
+// Used by JsonStreamReader
+template JsonReader::ParseStatus JsonReader::ParseStringToken<std::string>(const char *&s, const char *end, std::string &output);
+/*****************************************************************************/
+bool JsonReader::ParseLiteral(const char *&s, const char *end, const char *literal, std::size_t size)
+{
+    bool ok = false;
+    if ((static_cast<std::size_t>(end - s) >= size) && (std::memcmp(s, literal, size) == 0))
     {
-        result = (result * 10) + (*s++ - '0');
+        s += size;
+        ok = IsDelim(s, end);
     }
+    return ok;
+}
+/*****************************************************************************/
+/**
+ * @brief Convert a number token, the type is chosen in the same pass
+ *
+ * The token must follow the Json grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+ * Integers are kept as INTEGER when they fit in 64 bits signed, as UINTEGER up to
+ * 2^64 - 1; any other number is a double, converted with correct rounding.
+ * On error, *endptr is set to s and the value is invalid.
+ */
+JsonValue JsonReader::StringToNumber(const char *s, const char *end, const char **endptr)
+{
+    const char *start = s;
+    bool negative = false;
 
-    if (*s == '.')
+    *endptr = start;
+    if ((s < end) && (*s == '-'))
     {
+        negative = true;
         ++s;
-        doubleValue = true;
+    }
 
-        double fraction = 1;
-        while (isdigit(*s))
+    // Integer part, accumulated as long as it fits in 64 bits
+    const char *digits = s;
+    std::uint64_t mantissa = 0U;
+    bool overflow = false;
+    while ((s < end) && IsDigit(*s))
+    {
+        std::uint64_t digit = static_cast<std::uint64_t>(*s++ - '0');
+        if (mantissa > ((UINT64_MAX - digit) / 10U))
         {
-            fraction *= 0.1;
-            result += (*s++ - '0') * fraction;
+            overflow = true;
         }
+        mantissa = (mantissa * 10U) + digit;
     }
 
-    if (*s == 'e' || *s == 'E')
+    // At least one digit, no leading zero
+    if ((s == digits) || ((*digits == '0') && ((s - digits) > 1)))
     {
-        ++s;
-        doubleValue = true;
+        return JsonValue();
+    }
 
-        double base = 10;
-        if (*s == '+')
+    bool isInteger = !overflow;
+    if ((s < end) && (*s == '.'))
+    {
+        isInteger = false;
+        const char *fraction = ++s;
+        while ((s < end) && IsDigit(*s))
         {
             ++s;
         }
-        else if (*s == '-')
+        if (s == fraction)
+        {
+            return JsonValue();
+        }
+    }
+    if ((s < end) && ((*s == 'e') || (*s == 'E')))
+    {
+        isInteger = false;
+        ++s;
+        if ((s < end) && ((*s == '+') || (*s == '-')))
         {
             ++s;
-            base = 0.1;
         }
-
-        int exponent = 0;
-        while (isdigit(*s))
+        const char *exponent = s;
+        while ((s < end) && IsDigit(*s))
         {
-            exponent = (exponent * 10) + (*s++ - '0');
+            ++s;
         }
-
-        double power = 1;
-        for (; exponent; exponent >>= 1, base *= base)
+        if (s == exponent)
         {
-            if (exponent & 1)
-            {
-                power *= base;
-            }
+            return JsonValue();
         }
-
-        result *= power;
     }
 
-    *endptr = s;
-
-    result = (ch == '-') ? -result : result;
-
-    if (doubleValue)
+    if (isInteger && !negative)
     {
-        retVal = result;
+        *endptr = s;
+        return JsonValue(mantissa);
     }
-    else
+    if (isInteger && (mantissa <= (static_cast<std::uint64_t>(INT64_MAX) + 1U)))
     {
-        retVal = static_cast<std::int64_t>(result);
+        *endptr = s;
+        return JsonValue((mantissa == 0U) ? std::int64_t(0) : (-static_cast<std::int64_t>(mantissa - 1U) - 1));
     }
 
-    return retVal;
+    // The token is valid, from_chars converts all of it
+    double value = 0.0;
+    std::from_chars_result result = std::from_chars(start, s, value);
+    if (result.ec == std::errc::invalid_argument)
+    {
+        return JsonValue();
+    }
+    if (result.ec == std::errc::result_out_of_range)
+    {
+        // Infinity or zero, strtod gives the right one with the sign
+        value = std::strtod(std::string(start, s).c_str(), nullptr);
+    }
+    *endptr = s;
+    return JsonValue(value);
 }
 
-
 //=============================================================================
 // End of file JsonReader.cpp
 //=============================================================================
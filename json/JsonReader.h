@@ -7,10 +7,16 @@
 #define JSON_READER_H
 
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include "JsonValue.h"
+#include "JsonScan.h"
+
+namespace JsonBind {
+class Cursor;
+}
 
 /*****************************************************************************/
 
@@ -47,21 +53,61 @@ public:
         JSON_PARSE_UNEXPECTED_CHARACTER,
         JSON_PARSE_UNQUOTED_KEY,
         JSON_PARSE_BREAKING_BAD,
-        JSON_PARSE_ALLOC_ERROR
+        JSON_PARSE_ALLOC_ERROR,
+        JSON_PARSE_ABORTED,     // stopped by the caller
+        JSON_PARSE_IO_ERROR,
+        JSON_PARSE_TYPE_MISMATCH // the value does not fit the bound C++ type
     };
 
     // Helpers
     static bool ParseFile(JsonValue &json, const std::string &fileName);
-    static bool ParseString(JsonValue &json, const std::string &data);
+    static bool ParseString(JsonValue &json, std::string_view data);
+
+    /**
+     * @brief Parse a Json document in one pass, without copying the source buffer
+     *
+     * Values are created directly at their final place in the tree; nesting is
+     * tracked using a contiguous stack of the currently opened containers.
+     * On error, the json value is cleared.
+     *
+     * @param data Json document, does not need to be null terminated
+     * @param json Output tree
+     * @param offset Position of the parser when it stopped (error location)
+     * @return JSON_PARSE_OK on success
+     */
+    static ParseStatus Parse(std::string_view data, JsonValue &json, std::size_t &offset);
 
 private:
-    static JsonReader::ParseStatus Parse(char *s, char **endptr, JsonValue &json);
-    static JsonValue StringToNumber(char *s, char **endptr);
+    friend class JsonStreamReader; // shares the token decoders
+    friend class JsonBind::Cursor;
+
+    static ParseStatus ParseKey(const char *&s, const char *end, std::string &key);
+    template <typename String>
+    static ParseStatus ParseStringToken(const char *&s, const char *end, String &output);
+    static bool ParseLiteral(const char *&s, const char *end, const char *literal, std::size_t size);
+    static JsonValue StringToNumber(const char *s, const char *end, const char **endptr);
+    template <typename String>
+    static void AppendUtf8(String &output, std::uint32_t codePoint);
 
     /*****************************************************************************/
-    static inline bool IsDelim(char c)
+    static inline bool IsSpace(char c)
+    {
+        return JsonScan::IsSpace(c);
+    }
+    /*****************************************************************************/
+    static inline bool IsDigit(char c)
+    {
+        return (c >= '0') && (c <= '9');
+    }
+    /*****************************************************************************/
+    static inline const char *SkipWhitespace(const char *s, const char *end)
+    {
+        return JsonScan::SkipWhitespace(s, end);
+    }
+    /*****************************************************************************/
+    static inline bool IsDelim(const char *s, const char *end)
     {
-        return isspace(c) || c == ',' || c == ':' || c == ']' || c == '}' || c == '\0';
+        return (s == end) || IsSpace(*s) || (*s == ',') || (*s == ':') || (*s == ']') || (*s == '}');
     }
     /*****************************************************************************/
     static inline int CharToInt(char c)
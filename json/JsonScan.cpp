@@ -0,0 +1,236 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#include "JsonScan.h"
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define JSON_SCAN_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define JSON_SCAN_AVX2_TARGET
+#else
+#define JSON_SCAN_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+/*****************************************************************************/
+static const char *ScalarFindStringSpecial(const char *s, const char *end)
+{
+    while ((s < end) && (*s != '"') && (*s != '\\') && (static_cast<unsigned char>(*s) >= 0x20U))
+    {
+        ++s;
+    }
+    return s;
+}
+/*****************************************************************************/
+static const char *ScalarSkipWhitespace(const char *s, const char *end)
+{
+    while ((s < end) && JsonScan::IsSpace(*s))
+    {
+        ++s;
+    }
+    return s;
+}
+
+#ifdef JSON_SCAN_X86
+/*****************************************************************************/
+static inline std::uint32_t FirstBit(std::uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<std::uint32_t>(index);
+#else
+    return static_cast<std::uint32_t>(__builtin_ctz(mask));
+#endif
+}
+/*****************************************************************************/
+static const char *Sse2FindStringSpecial(const char *s, const char *end)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+
+    while ((end - s) >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        // max(v, 0x1F) == 0x1F <=> v <= 0x1F (unsigned)
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                       _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+        std::uint32_t mask = static_cast<std::uint32_t>(_mm_movemask_epi8(special));
+        if (mask != 0U)
+        {
+            return s + FirstBit(mask);
+        }
+        s += 16;
+    }
+    return ScalarFindStringSpecial(s, end);
+}
+/*****************************************************************************/
+static const char *Sse2SkipWhitespace(const char *s, const char *end)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+
+    while ((end - s) >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        std::uint32_t mask = ~static_cast<std::uint32_t>(_mm_movemask_epi8(ws)) & 0xFFFFU;
+        if (mask != 0U)
+        {
+            return s + FirstBit(mask);
+        }
+        s += 16;
+    }
+    return ScalarSkipWhitespace(s, end);
+}
+/*****************************************************************************/
+JSON_SCAN_AVX2_TARGET static const char *Avx2FindStringSpecial(const char *s, const char *end)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1F);
+
+    while ((end - s) >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        __m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+                                          _mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control));
+        std::uint32_t mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(special));
+        if (mask != 0U)
+        {
+            return s + FirstBit(mask);
+        }
+        s += 32;
+    }
+    return Sse2FindStringSpecial(s, end);
+}
+/*****************************************************************************/
+JSON_SCAN_AVX2_TARGET static const char *Avx2SkipWhitespace(const char *s, const char *end)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+
+    while ((end - s) >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+        std::uint32_t mask = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(ws));
+        if (mask != 0U)
+        {
+            return s + FirstBit(mask);
+        }
+        s += 32;
+    }
+    return Sse2SkipWhitespace(s, end);
+}
+/*****************************************************************************/
+static bool HasAvx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, 0, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+    __cpuidex(info, 1, 0);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || ((_xgetbv(0) & 0x6U) != 0x6U))
+    {
+        return false; // YMM registers not enabled by the OS
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif // JSON_SCAN_X86
+
+/*****************************************************************************/
+static std::atomic<JsonScan::Level> gLevel(JsonScan::SCALAR);
+
+// The function pointers are statically initialized to the first resolution
+// step, so the scanner can be used during the static initialization of other modules
+static const char *ResolveFindStringSpecial(const char *s, const char *end);
+static const char *ResolveSkipWhitespace(const char *s, const char *end);
+
+std::atomic<JsonScan::ScanFunc> JsonScan::mFindStringSpecial(ResolveFindStringSpecial);
+std::atomic<JsonScan::ScanFunc> JsonScan::mSkipWhitespace(ResolveSkipWhitespace);
+
+/*****************************************************************************/
+static const char *ResolveFindStringSpecial(const char *s, const char *end)
+{
+    JsonScan::SetLevel(JsonScan::GetBestLevel());
+    return JsonScan::FindStringSpecial(s, end);
+}
+/*****************************************************************************/
+static const char *ResolveSkipWhitespace(const char *s, const char *end)
+{
+    JsonScan::SetLevel(JsonScan::GetBestLevel());
+    return ScalarSkipWhitespace(s, end);
+}
+/*****************************************************************************/
+JsonScan::Level JsonScan::GetBestLevel()
+{
+#ifdef JSON_SCAN_X86
+    static const Level best = HasAvx2() ? AVX2 : SSE2;
+    return best;
+#else
+    return SCALAR;
+#endif
+}
+/*****************************************************************************/
+JsonScan::Level JsonScan::GetLevel()
+{
+    return gLevel;
+}
+/*****************************************************************************/
+bool JsonScan::SetLevel(Level level)
+{
+    if (level > GetBestLevel())
+    {
+        return false;
+    }
+
+    ScanFunc findStringSpecial = ScalarFindStringSpecial;
+    ScanFunc skipWhitespace = ScalarSkipWhitespace;
+
+    switch (level)
+    {
+#ifdef JSON_SCAN_X86
+    case AVX2:
+        findStringSpecial = Avx2FindStringSpecial;
+        skipWhitespace = Avx2SkipWhitespace;
+        break;
+    case SSE2:
+        findStringSpecial = Sse2FindStringSpecial;
+        skipWhitespace = Sse2SkipWhitespace;
+        break;
+#endif
+    default:
+        break;
+    }
+    mFindStringSpecial.store(findStringSpecial, std::memory_order_relaxed);
+    mSkipWhitespace.store(skipWhitespace, std::memory_order_relaxed);
+    gLevel = level;
+    return true;
+}
+
+//=============================================================================
+// End of file JsonScan.cpp
+//=============================================================================
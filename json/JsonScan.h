@@ -0,0 +1,83 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#ifndef JSON_SCAN_H
+#define JSON_SCAN_H
+
+#include <cstddef>
+#include <atomic>
+
+/*****************************************************************************/
+/**
+ * @brief Vectorized scanning primitives used by the Json parsers
+ *
+ * The input is processed 16 bytes (SSE2) or 32 bytes (AVX2) at a time. The best
+ * implementation is selected once at runtime depending on the CPU features; a
+ * portable scalar version is used on other architectures.
+ *
+ * None of the functions read past the end pointer.
+ */
+class JsonScan
+{
+public:
+    enum Level
+    {
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+
+    /**
+     * @brief Find the first character that ends a run of plain string characters
+     * @return pointer to the first quote, backslash or control character (< 0x20), end if none
+     */
+    static const char *FindStringSpecial(const char *s, const char *end)
+    {
+        return mFindStringSpecial.load(std::memory_order_relaxed)(s, end);
+    }
+
+    /**
+     * @brief Skip Json whitespaces (space, tab, line feed, carriage return)
+     * @return pointer to the first non-whitespace character, end if none
+     */
+    static inline const char *SkipWhitespace(const char *s, const char *end)
+    {
+        // Most of the time there is zero or one whitespace between the tokens
+        if ((s < end) && IsSpace(*s))
+        {
+            ++s;
+            if ((s < end) && IsSpace(*s))
+            {
+                s = mSkipWhitespace.load(std::memory_order_relaxed)(s, end);
+            }
+        }
+        return s;
+    }
+
+    static inline bool IsSpace(char c)
+    {
+        return (c == ' ') || (c == '\n') || (c == '\r') || (c == '\t');
+    }
+
+    /**
+     * @brief Force an implementation, mainly for testing and benchmarking
+     * @return false if the level is not supported by this CPU (the selection is unchanged)
+     */
+    static bool SetLevel(Level level);
+    static Level GetLevel();
+    static Level GetBestLevel();
+
+private:
+    typedef const char *(*ScanFunc)(const char *s, const char *end);
+
+    static std::atomic<ScanFunc> mFindStringSpecial;
+    static std::atomic<ScanFunc> mSkipWhitespace;
+};
+
+#endif // JSON_SCAN_H
+
+//=============================================================================
+// End of file JsonScan.h
+//=============================================================================
@@ -0,0 +1,557 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#include <algorithm>
+#include "JsonSnapshot.h"
+#include "JsonWriter.h"
+
+/*****************************************************************************/
+// Above this number of members, the lookups use a sorted index
+static const std::size_t cIndexThreshold = 8U;
+static const std::uint32_t cNotFound = UINT32_MAX;
+/*****************************************************************************/
+struct JsonSnapshot::Node
+{
+    mutable std::atomic<std::uint32_t> refs;
+    JsonValue::Tag tag;
+    union
+    {
+        std::int64_t integer;
+        std::uint64_t uinteger;
+        double real;
+        bool boolean;
+    };
+    std::string text;
+    std::vector<std::string> keys;          // objects: names of the members
+    std::vector<JsonSnapshot> children;     // objects: values of the members, arrays: entries
+    std::vector<std::uint32_t> sorted;      // big objects: positions of the members sorted by name
+
+    explicit Node(JsonValue::Tag t)
+        : refs(1U)
+        , tag(t)
+        , integer(0)
+    {
+
+    }
+
+    void Index()
+    {
+        sorted.clear();
+        if (keys.size() > cIndexThreshold)
+        {
+            sorted.resize(keys.size());
+            for (std::uint32_t i = 0U; i < sorted.size(); i++)
+            {
+                sorted[i] = i;
+            }
+            std::sort(sorted.begin(), sorted.end(), [this](std::uint32_t a, std::uint32_t b) {
+                return keys[a] < keys[b];
+            });
+        }
+    }
+
+    std::uint32_t FindMember(std::string_view name) const
+    {
+        if (sorted.empty())
+        {
+            for (std::uint32_t i = 0U; i < keys.size(); i++)
+            {
+                if (keys[i] == name)
+                {
+                    return i;
+                }
+            }
+        }
+        else
+        {
+            std::vector<std::uint32_t>::const_iterator it = std::lower_bound(sorted.begin(), sorted.end(), name,
+                [this](std::uint32_t pos, std::string_view key) { return std::string_view(keys[pos]) < key; });
+            if ((it != sorted.end()) && (keys[*it] == name))
+            {
+                return *it;
+            }
+        }
+        return cNotFound;
+    }
+};
+/*****************************************************************************/
+JsonSnapshot::JsonSnapshot(const JsonValue &value)
+    : mNode(Freeze(value))
+{
+
+}
+/*****************************************************************************/
+JsonSnapshot::JsonSnapshot(const JsonSnapshot &other) noexcept
+    : mNode(other.mNode)
+{
+    if (mNode != nullptr)
+    {
+        mNode->refs.fetch_add(1U, std::memory_order_relaxed);
+    }
+}
+/*****************************************************************************/
+JsonSnapshot::JsonSnapshot(JsonSnapshot &&other) noexcept
+    : mNode(other.mNode)
+{
+    other.mNode = nullptr;
+}
+/*****************************************************************************/
+JsonSnapshot::~JsonSnapshot()
+{
+    Release(mNode);
+}
+/*****************************************************************************/
+JsonSnapshot &JsonSnapshot::operator = (const JsonSnapshot &rhs) noexcept
+{
+    JsonSnapshot copy(rhs);
+    std::swap(mNode, copy.mNode);
+    return *this;
+}
+/*****************************************************************************/
+JsonSnapshot &JsonSnapshot::operator = (JsonSnapshot &&rhs) noexcept
+{
+    std::swap(mNode, rhs.mNode);
+    return *this;
+}
+/*****************************************************************************/
+void JsonSnapshot::Release(const Node *node)
+{
+    if ((node != nullptr) && (node->refs.fetch_sub(1U, std::memory_order_acq_rel) == 1U))
+    {
+        delete node;
+    }
+}
+/*****************************************************************************/
+const JsonSnapshot::Node *JsonSnapshot::Freeze(const JsonValue &value)
+{
+    if (!value.IsValid())
+    {
+        return nullptr;
+    }
+
+    Node *node = new Node(value.GetTag());
+    switch (value.GetTag())
+    {
+    case JsonValue::OBJECT:
+    {
+        const JsonObject &obj = value.GetObj();
+        node->keys.reserve(obj.GetSize());
+        node->children.reserve(obj.GetSize());
+        for (JsonObject::const_iterator it = obj.begin(); it != obj.end(); ++it)
+        {
+            node->keys.emplace_back(std::string_view(it->first));
+            node->children.push_back(JsonSnapshot(it->second));
+        }
+        node->Index();
+        break;
+    }
+    case JsonValue::ARRAY:
+    {
+        const JsonArray &array = value.GetArray();
+        node->children.reserve(array.Size());
+        for (JsonArray::const_iterator it = array.begin(); it != array.end(); ++it)
+        {
+            node->children.push_back(JsonSnapshot(*it));
+        }
+        break;
+    }
+    case JsonValue::STRING:
+        node->text = value.GetStringView();
+        break;
+    case JsonValue::INTEGER:
+        node->integer = value.GetInteger64();
+        break;
+    case JsonValue::UINTEGER:
+        node->uinteger = value.GetUnsigned64();
+        break;
+    case JsonValue::DOUBLE:
+        node->real = value.GetDouble();
+        break;
+    case JsonValue::BOOLEAN:
+        node->boolean = value.GetBool();
+        break;
+    default:
+        break;
+    }
+    return node;
+}
+/*****************************************************************************/
+JsonValue::Tag JsonSnapshot::GetTag() const
+{
+    return (mNode != nullptr) ? mNode->tag : JsonValue::INVALID;
+}
+/*****************************************************************************/
+std::int64_t JsonSnapshot::GetInteger64() const
+{
+    return IsInteger() ? mNode->integer : 0;
+}
+/*****************************************************************************/
+std::uint64_t JsonSnapshot::GetUnsigned64() const
+{
+    if (IsUnsigned())
+    {
+        return mNode->uinteger;
+    }
+    return (IsInteger() && (mNode->integer >= 0)) ? static_cast<std::uint64_t>(mNode->integer) : 0U;
+}
+/*****************************************************************************/
+double JsonSnapshot::GetDouble() const
+{
+    return IsDouble() ? mNode->real : 0.0;
+}
+/*****************************************************************************/
+bool JsonSnapshot::GetBool() const
+{
+    return IsBoolean() ? mNode->boolean : false;
+}
+/*****************************************************************************/
+std::string_view JsonSnapshot::GetStringView() const
+{
+    return IsString() ? std::string_view(mNode->text) : std::string_view();
+}
+/*****************************************************************************/
+std::uint32_t JsonSnapshot::Size() const
+{
+    return (mNode != nullptr) ? static_cast<std::uint32_t>(mNode->children.size()) : 0U;
+}
+/*****************************************************************************/
+std::string_view JsonSnapshot::GetKey(std::uint32_t index) const
+{
+    return (IsObject() && (index < mNode->keys.size())) ? std::string_view(mNode->keys[index]) : std::string_view();
+}
+/*****************************************************************************/
+JsonSnapshot JsonSnapshot::GetEntry(std::uint32_t index) const
+{
+    return (index < Size()) ? mNode->children[index] : JsonSnapshot();
+}
+/*****************************************************************************/
+JsonSnapshot JsonSnapshot::GetMember(std::string_view name) const
+{
+    std::uint32_t pos = IsObject() ? mNode->FindMember(name) : cNotFound;
+    return (pos != cNotFound) ? mNode->children[pos] : JsonSnapshot();
+}
+/*****************************************************************************/
+JsonSnapshot JsonSnapshot::Find(const JsonPath &path) const
+{
+    const JsonSnapshot *node = this;
+
+    for (std::size_t i = 0U; (i < path.Size()) && (node != nullptr); i++)
+    {
+        const JsonPath::Segment &segment = path[i];
+        const Node *current = node->mNode;
+        const JsonSnapshot *child = nullptr;
+
+        if (node->IsObject())
+        {
+            std::uint32_t pos = current->FindMember(segment.key);
+            child = (pos != cNotFound) ? &current->children[pos] : nullptr;
+        }
+        else if (node->IsArray())
+        {
+            if (segment.isIndex)
+            {
+                child = (segment.index < current->children.size()) ? &current->children[segment.index] : nullptr;
+            }
+            else
+            {
+                // First object entry that owns the key
+                for (std::size_t j = 0U; (j < current->children.size()) && (child == nullptr); j++)
+                {
+                    const JsonSnapshot &entry = current->children[j];
+                    std::uint32_t pos = entry.IsObject() ? entry.mNode->FindMember(segment.key) : cNotFound;
+                    child = (pos != cNotFound) ? &entry.mNode->children[pos] : nullptr;
+                }
+            }
+        }
+        node = child;
+    }
+    return (node != nullptr) ? *node : JsonSnapshot();
+}
+/*****************************************************************************/
+JsonSnapshot JsonSnapshot::Set(const JsonPath &path, const JsonSnapshot &value) const
+{
+    return SetAt(*this, path, 0U, value);
+}
+/*****************************************************************************/
+/**
+ * @brief Copy of a node with a new value below it, the untouched children are shared
+ */
+JsonSnapshot JsonSnapshot::SetAt(const JsonSnapshot &node, const JsonPath &path, std::size_t depth, const JsonSnapshot &value)
+{
+    if (depth == path.Size())
+    {
+        return value;
+    }
+
+    const JsonPath::Segment &segment = path[depth];
+    const Node *current = node.mNode;
+    JsonValue::Tag tag = node.GetTag();
+    if (tag == JsonValue::INVALID)
+    {
+        // Created on the way
+        tag = segment.isIndex ? JsonValue::ARRAY : JsonValue::OBJECT;
+    }
+
+    std::size_t size = node.Size();
+    std::size_t pos = cNotFound;
+    JsonSnapshot child;
+
+    if (tag == JsonValue::OBJECT)
+    {
+        pos = (current != nullptr) ? current->FindMember(segment.key) : cNotFound;
+        child = SetAt((pos != cNotFound) ? current->children[pos] : JsonSnapshot(), path, depth + 1U, value);
+    }
+    else if (tag == JsonValue::ARRAY)
+    {
+        if (segment.isIndex)
+        {
+            if (segment.index <= size)
+            {
+                pos = segment.index;
+                child = SetAt((pos < size) ? current->children[pos] : JsonSnapshot(), path, depth + 1U, value);
+            }
+        }
+        else
+        {
+            // Same rule as Find(): the first object entry that owns the key
+            for (std::size_t j = 0U; (j < size) && (pos == cNotFound); j++)
+            {
+                const JsonSnapshot &entry = current->children[j];
+                if (entry.IsObject() && (entry.mNode->FindMember(segment.key) != cNotFound))
+                {
+                    pos = j;
+                    child = SetAt(entry, path, depth, value);
+                }
+            }
+        }
+    }
+
+    if (!child.IsValid())
+    {
+        return JsonSnapshot();
+    }
+
+    Node *copy = new Node(tag);
+    if (current != nullptr)
+    {
+        copy->keys = current->keys;
+        copy->children = current->children;
+        copy->sorted = current->sorted;
+    }
+    if (pos < size)
+    {
+        copy->children[pos] = std::move(child);
+    }
+    else
+    {
+        if (tag == JsonValue::OBJECT)
+        {
+            copy->keys.push_back(segment.key);
+        }
+        copy->children.push_back(std::move(child));
+        copy->Index();
+    }
+    return JsonSnapshot(copy);
+}
+/*****************************************************************************/
+JsonValue JsonSnapshot::ToValue(const JsonValue::allocator_type &alloc) const
+{
+    JsonValue value(alloc);
+
+    switch (GetTag())
+    {
+    case JsonValue::OBJECT:
+    {
+        JsonObject &obj = value.GetObj();
+        for (std::size_t i = 0U; i < mNode->children.size(); i++)
+        {
+            obj.AddValue(mNode->keys[i], mNode->children[i].ToValue(alloc));
+        }
+        break;
+    }
+    case JsonValue::ARRAY:
+    {
+        JsonArray &array = value.GetArray();
+        for (std::size_t i = 0U; i < mNode->children.size(); i++)
+        {
+            array.AddValue(mNode->children[i].ToValue(alloc));
+        }
+        break;
+    }
+    case JsonValue::STRING:
+        value = JsonValue(JsonValue(mNode->text), alloc);
+        break;
+    case JsonValue::INTEGER:
+        value = JsonValue(mNode->integer);
+        break;
+    case JsonValue::UINTEGER:
+        value = JsonValue(mNode->uinteger);
+        break;
+    case JsonValue::DOUBLE:
+        value = JsonValue(mNode->real);
+        break;
+    case JsonValue::BOOLEAN:
+        value = JsonValue(mNode->boolean);
+        break;
+    case JsonValue::NULL_VAL:
+        value.SetNull();
+        break;
+    default:
+        break;
+    }
+    return value;
+}
+/*****************************************************************************/
+void JsonSnapshot::Write(JsonWriter &writer) const
+{
+    switch (GetTag())
+    {
+    case JsonValue::OBJECT:
+        writer.StartObject();
+        for (std::size_t i = 0U; i < mNode->children.size(); i++)
+        {
+            writer.Key(mNode->keys[i]);
+            mNode->children[i].Write(writer);
+        }
+        writer.EndObject();
+        break;
+    case JsonValue::ARRAY:
+        writer.StartArray();
+        for (std::size_t i = 0U; i < mNode->children.size(); i++)
+        {
+            mNode->children[i].Write(writer);
+        }
+        writer.EndArray();
+        break;
+    case JsonValue::STRING:
+        writer.String(mNode->text);
+        break;
+    case JsonValue::INTEGER:
+        writer.Integer(mNode->integer);
+        break;
+    case JsonValue::UINTEGER:
+        writer.Unsigned(mNode->uinteger);
+        break;
+    case JsonValue::DOUBLE:
+        writer.Double(mNode->real);
+        break;
+    case JsonValue::BOOLEAN:
+        writer.Bool(mNode->boolean);
+        break;
+    case JsonValue::NULL_VAL:
+        writer.Null();
+        break;
+    default:
+        break; // invalid value, nothing to write
+    }
+}
+/*****************************************************************************/
+std::string JsonSnapshot::ToString() const
+{
+    std::string text;
+    JsonWriter writer(text);
+    Write(writer);
+    return text;
+}
+/*****************************************************************************/
+
+//          *                          *                                  *
+
+/*****************************************************************************/
+/**
+ * The current version is reached through a word that packs its address with a
+ * count of "borrowed" references. A reader increments this count in the same
+ * atomic operation that reads the address, so the version cannot be deleted
+ * before the reader has taken its own reference. The reader then gives the
+ * borrowed reference back, unless a writer has replaced the version in the
+ * meantime: in that case the writer has added all the borrowed references to
+ * the reference count of the version, and the reader releases one of them.
+ *
+ * A version is published only once, so its address cannot come back while a
+ * reader is working on it. The user space addresses fit in 48 bits on the
+ * supported 64-bit platforms; up to 65535 readers can be in Get() at once.
+ */
+struct JsonPublisher::Version
+{
+    std::atomic<std::uint64_t> refs;
+    JsonSnapshot root;
+
+    explicit Version(const JsonSnapshot &snapshot)
+        : refs(1U)
+        , root(snapshot)
+    {
+
+    }
+};
+/*****************************************************************************/
+static const unsigned cBorrowedShift = 48U;
+static const std::uint64_t cBorrowedOne = std::uint64_t(1U) << cBorrowedShift;
+static const std::uint64_t cAddressMask = cBorrowedOne - 1U;
+
+static_assert(sizeof(std::uintptr_t) <= sizeof(std::uint64_t), "addresses must fit in 64 bits");
+/*****************************************************************************/
+JsonPublisher::JsonPublisher(const JsonSnapshot &initial)
+    : mCurrent(reinterpret_cast<std::uintptr_t>(new Version(initial)))
+{
+
+}
+/*****************************************************************************/
+JsonPublisher::~JsonPublisher()
+{
+    Release(GetVersion(mCurrent.load(std::memory_order_acquire)));
+}
+/*****************************************************************************/
+JsonPublisher::Version *JsonPublisher::GetVersion(std::uint64_t word)
+{
+    return reinterpret_cast<Version *>(static_cast<std::uintptr_t>(word & cAddressMask));
+}
+/*****************************************************************************/
+void JsonPublisher::Release(Version *version)
+{
+    if (version->refs.fetch_sub(1U, std::memory_order_acq_rel) == 1U)
+    {
+        delete version;
+    }
+}
+/*****************************************************************************/
+JsonSnapshot JsonPublisher::Get() const
+{
+    std::uint64_t word = mCurrent.fetch_add(cBorrowedOne, std::memory_order_acquire) + cBorrowedOne;
+    Version *version = GetVersion(word);
+    version->refs.fetch_add(1U, std::memory_order_relaxed);
+    JsonSnapshot snapshot = version->root;
+
+    bool returned = false;
+    while (!returned && (GetVersion(word) == version))
+    {
+        returned = mCurrent.compare_exchange_weak(word, word - cBorrowedOne, std::memory_order_relaxed);
+    }
+    if (!returned)
+    {
+        Release(version); // the borrowed reference, moved to the count by the writer
+    }
+    Release(version);
+    return snapshot;
+}
+/*****************************************************************************/
+JsonSnapshot JsonPublisher::Publish(const JsonSnapshot &snapshot)
+{
+    Version *next = new Version(snapshot);
+    std::uint64_t word = mCurrent.exchange(reinterpret_cast<std::uintptr_t>(next), std::memory_order_acq_rel);
+    Version *previous = GetVersion(word);
+    std::uint64_t borrowed = word >> cBorrowedShift;
+
+    if (borrowed > 0U)
+    {
+        previous->refs.fetch_add(borrowed, std::memory_order_relaxed);
+    }
+    JsonSnapshot old = previous->root;
+    Release(previous);
+    return old;
+}
+
+//=============================================================================
+// End of file JsonSnapshot.cpp
+//=============================================================================
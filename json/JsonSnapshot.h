@@ -0,0 +1,175 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#ifndef JSON_SNAPSHOT_H
+#define JSON_SNAPSHOT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include "JsonValue.h"
+#include "JsonPath.h"
+
+class JsonWriter;
+
+/*****************************************************************************/
+/**
+ * @brief Immutable, reference counted Json value
+ *
+ * A snapshot is frozen once from a JsonValue and never modified afterwards, so
+ * it can be read by any number of threads without synchronization. Copying a
+ * snapshot, or taking one of its children, only increments a reference count.
+ *
+ * Modifications build a new version: Set() copies the nodes along the path and
+ * shares all the other subtrees with the original.
+ *
+ *     JsonSnapshot config(json);
+ *     JsonSnapshot next = config.Set(JsonPath("network:port"), JsonSnapshot(JsonValue(8080)));
+ *     next.Find(JsonPath("network:port")).GetInteger64();  // 8080
+ *     config.Find(JsonPath("network:port")).GetInteger64(); // unchanged
+ */
+class JsonSnapshot
+{
+public:
+    JsonSnapshot() : mNode(nullptr) {} // invalid value
+    explicit JsonSnapshot(const JsonValue &value);
+    JsonSnapshot(const JsonSnapshot &other) noexcept;
+    JsonSnapshot(JsonSnapshot &&other) noexcept;
+    ~JsonSnapshot();
+
+    JsonSnapshot &operator = (const JsonSnapshot &rhs) noexcept;
+    JsonSnapshot &operator = (JsonSnapshot &&rhs) noexcept;
+
+    JsonValue::Tag GetTag() const;
+
+    bool IsValid() const      { return GetTag() != JsonValue::INVALID; }
+    bool IsArray() const      { return GetTag() == JsonValue::ARRAY; }
+    bool IsObject() const     { return GetTag() == JsonValue::OBJECT; }
+    bool IsNull() const       { return GetTag() == JsonValue::NULL_VAL; }
+    bool IsString() const     { return GetTag() == JsonValue::STRING; }
+    bool IsInteger() const    { return GetTag() == JsonValue::INTEGER; }
+    bool IsBoolean() const    { return GetTag() == JsonValue::BOOLEAN; }
+    bool IsDouble() const     { return GetTag() == JsonValue::DOUBLE; }
+    bool IsUnsigned() const   { return GetTag() == JsonValue::UINTEGER; }
+
+    std::int64_t GetInteger64() const;
+    std::uint64_t GetUnsigned64() const;
+    double GetDouble() const;
+    bool GetBool() const;
+    std::string_view GetStringView() const; // valid as long as the snapshot
+
+    /**
+     * @brief Number of members of an object, or entries of an array
+     */
+    std::uint32_t Size() const;
+
+    // Objects: name and value of the member at a position (insertion order)
+    std::string_view GetKey(std::uint32_t index) const;
+    JsonSnapshot GetEntry(std::uint32_t index) const; // also array entries
+    JsonSnapshot GetMember(std::string_view name) const;
+
+    /**
+     * @brief Same rules as JsonPath::Find(), an invalid snapshot is returned if not found
+     */
+    JsonSnapshot Find(const JsonPath &path) const;
+
+    /**
+     * @brief New version with a value at a path, the other subtrees are shared
+     *
+     * Missing object members are created (as objects for the intermediate
+     * segments); an array index can replace an entry or append one at the end.
+     *
+     * @return invalid snapshot if the path cannot be created
+     */
+    JsonSnapshot Set(const JsonPath &path, const JsonSnapshot &value) const;
+
+    /**
+     * @brief True if both snapshots share the same node (not a comparison of the contents)
+     */
+    bool IsSame(const JsonSnapshot &other) const { return mNode == other.mNode; }
+
+    // Mutable copy of the tree
+    JsonValue ToValue(const JsonValue::allocator_type &alloc = JsonValue::allocator_type()) const;
+    void Write(JsonWriter &writer) const;
+    std::string ToString() const;
+
+private:
+    struct Node;
+
+    const Node *mNode;
+
+    explicit JsonSnapshot(const Node *node) : mNode(node) {} // takes the reference
+    static const Node *Freeze(const JsonValue &value);
+    static void Release(const Node *node);
+    static JsonSnapshot SetAt(const JsonSnapshot &node, const JsonPath &path, std::size_t depth, const JsonSnapshot &value);
+};
+
+/*****************************************************************************/
+/**
+ * @brief Atomic holder of the current version of a snapshot
+ *
+ * Readers get the current version with Get(), which never blocks: it takes a
+ * few atomic operations whatever the number of readers and writers. A writer
+ * prepares the next version on the side and publishes it in one step; the
+ * readers keep their own version alive as long as they need it.
+ *
+ *     JsonPublisher config(JsonSnapshot(json));
+ *     // readers, any thread
+ *     JsonSnapshot current = config.Get();
+ *     // writer
+ *     config.Update([](const JsonSnapshot &current) {
+ *         return current.Set(JsonPath("network:port"), JsonSnapshot(JsonValue(8080)));
+ *     });
+ */
+class JsonPublisher
+{
+public:
+    explicit JsonPublisher(const JsonSnapshot &initial = JsonSnapshot());
+    ~JsonPublisher();
+
+    JsonPublisher(const JsonPublisher &) = delete;
+    JsonPublisher &operator = (const JsonPublisher &) = delete;
+
+    JsonSnapshot Get() const;
+
+    /**
+     * @brief Replace the current version
+     * @return previous version
+     */
+    JsonSnapshot Publish(const JsonSnapshot &snapshot);
+
+    /**
+     * @brief Read, modify and publish; the updates are serialized between writers
+     * @return the published version
+     */
+    template<typename Function>
+    JsonSnapshot Update(Function modify)
+    {
+        std::lock_guard<std::mutex> lock(mWriter);
+        JsonSnapshot next = modify(Get());
+        Publish(next);
+        return next;
+    }
+
+private:
+    struct Version;
+
+    // Pointer to the current version (low 48 bits) and number of readers that
+    // are taking a reference to it (high 16 bits)
+    mutable std::atomic<std::uint64_t> mCurrent;
+    std::mutex mWriter;
+
+    static Version *GetVersion(std::uint64_t word);
+    static void Release(Version *version);
+};
+
+#endif // JSON_SNAPSHOT_H
+
+//=============================================================================
+// End of file JsonSnapshot.h
+//=============================================================================
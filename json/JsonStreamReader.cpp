@@ -0,0 +1,630 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#include <cerrno>
+#include <fstream>
+
+#ifdef USE_WINDOWS_OS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "JsonStreamReader.h"
+#include "Util.h"
+
+/*****************************************************************************/
+JsonStreamReader::JsonStreamReader(IHandler &handler)
+    : mHandler(handler)
+    , mState(VALUE)
+    , mDepth(0U)
+    , mResume(0U)
+    , mMaxTokenSize(cDefaultMaxTokenSize)
+    , mOffset(0U)
+    , mStatus(JsonReader::JSON_PARSE_OK)
+    , mCapture(mArena.GetAllocator())
+    , mCaptureDepth(0U)
+    , mCapturing(false)
+{
+
+}
+/*****************************************************************************/
+void JsonStreamReader::Select(const std::string &keyPath)
+{
+    mSelections.push_back(keyPath.empty() ? std::vector<std::string>() : Util::Split(keyPath, ":"));
+}
+/*****************************************************************************/
+void JsonStreamReader::Reset()
+{
+    mState = VALUE;
+    mDepth = 0U;
+    mBuffer.clear();
+    mResume = 0U;
+    mOffset = 0U;
+    mStatus = JsonReader::JSON_PARSE_OK;
+    mBuild.clear();
+    mCapturing = false;
+    mCapture.SetNull();
+    mArena.release();
+}
+/*****************************************************************************/
+JsonReader::ParseStatus JsonStreamReader::Feed(const char *data, std::size_t size)
+{
+    if (mStatus != JsonReader::JSON_PARSE_OK)
+    {
+        return mStatus;
+    }
+
+    if (mBuffer.empty())
+    {
+        // Fast path: parse directly from the caller's chunk
+        const char *s = data;
+        mStatus = Parse(s, data + size, false);
+        mOffset += static_cast<std::uint64_t>(s - data);
+        if (mStatus == JsonReader::JSON_PARSE_OK)
+        {
+            mBuffer.assign(s, static_cast<std::size_t>((data + size) - s));
+        }
+    }
+    else
+    {
+        // A token is split between the chunks
+        mBuffer.append(data, size);
+        const char *s = mBuffer.data();
+        mStatus = Parse(s, s + mBuffer.size(), false);
+        std::size_t consumed = static_cast<std::size_t>(s - mBuffer.data());
+        mOffset += consumed;
+        mBuffer.erase(0U, consumed);
+    }
+
+    if ((mStatus == JsonReader::JSON_PARSE_OK) && (mBuffer.size() > mMaxTokenSize))
+    {
+        mStatus = JsonReader::JSON_PARSE_ALLOC_ERROR;
+    }
+    return mStatus;
+}
+/*****************************************************************************/
+JsonReader::ParseStatus JsonStreamReader::Finish()
+{
+    if (mStatus == JsonReader::JSON_PARSE_OK)
+    {
+        const char *s = mBuffer.data();
+        mStatus = Parse(s, s + mBuffer.size(), true);
+        mOffset += static_cast<std::uint64_t>(s - mBuffer.data());
+        mBuffer.clear();
+
+        if ((mStatus == JsonReader::JSON_PARSE_OK) && (mState != END))
+        {
+            // Truncated or empty document
+            mStatus = JsonReader::JSON_PARSE_BREAKING_BAD;
+        }
+    }
+    return mStatus;
+}
+/*****************************************************************************/
+JsonReader::ParseStatus JsonStreamReader::ParseFd(int fd, std::size_t chunkSize)
+{
+    std::vector<char> chunk(chunkSize);
+    JsonReader::ParseStatus status = JsonReader::JSON_PARSE_OK;
+
+    while (status == JsonReader::JSON_PARSE_OK)
+    {
+#ifdef USE_WINDOWS_OS
+        int n = _read(fd, chunk.data(), static_cast<unsigned int>(chunk.size()));
+#else
+        ssize_t n = read(fd, chunk.data(), chunk.size());
+#endif
+        if (n > 0)
+        {
+            status = Feed(chunk.data(), static_cast<std::size_t>(n));
+        }
+        else if (n == 0)
+        {
+            status = Finish();
+            break;
+        }
+        else if (errno != EINTR)
+        {
+            status = JsonReader::JSON_PARSE_IO_ERROR;
+            mStatus = status;
+        }
+    }
+    return status;
+}
+/*****************************************************************************/
+JsonReader::ParseStatus JsonStreamReader::ParseFile(const std::string &fileName, std::size_t chunkSize)
+{
+    std::ifstream f(fileName, std::ios_base::in | std::ios_base::binary);
+    JsonReader::ParseStatus status = JsonReader::JSON_PARSE_IO_ERROR;
+
+    if (f.is_open())
+    {
+        std::vector<char> chunk(chunkSize);
+        status = JsonReader::JSON_PARSE_OK;
+        while ((status == JsonReader::JSON_PARSE_OK) && f)
+        {
+            f.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            if (f.gcount() > 0)
+            {
+                status = Feed(chunk.data(), static_cast<std::size_t>(f.gcount()));
+            }
+        }
+
+        if (status == JsonReader::JSON_PARSE_OK)
+        {
+            status = f.eof() ? Finish() : JsonReader::JSON_PARSE_IO_ERROR;
+        }
+    }
+    mStatus = status;
+    return status;
+}
+/*****************************************************************************/
+/**
+ * @brief Parse as many tokens as possible
+ *
+ * When a token is not complete, s points to its first character and the
+ * function returns JSON_PARSE_OK, waiting for more data. With final set,
+ * the end of the buffer is the end of the document.
+ */
+JsonReader::ParseStatus JsonStreamReader::Parse(const char *&s, const char *end, bool final)
+{
+    JsonReader::ParseStatus status = JsonReader::JSON_PARSE_OK;
+    bool more = false;
+
+    while ((status == JsonReader::JSON_PARSE_OK) && !more)
+    {
+        s = JsonScan::SkipWhitespace(s, end);
+        if (s == end)
+        {
+            break;
+        }
+
+        bool ok = true;
+        switch (mState)
+        {
+        case END:
+            // Only whitespaces are allowed after the root value
+            status = JsonReader::JSON_PARSE_UNEXPECTED_CHARACTER;
+            break;
+        case FIRST_KEY:
+            if (*s == '}')
+            {
+                ++s;
+                ok = Close();
+                break;
+            }
+            /* fallthrough */
+        case KEY:
+            if (*s != '"')
+            {
+                status = JsonReader::JSON_PARSE_UNQUOTED_KEY;
+            }
+            else if (!final && !StringComplete(s, end))
+            {
+                more = true;
+            }
+            else
+            {
+                status = JsonReader::ParseStringToken(s, end, mString);
+                if (status == JsonReader::JSON_PARSE_OK)
+                {
+                    mState = COLON;
+                    ok = OnKey();
+                }
+            }
+            break;
+        case COLON:
+            if (*s == ':')
+            {
+                ++s;
+                mState = VALUE;
+            }
+            else
+            {
+                status = JsonReader::JSON_PARSE_UNEXPECTED_CHARACTER;
+            }
+            break;
+        case FIRST_VALUE:
+            if (*s == ']')
+            {
+                ++s;
+                ok = Close();
+                break;
+            }
+            /* fallthrough */
+        case VALUE:
+            status = ParseValue(s, end, final, more);
+            break;
+        case NEXT:
+        {
+            Level &level = mStack[mDepth - 1U];
+            if (*s == ',')
+            {
+                ++s;
+                if (level.isObject)
+                {
+                    mState = KEY;
+                }
+                else
+                {
+                    level.index++;
+                    mState = VALUE;
+                }
+            }
+            else if ((*s == '}') || (*s == ']'))
+            {
+                if ((*s == '}') != level.isObject)
+                {
+                    status = JsonReader::JSON_PARSE_MISMATCH_BRACKET;
+                }
+                else
+                {
+                    ++s;
+                    ok = Close();
+                }
+            }
+            else
+            {
+                status = JsonReader::JSON_PARSE_UNEXPECTED_CHARACTER;
+            }
+            break;
+        }
+        }
+
+        if (!ok)
+        {
+            status = JsonReader::JSON_PARSE_ABORTED;
+        }
+    }
+
+    return status;
+}
+/*****************************************************************************/
+JsonReader::ParseStatus JsonStreamReader::ParseValue(const char *&s, const char *end, bool final, bool &more)
+{
+    JsonReader::ParseStatus status = JsonReader::JSON_PARSE_OK;
+    bool ok = true;
+
+    if (!mCapturing && !mSelections.empty() && IsSelected())
+    {
+        mCapturing = true;
+        mCaptureDepth = mDepth;
+    }
+
+    switch (*s)
+    {
+    case '{':
+        ++s;
+        mState = FIRST_KEY;
+        ok = Open(true);
+        break;
+    case '[':
+        ++s;
+        mState = FIRST_VALUE;
+        ok = Open(false);
+        break;
+    case '"':
+        if (!final && !StringComplete(s, end))
+        {
+            more = true;
+        }
+        else
+        {
+            status = JsonReader::ParseStringToken(s, end, mString);
+            if (status == JsonReader::JSON_PARSE_OK)
+            {
+                ok = OnString();
+            }
+        }
+        break;
+    case 't':
+    case 'f':
+    case 'n':
+    {
+        const char *literal = (*s == 't') ? "true" : ((*s == 'f') ? "false" : "null");
+        std::size_t size = std::char_traits<char>::length(literal);
+
+        // The delimiter is needed as well
+        if (!final && (static_cast<std::size_t>(end - s) <= size))
+        {
+            more = true;
+        }
+        else if (!JsonReader::ParseLiteral(s, end, literal, size))
+        {
+            status = JsonReader::JSON_PARSE_BAD_IDENTIFIER;
+        }
+        else if (*literal == 'n')
+        {
+            JsonValue null;
+            null.SetNull();
+            ok = OnScalar(null);
+        }
+        else
+        {
+            ok = OnScalar(JsonValue(*literal == 't'));
+        }
+        break;
+    }
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+    {
+        const char *p = s;
+        while ((p < end) && (JsonReader::IsDigit(*p) || (*p == '-') || (*p == '+') || (*p == '.') || (*p == 'e') || (*p == 'E')))
+        {
+            ++p;
+        }
+
+        if (!final && (p == end))
+        {
+            more = true;
+        }
+        else if ((*s == '-') && (((s + 1) == end) || !JsonReader::IsDigit(s[1])))
+        {
+            status = JsonReader::JSON_PARSE_BAD_NUMBER;
+        }
+        else
+        {
+            JsonValue number = JsonReader::StringToNumber(s, end, &s);
+            if (!JsonReader::IsDelim(s, end))
+            {
+                status = JsonReader::JSON_PARSE_BAD_NUMBER;
+            }
+            else
+            {
+                ok = OnScalar(number);
+            }
+        }
+        break;
+    }
+    case ']':
+    case '}':
+    default:
+        status = JsonReader::JSON_PARSE_UNEXPECTED_CHARACTER;
+        break;
+    }
+
+    if (!ok)
+    {
+        status = JsonReader::JSON_PARSE_ABORTED;
+    }
+    return status;
+}
+/*****************************************************************************/
+/**
+ * @brief Check if the whole string token is available
+ *
+ * The position reached is remembered, so a long string split between many
+ * chunks is scanned only once.
+ *
+ * @param s points to the opening quote
+ */
+bool JsonStreamReader::StringComplete(const char *s, const char *end)
+{
+    const char *p = s + ((mResume > 0U) ? mResume : 1U);
+
+    for (;;)
+    {
+        p = JsonScan::FindStringSpecial(p, end);
+        if ((p == end) || ((*p == '\\') && ((end - p) < 2)))
+        {
+            mResume = static_cast<std::size_t>(p - s);
+            return false;
+        }
+        else if (*p == '\\')
+        {
+            p += 2;
+        }
+        else
+        {
+            // Closing quote, or invalid control character reported by the decoder
+            mResume = 0U;
+            return true;
+        }
+    }
+}
+/*****************************************************************************/
+bool JsonStreamReader::IsSelected() const
+{
+    for (const std::vector<std::string> &selection : mSelections)
+    {
+        if (selection.size() != mDepth)
+        {
+            continue;
+        }
+
+        bool match = true;
+        for (std::size_t i = 0U; (i < mDepth) && match; i++)
+        {
+            const std::string &pattern = selection[i];
+            const Level &level = mStack[i];
+            if (pattern != "*")
+            {
+                match = level.isObject ? (pattern == level.key) : (pattern == std::to_string(level.index));
+            }
+        }
+
+        if (match)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+/*****************************************************************************/
+std::string JsonStreamReader::GetKeyPath() const
+{
+    std::string keyPath;
+
+    for (std::size_t i = 0U; i < mDepth; i++)
+    {
+        if (i > 0U)
+        {
+            keyPath += ':';
+        }
+        keyPath += mStack[i].isObject ? mStack[i].key : std::to_string(mStack[i].index);
+    }
+    return keyPath;
+}
+/*****************************************************************************/
+void JsonStreamReader::PushLevel(bool isObject)
+{
+    if (mDepth == mStack.size())
+    {
+        mStack.emplace_back();
+    }
+
+    Level &level = mStack[mDepth++];
+    level.isObject = isObject;
+    level.index = 0U;
+    level.key.clear();
+}
+/*****************************************************************************/
+bool JsonStreamReader::Open(bool isObject)
+{
+    bool ok = true;
+
+    if (mCapturing)
+    {
+        JsonValue *slot = NextSlot();
+        slot->Reset(isObject ? JsonValue::OBJECT : JsonValue::ARRAY);
+        mBuild.push_back(slot);
+    }
+    else
+    {
+        ok = isObject ? mHandler.StartObject() : mHandler.StartArray();
+    }
+
+    PushLevel(isObject);
+    return ok;
+}
+/*****************************************************************************/
+bool JsonStreamReader::Close()
+{
+    bool ok = true;
+    bool isObject = mStack[mDepth - 1U].isObject;
+
+    mDepth--;
+    if (mCapturing)
+    {
+        mBuild.pop_back();
+    }
+    else
+    {
+        ok = isObject ? mHandler.EndObject() : mHandler.EndArray();
+    }
+
+    return ok && ValueDone();
+}
+/*****************************************************************************/
+bool JsonStreamReader::ValueDone()
+{
+    bool ok = true;
+
+    mState = (mDepth == 0U) ? END : NEXT;
+
+    if (mCapturing && (mDepth == mCaptureDepth))
+    {
+        // The selected subtree is complete
+        mCapturing = false;
+        ok = mHandler.Subtree(GetKeyPath(), mCapture);
+        mCapture.SetNull();
+        mArena.release();
+    }
+    return ok;
+}
+/*****************************************************************************/
+bool JsonStreamReader::OnKey()
+{
+    bool ok = true;
+
+    if (!mSelections.empty())
+    {
+        mStack[mDepth - 1U].key = mString;
+    }
+
+    if (!mCapturing)
+    {
+        ok = mHandler.Key(mString);
+    }
+    return ok;
+}
+/*****************************************************************************/
+bool JsonStreamReader::OnString()
+{
+    bool ok = true;
+
+    if (mCapturing)
+    {
+        NextSlot()->StringRef().assign(mString);
+    }
+    else
+    {
+        ok = mHandler.String(mString);
+    }
+    return ok && ValueDone();
+}
+/*****************************************************************************/
+bool JsonStreamReader::OnScalar(const JsonValue &value)
+{
+    bool ok = true;
+
+    if (mCapturing)
+    {
+        *NextSlot() = value;
+    }
+    else
+    {
+        switch (value.GetTag())
+        {
+        case JsonValue::INTEGER:
+            ok = mHandler.Integer(value.GetInteger64());
+            break;
+        case JsonValue::UINTEGER:
+            ok = mHandler.Unsigned(value.GetUnsigned64());
+            break;
+        case JsonValue::DOUBLE:
+            ok = mHandler.Double(value.GetDouble());
+            break;
+        case JsonValue::BOOLEAN:
+            ok = mHandler.Bool(value.GetBool());
+            break;
+        default:
+            ok = mHandler.Null();
+            break;
+        }
+    }
+    return ok && ValueDone();
+}
+/*****************************************************************************/
+/**
+ * @brief Slot of the next value of the subtree being built
+ */
+JsonValue *JsonStreamReader::NextSlot()
+{
+    if (mBuild.empty())
+    {
+        return &mCapture;
+    }
+
+    JsonValue *parent = mBuild.back();
+    if (parent->IsArray())
+    {
+        return &parent->mArray->Emplace();
+    }
+    return &parent->mObject->Emplace(mStack[mDepth - 1U].key);
+}
+
+//=============================================================================
+// End of file JsonStreamReader.cpp
+//=============================================================================
@@ -0,0 +1,170 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#ifndef JSON_STREAM_READER_H
+#define JSON_STREAM_READER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "JsonReader.h"
+
+/*****************************************************************************/
+/**
+ * @brief Event driven (SAX-like) Json reader
+ *
+ * The document is pushed in chunks of any size; the reader keeps only the bytes of
+ * the token currently split between two chunks, so the memory usage does not depend
+ * on the document size. Each syntax element is reported to a handler.
+ *
+ * Some subtrees can be selected by key path (':' separated, '*' matches any key or
+ * array index, array entries are designated by their index). Instead of events, the
+ * selected subtrees are delivered as a JsonValue, built in an arena that is recycled
+ * after each delivery.
+ *
+ * Example, process the records of a huge export one by one:
+ *
+ *     class Handler : public JsonStreamReader::IHandler
+ *     {
+ *         bool Subtree(const std::string &keyPath, JsonValue &value) { ...; return true; }
+ *     };
+ *
+ *     Handler handler;
+ *     JsonStreamReader reader(handler);
+ *     reader.Select("records:*");
+ *     reader.ParseFile("export.json");
+ */
+class JsonStreamReader
+{
+public:
+    /**
+     * @brief Reader events, returning false stops the parsing
+     *
+     * The string views are valid only during the call.
+     */
+    class IHandler
+    {
+    public:
+        virtual ~IHandler() {}
+
+        virtual bool StartObject() { return true; }
+        virtual bool EndObject() { return true; }
+        virtual bool StartArray() { return true; }
+        virtual bool EndArray() { return true; }
+        virtual bool Key(std::string_view key) { (void) key; return true; }
+        virtual bool String(std::string_view value) { (void) value; return true; }
+        virtual bool Integer(std::int64_t value) { (void) value; return true; }
+        virtual bool Unsigned(std::uint64_t value) { (void) value; return true; } // above INT64_MAX
+        virtual bool Double(double value) { (void) value; return true; }
+        virtual bool Bool(bool value) { (void) value; return true; }
+        virtual bool Null() { return true; }
+
+        /**
+         * @brief Selected subtree, the value lives in the reader's arena, which is released after the call
+         *
+         * To keep the value, copy it or move it to the heap with the allocator-extended constructor:
+         * JsonValue(std::move(value), JsonValue::allocator_type()). A plain move keeps the arena.
+         */
+        virtual bool Subtree(const std::string &keyPath, JsonValue &value) { (void) keyPath; (void) value; return true; }
+    };
+
+    static const std::size_t cDefaultChunkSize = 64U * 1024U;
+    static const std::size_t cDefaultMaxTokenSize = 16U * 1024U * 1024U;
+
+    JsonStreamReader(IHandler &handler);
+
+    /**
+     * @brief Deliver the values located at this key path as JsonValue instead of events
+     */
+    void Select(const std::string &keyPath);
+
+    /**
+     * @brief Limit the size of a single token (string or number) kept between two chunks
+     */
+    void SetMaxTokenSize(std::size_t size) { mMaxTokenSize = size; }
+
+    /**
+     * @brief Push the next chunk of the document
+     * @return JSON_PARSE_OK as long as the document is valid so far
+     */
+    JsonReader::ParseStatus Feed(const char *data, std::size_t size);
+
+    /**
+     * @brief End of the document, checks that it is complete
+     */
+    JsonReader::ParseStatus Finish();
+
+    /**
+     * @brief Prepare the reader for a new document (the selections are kept)
+     */
+    void Reset();
+
+    // Helpers, read the whole input chunk by chunk then call Finish()
+    JsonReader::ParseStatus ParseFd(int fd, std::size_t chunkSize = cDefaultChunkSize);
+    JsonReader::ParseStatus ParseFile(const std::string &fileName, std::size_t chunkSize = cDefaultChunkSize);
+
+    // Number of bytes consumed since the beginning of the document
+    std::uint64_t GetOffset() const { return mOffset; }
+
+private:
+    enum State
+    {
+        VALUE,          // a value is expected
+        FIRST_VALUE,    // after '[': a value or ']'
+        KEY,            // after ',' in an object
+        FIRST_KEY,      // after '{': a key or '}'
+        COLON,
+        NEXT,           // after a value: ',' or the end of the container
+        END             // root value done
+    };
+
+    struct Level
+    {
+        bool isObject;
+        std::uint32_t index;    // current array entry
+        std::string key;        // current object member (only kept if some subtrees are selected)
+    };
+
+    IHandler &mHandler;
+    State mState;
+    std::vector<Level> mStack;
+    std::size_t mDepth; // number of used levels in mStack, the levels are recycled
+    std::string mBuffer; // incomplete token, waiting for the next chunk
+    std::size_t mResume; // string scan position inside the incomplete token
+    std::size_t mMaxTokenSize;
+    std::uint64_t mOffset;
+    std::string mString; // decoded string
+    JsonReader::ParseStatus mStatus;
+
+    // Subtrees materialization
+    std::vector<std::vector<std::string>> mSelections;
+    JsonArena mArena;
+    JsonValue mCapture;
+    std::vector<JsonValue *> mBuild; // opened containers of the subtree being built
+    std::size_t mCaptureDepth;
+    bool mCapturing;
+
+    JsonReader::ParseStatus Parse(const char *&s, const char *end, bool final);
+    JsonReader::ParseStatus ParseValue(const char *&s, const char *end, bool final, bool &more);
+    bool StringComplete(const char *s, const char *end);
+
+    bool IsSelected() const;
+    std::string GetKeyPath() const;
+    void PushLevel(bool isObject);
+    bool Open(bool isObject);
+    bool Close();
+    bool ValueDone();
+    bool OnKey();
+    bool OnString();
+    bool OnScalar(const JsonValue &value);
+    JsonValue *NextSlot();
+};
+
+#endif // JSON_STREAM_READER_H
+
+//=============================================================================
+// End of file JsonStreamReader.h
+//=============================================================================
@@ -3,50 +3,241 @@
  * Copyright (c) 2019 Anthony Rabine
  */
 
+#include <algorithm>
 #include "JsonValue.h"
-#include "Util.h"
-#include <sstream>
-#include <regex>
+#include "JsonWriter.h"
+#include "JsonPath.h"
+#include "Cbor.h"
 
 /*****************************************************************************/
-// Helper function
-static std::string CreateIndent(std::int32_t level)
+// Allocate and construct an object using a memory resource, the allocator is
+// propagated to the object (uses-allocator construction)
+template <typename T, typename... Args>
+static T *Create(std::pmr::memory_resource *resource, Args&&... args)
 {
-    std::string indent;
+    std::pmr::polymorphic_allocator<T> alloc(resource);
+    T *p = alloc.allocate(1U);
+    alloc.construct(p, std::forward<Args>(args)...);
+    return p;
+}
+/*****************************************************************************/
+template <typename T>
+static void Delete(std::pmr::memory_resource *resource, T *p)
+{
+    std::pmr::polymorphic_allocator<T> alloc(resource);
+    p->~T();
+    alloc.deallocate(p, 1U);
+}
+/*****************************************************************************/
+// An arena frees all its memory in one shot, its values do not need to be destroyed one by one
+static inline bool IsArena(std::pmr::memory_resource *resource)
+{
+    return (resource != std::pmr::new_delete_resource()) && (dynamic_cast<JsonArena *>(resource) != nullptr);
+}
+/*****************************************************************************/
+std::string_view JsonArena::Intern(std::string_view key)
+{
+    if (key.empty())
+    {
+        return std::string_view();
+    }
 
-    for (std::int32_t i = 0; i < (4 * level); i++)
+    std::pmr::unordered_set<std::string_view>::const_iterator it = mKeys.find(key);
+    if (it == mKeys.end())
     {
-        indent += " ";
+        char *text = static_cast<char *>(allocate(key.size(), 1U));
+        std::memcpy(text, key.data(), key.size());
+        it = mKeys.insert(std::string_view(text, key.size())).first;
     }
-    return indent;
+    return *it;
 }
 /*****************************************************************************/
-std::string JsonArray::ToString(std::int32_t level) const
+void JsonArena::release()
 {
-    std::string crlf;
-    std::string indent;
-    std::int32_t nextLevel = -1;
-
-    if (level >= 0)
     {
-        crlf = "\n";
-        indent = CreateIndent(level + 1);
-        nextLevel = level + 1;
+        // The key set and its texts live in the arena: forget them before the memory
+        std::pmr::unordered_set<std::string_view> empty(this);
+        mKeys.swap(empty);
     }
-    std::string text = "[" + crlf;
+    mBuffer.release();
+}
+/*****************************************************************************/
+void *JsonArena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    return mBuffer.allocate(bytes, alignment);
+}
+/*****************************************************************************/
+void JsonArena::do_deallocate(void *p, std::size_t bytes, std::size_t alignment)
+{
+    mBuffer.deallocate(p, bytes, alignment);
+}
+/*****************************************************************************/
+bool JsonArena::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
+/*****************************************************************************/
+
+//          *                          *                                  *
 
-    std::uint32_t index = 0U;
-    for (std::vector<JsonValue>::const_iterator iter = mArray.begin(); iter != mArray.end(); ++iter)
+/*****************************************************************************/
+JsonKey::JsonKey(std::string_view text, const allocator_type &alloc)
+    : mSize(0U)
+    , mStorage(INLINE)
+    , mResource(alloc.resource())
+{
+    Assign(text, false);
+}
+/*****************************************************************************/
+JsonKey::JsonKey(std::string_view text, bool shared, const allocator_type &alloc)
+    : mSize(0U)
+    , mStorage(INLINE)
+    , mResource(alloc.resource())
+{
+    Assign(text, shared);
+}
+/*****************************************************************************/
+JsonKey::JsonKey(const JsonKey &key, const allocator_type &alloc)
+    : mSize(0U)
+    , mStorage(INLINE)
+    , mResource(alloc.resource())
+{
+    // A shared key can only be shared again inside the same arena
+    Assign(key, key.IsShared() && mResource->is_equal(*key.mResource));
+}
+/*****************************************************************************/
+JsonKey::JsonKey(JsonKey &&key) noexcept
+    : mSize(0U)
+    , mStorage(INLINE)
+    , mResource(key.mResource)
+{
+    Steal(key);
+}
+/*****************************************************************************/
+JsonKey::JsonKey(JsonKey &&key, const allocator_type &alloc)
+    : mSize(0U)
+    , mStorage(INLINE)
+    , mResource(alloc.resource())
+{
+    if (mResource->is_equal(*key.mResource))
+    {
+        Steal(key);
+    }
+    else
+    {
+        Assign(key, false);
+    }
+}
+/*****************************************************************************/
+JsonKey::~JsonKey()
+{
+    Release();
+}
+/*****************************************************************************/
+JsonKey &JsonKey::operator = (const JsonKey &rhs)
+{
+    if (this != &rhs)
+    {
+        Release();
+        Assign(rhs, rhs.IsShared() && mResource->is_equal(*rhs.mResource));
+    }
+    return *this;
+}
+/*****************************************************************************/
+JsonKey &JsonKey::operator = (JsonKey &&rhs)
+{
+    if (this != &rhs)
     {
-        text += indent + iter->ToString(nextLevel);
-        index++;
-        if (index < mArray.size())
+        if (mResource->is_equal(*rhs.mResource))
         {
-            text += "," + crlf;
+            Release();
+            Steal(rhs);
+        }
+        else
+        {
+            *this = static_cast<const JsonKey &>(rhs);
         }
     }
+    return *this;
+}
+/*****************************************************************************/
+/**
+ * @brief Store a short text inline, point to a shared text or make our own copy
+ *
+ * The key must be empty.
+ */
+void JsonKey::Assign(std::string_view text, bool shared)
+{
+    mSize = static_cast<std::uint32_t>(text.size());
+    if (text.size() <= cInlineSize)
+    {
+        std::memcpy(mInline, text.data(), text.size());
+        mStorage = INLINE;
+    }
+    else if (shared)
+    {
+        mText = text.data();
+        mStorage = SHARED;
+    }
+    else
+    {
+        char *copy = static_cast<char *>(mResource->allocate(text.size(), 1U));
+        std::memcpy(copy, text.data(), text.size());
+        mText = copy;
+        mStorage = OWNED;
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief Take the text of a key using the same memory resource, the key must be empty
+ */
+void JsonKey::Steal(JsonKey &key)
+{
+    std::memcpy(mInline, key.mInline, sizeof(mInline));
+    mSize = key.mSize;
+    mStorage = key.mStorage;
+    key.mSize = 0U;
+    key.mStorage = INLINE;
+}
+/*****************************************************************************/
+void JsonKey::Release()
+{
+    if (mStorage == OWNED)
+    {
+        mResource->deallocate(const_cast<char *>(mText), mSize, 1U);
+    }
+    mSize = 0U;
+    mStorage = INLINE;
+}
+/*****************************************************************************/
 
-    text += crlf + indent + "]";
+//          *                          *                                  *
+
+/*****************************************************************************/
+JsonArray::JsonArray(const allocator_type &alloc)
+    : mArray(alloc)
+{
+
+}
+/*****************************************************************************/
+JsonArray::JsonArray(const JsonArray &array, const allocator_type &alloc)
+    : mArray(array.mArray, alloc)
+{
+
+}
+/*****************************************************************************/
+JsonArray::JsonArray(JsonArray &&array, const allocator_type &alloc)
+    : mArray(std::move(array.mArray), alloc)
+{
+
+}
+/*****************************************************************************/
+std::string JsonArray::ToString(std::int32_t level) const
+{
+    std::string text;
+    JsonWriter writer(text, (level >= 0) ? JsonWriter::PRETTY : JsonWriter::COMPACT);
+    writer.SetIndentLevel((level >= 0) ? level : 0);
+    writer.Write(*this);
     return text;
 }
 /*****************************************************************************/
@@ -60,30 +251,59 @@ void JsonArray::AddValue(const JsonValue &value)
     mArray.push_back(value);
 }
 /*****************************************************************************/
+void JsonArray::AddValue(JsonValue &&value)
+{
+    mArray.push_back(std::move(value));
+}
+/*****************************************************************************/
 bool JsonArray::ReplaceValue(const std::string &keyPath, const JsonValue &value)
 {
-    bool ret = false;
-    std::uint32_t index = 0U;
-
-    std::vector<std::string> keys = Util::Split(keyPath, ":");
-    std::istringstream(keys[0]) >> index;
-    keys.erase(keys.begin());
-
-    if (index < Size())
+    JsonValue *slot = Find(keyPath);
+    if (slot != nullptr)
     {
-        if (keys.size() == 0)
-        {
-            mArray[index] = value;
-            ret = true;
-        }
-        else
-        {
-            // Forward deeper
-            ret = mArray[index].ReplaceValue(Util::Join(keys, ":"), value);
-        }
+        *slot = value;
     }
-
-    return ret;
+    return slot != nullptr;
+}
+/*****************************************************************************/
+bool JsonArray::ReplaceValue(const std::string &keyPath, JsonValue &&value)
+{
+    JsonValue *slot = Find(keyPath);
+    if (slot != nullptr)
+    {
+        *slot = std::move(value);
+    }
+    return slot != nullptr;
+}
+/*****************************************************************************/
+const JsonValue *JsonArray::Find(const std::string &keyPath) const
+{
+    return JsonPath::Resolve(*this, keyPath);
+}
+/*****************************************************************************/
+JsonValue *JsonArray::Find(const std::string &keyPath)
+{
+    return const_cast<JsonValue *>(JsonPath::Resolve(*this, keyPath));
+}
+/*****************************************************************************/
+const JsonValue *JsonArray::Find(const JsonPath &path) const
+{
+    return path.Find(*this);
+}
+/*****************************************************************************/
+JsonValue *JsonArray::Find(const JsonPath &path)
+{
+    return path.Find(*this);
+}
+/*****************************************************************************/
+const JsonValue *JsonArray::Find(std::uint32_t index) const
+{
+    return (index < mArray.size()) ? &mArray[index] : nullptr;
+}
+/*****************************************************************************/
+JsonValue *JsonArray::Find(std::uint32_t index)
+{
+    return (index < mArray.size()) ? &mArray[index] : nullptr;
 }
 /*****************************************************************************/
 bool JsonArray::DeleteEntry(uint32_t index)
@@ -97,363 +317,710 @@ bool JsonArray::DeleteEntry(uint32_t index)
     return success;
 }
 /*****************************************************************************/
+bool JsonArray::operator == (const JsonArray &rhs) const
+{
+    return (mArray.size() == rhs.mArray.size()) && std::equal(mArray.begin(), mArray.end(), rhs.mArray.begin());
+}
+/*****************************************************************************/
 JsonValue JsonArray::GetEntry(std::uint32_t index) const
 {
-    JsonValue value;
-
-    if (index < mArray.size())
-    {
-        value = mArray[index];
-    }
-    return value;
+    const JsonValue *value = Find(index);
+    return (value != nullptr) ? *value : JsonValue();
 }
-
+/*****************************************************************************/
 uint32_t JsonArray::Size() const
 {
     return static_cast<std::uint32_t>(mArray.size());
 }
 /*****************************************************************************/
+JsonValue &JsonArray::Emplace()
+{
+    mArray.emplace_back();
+    return mArray.back();
+}
+/*****************************************************************************/
 
 //          *                          *                                  *
 
 /*****************************************************************************/
 void JsonObject::Clear()
 {
-    mObject.clear();
+    mMembers.clear();
+    mIndex.clear();
+}
+/*****************************************************************************/
+JsonObject::JsonObject(const allocator_type &alloc)
+    : mMembers(alloc)
+    , mIndex(alloc)
+{
+
 }
 /*****************************************************************************/
 JsonObject::JsonObject(const JsonObject &obj)
+    : mMembers(obj.mMembers)
+    , mIndex(obj.mIndex)
+{
+
+}
+/*****************************************************************************/
+JsonObject::JsonObject(JsonObject &&obj) noexcept
+    : mMembers(std::move(obj.mMembers))
+    , mIndex(std::move(obj.mIndex))
+{
+
+}
+/*****************************************************************************/
+JsonObject::JsonObject(const JsonObject &obj, const allocator_type &alloc)
+    : mMembers(obj.mMembers, alloc)
+    , mIndex(obj.mIndex, alloc)
+{
+
+}
+/*****************************************************************************/
+JsonObject::JsonObject(JsonObject &&obj, const allocator_type &alloc)
+    : mMembers(std::move(obj.mMembers), alloc)
+    , mIndex(std::move(obj.mIndex), alloc)
 {
-    *this = obj;
+
 }
 /*****************************************************************************/
 JsonObject &JsonObject::operator = (JsonObject const &rhs)
 {
-    mObject = rhs.mObject;
+    mMembers = rhs.mMembers;
+    mIndex = rhs.mIndex;
+    return *this;
+}
+/*****************************************************************************/
+JsonObject &JsonObject::operator = (JsonObject &&rhs)
+{
+    mMembers = std::move(rhs.mMembers);
+    mIndex = std::move(rhs.mIndex);
     return *this;
 }
 /*****************************************************************************/
 std::string JsonObject::ToString(int32_t level) const
 {
-    std::string crlf;
-    std::string indent;
-    std::int32_t nextLevel = -1;
-
-    if (level >= 0)
-    {
-        crlf = "\n";
-        indent = CreateIndent(level + 1);
-        nextLevel = level + 1;
-    }
-
-    std::string text = "{" + crlf;
-    std::uint32_t index = 0U;
-
-    for (std::map<std::string, JsonValue>::const_iterator it = mObject.begin(); it != mObject.end(); ++it)
-    {
-        text += indent + "\"" + it->first + "\":" + it->second.ToString(nextLevel);
-        index++;
-        if (index < mObject.size())
-        {
-            text += "," + crlf;
-        }
-    }
-
-    text += crlf + indent + "}";
+    std::string text;
+    JsonWriter writer(text, (level >= 0) ? JsonWriter::PRETTY : JsonWriter::COMPACT);
+    writer.SetIndentLevel((level >= 0) ? level : 0);
+    writer.Write(*this);
     return text;
 }
 /*****************************************************************************/
 std::string JsonObject::ToCBor() const
 {
-    return "";
+    std::string data;
+    CBor::Encoder encoder(data);
+    encoder.Write(*this);
+    return data;
 }
 /*****************************************************************************/
 void JsonObject::AddValue(const std::string &name, const JsonValue &value)
 {
-    mObject[name] = value;
+    Emplace(name) = value;
 }
 /*****************************************************************************/
-bool JsonObject::ReplaceValue(const std::string &keyPath, const JsonValue &value)
+void JsonObject::AddValue(const std::string &name, JsonValue &&value)
 {
-    bool ret = false;
-    std::vector<std::string> keys = Util::Split(keyPath, ":");
-    std::string name = keys[0];
-    keys.erase(keys.begin());
+    Emplace(name) = std::move(value);
+}
+/*****************************************************************************/
+/**
+ * @brief Value of a member, created at the end if the name is new
+ *
+ * With an interning arena, the long names are shared instead of copied.
+ */
+JsonValue &JsonObject::Emplace(std::string_view name, JsonArena *interning)
+{
+    std::size_t pos = Lookup(name);
+    if (pos != std::string::npos)
+    {
+        return mMembers[pos].second;
+    }
+
+    pos = mMembers.size();
+    if ((interning != nullptr) && (name.size() > JsonKey::cInlineSize))
+    {
+        mMembers.emplace_back(std::piecewise_construct, std::forward_as_tuple(interning->Intern(name), true), std::forward_as_tuple());
+    }
+    else
+    {
+        mMembers.emplace_back(std::piecewise_construct, std::forward_as_tuple(name), std::forward_as_tuple());
+    }
 
-    for (std::map<std::string, JsonValue>::iterator it = mObject.begin(); it != mObject.end(); ++it)
+    if (!mIndex.empty() && ((mMembers.size() * 2U) <= mIndex.size()))
     {
-        if (it->first == name)
+        std::size_t mask = mIndex.size() - 1U;
+        std::size_t slot = std::hash<std::string_view>()(name) & mask;
+        while (mIndex[slot] != 0U)
         {
-            if (keys.size() == 0)
-            {
-                // The key is in this object, replace it with the new value
-                it->second = value;
-                ret = true;
-            }
-            else
-            {
-                ret = it->second.ReplaceValue(Util::Join(keys, ":"), value); // go deeper
-            }
+            slot = (slot + 1U) & mask;
         }
+        mIndex[slot] = static_cast<std::uint32_t>(pos + 1U);
     }
-
-    return ret;
+    else if (mMembers.size() > cIndexThreshold)
+    {
+        // Load factor kept below 50%
+        Rehash(mIndex.empty() ? (cIndexThreshold * 4U) : (mIndex.size() * 2U));
+    }
+    return mMembers[pos].second;
 }
 /*****************************************************************************/
-bool JsonObject::HasValue(const std::string &keyPath) const
+/**
+ * @brief Position of a member, std::string::npos if not found
+ */
+std::size_t JsonObject::Lookup(std::string_view name) const
 {
-    bool ret = false;
-    std::vector<std::string> keys = Util::Split(keyPath, ":");
-    std::string name = keys[0];
-    keys.erase(keys.begin());
-
-    for (std::map<std::string, JsonValue>::const_iterator it = mObject.begin(); it != mObject.end(); ++it)
+    if (mIndex.empty())
     {
-        if (it->first == name)
+        for (std::size_t i = 0U; i < mMembers.size(); i++)
         {
-            if (keys.size() == 0)
+            if (mMembers[i].first == name)
             {
-                // The key is in this object
-                ret = true;
+                return i;
             }
-            else
+        }
+    }
+    else
+    {
+        std::size_t mask = mIndex.size() - 1U;
+        std::size_t slot = std::hash<std::string_view>()(name) & mask;
+        while (mIndex[slot] != 0U)
+        {
+            std::size_t pos = mIndex[slot] - 1U;
+            if (mMembers[pos].first == name)
             {
-                ret = it->second.HasValue(Util::Join(keys, ":")); // go deeper
+                return pos;
             }
+            slot = (slot + 1U) & mask;
         }
     }
-    return ret;
+    return std::string::npos;
 }
 /*****************************************************************************/
-JsonValue JsonObject::GetValue(const std::string &keyPath) const
+/**
+ * @brief Rebuild the hash index, the capacity is a power of two
+ */
+void JsonObject::Rehash(std::size_t capacity)
 {
-    JsonValue value;
-    std::vector<std::string> keys = Util::Split(keyPath, ":");
-    std::string name = keys[0];
-    keys.erase(keys.begin());
+    mIndex.assign(capacity, 0U);
 
-    for (std::map<std::string, JsonValue>::const_iterator it = mObject.begin(); it != mObject.end(); ++it)
+    std::size_t mask = capacity - 1U;
+    for (std::size_t pos = 0U; pos < mMembers.size(); pos++)
     {
-        if (it->first == name)
+        std::size_t slot = std::hash<std::string_view>()(mMembers[pos].first) & mask;
+        while (mIndex[slot] != 0U)
         {
-            if (keys.size() == 0)
-            {
-                // The key is in this object
-                value = it->second;
-            }
-            else
-            {
-                value = it->second.FindValue(Util::Join(keys, ":")); // go deeper
-            }
+            slot = (slot + 1U) & mask;
         }
+        mIndex[slot] = static_cast<std::uint32_t>(pos + 1U);
     }
-
-    return value;
+}
+/*****************************************************************************/
+bool JsonObject::ReplaceValue(const std::string &keyPath, const JsonValue &value)
+{
+    JsonValue *slot = Find(keyPath);
+    if (slot != nullptr)
+    {
+        *slot = value;
+    }
+    return slot != nullptr;
+}
+/*****************************************************************************/
+bool JsonObject::ReplaceValue(const std::string &keyPath, JsonValue &&value)
+{
+    JsonValue *slot = Find(keyPath);
+    if (slot != nullptr)
+    {
+        *slot = std::move(value);
+    }
+    return slot != nullptr;
+}
+/*****************************************************************************/
+bool JsonObject::HasValue(const std::string &keyPath) const
+{
+    return Find(keyPath) != nullptr;
+}
+/*****************************************************************************/
+JsonValue JsonObject::GetValue(const std::string &keyPath) const
+{
+    const JsonValue *value = Find(keyPath);
+    return (value != nullptr) ? *value : JsonValue();
+}
+/*****************************************************************************/
+const JsonValue *JsonObject::Find(const std::string &keyPath) const
+{
+    return JsonPath::Resolve(*this, keyPath);
+}
+/*****************************************************************************/
+JsonValue *JsonObject::Find(const std::string &keyPath)
+{
+    return const_cast<JsonValue *>(JsonPath::Resolve(*this, keyPath));
+}
+/*****************************************************************************/
+const JsonValue *JsonObject::Find(const JsonPath &path) const
+{
+    return path.Find(*this);
+}
+/*****************************************************************************/
+JsonValue *JsonObject::Find(const JsonPath &path)
+{
+    return path.Find(*this);
+}
+/*****************************************************************************/
+const JsonValue *JsonObject::FindMember(std::string_view name) const
+{
+    std::size_t pos = Lookup(name);
+    return (pos != std::string::npos) ? &mMembers[pos].second : nullptr;
+}
+/*****************************************************************************/
+JsonValue *JsonObject::FindMember(std::string_view name)
+{
+    std::size_t pos = Lookup(name);
+    return (pos != std::string::npos) ? &mMembers[pos].second : nullptr;
 }
 /*****************************************************************************/
 std::vector<std::string> JsonObject::GetKeys() const
 {
     std::vector<std::string> keys;
 
-    for (std::map<std::string, JsonValue>::const_iterator it = mObject.begin(); it != mObject.end(); ++it)
+    for (const_iterator it = mMembers.begin(); it != mMembers.end(); ++it)
     {
-        keys.push_back(it->first);
+        keys.push_back(std::string(it->first));
     }
 
     return keys;
 }
 /*****************************************************************************/
-
-//          *                          *                                  *
-
-/*****************************************************************************/
-std::string JsonValue::ToString(std::int32_t level) const
+bool JsonObject::DeleteMember(std::string_view name)
 {
-    std::string text;
+    std::size_t pos = Lookup(name);
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
 
-    if (IsString())
+    mMembers.erase(mMembers.begin() + static_cast<std::ptrdiff_t>(pos));
+    if (!mIndex.empty())
     {
-        std::regex reg("\\\\");
-        std::string escapedString = std::regex_replace(GetString(), reg, "\\\\");
-        text = "\"" + escapedString + "\"";
+        // The members after the deleted one have moved
+        Rehash(mIndex.size());
     }
-    else if (GetTag() == INTEGER)
+    return true;
+}
+/*****************************************************************************/
+bool JsonObject::operator == (const JsonObject &rhs) const
+{
+    if (mMembers.size() != rhs.mMembers.size())
     {
-        text = std::to_string(GetInteger64());
+        return false;
     }
-    else if (GetTag() == BOOLEAN)
+
+    for (const_iterator it = mMembers.begin(); it != mMembers.end(); ++it)
     {
-        if (GetBool())
+        const JsonValue *other = rhs.FindMember(it->first);
+        if ((other == nullptr) || (*other != it->second))
         {
-            text = "true";
+            return false;
         }
-        else
-        {
-            text = "false";
-        }
-    }
-    else if (GetTag() == DOUBLE)
-    {
-        text = std::to_string(GetDouble());
-    }
-    else if (GetTag() == NULL_VAL)
-    {
-        text = "null";
-    }
-    else if (IsObject())
-    {
-        text = mObject.ToString(level);
-    }
-    else
-    {
-        text = mArray.ToString(level);
     }
+    return true;
+}
+/*****************************************************************************/
+
+//          *                          *                                  *
 
+/*****************************************************************************/
+std::string JsonValue::ToString(std::int32_t level) const
+{
+    std::string text;
+    JsonWriter writer(text, (level >= 0) ? JsonWriter::PRETTY : JsonWriter::COMPACT);
+    writer.SetIndentLevel((level >= 0) ? level : 0);
+    writer.Write(*this);
     return text;
 }
 /*****************************************************************************/
+std::string JsonValue::ToCBor() const
+{
+    std::string data;
+    CBor::Encoder encoder(data);
+    encoder.Write(*this);
+    return data;
+}
+/*****************************************************************************/
 JsonValue::JsonValue(std::int32_t value)
-    : mTag(INTEGER)
-    , mIntegerValue(value)
-    , mDoubleValue(0.0)
-    , mBoolValue(false)
+    : mInteger(value)
+    , mResource(std::pmr::get_default_resource())
+    , mTag(INTEGER)
 {
 
 }
 /*****************************************************************************/
 JsonValue::JsonValue(std::uint32_t value)
-    : mTag(INTEGER)
-    , mIntegerValue(static_cast<std::int64_t>(value))
-    , mDoubleValue(0.0)
-    , mBoolValue(false)
+    : mInteger(static_cast<std::int64_t>(value))
+    , mResource(std::pmr::get_default_resource())
+    , mTag(INTEGER)
 {
 
 }
 /*****************************************************************************/
 JsonValue::JsonValue(std::int64_t value)
-    : mTag(INTEGER)
-    , mIntegerValue(value)
-    , mDoubleValue(0.0)
-    , mBoolValue(false)
+    : mInteger(value)
+    , mResource(std::pmr::get_default_resource())
+    , mTag(INTEGER)
 {
 
+}
+/*****************************************************************************/
+JsonValue::JsonValue(std::uint64_t value)
+    : mResource(std::pmr::get_default_resource())
+    , mTag(INTEGER)
+{
+    if (value > static_cast<std::uint64_t>(INT64_MAX))
+    {
+        mUnsigned = value;
+        mTag = UINTEGER;
+    }
+    else
+    {
+        mInteger = static_cast<std::int64_t>(value);
+    }
 }
 /*****************************************************************************/
 JsonValue::JsonValue(std::uint16_t value)
-    : mTag(INTEGER)
-    , mIntegerValue(static_cast<std::int64_t>(value))
-    , mDoubleValue(0.0)
-    , mBoolValue(false)
+    : mInteger(static_cast<std::int64_t>(value))
+    , mResource(std::pmr::get_default_resource())
+    , mTag(INTEGER)
 {
 
 }
 /*****************************************************************************/
 JsonValue::JsonValue(std::uint8_t value)
-    : mTag(INTEGER)
-    , mIntegerValue(static_cast<std::int64_t>(value))
-    , mDoubleValue(0.0)
-    , mBoolValue(false)
+    : mInteger(static_cast<std::int64_t>(value))
+    , mResource(std::pmr::get_default_resource())
+    , mTag(INTEGER)
 {
 
 }
 /*****************************************************************************/
 JsonValue::JsonValue(double value)
-    : mTag(DOUBLE)
-    , mIntegerValue(0)
-    , mDoubleValue(value)
-    , mBoolValue(false)
+    : mDouble(value)
+    , mResource(std::pmr::get_default_resource())
+    , mTag(DOUBLE)
 {
 
 }
 /*****************************************************************************/
 JsonValue::JsonValue(const char *value)
-    : mTag(STRING)
-    , mIntegerValue(0)
-    , mDoubleValue(0.0)
-    , mStringValue(value)
-    , mBoolValue(false)
+    : mResource(std::pmr::get_default_resource())
+    , mTag(STRING)
 {
-
+    mString = Create<std::pmr::string>(mResource, value);
 }
 /*****************************************************************************/
 JsonValue::JsonValue(const std::string &value)
-    : mTag(STRING)
-    , mIntegerValue(0)
-    , mDoubleValue(0.0)
-    , mStringValue(value)
-    , mBoolValue(false)
+    : mResource(std::pmr::get_default_resource())
+    , mTag(STRING)
 {
-
+    mString = Create<std::pmr::string>(mResource, value.data(), value.size());
 }
 /*****************************************************************************/
 JsonValue::JsonValue(bool value)
-    : mTag(BOOLEAN)
-    , mIntegerValue(0)
-    , mDoubleValue(0.0)
-    , mBoolValue(value)
+    : mBool(value)
+    , mResource(std::pmr::get_default_resource())
+    , mTag(BOOLEAN)
 {
 
 }
 /*****************************************************************************/
 JsonValue::JsonValue(const JsonValue &value)
+    : mInteger(0)
+    , mResource(std::pmr::get_default_resource())
+    , mTag(INVALID)
 {
-    *this = value;
+    CopyFrom(value);
+}
+/*****************************************************************************/
+JsonValue::JsonValue(JsonValue &&value) noexcept
+    : mInteger(0)
+    , mResource(value.mResource)
+    , mTag(INVALID)
+{
+    StealFrom(value);
 }
 /*****************************************************************************/
 JsonValue::JsonValue(const JsonObject &obj)
-    : mTag(OBJECT)
-    , mIntegerValue(0)
-    , mDoubleValue(0.0)
-    , mBoolValue(false)
+    : mResource(std::pmr::get_default_resource())
+    , mTag(OBJECT)
 {
-    mObject = obj;
+    mObject = Create<JsonObject>(mResource, obj);
 }
 /*****************************************************************************/
 JsonValue::JsonValue(const JsonArray &array)
-    : mTag(ARRAY)
-    , mIntegerValue(0)
-    , mDoubleValue(0.0)
-    , mBoolValue(false)
+    : mResource(std::pmr::get_default_resource())
+    , mTag(ARRAY)
 {
-    mArray = array;
+    mArray = Create<JsonArray>(mResource, array);
+}
+/*****************************************************************************/
+JsonValue::JsonValue(JsonObject &&obj)
+    : mResource(std::pmr::get_default_resource())
+    , mTag(OBJECT)
+{
+    mObject = Create<JsonObject>(mResource, std::move(obj));
+}
+/*****************************************************************************/
+JsonValue::JsonValue(JsonArray &&array)
+    : mResource(std::pmr::get_default_resource())
+    , mTag(ARRAY)
+{
+    mArray = Create<JsonArray>(mResource, std::move(array));
 }
 /*****************************************************************************/
 JsonValue::JsonValue()
-    : mTag(INVALID)
-    , mIntegerValue(0)
-    , mDoubleValue(0.0)
-    , mBoolValue(false)
+    : mInteger(0)
+    , mResource(std::pmr::get_default_resource())
+    , mTag(INVALID)
 {
 
+}
+/*****************************************************************************/
+JsonValue::JsonValue(const allocator_type &alloc)
+    : mInteger(0)
+    , mResource(alloc.resource())
+    , mTag(INVALID)
+{
+
+}
+/*****************************************************************************/
+JsonValue::JsonValue(const JsonValue &value, const allocator_type &alloc)
+    : mInteger(0)
+    , mResource(alloc.resource())
+    , mTag(INVALID)
+{
+    CopyFrom(value);
+}
+/*****************************************************************************/
+JsonValue::JsonValue(JsonValue &&value, const allocator_type &alloc)
+    : mInteger(0)
+    , mResource(alloc.resource())
+    , mTag(INVALID)
+{
+    if (mResource->is_equal(*value.mResource))
+    {
+        StealFrom(value);
+    }
+    else
+    {
+        CopyFrom(value);
+    }
+}
+/*****************************************************************************/
+JsonValue::~JsonValue()
+{
+    Destroy();
 }
 /*****************************************************************************/
 JsonValue &JsonValue::operator =(const JsonValue &rhs)
 {
-    mTag = rhs.mTag;
-    mObject = rhs.mObject;
-    mArray = rhs.mArray;
-    mIntegerValue = rhs.mIntegerValue;
-    mDoubleValue = rhs.mDoubleValue;
-    mStringValue = rhs.mStringValue;
-    mBoolValue = rhs.mBoolValue;
+    if (this != &rhs)
+    {
+        // Copy first: rhs may be one of our children
+        JsonValue copy(rhs, GetAllocator());
+        Destroy();
+        StealFrom(copy);
+    }
     return *this;
 }
 /*****************************************************************************/
-void JsonValue::Clear()
+JsonValue &JsonValue::operator =(JsonValue &&rhs)
+{
+    if (this != &rhs)
+    {
+        if (mResource->is_equal(*rhs.mResource))
+        {
+            // Detach first: rhs may be one of our children
+            JsonValue tmp(std::move(rhs));
+            Destroy();
+            StealFrom(tmp);
+        }
+        else
+        {
+            // Other memory resource: deep copy, which may throw
+            *this = static_cast<const JsonValue &>(rhs);
+        }
+    }
+    return *this;
+}
+/*****************************************************************************/
+bool JsonValue::operator == (const JsonValue &rhs) const
 {
+    if (mTag != rhs.mTag)
+    {
+        return false;
+    }
+
+    switch (mTag)
+    {
+    case OBJECT:
+        return *mObject == *rhs.mObject;
+    case ARRAY:
+        return *mArray == *rhs.mArray;
+    case STRING:
+        return *mString == *rhs.mString;
+    case INTEGER:
+        return mInteger == rhs.mInteger;
+    case UINTEGER:
+        return mUnsigned == rhs.mUnsigned;
+    case DOUBLE:
+        return mDouble == rhs.mDouble;
+    case BOOLEAN:
+        return mBool == rhs.mBool;
+    default:
+        return true; // null or invalid
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief Deep copy of a value, using our own memory resource
+ * The current value must be empty (destroyed)
+ */
+void JsonValue::CopyFrom(const JsonValue &value)
+{
+    switch (value.mTag)
+    {
+    case OBJECT:
+        mObject = Create<JsonObject>(mResource, *value.mObject);
+        break;
+    case ARRAY:
+        mArray = Create<JsonArray>(mResource, *value.mArray);
+        break;
+    case STRING:
+        mString = Create<std::pmr::string>(mResource, *value.mString);
+        break;
+    default:
+        mInteger = value.mInteger; // copy the scalar bits
+        break;
+    }
+    mTag = value.mTag;
+}
+/*****************************************************************************/
+/**
+ * @brief Take the payload of a value that uses the same memory resource
+ * The current value must be empty (destroyed), the other one is left invalid
+ */
+void JsonValue::StealFrom(JsonValue &value)
+{
+    mInteger = value.mInteger; // whole union, including the pointers
+    mTag = value.mTag;
+    value.mInteger = 0;
+    value.mTag = INVALID;
+}
+/*****************************************************************************/
+void JsonValue::Destroy()
+{
+    if (((mTag == OBJECT) || (mTag == ARRAY) || (mTag == STRING)) && !IsArena(mResource))
+    {
+        if (mTag == OBJECT)
+        {
+            Delete(mResource, mObject);
+        }
+        else if (mTag == ARRAY)
+        {
+            Delete(mResource, mArray);
+        }
+        else
+        {
+            Delete(mResource, mString);
+        }
+    }
+    mInteger = 0;
     mTag = INVALID;
-    mObject.Clear();
-    mArray.Clear();
+}
+/*****************************************************************************/
+/**
+ * @brief Replace the current value by an empty value of another type
+ */
+void JsonValue::Reset(Tag tag)
+{
+    Destroy();
+    if (tag == OBJECT)
+    {
+        mObject = Create<JsonObject>(mResource);
+    }
+    else if (tag == ARRAY)
+    {
+        mArray = Create<JsonArray>(mResource);
+    }
+    else if (tag == STRING)
+    {
+        mString = Create<std::pmr::string>(mResource);
+    }
+    mTag = tag;
+}
+/*****************************************************************************/
+void JsonValue::Clear()
+{
+    Destroy();
+}
+/*****************************************************************************/
+JsonObject &JsonValue::GetObj()
+{
+    if (mTag != OBJECT)
+    {
+        Reset(OBJECT);
+    }
+    return *mObject;
+}
+/*****************************************************************************/
+JsonArray &JsonValue::GetArray()
+{
+    if (mTag != ARRAY)
+    {
+        Reset(ARRAY);
+    }
+    return *mArray;
+}
+/*****************************************************************************/
+const JsonObject &JsonValue::GetObj() const
+{
+    static const JsonObject empty;
+    return (mTag == OBJECT) ? *mObject : empty;
+}
+/*****************************************************************************/
+const JsonArray &JsonValue::GetArray() const
+{
+    static const JsonArray empty;
+    return (mTag == ARRAY) ? *mArray : empty;
+}
+/*****************************************************************************/
+std::string JsonValue::GetString() const
+{
+    return (mTag == STRING) ? std::string(mString->data(), mString->size()) : std::string();
+}
+/*****************************************************************************/
+std::string_view JsonValue::GetStringView() const
+{
+    return (mTag == STRING) ? std::string_view(*mString) : std::string_view();
+}
+/*****************************************************************************/
+std::pmr::string &JsonValue::StringRef()
+{
+    if (mTag != STRING)
+    {
+        Reset(STRING);
+    }
+    return *mString;
 }
 /*****************************************************************************/
 bool JsonValue::GetValue(const std::string &nodePath, std::string &value) const
 {
     bool ret = false;
 
-    JsonValue json = FindValue(nodePath);
-    if (json.IsString())
+    const JsonValue *json = Find(nodePath);
+    if ((json != nullptr) && json->IsString())
     {
-        value = json.GetString();
+        value.assign(json->GetStringView());
         ret = true;
     }
 
@@ -464,10 +1031,10 @@ bool JsonValue::GetValue(const std::string &nodePath, std::uint32_t &value) cons
 {
     bool ret = false;
 
-    JsonValue json = FindValue(nodePath);
-    if (json.IsInteger())
+    const JsonValue *json = Find(nodePath);
+    if ((json != nullptr) && json->IsInteger())
     {
-        value = static_cast<std::uint32_t>(json.GetInteger());
+        value = static_cast<std::uint32_t>(json->GetInteger());
         ret = true;
     }
 
@@ -478,10 +1045,10 @@ bool JsonValue::GetValue(const std::string &nodePath, std::uint16_t &value) cons
 {
     bool ret = false;
 
-    JsonValue json = FindValue(nodePath);
-    if (json.IsInteger())
+    const JsonValue *json = Find(nodePath);
+    if ((json != nullptr) && json->IsInteger())
     {
-        value = static_cast<std::uint16_t>(json.GetInteger());
+        value = static_cast<std::uint16_t>(json->GetInteger());
         ret = true;
     }
 
@@ -492,10 +1059,10 @@ bool JsonValue::GetValue(const std::string &nodePath, std::int32_t &value) const
 {
     bool ret = false;
 
-    JsonValue json = FindValue(nodePath);
-    if (json.IsInteger())
+    const JsonValue *json = Find(nodePath);
+    if ((json != nullptr) && json->IsInteger())
     {
-        value = json.GetInteger();
+        value = json->GetInteger();
         ret = true;
     }
 
@@ -506,10 +1073,10 @@ bool JsonValue::GetValue(const std::string &nodePath, bool &value) const
 {
     bool ret = false;
 
-    JsonValue json = FindValue(nodePath);
-    if (json.IsBoolean())
+    const JsonValue *json = Find(nodePath);
+    if ((json != nullptr) && json->IsBoolean())
     {
-        value = json.GetBool();
+        value = json->GetBool();
         ret = true;
     }
 
@@ -520,10 +1087,10 @@ bool JsonValue::GetValue(const std::string &nodePath, double &value) const
 {
     bool ret = false;
 
-    JsonValue json = FindValue(nodePath);
-    if (json.IsDouble())
+    const JsonValue *json = Find(nodePath);
+    if ((json != nullptr) && json->IsDouble())
     {
-        value = json.GetDouble();
+        value = json->GetDouble();
         ret = true;
     }
 
@@ -532,67 +1099,63 @@ bool JsonValue::GetValue(const std::string &nodePath, double &value) const
 /*****************************************************************************/
 bool JsonValue::HasValue(const std::string &keyPath) const
 {
-    JsonValue val = FindValue(keyPath);
-    return val.IsValid();
+    return Find(keyPath) != nullptr;
 }
 /*****************************************************************************/
 JsonValue JsonValue::FindValue(const std::string &keyPath) const
 {
-    std::vector<std::string> keys = Util::Split(keyPath, ":");
-    bool found = false;
-    JsonValue temp = *this;
-
-    for (std::uint32_t i = 0U; i < keys.size(); i++)
-    {
-        if (temp.IsObject())
-        {
-            if (temp.GetObj().HasValue(keys[i]))
-            {
-                temp = temp.GetObj().GetValue(keys[i]);
-                found = true;
-            }
-        }
-        else if (temp.IsArray())
-        {
-            for (JsonArray::iterator iter = temp.GetArray().begin(); iter != temp.GetArray().end(); ++iter)
-            {
-                if (iter->IsObject())
-                {
-                    if (iter->GetObj().HasValue(keys[i]))
-                    {
-                        temp = iter->GetObj().GetValue(keys[i]);
-                        found = true;
-                        break;
-                    }
-                }
-            }
-        }
-        else
-        {
-            break;
-        }
-    }
-    return found ? temp : JsonValue();
+    const JsonValue *value = Find(keyPath);
+    return (value != nullptr) ? *value : JsonValue();
+}
+/*****************************************************************************/
+const JsonValue *JsonValue::Find(const std::string &keyPath) const
+{
+    return JsonPath::Resolve(*this, keyPath);
+}
+/*****************************************************************************/
+JsonValue *JsonValue::Find(const std::string &keyPath)
+{
+    return const_cast<JsonValue *>(JsonPath::Resolve(*this, keyPath));
+}
+/*****************************************************************************/
+const JsonValue *JsonValue::Find(const JsonPath &path) const
+{
+    return path.Find(*this);
+}
+/*****************************************************************************/
+JsonValue *JsonValue::Find(const JsonPath &path)
+{
+    return path.Find(*this);
 }
 /*****************************************************************************/
 bool JsonValue::ReplaceValue(const std::string &keyPath, const JsonValue &value)
 {
-    bool ret = false;
-
-    if (IsObject())
+    JsonValue *slot = Find(keyPath);
+    if (slot != nullptr)
     {
-        ret = GetObj().ReplaceValue(keyPath, value);
+        *slot = value;
     }
-    else if (IsArray())
+    return slot != nullptr;
+}
+/*****************************************************************************/
+bool JsonValue::ReplaceValue(const std::string &keyPath, JsonValue &&value)
+{
+    JsonValue *slot = Find(keyPath);
+    if (slot != nullptr)
     {
-        ret = GetArray().ReplaceValue(keyPath, value);
+        *slot = std::move(value);
     }
-    else
+    return slot != nullptr;
+}
+/*****************************************************************************/
+bool JsonValue::ReplaceValue(const JsonPath &path, JsonValue &&value)
+{
+    JsonValue *slot = Find(path);
+    if (slot != nullptr)
     {
-        // Nothing
+        *slot = std::move(value);
     }
-
-    return ret;
+    return slot != nullptr;
 }
 
 //=============================================================================
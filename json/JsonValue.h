@@ -7,14 +7,19 @@
 #define JSONVALUE_H
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
+#include <utility>
+#include <unordered_set>
+#include <cstring>
 #include <cstdint>
+#include <memory_resource>
 
 // Forward declarations to resolve inter-dependency between Array and Object
 class JsonArray;
 class JsonObject;
 class JsonValue;
+class JsonPath;
 
 namespace CBor {
 
@@ -29,14 +34,159 @@ enum Major {
     SimpleTypesType = 7U
 };
 
+class Decoder;
+
 }
 
 /*****************************************************************************/
+/**
+ * @brief Per-document memory arena
+ *
+ * All the nodes of a tree whose root has been created with the arena allocator
+ * are allocated in large blocks. The whole tree is freed in one shot when the arena
+ * is destroyed: the values living in the arena skip their individual destruction.
+ *
+ * Example:
+ *
+ *     JsonArena arena;
+ *     JsonValue json(arena.GetAllocator());
+ *     JsonReader::ParseString(json, data);
+ *
+ * The arena must outlive the values allocated in it. Moving a value (move
+ * constructor) keeps it in its arena, the result still depends on the arena
+ * lifetime. To get an independent tree on the heap, copy the value (copy
+ * constructor) or move it with an allocator of the destination:
+ *
+ *     JsonValue kept(std::move(json), JsonValue::allocator_type());
+ *
+ * With key interning enabled, the object keys created by JsonReader in this
+ * arena are stored once: all the members with the same key share one copy of
+ * its text, which helps big arrays of similar records. Short keys are always
+ * stored inline in the member (see JsonKey), only the longer ones are interned.
+ */
+class JsonArena : public std::pmr::memory_resource
+{
+public:
+    explicit JsonArena(std::size_t initialSize = 64U * 1024U)
+        : mBuffer(initialSize)
+        , mKeys(this)
+        , mInterning(false)
+    {
+
+    }
+
+    std::pmr::polymorphic_allocator<JsonValue> GetAllocator()
+    {
+        return std::pmr::polymorphic_allocator<JsonValue>(this);
+    }
+
+    void SetKeyInterning(bool enable) { mInterning = enable; }
+    bool IsKeyInterning() const { return mInterning; }
+
+    /**
+     * @brief Shared copy of a key, valid as long as the arena
+     */
+    std::string_view Intern(std::string_view key);
+    std::size_t GetInternedCount() const { return mKeys.size(); }
+
+    /**
+     * @brief Free all the memory of the arena, including the interned keys
+     */
+    void release();
+
+private:
+    // Implemented virtual methods from std::pmr::memory_resource
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+    std::pmr::monotonic_buffer_resource mBuffer; // kept private: its own release() would forget the key set
+    std::pmr::unordered_set<std::string_view> mKeys; // texts stored in the arena
+    bool mInterning;
+};
+
+/*****************************************************************************/
+/**
+ * @brief Key of an object member
+ *
+ * Short texts are stored inline. Longer ones are either owned, allocated with
+ * the memory resource of the object, or shared: interned in a JsonArena that
+ * outlives the object. Keys are compared by address first, so shared keys are
+ * matched without comparing the texts.
+ */
+class JsonKey
+{
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+    static const std::size_t cInlineSize = 16U;
+
+    JsonKey(std::string_view text, const allocator_type &alloc = allocator_type());
+    JsonKey(std::string_view text, bool shared, const allocator_type &alloc = allocator_type());
+    JsonKey(const JsonKey &key, const allocator_type &alloc = allocator_type());
+    JsonKey(JsonKey &&key) noexcept;
+    JsonKey(JsonKey &&key, const allocator_type &alloc);
+    ~JsonKey();
+
+    JsonKey &operator = (const JsonKey &rhs);
+    JsonKey &operator = (JsonKey &&rhs);
+
+    operator std::string_view() const { return std::string_view(data(), mSize); }
+    const char *data() const { return (mStorage == INLINE) ? mInline : mText; }
+    std::size_t size() const { return mSize; }
+    bool IsShared() const { return mStorage == SHARED; }
+
+    bool operator == (std::string_view text) const
+    {
+        const char *d = data();
+        return (mSize == text.size()) && ((d == text.data()) || (std::memcmp(d, text.data(), mSize) == 0));
+    }
+
+private:
+    enum Storage : std::uint8_t
+    {
+        INLINE,
+        OWNED,
+        SHARED
+    };
+
+    union
+    {
+        const char *mText;              // OWNED or SHARED
+        char mInline[cInlineSize];
+    };
+    std::uint32_t mSize;
+    Storage mStorage;
+    std::pmr::memory_resource *mResource;
+
+    void Assign(std::string_view text, bool shared);
+    void Steal(JsonKey &key);
+    void Release();
+};
+
+/*****************************************************************************/
+/**
+ * @brief Json object, the members are kept in insertion order
+ *
+ * The members are stored in a flat vector; small objects are searched linearly,
+ * bigger ones get an open addressing hash index. Lookups take a string_view and
+ * never allocate.
+ */
 class JsonObject
 {
 public:
+    using allocator_type = std::pmr::polymorphic_allocator<JsonValue>;
+    using Member = std::pair<JsonKey, JsonValue>;
+
+    // Above this number of members, a hash index is used for the lookups
+    static const std::size_t cIndexThreshold = 16U;
+
     JsonObject() {}
+    explicit JsonObject(const allocator_type &alloc);
     JsonObject(const JsonObject &obj);
+    JsonObject(JsonObject &&obj) noexcept;
+    JsonObject(const JsonObject &obj, const allocator_type &alloc);
+    JsonObject(JsonObject &&obj, const allocator_type &alloc);
 
     std::string ToString(std::int32_t level = -1) const;
     std::string ToCBor() const;
@@ -44,40 +194,127 @@ public:
     JsonValue GetValue(const std::string &keyPath) const;
     void Clear();
     void AddValue(const std::string &name, const JsonValue &value);
+    void AddValue(const std::string &name, JsonValue &&value);
     bool ReplaceValue(const std::string &keyPath, const JsonValue &value);
-    std::uint32_t GetSize() { return static_cast<std::uint32_t>(mObject.size()); }
+    bool ReplaceValue(const std::string &keyPath, JsonValue &&value);
+    std::uint32_t GetSize() const { return static_cast<std::uint32_t>(mMembers.size()); }
     std::vector<std::string> GetKeys() const;
+    bool DeleteMember(std::string_view name);
+
+    /**
+     * @brief Find a value without copying it, using a key path separated by ':' characters
+     * @return nullptr if not found; the pointer is valid until the object is modified
+     */
+    const JsonValue *Find(const std::string &keyPath) const;
+    JsonValue *Find(const std::string &keyPath);
+    const JsonValue *Find(const JsonPath &path) const;
+    JsonValue *Find(const JsonPath &path);
+
+    /**
+     * @brief Direct member of this object (no key path)
+     */
+    const JsonValue *FindMember(std::string_view name) const;
+    JsonValue *FindMember(std::string_view name);
 
     JsonObject &operator = (JsonObject const &rhs);
+    JsonObject &operator = (JsonObject &&rhs);
+
+    // Same members with equal values, whatever their order
+    bool operator == (const JsonObject &rhs) const;
+    bool operator != (const JsonObject &rhs) const { return !(*this == rhs); }
+
+    // Members in insertion order, it->first is the key and it->second the value
+    typedef std::pmr::vector<Member>::const_iterator const_iterator;
+    const_iterator begin() const { return mMembers.begin(); }
+    const_iterator end() const { return mMembers.end(); }
 
 private:
-    std::map<std::string, JsonValue> mObject;
+    friend class JsonReader; // builds the members in place while parsing
+    friend class JsonStreamReader;
+    friend class CBor::Decoder;
+
+    std::pmr::vector<Member> mMembers;
+    std::pmr::vector<std::uint32_t> mIndex; // position + 1 of the members, 0 is a free slot
+
+    JsonValue &Emplace(std::string_view name, JsonArena *interning = nullptr);
+    std::size_t Lookup(std::string_view name) const;
+    void Rehash(std::size_t capacity);
 };
 
 /*****************************************************************************/
 class JsonArray
 {
 public:
+    using allocator_type = std::pmr::polymorphic_allocator<JsonValue>;
+
+    JsonArray() {}
+    explicit JsonArray(const allocator_type &alloc);
+    JsonArray(const JsonArray &array) = default;
+    JsonArray(JsonArray &&array) noexcept = default;
+    JsonArray(const JsonArray &array, const allocator_type &alloc);
+    JsonArray(JsonArray &&array, const allocator_type &alloc);
+
+    JsonArray &operator = (JsonArray const &rhs) = default;
+    JsonArray &operator = (JsonArray &&rhs) = default;
+
+    bool operator == (const JsonArray &rhs) const;
+    bool operator != (const JsonArray &rhs) const { return !(*this == rhs); }
+
     std::string ToString(int32_t level = -1) const;
     void Clear();
     // JsonArray
     JsonValue GetEntry(std::uint32_t index) const;
     std::uint32_t Size() const;
     void AddValue(const JsonValue &value);
+    void AddValue(JsonValue &&value);
     bool ReplaceValue(const std::string &keyPath, const JsonValue &value);
+    bool ReplaceValue(const std::string &keyPath, JsonValue &&value);
     bool DeleteEntry(std::uint32_t index);
 
-    typedef std::vector<JsonValue>::iterator iterator;
+    /**
+     * @brief Find an entry without copying it
+     * @return nullptr if out of range; the pointer is valid until the array is modified
+     */
+    const JsonValue *Find(std::uint32_t index) const;
+    JsonValue *Find(std::uint32_t index);
+
+    /**
+     * @brief Find a value using a key path starting with an index (eg: "1:address")
+     */
+    const JsonValue *Find(const std::string &keyPath) const;
+    JsonValue *Find(const std::string &keyPath);
+    const JsonValue *Find(const JsonPath &path) const;
+    JsonValue *Find(const JsonPath &path);
+
+    typedef std::pmr::vector<JsonValue>::iterator iterator;
+    typedef std::pmr::vector<JsonValue>::const_iterator const_iterator;
     iterator begin() { return mArray.begin(); }
     iterator end() { return mArray.end(); }
+    const_iterator begin() const { return mArray.begin(); }
+    const_iterator end() const { return mArray.end(); }
 
 private:
-    std::vector<JsonValue> mArray;
+    friend class JsonReader; // builds the entries in place while parsing
+    friend class JsonStreamReader;
+    friend class CBor::Decoder;
+
+    std::pmr::vector<JsonValue> mArray;
+
+    JsonValue &Emplace();
 };
 /*****************************************************************************/
+/**
+ * @brief The JsonValue class
+ *
+ * Compact tagged union: scalars are stored inline, strings, arrays and objects are
+ * stored behind a pointer allocated from the value's memory resource (heap by default,
+ * or a JsonArena). The memory resource is propagated to all the children.
+ */
 class JsonValue
 {
 public:
+    using allocator_type = std::pmr::polymorphic_allocator<JsonValue>;
+
     enum Tag
     {
         INVALID,
@@ -87,11 +324,13 @@ public:
         DOUBLE,
         BOOLEAN,
         STRING,
-        NULL_VAL
+        NULL_VAL,
+        UINTEGER    // unsigned integer that does not fit in INTEGER (above INT64_MAX)
     };
 
     // From Value class
     JsonValue(std::int64_t value);
+    JsonValue(std::uint64_t value);
     JsonValue(std::int32_t value);
     JsonValue(std::uint32_t value);
     JsonValue(std::uint16_t value);
@@ -101,9 +340,19 @@ public:
     JsonValue(const std::string &value);
     JsonValue(bool value);
     JsonValue(const JsonValue &value);
+    JsonValue(JsonValue &&value) noexcept; // keeps the memory resource (arena) of the moved value
     JsonValue(); // default constructor creates an invalid value!
     JsonValue(const JsonObject &obj);
     JsonValue(const JsonArray &array);
+    JsonValue(JsonObject &&obj);
+    JsonValue(JsonArray &&array);
+
+    // Allocator-extended constructors, the value and its children use the allocator's memory resource
+    explicit JsonValue(const allocator_type &alloc);
+    JsonValue(const JsonValue &value, const allocator_type &alloc);
+    JsonValue(JsonValue &&value, const allocator_type &alloc); // copies when the memory resources differ
+
+    ~JsonValue();
 
     // Implemented virtual methods from IJsonNode
     Tag GetTag() const
@@ -111,10 +360,26 @@ public:
         return mTag;
     }
 
+    allocator_type GetAllocator() const
+    {
+        return allocator_type(mResource);
+    }
+
     std::string ToString(int32_t level = -1) const;
+    std::string ToCBor() const;
     void Clear();
 
     JsonValue &operator = (JsonValue const &rhs);
+    JsonValue &operator = (JsonValue &&rhs); // copies (and may throw) when the memory resources differ
+
+    /**
+     * @brief Deep comparison: same type and same contents
+     *
+     * Numbers of different types are different (1 is not 1.0), the order of
+     * the object members does not matter.
+     */
+    bool operator == (const JsonValue &rhs) const;
+    bool operator != (const JsonValue &rhs) const { return !(*this == rhs); }
 
     bool IsValid() const      { return mTag != INVALID; }
     bool IsArray() const      { return mTag == ARRAY; }
@@ -124,15 +389,29 @@ public:
     bool IsInteger() const    { return mTag == INTEGER; }
     bool IsBoolean() const    { return mTag == BOOLEAN; }
     bool IsDouble() const     { return mTag == DOUBLE; }
+    bool IsUnsigned() const   { return mTag == UINTEGER; }
 
-    JsonObject &GetObj() { return mObject; }
-    JsonArray &GetArray() { return mArray; }
+    /**
+     * @brief Access to the object or array container
+     *
+     * If the value is not of the requested type, it is first turned into an empty
+     * container of that type. The const versions return an empty container instead.
+     */
+    JsonObject &GetObj();
+    JsonArray &GetArray();
+    const JsonObject &GetObj() const;
+    const JsonArray &GetArray() const;
 
-    std::int32_t    GetInteger() const   { return static_cast<int32_t>(mIntegerValue); }
-    std::int64_t    GetInteger64() const { return mIntegerValue; }
-    double          GetDouble() const    { return mDoubleValue; }
-    bool            GetBool() const      { return mBoolValue; }
-    std::string     GetString() const    { return mStringValue; }
+    std::int32_t    GetInteger() const   { return static_cast<int32_t>(GetInteger64()); }
+    std::int64_t    GetInteger64() const { return (mTag == INTEGER) ? mInteger : 0; }
+    std::uint64_t   GetUnsigned64() const
+    {
+        return (mTag == UINTEGER) ? mUnsigned : (((mTag == INTEGER) && (mInteger >= 0)) ? static_cast<std::uint64_t>(mInteger) : 0U);
+    }
+    double          GetDouble() const    { return (mTag == DOUBLE) ? mDouble : 0.0; }
+    bool            GetBool() const      { return (mTag == BOOLEAN) ? mBool : false; }
+    std::string     GetString() const;
+    std::string_view GetStringView() const; // valid until the value is modified
 
     bool GetValue(const std::string &nodePath, std::string &value) const;
     bool GetValue(const std::string &nodePath, std::uint32_t &value) const;
@@ -143,7 +422,7 @@ public:
 
     void SetNull()
     {
-        mTag = NULL_VAL;
+        Reset(NULL_VAL);
     }
 
     /**
@@ -154,17 +433,45 @@ public:
     bool HasValue(const std::string &keyPath) const;
     JsonValue FindValue(const std::string &keyPath) const;
     bool ReplaceValue(const std::string &keyPath, const JsonValue &value);
+    bool ReplaceValue(const std::string &keyPath, JsonValue &&value);
+
+    /**
+     * @brief Same as FindValue, but returns a pointer to the value instead of a copy
+     * @return nullptr if not found; the pointer is valid until the tree is modified
+     */
+    const JsonValue *Find(const std::string &keyPath) const;
+    JsonValue *Find(const std::string &keyPath);
+
+    /**
+     * @brief Lookup with a compiled path, to be preferred for repeated lookups
+     */
+    const JsonValue *Find(const JsonPath &path) const;
+    JsonValue *Find(const JsonPath &path);
+    bool ReplaceValue(const JsonPath &path, JsonValue &&value);
 
 private:
+    friend class JsonReader;
+    friend class JsonStreamReader;
+    friend class CBor::Decoder;
+
+    union
+    {
+        std::int64_t mInteger;
+        std::uint64_t mUnsigned;
+        double mDouble;
+        bool mBool;
+        JsonObject *mObject;
+        JsonArray *mArray;
+        std::pmr::string *mString;
+    };
+    std::pmr::memory_resource *mResource;
     Tag mTag;
-    JsonObject mObject;
-    JsonArray mArray;
-
-    //std::variant<std::int64_t, double, bool> mScaler;
-    std::int64_t mIntegerValue;
-    double mDoubleValue;
-    std::string mStringValue;
-    bool mBoolValue;
+
+    void Reset(Tag tag);
+    void Destroy();
+    void CopyFrom(const JsonValue &value);
+    void StealFrom(JsonValue &value);
+    std::pmr::string &StringRef();
 };
 
 #endif // JSONVALUE_H
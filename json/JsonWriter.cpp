@@ -5,8 +5,110 @@
 
 #include <fstream>
 #include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <charconv>
+
+#ifdef USE_WINDOWS_OS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 #include "JsonWriter.h"
+#include "JsonScan.h"
+
+/*****************************************************************************/
+// Escape sequence of the characters found by JsonScan::FindStringSpecial,
+// 'u' means \u00XX
+static const char cEscapeTable[0x60] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0,   0,   '"', 0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   '\\', 0,  0,   0
+};
+
+static const char cSpaces[] = "                                                                ";
+static const char cHex[] = "0123456789abcdef";
+
+/*****************************************************************************/
+JsonWriter::JsonWriter(std::string &output, Style style)
+    : mOut(&output)
+    , mStream(nullptr)
+    , mFd(-1)
+    , mGood(true)
+    , mStyle(style)
+    , mLevel(0)
+    , mDepth(0)
+    , mFirst(true)
+    , mAfterKey(false)
+{
 
+}
+/*****************************************************************************/
+JsonWriter::JsonWriter(std::ostream &output, Style style)
+    : JsonWriter(mChunk, style)
+{
+    mStream = &output;
+    mChunk.reserve(cChunkSize + 64U);
+}
+/*****************************************************************************/
+JsonWriter::JsonWriter(int fd, Style style)
+    : JsonWriter(mChunk, style)
+{
+    mFd = fd;
+    mChunk.reserve(cChunkSize + 64U);
+}
+/*****************************************************************************/
+JsonWriter::~JsonWriter()
+{
+    Flush();
+}
+/*****************************************************************************/
+bool JsonWriter::Flush()
+{
+    if ((mOut != &mChunk) || mChunk.empty())
+    {
+        return mGood;
+    }
+
+    if (mStream != nullptr)
+    {
+        mStream->write(mChunk.data(), static_cast<std::streamsize>(mChunk.size()));
+        mGood = mGood && mStream->good();
+    }
+    else
+    {
+        const char *data = mChunk.data();
+        std::size_t size = mChunk.size();
+        while (mGood && (size > 0U))
+        {
+#ifdef USE_WINDOWS_OS
+            int n = _write(mFd, data, static_cast<unsigned int>(size));
+#else
+            ssize_t n = write(mFd, data, size);
+#endif
+            if (n > 0)
+            {
+                data += n;
+                size -= static_cast<std::size_t>(n);
+            }
+            else if ((n < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            else
+            {
+                mGood = false;
+            }
+        }
+    }
+    mChunk.clear();
+    return mGood;
+}
 /*****************************************************************************/
 bool JsonWriter::SaveToFile(const JsonObject &i_value, const std::string &fileName)
 {
@@ -15,12 +117,254 @@ bool JsonWriter::SaveToFile(const JsonObject &i_value, const std::string &fileNa
 
     if (f.is_open())
     {
-        f << i_value.ToString(0U) << std::endl;
+        JsonWriter writer(f, PRETTY);
+        writer.Write(i_value);
+        writer.Put('\n');
+        bool success = writer.Flush();
         f.close();
-        return true;
+        return success;
     }
     return false;
 }
+/*****************************************************************************/
+void JsonWriter::Write(const JsonValue &value)
+{
+    switch (value.GetTag())
+    {
+    case JsonValue::OBJECT:
+        Write(value.GetObj());
+        break;
+    case JsonValue::ARRAY:
+        Write(value.GetArray());
+        break;
+    case JsonValue::STRING:
+        String(value.GetStringView());
+        break;
+    case JsonValue::INTEGER:
+        Integer(value.GetInteger64());
+        break;
+    case JsonValue::UINTEGER:
+        Unsigned(value.GetUnsigned64());
+        break;
+    case JsonValue::DOUBLE:
+        Double(value.GetDouble());
+        break;
+    case JsonValue::BOOLEAN:
+        Bool(value.GetBool());
+        break;
+    case JsonValue::NULL_VAL:
+        Null();
+        break;
+    default:
+        break; // invalid value, nothing to write
+    }
+}
+/*****************************************************************************/
+void JsonWriter::Write(const JsonObject &obj)
+{
+    StartObject();
+    for (JsonObject::const_iterator it = obj.begin(); it != obj.end(); ++it)
+    {
+        Key(it->first);
+        Write(it->second);
+    }
+    EndObject();
+}
+/*****************************************************************************/
+void JsonWriter::Write(const JsonArray &array)
+{
+    StartArray();
+    for (JsonArray::const_iterator it = array.begin(); it != array.end(); ++it)
+    {
+        Write(*it);
+    }
+    EndArray();
+}
+/*****************************************************************************/
+void JsonWriter::StartObject()
+{
+    BeginValue();
+    Put('{');
+    mDepth++;
+    mFirst = true;
+}
+/*****************************************************************************/
+void JsonWriter::EndObject()
+{
+    mDepth--;
+    if (!mFirst)
+    {
+        NewLine(mDepth);
+    }
+    Put('}');
+    mFirst = false;
+}
+/*****************************************************************************/
+void JsonWriter::StartArray()
+{
+    BeginValue();
+    Put('[');
+    mDepth++;
+    mFirst = true;
+}
+/*****************************************************************************/
+void JsonWriter::EndArray()
+{
+    mDepth--;
+    if (!mFirst)
+    {
+        NewLine(mDepth);
+    }
+    Put(']');
+    mFirst = false;
+}
+/*****************************************************************************/
+void JsonWriter::Key(std::string_view key)
+{
+    BeginValue();
+    PutEscaped(key);
+    Put(':');
+    mAfterKey = true;
+}
+/*****************************************************************************/
+void JsonWriter::String(std::string_view value)
+{
+    BeginValue();
+    PutEscaped(value);
+}
+/*****************************************************************************/
+void JsonWriter::Integer(std::int64_t value)
+{
+    char buffer[24];
+    BeginValue();
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    Put(buffer, static_cast<std::size_t>(result.ptr - buffer));
+}
+/*****************************************************************************/
+void JsonWriter::Unsigned(std::uint64_t value)
+{
+    char buffer[24];
+    BeginValue();
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    Put(buffer, static_cast<std::size_t>(result.ptr - buffer));
+}
+/*****************************************************************************/
+/**
+ * @brief Shortest text that reads back to the exact same double
+ *
+ * A ".0" is added to integral values so that they are parsed again as doubles.
+ * Json has no infinity nor NaN, they are written as null.
+ */
+void JsonWriter::Double(double value)
+{
+    if (!std::isfinite(value))
+    {
+        Null();
+        return;
+    }
+
+    char buffer[32];
+    BeginValue();
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer) - 2U, value);
+    std::size_t size = static_cast<std::size_t>(result.ptr - buffer);
+    if (std::memchr(buffer, '.', size) == nullptr && std::memchr(buffer, 'e', size) == nullptr)
+    {
+        buffer[size++] = '.';
+        buffer[size++] = '0';
+    }
+    Put(buffer, size);
+}
+/*****************************************************************************/
+void JsonWriter::Bool(bool value)
+{
+    BeginValue();
+    if (value)
+    {
+        Put("true", 4U);
+    }
+    else
+    {
+        Put("false", 5U);
+    }
+}
+/*****************************************************************************/
+void JsonWriter::Null()
+{
+    BeginValue();
+    Put("null", 4U);
+}
+/*****************************************************************************/
+/**
+ * @brief Separator before a new element: comma, new line and indentation
+ */
+void JsonWriter::BeginValue()
+{
+    if (mAfterKey)
+    {
+        mAfterKey = false;
+    }
+    else if (mDepth > 0)
+    {
+        if (!mFirst)
+        {
+            Put(',');
+        }
+        NewLine(mDepth);
+    }
+    mFirst = false;
+}
+/*****************************************************************************/
+void JsonWriter::NewLine(std::int32_t depth)
+{
+    if (mStyle == PRETTY)
+    {
+        std::size_t indent = 4U * static_cast<std::size_t>(mLevel + depth);
+        Put('\n');
+        while (indent > 0U)
+        {
+            std::size_t size = (indent < (sizeof(cSpaces) - 1U)) ? indent : (sizeof(cSpaces) - 1U);
+            Put(cSpaces, size);
+            indent -= size;
+        }
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief Write a quoted string, the runs without special characters are copied in one go
+ */
+void JsonWriter::PutEscaped(std::string_view text)
+{
+    const char *s = text.data();
+    const char *end = s + text.size();
+
+    Put('"');
+    while (s < end)
+    {
+        const char *run = s;
+        s = JsonScan::FindStringSpecial(s, end);
+        if (s > run)
+        {
+            Put(run, static_cast<std::size_t>(s - run));
+        }
+
+        if (s < end)
+        {
+            unsigned char c = static_cast<unsigned char>(*s++);
+            char escape = cEscapeTable[c];
+            if (escape == 'u')
+            {
+                char sequence[6] = { '\\', 'u', '0', '0', cHex[c >> 4U], cHex[c & 0x0FU] };
+                Put(sequence, sizeof(sequence));
+            }
+            else
+            {
+                char sequence[2] = { '\\', escape };
+                Put(sequence, sizeof(sequence));
+            }
+        }
+    }
+    Put('"');
+}
 
 
 //=============================================================================
@@ -7,16 +7,110 @@
 #define JSON_WRITER_H
 
 #include <string>
-#include <vector>
-#include <map>
-#include <utility>
+#include <string_view>
+#include <ostream>
+#include <cstdint>
 #include "JsonValue.h"
 
 /*****************************************************************************/
+/**
+ * @brief Json serializer
+ *
+ * The text is emitted directly into the output: a string (appended), a stream or a
+ * file descriptor. For streams and file descriptors, a fixed size buffer is used and
+ * flushed when full, so the memory usage does not depend on the document size.
+ *
+ * A tree can be written in one call, or the document can be generated element by
+ * element without building any JsonValue:
+ *
+ *     std::string text;
+ *     JsonWriter writer(text);
+ *     writer.StartObject();
+ *     writer.Key("id");
+ *     writer.Integer(42);
+ *     writer.EndObject();
+ */
 class JsonWriter
 {
 public:
+    enum Style
+    {
+        COMPACT,
+        PRETTY      // one element per line, 4 spaces indentation
+    };
+
+    static const std::size_t cChunkSize = 64U * 1024U;
+
+    explicit JsonWriter(std::string &output, Style style = COMPACT);
+    explicit JsonWriter(std::ostream &output, Style style = COMPACT);
+    explicit JsonWriter(int fd, Style style = COMPACT);
+    ~JsonWriter();
+
+    // Pretty style: indentation level of the first line
+    void SetIndentLevel(std::int32_t level) { mLevel = level; }
+
+    void Write(const JsonValue &value);
+    void Write(const JsonObject &obj);
+    void Write(const JsonArray &array);
+
+    void StartObject();
+    void EndObject();
+    void StartArray();
+    void EndArray();
+    void Key(std::string_view key);
+    void String(std::string_view value);
+    void Integer(std::int64_t value);
+    void Unsigned(std::uint64_t value);
+    void Double(double value);
+    void Bool(bool value);
+    void Null();
+
+    // Line feed after a top level value (newline delimited documents)
+    void EndLine() { Put('\n'); }
+
+    /**
+     * @brief Send the buffered text to the stream or file descriptor
+     * @return false if an output error occured (now or before)
+     */
+    bool Flush();
+
     static bool SaveToFile(const JsonObject &i_value, const std::string &fileName);
+
+private:
+    std::string mChunk;     // output buffer for the streams and file descriptors
+    std::string *mOut;      // where the text is appended
+    std::ostream *mStream;
+    int mFd;
+    bool mGood;
+    Style mStyle;
+    std::int32_t mLevel;
+    std::int32_t mDepth;
+    bool mFirst;            // no element written yet in the current container
+    bool mAfterKey;
+
+    void BeginValue();
+    void NewLine(std::int32_t depth);
+    void PutEscaped(std::string_view text);
+
+    inline void Put(const char *data, std::size_t size)
+    {
+        mOut->append(data, size);
+        CheckFull();
+    }
+
+    inline void Put(char c)
+    {
+        mOut->push_back(c);
+        CheckFull();
+    }
+
+    inline void CheckFull()
+    {
+        if ((mOut == &mChunk) && (mChunk.size() >= cChunkSize))
+        {
+            Flush();
+        }
+    }
 };
 
 
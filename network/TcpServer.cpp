@@ -33,9 +33,26 @@
 namespace tcp
 {
 
+/*****************************************************************************/
+TcpServer::IEvent::~IEvent()
+{
+
+}
 /*****************************************************************************/
 TcpServer::TcpServer(IEvent &handler)
-    : mInitialized(false)
+    : mReactorCount(1U)
+    , mRunning(0U)
+    , mLowWatermark(64U * 1024U)
+    , mHighWatermark(1024U * 1024U)
+    , mMaxOutput(16U * 1024U * 1024U)
+    , mMaxInput(16U * 1024U * 1024U)
+    , mSlowPolicy(DISCONNECT)
+    , mBackend(BACKEND_EPOLL)
+    , mActiveBackend(BACKEND_EPOLL)
+    , mIdleTimeout(0U)
+    , mReadTimeout(0U)
+    , mWriteTimeout(0U)
+    , mInitialized(false)
     , mEventHandler(handler)
     , mMaxSd(0)
     , mReceiveFd(-1)
@@ -49,6 +66,36 @@ TcpServer::~TcpServer(void)
     Stop();
 }
 /*****************************************************************************/
+void TcpServer::SetReactors(std::uint32_t count)
+{
+    mReactorCount = (count > 0U) ? count : 1U; // one select() thread anyway
+}
+/*****************************************************************************/
+void TcpServer::SetBackend(Backend backend)
+{
+    mBackend = backend;
+}
+/*****************************************************************************/
+void TcpServer::SetOutputLimits(std::size_t lowWatermark, std::size_t highWatermark, std::size_t maxSize, SlowConsumerPolicy policy)
+{
+    mHighWatermark = std::min(highWatermark, maxSize);
+    mLowWatermark = std::min(lowWatermark, mHighWatermark);
+    mMaxOutput = maxSize;
+    mSlowPolicy = policy;
+}
+/*****************************************************************************/
+void TcpServer::SetInputLimit(std::size_t maxSize)
+{
+    mMaxInput = (maxSize > 0U) ? maxSize : 1U;
+}
+/*****************************************************************************/
+void TcpServer::SetTimeouts(std::uint32_t idleMs, std::uint32_t readMs, std::uint32_t writeMs)
+{
+    mIdleTimeout = idleMs;
+    mReadTimeout = readMs;
+    mWriteTimeout = writeMs;
+}
+/*****************************************************************************/
 bool TcpServer::Start(std::int32_t maxConnections, bool localHostOnly, std::uint16_t tcpPort, std::uint16_t wsPort)
 {
     mTcpServer.CreateServer(tcpPort, localHostOnly, maxConnections);
@@ -60,7 +107,7 @@ bool TcpServer::Start(std::int32_t maxConnections, bool localHostOnly, std::uint
     // Create the thread the first time only
     if (!mInitialized)
     {
-        mThread = std::thread(&TcpServer::Run, this);
+        mThread = std::thread([this]() { Run(); });
         mInitialized = true;
     }
 
@@ -91,6 +138,91 @@ void TcpServer::Join()
     }
 }
 /*****************************************************************************/
+bool TcpServer::SendToAllClients(const std::string &data, bool wsOnly)
+{
+    BroadcastReport report = Broadcast(data, wsOnly);
+    return (report.dropped == 0U) && (report.closed == 0U);
+}
+/*****************************************************************************/
+bool TcpServer::Send(const ConnPtr &conn, const std::string &data)
+{
+    if (!conn)
+    {
+        return false;
+    }
+
+    // All the handles given by the server are clients
+    std::shared_ptr<Client> client = std::static_pointer_cast<Client>(std::const_pointer_cast<Conn>(conn));
+
+    if (conn->peer.isWebSocket)
+    {
+        return WriteDirect(*client, TcpSocket::BuildWsFrame(TcpSocket::WEBSOCKET_OPCODE_TEXT, data));
+    }
+    return WriteDirect(*client, data);
+}
+/*****************************************************************************/
+TcpServer::BroadcastReport TcpServer::Broadcast(const std::string &data, bool wsOnly)
+{
+    std::vector<ConnPtr> subscribers;
+
+    mMutex.lock();
+    for (auto &c : mClients)
+    {
+        if (c->peer.isWebSocket || !wsOnly)
+        {
+            subscribers.push_back(c);
+        }
+    }
+    mMutex.unlock();
+
+    return Broadcast(data, subscribers);
+}
+/*****************************************************************************/
+TcpServer::BroadcastReport TcpServer::Broadcast(const std::string &data, const std::vector<ConnPtr> &subscribers)
+{
+    BroadcastReport report;
+    std::string frame; // built once, for the first WebSocket
+
+    for (auto &conn : subscribers)
+    {
+        // A WebSocket is ready once the handshake is done
+        if (!conn || !conn->IsConnected())
+        {
+            continue;
+        }
+
+        if (conn->peer.isWebSocket && frame.empty())
+        {
+            frame = TcpSocket::BuildWsFrame(TcpSocket::WEBSOCKET_OPCODE_TEXT, data);
+        }
+
+        Client &client = *std::static_pointer_cast<Client>(std::const_pointer_cast<Conn>(conn));
+        if (WriteDirect(client, conn->peer.isWebSocket ? frame : data))
+        {
+            report.sent++;
+        }
+        else
+        {
+            report.closed++;
+        }
+    }
+    return report;
+}
+/*****************************************************************************/
+/**
+ * @brief Blocking write, the messages of a connection are not mixed
+ */
+bool TcpServer::WriteDirect(Client &client, const std::string &buffer)
+{
+    std::lock_guard<std::mutex> lock(client.outputMutex);
+
+    if (client.closed || (client.state == Conn::cStateDeleteLater))
+    {
+        return false;
+    }
+    return TcpSocket::Write(buffer, client.peer);
+}
+/*****************************************************************************/
 void TcpServer::Run()
 {
     bool end_server = false;
@@ -131,14 +263,6 @@ void TcpServer::Run()
     FD_SET(mReceiveFd, &mMasterSet);
 #endif
 
-    /*************************************************************/
-    /* Initialize the timeval struct to N minutes.  If no        */
-    /* activity after N minutes this program will end.           */
-    /* 0 means unlimited (== no timeout)                         */
-    /*************************************************************/
-    //   timeout.tv_sec  = 0; //10 * 60;
-    //   timeout.tv_usec = 0;
-
     /*************************************************************/
     /* Loop waiting for incoming connects or for incoming data   */
     /* on any of the connected sockets.                          */
@@ -153,7 +277,6 @@ void TcpServer::Run()
         /**********************************************************/
         /* Call select() and wait N minutes for it to complete.   */
         /**********************************************************/
-        //    printf("Waiting on select()...\n");
         int rc = select(mMaxSd + 1, &working_set, nullptr, nullptr, nullptr); // &timeout);
 
         if (rc < 0)
@@ -184,58 +307,41 @@ void TcpServer::Run()
             /* One or more descriptors are readable.  Need to         */
             /* determine which ones they are.                         */
             /**********************************************************/
-            for (int i = 0; i < rc; i++)
+            if ((mReceiveFd >= 0) && FD_ISSET(mReceiveFd, &working_set))
             {
-                if (FD_ISSET(mReceiveFd, &working_set))
-                {
-                    end_server = true;
-                    mEventHandler.ServerTerminated(IEvent::CLOSED);
-                    break;
-                }
+                end_server = true;
+                mEventHandler.ServerTerminated(IEvent::CLOSED);
+                break;
+            }
 
-                if (mTcpServer.IsValid())
-                {
-                    if (FD_ISSET(mTcpServer.GetSocket(), &working_set))
-                    {
-                        /****************************************************/
-                        /* This is the listening socket                     */
-                        /****************************************************/
-                        mMutex.lock();
-                        IncommingConnection(false);
-                        mMutex.unlock();
-                    }
-                }
-                if (mWsServer.IsValid())
-                {
-                    if (FD_ISSET(mWsServer.GetSocket(), &working_set))
-                    {
-                        /****************************************************/
-                        /* This is the listening socket                     */
-                        /****************************************************/
-                        mMutex.lock();
-                        IncommingConnection(true);
-                        mMutex.unlock();
-                    }
-                }
+            std::lock_guard<std::mutex> lock(mMutex);
 
-                mMutex.lock();
+            /****************************************************/
+            /* The listening sockets                            */
+            /****************************************************/
+            if (mTcpServer.IsValid() && FD_ISSET(mTcpServer.GetSocket(), &working_set))
+            {
+                IncommingConnection(false);
+            }
+            if (mWsServer.IsValid() && FD_ISSET(mWsServer.GetSocket(), &working_set))
+            {
+                IncommingConnection(true);
+            }
 
-                // Scan for already connected clients
-                for (size_t j = 0; j < mClients.size(); j++)
+            // Scan for already connected clients
+            for (auto &c : mClients)
+            {
+                if (FD_ISSET(c->peer.socket, &working_set))
                 {
-                    if (FD_ISSET(mClients[j].peer.socket, &working_set))
-                    {
-                        /****************************************************/
-                        /* This is not the listening socket, therefore an   */
-                        /* existing connection must be readable             */
-                        /****************************************************/
-                        IncommingData(mClients[j]);
-                    }
+                    /****************************************************/
+                    /* This is not the listening socket, therefore an   */
+                    /* existing connection must be readable             */
+                    /****************************************************/
+                    IncommingData(c);
                 }
-
-                UpdateClients(); // refresh status, manage proper closing if necessary
-                mMutex.unlock();
             }
+
+            UpdateClients(); // refresh status, manage proper closing if necessary
         }
     }
     while (end_server == false);
@@ -243,23 +349,18 @@ void TcpServer::Run()
     /*************************************************************/
     /* Cleanup all of the sockets that are open                  */
     /*************************************************************/
-    mMutex.lock();
-    for (size_t i = 0; i < mClients.size(); i++)
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto &c : mClients)
     {
-        if (FD_ISSET(mClients[i].peer.socket, &mMasterSet))
-        {
-            TcpSocket::Close(mClients[i].peer);
-        }
+        c->state = Conn::cStateDeleteLater;
     }
-    mMutex.unlock();
+    UpdateClients();
 }
 /*****************************************************************************/
 void TcpServer::IncommingConnection(bool isWebSocket)
 {
     int new_sd;
-    bool webSocket = false;
 
-    //    printf("  Listening socket is readable\n");
     /*************************************************/
     /* Accept all incoming connections that are      */
     /* queued up on the listening socket before we   */
@@ -270,68 +371,46 @@ void TcpServer::IncommingConnection(bool isWebSocket)
         /**********************************************/
         /* Accept each incoming connection.  If       */
         /* accept fails with EWOULDBLOCK, then we     */
-        /* have accepted all of them.  Any other      */
-        /* failure on accept will cause us to end the */
-        /* server.                                    */
+        /* have accepted all of them.                 */
         /**********************************************/
-        if (isWebSocket)
-        {
-            new_sd = mWsServer.Accept();
-            webSocket = true;
-        }
-        else
-        {
-            new_sd = mTcpServer.Accept();
-        }
+        new_sd = isWebSocket ? mWsServer.Accept() : mTcpServer.Accept();
 
         if (new_sd >= 0)
         {
-            Conn newPeer(new_sd, webSocket);
-            // Save peers descriptor
-            mClients.push_back(newPeer);
+            std::shared_ptr<Client> conn = std::make_shared<Client>(new_sd, isWebSocket, -1, mPool);
+            mClients.push_back(conn);
 
             /**********************************************/
             /* Add the new incoming connection to the     */
             /* master read set                            */
             /**********************************************/
-            //     printf("  New incoming connection - %d\n", new_sd);
             FD_SET(new_sd, &mMasterSet);
 
             // Update the maximum socket file identifier
             UpdateMaxSocket();
 
-            if (!webSocket)
+            if (!isWebSocket)
             {
                 // Signal a new client only if not a web socket (need a handshake before considering it is connected)
-                mEventHandler.NewConnection(newPeer);
+                conn->events->post([this, conn]() {
+                    mEventHandler.NewConnection(conn);
+                });
             }
         }
-
-        /**********************************************/
-        /* Loop back up and accept another incoming   */
-        /* connection                                 */
-        /**********************************************/
     }
     while (new_sd >= 0);
 }
 /*****************************************************************************/
-void TcpServer::IncommingData(Conn &conn)
+void TcpServer::IncommingData(const std::shared_ptr<Client> &handle)
 {
+    Client &conn = *handle;
     TcpSocket socket(conn.peer);
 
-    // printf("  Descriptor %d is readable\n", in_sock);
-    /*************************************************/
-    /* Receive all incoming data on this socket      */
-    /* before we loop back and call select again.    */
-    /*************************************************/
-
     /**********************************************/
-    /* Receive data on this connection until the  */
-    /* recv fails with EWOULDBLOCK.  If any other */
-    /* failure occurs, we will close the          */
-    /* connection.                                */
+    /* Receive what is available on this          */
+    /* connection. If any failure occurs, we will */
+    /* close the connection.                      */
     /**********************************************/
-
     bool hasData = socket.Recv();
     if (hasData)
     {
@@ -343,13 +422,15 @@ void TcpServer::IncommingData(Conn &conn)
                 {
                     // Websocket handshake success, warn the application
                     conn.state = Conn::cStateConnected;
-                    mEventHandler.NewConnection(conn);
-                    hasData = false; // Handshake is not application data
+                    handle->events->post([this, handle]() {
+                        mEventHandler.NewConnection(handle);
+                    });
                 }
                 else
                 {
                     TLogError("Websocket handshake failure.");
                 }
+                hasData = false; // Handshake is not application data
             }
             else
             {
@@ -365,10 +446,11 @@ void TcpServer::IncommingData(Conn &conn)
 
         if (hasData)
         {
-          //  mEventHandler.ReadData(conn);
-            mPool.enqueue_work([=]() {
-                mEventHandler.ReadData(conn);
+            // The message is moved up to the handler
+            handle->events->post([this, handle, payload = std::move(conn.payload)]() mutable {
+                mEventHandler.ReadData(handle, std::move(payload));
             });
+            conn.payload.clear();
         }
     }
     else
@@ -379,7 +461,6 @@ void TcpServer::IncommingData(Conn &conn)
 /*****************************************************************************/
 void TcpServer::UpdateClients()
 {
-    bool cleanUp = true;
     /*************************************************/
     /* Check to see if the connection has been       */
     /* closed by the client.                         */
@@ -389,51 +470,40 @@ void TcpServer::UpdateClients()
     /* based on the bits that are still turned on in */
     /* the master set.                               */
     /*************************************************/
-
-    while (cleanUp)
+    auto it = mClients.begin();
+    while (it != mClients.end())
     {
-        bool haveDeleted = false;
-        for (size_t i = 0; i < mClients.size(); i++)
+        std::shared_ptr<Client> conn = *it;
+        if (conn->state != Conn::cStateDeleteLater)
         {
-            Conn conn = mClients[i];
-            if (conn.state == Conn::cStateDeleteLater)
-            {
-                FD_CLR((u_int)conn.peer.socket, &mMasterSet); // need a cast here because of the macro
-
-                mClients.erase(mClients.begin() + i);
+            ++it;
+            continue;
+        }
 
-                // Signal the disconnection
-                // In case of the websocket, only warn upper layers if the handshake process has been done
-                if (conn.IsConnected())
-                {
-                    mEventHandler.ClientClosed(conn);
-                }
-                conn.payload.clear();
-                conn.state = Conn::cStateClosed;
+        it = mClients.erase(it);
+        FD_CLR((u_int)conn->peer.socket, &mMasterSet); // need a cast here because of the macro
 
-                haveDeleted = true;
-                break; // we have modified the array so we can't continue, leave the loop!!
-            }
+        // Signal the disconnection
+        // In case of the websocket, only warn upper layers if the handshake process has been done
+        if (conn->IsConnected())
+        {
+            conn->events->post([this, conn]() {
+                mEventHandler.ConnectionClosed(conn, IEvent::CLOSED);
+            });
         }
-        cleanUp = haveDeleted; // continue cleanup
+
+        // No more writes from the handlers, the handlers may still hold the connection
+        std::lock_guard<std::mutex> lock(conn->outputMutex);
+        conn->closed = true;
+        Peer peer = conn->peer;
+        TcpSocket::Close(peer);
     }
 
     UpdateMaxSocket();
 }
 /*****************************************************************************/
-
-
-static bool compare_conn(Conn a, Conn b)
-{
-    return (a < b);
-}
 void TcpServer::UpdateMaxSocket()
 {
-    std::vector<Conn>::iterator pos;
-
-    // find the maximum socket file descriptor with the clients
-    pos = std::max_element(mClients.begin(), mClients.end(), compare_conn);
-
     // Find max socket of the servers
     mMaxSd = mTcpServer.GetSocket();
     if (mWsServer.GetSocket() > mMaxSd)
@@ -441,13 +511,14 @@ void TcpServer::UpdateMaxSocket()
         mMaxSd = mWsServer.GetSocket();
     }
 
-	if (pos != mClients.end())
-	{
-		if (*pos > mMaxSd)
-		{
-            mMaxSd = pos->peer.socket;
-		}
-	}
+    // And of the clients
+    for (auto &c : mClients)
+    {
+        if (c->peer.socket > mMaxSd)
+        {
+            mMaxSd = c->peer.socket;
+        }
+    }
 }
 
 } // namespace tcp
@@ -10,11 +10,16 @@
 #include <vector>
 #include <mutex>
 #include <map>
+#include <memory>
+#include <atomic>
+#include <deque>
 #include "TcpServerBase.h"
 #include "Observer.h"
 #include "ThreadQueue.h"
 #include "HttpProtocol.h"
 #include "Pool.h"
+#include "Strand.h"
+#include "TimerWheel.h"
 
 #ifdef USE_LINUX_OS
 #include <sys/epoll.h>
@@ -31,6 +36,25 @@ namespace tcp
  * Events on the server socket are throwed through the IEvent interface that
  * must be implemented in the user side of this class. The event handler is
  * required in the constructor.
+ *
+ * The sockets are served by one or more event loop threads (reactors). Each
+ * reactor has its own epoll instance and its own listening sockets bound to
+ * the same port (SO_REUSEPORT), so the kernel spreads the new connections
+ * between them; when the option is not available, the reactors share the
+ * listening sockets of the first one (EPOLLEXCLUSIVE). A connection is served
+ * by the reactor that accepted it until it is closed.
+ *
+ * On Linux, the reactors use io_uring when the kernel supports it (accepts,
+ * receptions in buffers provided to the kernel and write notifications are
+ * submitted in batches), epoll otherwise; see SetBackend().
+ *
+ * The IEvent handlers are called from a thread pool. The events of one
+ * connection go through its strand: they are delivered in order and never
+ * concurrently, while the events of different connections run in parallel.
+ *
+ * On Windows (TcpServer.cpp), one select() thread serves all the connections
+ * and Send() writes synchronously: the reactors, the backends, the output
+ * queues and the deadlines are only available on Linux.
  */
 class TcpServer
 {
@@ -50,36 +74,98 @@ public:
         /**
          * @brief NewConnection
          * Called when a new TCP/IP connection has been created
-         * @param socket
+         * @param conn handle to the connection, can be kept to send data later
          */
-        virtual void NewConnection(const tcp::Conn &conn) = 0;
+        virtual void NewConnection(const tcp::ConnPtr &conn) = 0;
 
         /**
          * @brief ReadData
          * Called when new data have been sent by the peer to the server
-         * @param socket
-         * @param data
+         * @param conn
+         * @param payload received data (or complete WebSocket message), the handler can take it
          */
-        virtual void ReadData(const tcp::Conn &conn) = 0;
+        virtual void ReadData(const tcp::ConnPtr &conn, std::string &&payload) = 0;
 
         /**
          * @brief ClientClosed
          * Called when a client has closed its connection
-         * @param socket
+         * @param conn
+         */
+        virtual void ClientClosed(const tcp::ConnPtr &conn) = 0;
+
+        /**
+         * @brief ConnectionClosed
+         * Called when a connection is closed, with the reason: CLOSED, or
+         * TIMEOUT when a deadline has expired (see SetTimeouts()).
+         * Calls ClientClosed() by default.
          */
-        virtual void ClientClosed(const tcp::Conn &conn) = 0;
+        virtual void ConnectionClosed(const tcp::ConnPtr &conn, tcp::TcpServer::IEvent::CloseType type) { (void) type; ClientClosed(conn); }
 
         /**
          * @brief ServerTerminated
          * Called when the server is about to shutdown (mainly because of an internal problem)
          */
         virtual void ServerTerminated(tcp::TcpServer::IEvent::CloseType type) = 0;
+
+        /**
+         * @brief HighWatermark
+         * Called when the output queue of a connection grows above the high
+         * watermark: the peer reads slower than the application sends
+         */
+        virtual void HighWatermark(const tcp::ConnPtr &conn) { (void) conn; }
+
+        /**
+         * @brief LowWatermark
+         * Called when the output queue of a connection, after a HighWatermark(),
+         * is back under the low watermark
+         */
+        virtual void LowWatermark(const tcp::ConnPtr &conn) { (void) conn; }
+    };
+
+    enum Backend
+    {
+        BACKEND_AUTO,       // io_uring if available, epoll otherwise
+        BACKEND_EPOLL,      // default
+        BACKEND_IO_URING    // falls back to epoll if not available
+    };
+
+    enum SlowConsumerPolicy
+    {
+        DROP_MESSAGES,  // the messages that do not fit in the output queue are discarded
+        DISCONNECT      // the connection is closed
+    };
+
+    /**
+     * @brief Fan-out result of a Broadcast(), in number of connections
+     */
+    struct BroadcastReport
+    {
+        std::uint32_t sent = 0U;      // completely written to the socket
+        std::uint32_t queued = 0U;    // (partly) waiting in the output queue
+        std::uint32_t dropped = 0U;   // output queue full
+        std::uint32_t closed = 0U;    // connection closed or being closed
     };
 
     TcpServer(IEvent &handler);
 
     virtual ~TcpServer(void);
 
+    /**
+     * @brief Number of reactor threads, used at the next Start() (default is 1)
+     */
+    void SetReactors(std::uint32_t count);
+    std::uint32_t GetReactors() const { return mReactorCount; }
+
+    /**
+     * @brief Event loop implementation, used at the next Start() (default is BACKEND_EPOLL)
+     */
+    void SetBackend(Backend backend);
+
+    /**
+     * @brief Implementation selected by the last Start(): BACKEND_EPOLL or BACKEND_IO_URING
+     */
+    Backend GetBackend() const { return mActiveBackend; }
+
     /**
      * @brief Start the Tcp thread server, with an optional WebSocket port to listen at
      * @param tcpPort
@@ -94,37 +180,182 @@ public:
     bool IsStarted() { return mInitialized; }
     bool SendToAllClients(const std::string &data, bool wsOnly);
 
+    /**
+     * @brief Send the same message to many connections
+     *
+     * The WebSocket frame (and the raw copy for the Tcp connections) is built
+     * once in a shared buffer: the slow connections queue a reference to it,
+     * not a copy. The WebSocket connections are served once the handshake is
+     * done.
+     */
+    BroadcastReport Broadcast(const std::string &data, bool wsOnly);
+    BroadcastReport Broadcast(const std::string &data, const std::vector<ConnPtr> &subscribers);
+
+    /**
+     * @brief Send data to a connection, with a WebSocket frame if needed
+     *
+     * Never blocks: what the socket does not accept immediately is queued and
+     * sent by the reactor thread when the peer reads. Can be called from any
+     * thread, the messages of one thread are sent in order.
+     *
+     * @param conn connection handle given by this server
+     * @return false if the connection is closed or the message has been dropped
+     */
+    bool Send(const ConnPtr &conn, const std::string &data);
+
+    /**
+     * @brief Output queue limits of each connection, in bytes
+     *
+     * The watermarks are reported with IEvent::HighWatermark() and
+     * IEvent::LowWatermark(); a message that would make the queue larger than
+     * maxSize is handled according to the policy.
+     * Defaults: 64 KiB, 1 MiB, 16 MiB, DISCONNECT.
+     */
+    void SetOutputLimits(std::size_t lowWatermark, std::size_t highWatermark, std::size_t maxSize, SlowConsumerPolicy policy);
+
+    /**
+     * @brief Receive limit of each connection, in bytes (default 16 MiB)
+     *
+     * The data is received straight into the connection buffers. A Tcp stream
+     * is delivered by pieces of at most maxSize; a WebSocket frame or message
+     * larger than maxSize closes the connection.
+     */
+    void SetInputLimit(std::size_t maxSize);
+
+    /**
+     * @brief Connection deadlines in milliseconds, used at the next Start() (0: disabled, the default)
+     *
+     * idle: nothing received nor sent; read: nothing received from the peer;
+     * write: queued output not read by the peer. The expired connections are
+     * closed and reported with the TIMEOUT type to IEvent::ConnectionClosed().
+     * The deadlines are checked by each reactor with a timer wheel, a few tens
+     * of milliseconds late at most. After the first expiry, a reactor wakes up
+     * every 50 ms (the wheel tick) as long as one of its connections has a
+     * pending deadline, even when nothing happens on the sockets.
+     */
+    void SetTimeouts(std::uint32_t idleMs, std::uint32_t readMs, std::uint32_t writeMs);
+
 private:
-    TcpServerBase   mTcpServer;
-    TcpServerBase   mWsServer;
-    std::thread mThread;
-    std::vector<Conn> mClients;
-    std::mutex mMutex; // To protect mClients
+    struct Uring;
+
+    struct Client : public Conn
+    {
+        Client(SocketType s, bool ws, int epoll, thread_pool &pool)
+            : Conn(s, ws)
+            , epollFd(epoll)
+            , events(std::make_shared<strand>(pool))
+        {
+
+        }
+
+        int epollFd;                // of the reactor that serves this connection
+        Uring *ring = nullptr;      // or its io_uring instance
+        std::uint64_t serial = 0U;  // identifies the timer of this connection
+        std::int64_t lastRead = 0;  // date of the last received data, reactor thread only
+        IEvent::CloseType closeReason = IEvent::CLOSED;
+        std::string input;          // WebSocket frames being received, reused; its size is the allocated room
+        std::size_t inputSize = 0U; // bytes received in input
+        std::shared_ptr<strand> events; // the handlers of this connection run one at a time, in order
+        std::mutex outputMutex;     // protects the members below, held during the socket writes
+        std::deque<std::shared_ptr<const std::string>> output; // buffers not accepted yet by the socket
+        std::size_t outputOffset = 0U; // bytes of the first buffer already sent
+        std::size_t outputSize = 0U;   // bytes waiting in the queue
+        std::int64_t lastSend = 0;  // date of the last progress of the output
+        bool waitWritable = false;  // EPOLLOUT requested
+        bool aboveHigh = false;     // high watermark reported
+        bool closed = false;        // nothing can be sent anymore
+    };
+
+    struct Reactor
+    {
+        TcpServerBase tcpServer;
+        TcpServerBase wsServer;
+        TcpServerBase *tcpListener = nullptr; // own sockets, or the ones of the first reactor
+        TcpServerBase *wsListener = nullptr;
+        std::thread thread;
+        std::vector<std::shared_ptr<Client>> clients; // indexed by socket descriptor, the epoll events point to the entries
+        std::vector<SocketType> closing; // removals, done in one batch after each epoll_wait()
+        std::mutex mutex; // To protect clients
+        TimerWheel timers; // deadlines of the clients
+        std::vector<TimerWheel::Entry> expired;
+        std::uint64_t serial = 0U;
+        int epollFd = -1;
+        std::shared_ptr<Uring> ring; // io_uring backend
+
+        // Pipe to properly quit epoll_wait() and exit the thread
+        int receiveFd = -1;
+        int sendFd = -1;
+    };
+
+    std::vector<std::unique_ptr<Reactor>> mReactors;
+    std::uint32_t mReactorCount;
+    std::atomic<std::uint32_t> mRunning; // reactor threads not yet terminated
+    std::size_t mLowWatermark;
+    std::size_t mHighWatermark;
+    std::size_t mMaxOutput;
+    std::size_t mMaxInput;
+    SlowConsumerPolicy mSlowPolicy;
+    Backend mBackend;
+    Backend mActiveBackend;
+    std::uint32_t mIdleTimeout;
+    std::uint32_t mReadTimeout;
+    std::uint32_t mWriteTimeout;
     bool mInitialized;
     IEvent     &mEventHandler;
 
 #ifdef USE_WINDOWS_OS
+    // select() server (TcpServer.cpp)
+    TcpServerBase mTcpServer;
+    TcpServerBase mWsServer;
+    std::thread mThread;
+    std::vector<std::shared_ptr<Client>> mClients;
+    std::mutex mMutex; // To protect mClients
     SocketType  mMaxSd;
     fd_set mMasterSet;
-    void UpdateMaxSocket();
-
-
-#endif
-
-    thread_pool mPool;
-    int mEpollFd;
-
-    // Pipes on Linux to properly close the socket and quit select()
     int mReceiveFd;
     int mSendFd;
 
     void Run();
     void IncommingConnection(bool isWebSocket);
-    void IncommingData(Conn &conn);
-    void DeliverWsData(Conn &conn, std::string &buf);
-    std::string WsOpcodeToString(std::uint8_t opcode);
     void UpdateClients();
-    void RemoveClient(int fd);
+    void UpdateMaxSocket();
+    bool WriteDirect(Client &client, const std::string &buffer);
+#endif
+
+    thread_pool mPool;
+
+    bool CreateListeners(Reactor &reactor, std::int32_t maxConnections, bool localHostOnly, std::uint16_t tcpPort, std::uint16_t wsPort, bool reusePort);
+    bool SetupReactor(Reactor &reactor);
+    void CloseReactor(Reactor &reactor);
+    void Run(Reactor &reactor);
+    void Terminate(Reactor &reactor, IEvent::CloseType reason);
+    void IncommingConnection(Reactor &reactor, bool isWebSocket);
+    std::shared_ptr<Client> AddClient(Reactor &reactor, SocketType sd, bool isWebSocket);
+    void IncommingData(const std::shared_ptr<Client> &client);
+    void ReceiveData(const std::shared_ptr<Client> &client, const char *data, std::size_t size);
+    std::size_t ReserveInput(std::string &buffer, std::size_t used, std::size_t wanted);
+    std::size_t DecodeWebSocket(const std::shared_ptr<Client> &client, const char *data, std::size_t size);
+    void CompactInput(Client &client, std::size_t consumed);
+    void DeliverPayload(const std::shared_ptr<Client> &client);
+
+    // io_uring backend (TcpServerUring.cpp)
+    static bool IsUringAvailable();
+    bool SetupUring(Reactor &reactor);
+    void RunUring(Reactor &reactor);
+    void UringWatchWritable(Client &client);
+    enum WriteResult { WRITE_SENT, WRITE_QUEUED, WRITE_DROPPED, WRITE_CLOSED };
+
+    class Message;
+
+    WriteResult Write(const std::shared_ptr<Client> &client, const char *data, std::size_t size, const std::shared_ptr<const std::string> &shared = nullptr);
+    void Fanout(const std::shared_ptr<Client> &client, Message &message, BroadcastReport &report);
+    void Flush(Reactor &reactor, const std::shared_ptr<Client> &client);
+    void WatchWritable(Client &client, bool enable);
+    void UpdateClients(Reactor &reactor);
+    void RemoveClient(Reactor &reactor, Conn &conn);
+    bool HasTimeouts() const { return (mIdleTimeout > 0U) || (mReadTimeout > 0U) || (mWriteTimeout > 0U); }
+    std::int64_t NextDeadline(Client &client, std::int64_t now);
+    void CheckDeadlines(Reactor &reactor);
 };
 
 
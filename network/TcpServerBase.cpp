@@ -13,7 +13,7 @@ TcpServerBase::TcpServerBase()
 
 }
 /*****************************************************************************/
-bool TcpServerBase::CreateServer(std::uint16_t port, bool localHostOnly, std::int32_t maxConnections)
+bool TcpServerBase::CreateServer(std::uint16_t port, bool localHostOnly, std::int32_t maxConnections, bool reusePort)
 {
     /*************************************************************/
     /* Create an AF_INET stream socket to receive incoming       */
@@ -31,6 +31,25 @@ bool TcpServerBase::CreateServer(std::uint16_t port, bool localHostOnly, std::in
     /*************************************************************/
     SetNonBlocking(GetSocket());
 
+    /*************************************************************/
+    /* Several listening sockets on the same port: must be set   */
+    /* on each of them before the bind                           */
+    /*************************************************************/
+    if (reusePort)
+    {
+#ifdef SO_REUSEPORT
+        std::int32_t on = 1;
+        if (setsockopt(GetSocket(), SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char *>(&on), sizeof(on)) != 0)
+        {
+            Close();
+            return false;
+        }
+#else
+        Close();
+        return false;
+#endif
+    }
+
     /*************************************************************/
     /* Bind the socket                                           */
     /*************************************************************/
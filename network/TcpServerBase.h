@@ -16,7 +16,12 @@ class TcpServerBase : public TcpSocket
 public:
     TcpServerBase();
 
-    bool CreateServer(std::uint16_t port, bool localHostOnly, int32_t maxConnections);
+    /**
+     * @brief Create a non-blocking listening socket
+     * @param reusePort allow several sockets to listen to the same port
+     * (SO_REUSEPORT), the kernel then balances the connections between them
+     */
+    bool CreateServer(std::uint16_t port, bool localHostOnly, int32_t maxConnections, bool reusePort = false);
 };
 
 } // namespace tcp
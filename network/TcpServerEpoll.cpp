@@ -7,10 +7,12 @@
 #include "Log.h"
 
 #include <sys/epoll.h>
+#include <sys/uio.h>
 
 #include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <limits>
 #include <sstream>
 
 
@@ -19,12 +21,27 @@
 namespace tcp
 {
 
+/*****************************************************************************/
+TcpServer::IEvent::~IEvent()
+{
+
+}
 /*****************************************************************************/
 TcpServer::TcpServer(IEvent &handler)
-    : mInitialized(false)
+    : mReactorCount(1U)
+    , mRunning(0U)
+    , mLowWatermark(64U * 1024U)
+    , mHighWatermark(1024U * 1024U)
+    , mMaxOutput(16U * 1024U * 1024U)
+    , mMaxInput(16U * 1024U * 1024U)
+    , mSlowPolicy(DISCONNECT)
+    , mBackend(BACKEND_EPOLL)
+    , mActiveBackend(BACKEND_EPOLL)
+    , mIdleTimeout(0U)
+    , mReadTimeout(0U)
+    , mWriteTimeout(0U)
+    , mInitialized(false)
     , mEventHandler(handler)
-    , mReceiveFd(-1)
-    , mSendFd(-1)
 {
 
 }
@@ -34,16 +51,83 @@ TcpServer::~TcpServer()
     Stop();
 }
 /*****************************************************************************/
+void TcpServer::SetReactors(std::uint32_t count)
+{
+    mReactorCount = (count > 0U) ? count : 1U;
+}
+/*****************************************************************************/
+void TcpServer::SetBackend(Backend backend)
+{
+    mBackend = backend;
+}
+/*****************************************************************************/
+void TcpServer::SetOutputLimits(std::size_t lowWatermark, std::size_t highWatermark, std::size_t maxSize, SlowConsumerPolicy policy)
+{
+    mHighWatermark = std::min(highWatermark, maxSize);
+    mLowWatermark = std::min(lowWatermark, mHighWatermark);
+    mMaxOutput = maxSize;
+    mSlowPolicy = policy;
+}
+/*****************************************************************************/
+void TcpServer::SetInputLimit(std::size_t maxSize)
+{
+    mMaxInput = (maxSize > 0U) ? maxSize : 1U;
+}
+/*****************************************************************************/
+void TcpServer::SetTimeouts(std::uint32_t idleMs, std::uint32_t readMs, std::uint32_t writeMs)
+{
+    mIdleTimeout = idleMs;
+    mReadTimeout = readMs;
+    mWriteTimeout = writeMs;
+}
+/*****************************************************************************/
+bool TcpServer::CreateListeners(Reactor &reactor, std::int32_t maxConnections, bool localHostOnly, std::uint16_t tcpPort, std::uint16_t wsPort, bool reusePort)
+{
+    bool isTcpServerValid = false;
+    bool isWsServerValid = false;
+
+    if (tcpPort > 0U)
+    {
+        isTcpServerValid = reactor.tcpServer.CreateServer(tcpPort, localHostOnly, maxConnections, reusePort);
+    }
+
+    if (wsPort > 0U)
+    {
+        isWsServerValid = reactor.wsServer.CreateServer(wsPort, localHostOnly, maxConnections, reusePort);
+    }
+
+    // All the requested servers must be available
+    if (((tcpPort > 0U) && !isTcpServerValid) ||
+        ((wsPort > 0U) && !isWsServerValid))
+    {
+        reactor.tcpServer.Close();
+        reactor.wsServer.Close();
+        return false;
+    }
+
+    reactor.tcpListener = &reactor.tcpServer;
+    reactor.wsListener = &reactor.wsServer;
+    return true;
+}
+/*****************************************************************************/
 bool TcpServer::Start(std::int32_t maxConnections, bool localHostOnly, std::uint16_t tcpPort, std::uint16_t wsPort)
 {
     Stop();
+    mReactors.clear();
+
+    bool reusePort = mReactorCount > 1U;
+    std::unique_ptr<Reactor> first(new Reactor());
+
     bool isTcpServerValid = false;
     bool isWsServerValid = false;
 
     if (tcpPort > 0U)
     {
-
-        isTcpServerValid = mTcpServer.CreateServer(tcpPort, localHostOnly, maxConnections);
+        isTcpServerValid = first->tcpServer.CreateServer(tcpPort, localHostOnly, maxConnections, reusePort);
+        if (!isTcpServerValid && reusePort)
+        {
+            isTcpServerValid = first->tcpServer.CreateServer(tcpPort, localHostOnly, maxConnections);
+        }
         if (!isTcpServerValid)
         {
             std::cerr << "TCP Server creation failure (port maybe not free)" << std::endl;
@@ -52,149 +136,207 @@ bool TcpServer::Start(std::int32_t maxConnections, bool localHostOnly, std::uint
 
     if (wsPort > 0U)
     {
-        isWsServerValid = mWsServer.CreateServer(wsPort, localHostOnly, maxConnections);
+        isWsServerValid = first->wsServer.CreateServer(wsPort, localHostOnly, maxConnections, reusePort);
+        if (!isWsServerValid && reusePort)
+        {
+            isWsServerValid = first->wsServer.CreateServer(wsPort, localHostOnly, maxConnections);
+        }
         if (!isWsServerValid)
         {
              std::cerr << "Websocket Server creation failure (port maybe not free)" << std::endl;
         }
     }
 
-    if (isTcpServerValid || isWsServerValid)
-    {
-        // Create the thread the first time only
-        if (!mInitialized)
-        {
-            mThread = std::thread(&TcpServer::Run, this);
-            mInitialized = true;
-        }
-    }
-    else
+    if (!isTcpServerValid && !isWsServerValid)
     {
          std::cerr << "No any TCP server created" << std::endl;
+         return false;
     }
 
-    return mInitialized;
-}
-/*****************************************************************************/
-void TcpServer::Stop()
-{
-    if (mSendFd > 0)
+    first->tcpListener = &first->tcpServer;
+    first->wsListener = &first->wsServer;
+    mReactors.push_back(std::move(first));
+
+    for (std::uint32_t i = 1U; i < mReactorCount; i++)
     {
-#ifdef USE_WINDOWS_OS
-        _write(mSendFd, "1", 1);
-#else
-        (void) write(mSendFd, "1", 1);
-#endif
+        std::unique_ptr<Reactor> reactor(new Reactor());
+
+        // Own listening sockets on the same ports if possible, otherwise share the first ones
+        if (!CreateListeners(*reactor, maxConnections, localHostOnly,
+                             isTcpServerValid ? tcpPort : 0U,
+                             isWsServerValid ? wsPort : 0U, true))
+        {
+            reactor->tcpListener = &mReactors[0]->tcpServer;
+            reactor->wsListener = &mReactors[0]->wsServer;
+        }
+        mReactors.push_back(std::move(reactor));
     }
-    mTcpServer.Close();
-    mWsServer.Close();
-    Join();
-}
-/*****************************************************************************/
-void TcpServer::Join()
-{
-    if (mInitialized && mThread.joinable())
+
+    // io_uring when the kernel provides what we need, epoll otherwise
+    mActiveBackend = BACKEND_EPOLL;
+    if ((mBackend != BACKEND_EPOLL) && IsUringAvailable())
     {
-        mThread.join();
-        mInitialized = false;
+        mActiveBackend = BACKEND_IO_URING;
     }
-}
-/*****************************************************************************/
-bool TcpServer::SendToAllClients(const std::string &data, bool wsOnly)
-{
+
     bool success = true;
-    mMutex.lock();
-    for (auto &c : mClients)
+    for (auto &r : mReactors)
+    {
+        success = success && ((mActiveBackend == BACKEND_IO_URING) ? SetupUring(*r) : SetupReactor(*r));
+    }
+
+    if (success)
     {
-        bool canSend = wsOnly ? c.peer.isWebSocket : true;
-        if (canSend)
+        mRunning = static_cast<std::uint32_t>(mReactors.size());
+        for (auto &r : mReactors)
         {
-            if (!tcp::TcpSocket::Send(data, c.peer))
+            Reactor *reactor = r.get();
+            if (mActiveBackend == BACKEND_IO_URING)
             {
-                c.state = Conn::cStateDeleteLater;
-                success = false;
+                reactor->thread = std::thread([this, reactor]() { RunUring(*reactor); });
             }
+            else
+            {
+                reactor->thread = std::thread([this, reactor]() { Run(*reactor); });
+            }
+        }
+        mInitialized = true;
+    }
+    else
+    {
+        for (auto &r : mReactors)
+        {
+            CloseReactor(*r);
         }
+        mReactors.clear();
     }
-    mMutex.unlock();
-    return success;
+
+    return mInitialized;
 }
 /*****************************************************************************/
-void TcpServer::Run()
+bool TcpServer::SetupReactor(Reactor &reactor)
 {
-    bool end_server = false;
-    struct epoll_event events[MAXEVENTS];
     struct epoll_event ev;
 
-    //************************************************************
-    // Initialize the epoll stuff
-    //************************************************************
-    mEpollFd = epoll_create1(0);
-    if (mEpollFd == -1) {
-        perror("epoll_create1");
-        exit(1);
+    reactor.epollFd = epoll_create1(0);
+    if (reactor.epollFd == -1)
+    {
+        TLogError("[TCP] epoll_create1 failure: " + std::string(strerror(errno)));
+        return false;
     }
 
-    if (mTcpServer.IsValid())
+    // A shared listening socket wakes up only one of the reactors
+    std::uint32_t listenEvents = EPOLLIN | EPOLLET;
+#ifdef EPOLLEXCLUSIVE
+    if (mReactors.size() > 1U)
     {
-        // Add TCP server
-        memset(&ev, 0, sizeof(ev));
-        ev.data.fd = mTcpServer.GetSocket();
-        ev.events = EPOLLIN | EPOLLET;
-        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mTcpServer.GetSocket(), &ev) == -1)
-        {
-            perror("epoll_ctl");
-            exit(1);
-        }
+        listenEvents |= EPOLLEXCLUSIVE;
     }
+#endif
 
-    if (mWsServer.IsValid())
+    TcpServerBase *listeners[2] = { reactor.tcpListener, reactor.wsListener };
+    for (auto l : listeners)
     {
-        // Add Websocket server
-        memset(&ev, 0, sizeof(ev));
-        ev.data.fd = mWsServer.GetSocket();
-        ev.events = EPOLLIN | EPOLLET;
-        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWsServer.GetSocket(), &ev) == -1)
+        if (l->IsValid())
         {
-            perror("epoll_ctl");
-            exit(1);
+            memset(&ev, 0, sizeof(ev));
+            ev.data.ptr = l;
+            ev.events = listenEvents;
+            if (epoll_ctl(reactor.epollFd, EPOLL_CTL_ADD, l->GetSocket(), &ev) == -1)
+            {
+                TLogError("[TCP] Cannot add server socket to epoll: " + std::string(strerror(errno)));
+                return false;
+            }
         }
     }
 
-#ifdef USE_LINUX_OS
     /*************************************************************/
-    /* Use a pipe on Unix to gracefully quit the select(),       */
+    /* Use a pipe on Unix to gracefully quit the epoll_wait(),   */
     /* close the socket and finally exit the thread              */
     /*************************************************************/
     int pipefd[2];
     if (pipe(pipefd) != 0)
     {
-        std::cout << "Pipe creation error, exiting ..." << std::endl;
-        return;
+        TLogError("[TCP] Pipe creation error");
+        return false;
     }
 
-    mReceiveFd = pipefd[0];
-    mSendFd = pipefd[1];
-    fcntl(mSendFd, F_SETFL, O_NONBLOCK);
+    reactor.receiveFd = pipefd[0];
+    reactor.sendFd = pipefd[1];
+    fcntl(reactor.sendFd, F_SETFL, O_NONBLOCK);
 
     memset(&ev, 0, sizeof(ev));
-    ev.data.fd = mReceiveFd;
+    ev.data.ptr = &reactor.receiveFd;
     ev.events = EPOLLIN | EPOLLET;
-    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mReceiveFd, &ev) == -1)
+    if (epoll_ctl(reactor.epollFd, EPOLL_CTL_ADD, reactor.receiveFd, &ev) == -1)
     {
-        perror("epoll_ctl");
-        exit(1);
+        TLogError("[TCP] Cannot add pipe to epoll: " + std::string(strerror(errno)));
+        return false;
     }
 
-#endif
+    return true;
+}
+/*****************************************************************************/
+void TcpServer::CloseReactor(Reactor &reactor)
+{
+    reactor.tcpServer.Close();
+    reactor.wsServer.Close();
+    reactor.ring.reset(); // cancels the pending operations
 
-    /*************************************************************/
-    /* Initialize the timeval struct to N minutes.  If no        */
-    /* activity after N minutes this program will end.           */
-    /* 0 means unlimited (== no timeout)                         */
-    /*************************************************************/
-    //   timeout.tv_sec  = 0; //10 * 60;
-    //   timeout.tv_usec = 0;
+    int *fds[3] = { &reactor.epollFd, &reactor.receiveFd, &reactor.sendFd };
+    for (auto fd : fds)
+    {
+        if (*fd >= 0)
+        {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+/*****************************************************************************/
+void TcpServer::Stop()
+{
+    for (auto &r : mReactors)
+    {
+        if (r->sendFd >= 0)
+        {
+            (void) write(r->sendFd, "1", 1);
+        }
+    }
+    Join();
+
+    for (auto &r : mReactors)
+    {
+        CloseReactor(*r);
+    }
+}
+/*****************************************************************************/
+void TcpServer::Join()
+{
+    if (mInitialized)
+    {
+        for (auto &r : mReactors)
+        {
+            if (r->thread.joinable())
+            {
+                r->thread.join();
+            }
+        }
+        mInitialized = false;
+    }
+}
+/*****************************************************************************/
+bool TcpServer::SendToAllClients(const std::string &data, bool wsOnly)
+{
+    BroadcastReport report = Broadcast(data, wsOnly);
+    return (report.dropped == 0U) && (report.closed == 0U);
+}
+/*****************************************************************************/
+void TcpServer::Run(Reactor &reactor)
+{
+    bool end_server = false;
+    IEvent::CloseType reason = IEvent::CLOSED;
+    struct epoll_event events[MAXEVENTS];
 
     /*************************************************************/
     /* Loop waiting for incoming connects or for incoming data   */
@@ -202,159 +344,205 @@ void TcpServer::Run()
     /*************************************************************/
     do
     {
-        /**********************************************************/
-        /* Call select() and wait N minutes for it to complete.   */
-        /**********************************************************/
-        //    printf("Waiting on select()...\n");
-        int n = epoll_wait(mEpollFd, events, MAXEVENTS, -1);
+        // Wake up for the next connection deadline, if any
+        int n = epoll_wait(reactor.epollFd, events, MAXEVENTS, reactor.timers.NextTimeout(TimerWheel::Now()));
 
         if (n < 0)
         {
             if (!TcpSocket::AnalyzeSocketError("epoll_wait"))
             {
                 end_server = true;
-                mPool.enqueue_work([=]() {
-                    mEventHandler.ServerTerminated(IEvent::WAIT_SOCK_FAILED);
-                });
+                reason = IEvent::WAIT_SOCK_FAILED;
             }
         }
         else
         {
-            std::lock_guard<std::mutex> lock(mMutex);
+            std::lock_guard<std::mutex> lock(reactor.mutex);
             for (int i = 0; i < n; i++)
             {
-                if (events[i].events & (EPOLLHUP | EPOLLERR))
-                {
-                    /* An error has occured on this fd, or the socket is not
-                    * ready for reading (why were we notified then?) */
-                    fprintf (stderr, "epoll error. events=%u\n", events[i].events);
-                    int       error = 0;
-                    socklen_t errlen = sizeof(error);
-                    if (getsockopt(events[i].data.fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen) == 0)
-                    {
-                        printf("error = %s\n", strerror(error));
-                    }
+                // The listening sockets and the pipe are identified by their address, anything else is a client
+                void *source = events[i].data.ptr;
 
-                    RemoveClient(events[i].data.fd);
-                    continue;
-                }
-                else if (events[i].events & EPOLLRDHUP)
-                {
-                    std::cout << "EPOLLRDHUP on " << events[i].data.fd << std::endl;
-                    RemoveClient(events[i].data.fd);
-                    continue;
-                }
-                else if (mReceiveFd == events[i].data.fd)
+                if (source == &reactor.receiveFd)
                 {
                     end_server = true;
-                    mPool.enqueue_work([=]() {
-                        mEventHandler.ServerTerminated(IEvent::CLOSED);
-                    });
                 }
-                else if (mTcpServer.GetSocket() == events[i].data.fd)
+                else if (source == reactor.tcpListener)
                 {
-                    if (mTcpServer.IsValid())
+                    if (reactor.tcpListener->IsValid())
                     {
                         /****************************************************/
                         /* This is the listening socket                     */
                         /****************************************************/
-                        IncommingConnection(false);
+                        IncommingConnection(reactor, false);
                     }
-
                 }
-                else if (mWsServer.GetSocket() == events[i].data.fd)
+                else if (source == reactor.wsListener)
                 {
-                    if (mWsServer.IsValid())
+                    if (reactor.wsListener->IsValid())
                     {
                         /****************************************************/
                         /* This is the listening socket                     */
                         /****************************************************/
-                        IncommingConnection(true);
+                        IncommingConnection(reactor, true);
                     }
                 }
                 else
                 {
-                    // Scan for already connected clients
-                    for (size_t j = 0; j < mClients.size(); j++)
+                    Client &conn = *static_cast<Client *>(source);
+
+                    if (events[i].events & (EPOLLHUP | EPOLLERR))
                     {
-                        if (mClients[j].peer.socket == events[i].data.fd)
+                        /* An error has occured on this fd, or the socket is not
+                        * ready for reading (why were we notified then?) */
+                        fprintf (stderr, "epoll error. events=%u\n", events[i].events);
+                        int       error = 0;
+                        socklen_t errlen = sizeof(error);
+                        if (getsockopt(conn.peer.socket, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen) == 0)
+                        {
+                            printf("error = %s\n", strerror(error));
+                        }
+
+                        RemoveClient(reactor, conn);
+                    }
+                    else if (events[i].events & EPOLLRDHUP)
+                    {
+                        std::cout << "EPOLLRDHUP on " << conn.peer.socket << std::endl;
+                        RemoveClient(reactor, conn);
+                    }
+                    else
+                    {
+                        const std::shared_ptr<Client> &client = reactor.clients[conn.peer.socket];
+
+                        if ((events[i].events & EPOLLOUT) && (conn.state != Conn::cStateDeleteLater))
+                        {
+                            // The peer has read some data, continue to send the output queue
+                            Flush(reactor, client);
+                        }
+
+                        if ((events[i].events & EPOLLIN) && (conn.state != Conn::cStateDeleteLater))
                         {
                             /****************************************************/
                             /* This is not the listening socket, therefore an   */
                             /* existing connection must be readable             */
                             /****************************************************/
-                            IncommingData(mClients[j]);
+                            IncommingData(client);
+                            if (conn.state == Conn::cStateDeleteLater)
+                            {
+                                reactor.closing.push_back(conn.peer.socket);
+                            }
                         }
                     }
                 }
             }
-            UpdateClients(); // refresh status, manage proper closing if necessary
+            CheckDeadlines(reactor);
+            UpdateClients(reactor); // refresh status, manage proper closing if necessary
         }
 
     }
     while (end_server == false);
 
+    Terminate(reactor, reason);
+}
+/*****************************************************************************/
+void TcpServer::Terminate(Reactor &reactor, IEvent::CloseType reason)
+{
     /*************************************************************/
     /* Cleanup all of the sockets that are open                  */
     /*************************************************************/
-    mMutex.lock();
-    for (size_t i = 0; i < mClients.size(); i++)
+    reactor.mutex.lock();
+    for (auto &c : reactor.clients)
     {
-        if (mClients[i].IsConnected())
+        if (c)
         {
-            TcpSocket::Close(mClients[i].peer);
+            std::lock_guard<std::mutex> lock(c->outputMutex);
+            c->closed = true;
+
+            // The handlers may still hold the connection, its descriptor value is kept
+            Peer peer = c->peer;
+            TcpSocket::Close(peer);
         }
     }
 
-    mClients.clear();
-    mMutex.unlock();
+    reactor.clients.clear();
+    reactor.closing.clear();
+    reactor.timers.Clear();
+    reactor.mutex.unlock();
+
+    // The application is warned once, by the last reactor to leave
+    if (--mRunning == 0U)
+    {
+        mPool.enqueue_work([=]() {
+            mEventHandler.ServerTerminated(reason);
+        });
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief Save the new connection in the table of the reactor, start its deadlines
+ */
+std::shared_ptr<TcpServer::Client> TcpServer::AddClient(Reactor &reactor, SocketType sd, bool isWebSocket)
+{
+    // Save peers descriptor, the connection now belongs to this reactor
+    if (static_cast<std::size_t>(sd) >= reactor.clients.size())
+    {
+        reactor.clients.resize(static_cast<std::size_t>(sd) + 1U);
+    }
+    std::shared_ptr<Client> conn = std::make_shared<Client>(sd, isWebSocket, reactor.epollFd, mPool);
+    conn->ring = reactor.ring.get();
+    conn->serial = ++reactor.serial;
+    reactor.clients[sd] = conn;
+
+    if (HasTimeouts())
+    {
+        std::int64_t now = TimerWheel::Now();
+        conn->lastRead = now;
+        conn->lastSend = now;
+        reactor.timers.Schedule(sd, conn->serial, NextDeadline(*conn, now));
+    }
+    return conn;
 }
 /*****************************************************************************/
-void TcpServer::IncommingConnection(bool isWebSocket)
+void TcpServer::IncommingConnection(Reactor &reactor, bool isWebSocket)
 {
     int new_sd;
     bool webSocket = false;
 
-    //    printf("  Listening socket is readable\n");
     /*************************************************/
     /* Accept all incoming connections that are      */
     /* queued up on the listening socket before we   */
-    /* loop back and call select again.              */
+    /* loop back and call epoll_wait again.          */
     /*************************************************/
     do
     {
         /**********************************************/
         /* Accept each incoming connection.  If       */
         /* accept fails with EWOULDBLOCK, then we     */
-        /* have accepted all of them.  Any other      */
-        /* failure on accept will cause us to end the */
-        /* server.                                    */
+        /* have accepted all of them.                 */
         /**********************************************/
         if (isWebSocket)
         {
-            new_sd = mWsServer.Accept();
+            new_sd = reactor.wsListener->Accept();
             webSocket = true;
         }
         else
         {
-            new_sd = mTcpServer.Accept();
+            new_sd = reactor.tcpListener->Accept();
         }
 
         if (new_sd >= 0)
         {
-            Conn newPeer(new_sd, webSocket);
-            // Save peers descriptor
-            mClients.push_back(newPeer);
+            std::shared_ptr<Client> conn = AddClient(reactor, new_sd, webSocket);
 
             /**********************************************/
             /* Add the new incoming connection to the     */
-            /* master read set                            */
+            /* reactor interest list                      */
             /**********************************************/
             struct epoll_event ev;
             memset(&ev, 0, sizeof(ev));
             ev.events = EPOLLIN | EPOLLET;
-            ev.data.fd = new_sd;
-            if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, new_sd, &ev) == -1)
+            ev.data.ptr = conn.get();
+            if (epoll_ctl(reactor.epollFd, EPOLL_CTL_ADD, new_sd, &ev) == -1)
             {
                 perror("Cannot add socket to epoll");
             }
@@ -362,8 +550,8 @@ void TcpServer::IncommingConnection(bool isWebSocket)
             if (!webSocket)
             {
                 // Signal a new client only if not a web socket (need a handshake before considering it is connected)
-                mPool.enqueue_work([=]() {
-                    mEventHandler.NewConnection(newPeer);
+                conn->events->post([this, conn]() {
+                    mEventHandler.NewConnection(conn);
                 });
             }
         }
@@ -376,133 +564,675 @@ void TcpServer::IncommingConnection(bool isWebSocket)
     while (new_sd >= 0);
 }
 /*****************************************************************************/
-void TcpServer::IncommingData(Conn &conn)
+/**
+ * @brief Grow a receive buffer to have room for wanted bytes after used, within the input limit
+ * @return the room available
+ */
+std::size_t TcpServer::ReserveInput(std::string &buffer, std::size_t used, std::size_t wanted)
 {
-    TcpSocket socket(conn.peer);
-
-    // printf("  Descriptor %d is readable\n", in_sock);
-    /*************************************************/
-    /* Receive all incoming data on this socket      */
-    /* before we loop back and call select again.    */
-    /*************************************************/
+    std::size_t target = std::min(used + wanted, std::max(mMaxInput, used));
+    if (buffer.size() < target)
+    {
+        buffer.resize(target);
+    }
+    return std::min(buffer.size(), std::max(mMaxInput, used)) - used;
+}
+/*****************************************************************************/
+void TcpServer::IncommingData(const std::shared_ptr<Client> &handle)
+{
+    static const std::size_t cMaxChunk = 64U * 1024U;
+    Client &conn = *handle;
+    std::size_t chunk = 4096U;
+    bool drained = false;
+    bool received = false;
 
     /**********************************************/
     /* Receive data on this connection until the  */
-    /* recv fails with EWOULDBLOCK.  If any other */
+    /* socket is empty (edge triggered). If any   */
     /* failure occurs, we will close the          */
     /* connection.                                */
     /**********************************************/
+    while (!drained && (conn.state != Conn::cStateDeleteLater))
+    {
+        // Straight into the connection: the Tcp message itself, or the buffer of the WebSocket frames
+        bool ws = conn.peer.isWebSocket;
+        std::string &buffer = ws ? conn.input : conn.payload;
+        std::size_t used = ws ? conn.inputSize : conn.payload.size();
+        std::size_t room = ReserveInput(buffer, used, chunk);
 
-    bool hasData = socket.Recv();
-    if (hasData)
+        if (room == 0U)
+        {
+            if (ws)
+            {
+                TLogError("[TCP] WebSocket frame larger than the input limit");
+                conn.state = Conn::cStateDeleteLater;
+                break;
+            }
+            DeliverPayload(handle); // the Tcp data goes up by pieces of the input limit
+            continue;
+        }
+
+        ssize_t n = ::recv(conn.peer.socket, &buffer[used], room, 0);
+        if (n > 0)
+        {
+            received = true;
+            drained = (static_cast<std::size_t>(n) < room);
+            chunk = std::min(chunk * 2U, cMaxChunk); // larger reads while the socket is full
+            if (ws)
+            {
+                conn.inputSize += static_cast<std::size_t>(n);
+                CompactInput(conn, DecodeWebSocket(handle, conn.input.data(), conn.inputSize));
+            }
+            else
+            {
+                buffer.resize(used + static_cast<std::size_t>(n));
+            }
+        }
+        else
+        {
+            if (!ws)
+            {
+                buffer.resize(used);
+            }
+            if ((n == 0) || !TcpSocket::AnalyzeSocketError("recv()"))
+            {
+                conn.state = Conn::cStateDeleteLater;
+            }
+            drained = true;
+        }
+    }
+
+    if (received && HasTimeouts())
+    {
+        conn.lastRead = TimerWheel::Now();
+    }
+
+    if (!conn.peer.isWebSocket && !conn.payload.empty())
+    {
+        DeliverPayload(handle);
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief Data received in a buffer that is not owned by the connection (io_uring)
+ *
+ * The complete WebSocket frames are decoded from the view, only an incomplete
+ * frame is copied into the connection buffer.
+ */
+void TcpServer::ReceiveData(const std::shared_ptr<Client> &handle, const char *data, std::size_t size)
+{
+    Client &conn = *handle;
+
+    if (HasTimeouts())
     {
-        if (conn.peer.isWebSocket)
+        conn.lastRead = TimerWheel::Now();
+    }
+
+    if (!conn.peer.isWebSocket)
+    {
+        conn.payload.append(data, size);
+        DeliverPayload(handle);
+        return;
+    }
+
+    std::size_t consumed = 0U;
+    if (conn.inputSize == 0U)
+    {
+        consumed = DecodeWebSocket(handle, data, size);
+    }
+
+    if ((consumed < size) && (conn.state != Conn::cStateDeleteLater))
+    {
+        std::size_t rest = size - consumed;
+        if (ReserveInput(conn.input, conn.inputSize, rest) < rest)
         {
-            if (conn.IsClosed())
+            TLogError("[TCP] WebSocket frame larger than the input limit");
+            conn.state = Conn::cStateDeleteLater;
+            return;
+        }
+        memcpy(&conn.input[conn.inputSize], data + consumed, rest);
+        conn.inputSize += rest;
+        CompactInput(conn, DecodeWebSocket(handle, conn.input.data(), conn.inputSize));
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief Handshake and complete frames at the beginning of data
+ * @return the size of what has been processed
+ */
+std::size_t TcpServer::DecodeWebSocket(const std::shared_ptr<Client> &handle, const char *data, std::size_t size)
+{
+    static const char cEndOfHeader[] = "\r\n\r\n";
+    Client &conn = *handle;
+    std::size_t consumed = 0U;
+
+    while ((consumed < size) && (conn.state != Conn::cStateDeleteLater))
+    {
+        const char *start = data + consumed;
+        const char *end = data + size;
+
+        if (conn.IsClosed())
+        {
+            // The handshake request is complete with its empty line
+            const char *found = std::search(start, end, cEndOfHeader, cEndOfHeader + 4);
+            if (found == end)
             {
-                if (socket.ProceedWsHandshake())
-                {
-                    // Websocket handshake success, warn the application
-                    conn.state = Conn::cStateConnected;
-                    mPool.enqueue_work([=]() {
-                        mEventHandler.NewConnection(conn);
-                    });
-                    hasData = false; // Handshake is not application data
-                }
-                else
-                {
-                    conn.state = Conn::cStateDeleteLater;
-                    TLogError("Websocket handshake failure.");
-                }
+                break;
+            }
+
+            std::size_t length = static_cast<std::size_t>(found - start) + 4U;
+            TcpSocket socket(conn.peer);
+            socket.AppendData(start, length);
+            consumed += length;
+
+            if (socket.ProceedWsHandshake())
+            {
+                // Websocket handshake success, warn the application
+                conn.state = Conn::cStateConnected;
+                conn.events->post([this, handle]() {
+                    mEventHandler.NewConnection(handle);
+                });
             }
             else
             {
-                // Assume we are in the connected state, manage the frame to extract the data
-                hasData = socket.DecodeWsData(conn);
+                conn.state = Conn::cStateDeleteLater;
+                TLogError("Websocket handshake failure.");
             }
         }
         else
         {
-            // Transfer the received data to to connection payload
-            socket.DeliverData(conn);
+            // Connected state, manage the frame to extract the data
+            std::size_t frame;
+            TcpSocket::WS_RESULT res = TcpSocket::DecodeWsFrame(start, static_cast<std::size_t>(end - start), conn.payload, frame);
+            if (res == TcpSocket::WS_INCOMPLETE)
+            {
+                break;
+            }
+            consumed += frame;
+
+            if (res == TcpSocket::WS_CLOSE)
+            {
+                conn.state = Conn::cStateDeleteLater;
+            }
+            else if (res == TcpSocket::WS_SEND_PONG)
+            {
+                // Through the output queue, not to be mixed with a partially sent message
+                std::string pong = TcpSocket::BuildWsFrame(TcpSocket::WEBSOCKET_OPCODE_PONG, std::string());
+                Write(handle, pong.data(), pong.size());
+            }
+            else if (res == TcpSocket::WS_DATA)
+            {
+                DeliverPayload(handle);
+            }
+            else if (conn.payload.size() > mMaxInput)
+            {
+                TLogError("[TCP] WebSocket message larger than the input limit");
+                conn.state = Conn::cStateDeleteLater;
+            }
         }
+    }
+    return consumed;
+}
+/*****************************************************************************/
+/**
+ * @brief Remove the processed bytes from the connection buffer, release it when empty and large
+ */
+void TcpServer::CompactInput(Client &conn, std::size_t consumed)
+{
+    static const std::size_t cKeepInput = 16U * 1024U;
 
-        if (hasData)
+    if (consumed > 0U)
+    {
+        std::size_t rest = conn.inputSize - consumed;
+        if (rest > 0U)
         {
-            mPool.enqueue_work([=]() {
-                mEventHandler.ReadData(conn);
-            });
-//            mEventHandler.ReadData(conn);
+            memmove(&conn.input[0], &conn.input[consumed], rest);
+        }
+        conn.inputSize = rest;
+    }
+
+    if ((conn.inputSize == 0U) && (conn.input.size() > cKeepInput))
+    {
+        std::string().swap(conn.input);
+    }
+}
+/*****************************************************************************/
+void TcpServer::DeliverPayload(const std::shared_ptr<Client> &handle)
+{
+    // The message is moved up to the handler, never copied
+    Client &conn = *handle;
+    conn.events->post([this, handle, payload = std::move(conn.payload)]() mutable {
+        mEventHandler.ReadData(handle, std::move(payload));
+    });
+    conn.payload.clear();
+}
+/*****************************************************************************/
+/**
+ * @brief Shared buffers of a broadcast, built at the first connection that needs them
+ */
+class TcpServer::Message
+{
+public:
+    explicit Message(const std::string &data)
+        : mData(data)
+    {
+
+    }
+
+    const std::shared_ptr<const std::string> &Get(bool webSocket)
+    {
+        std::shared_ptr<const std::string> &buffer = webSocket ? mFrame : mRaw;
+        if (!buffer)
+        {
+            buffer = std::make_shared<const std::string>(webSocket ? TcpSocket::BuildWsFrame(TcpSocket::WEBSOCKET_OPCODE_TEXT, mData) : mData);
         }
+        return buffer;
+    }
+
+private:
+    const std::string &mData;
+    std::shared_ptr<const std::string> mRaw;
+    std::shared_ptr<const std::string> mFrame;
+};
+/*****************************************************************************/
+bool TcpServer::Send(const ConnPtr &conn, const std::string &data)
+{
+    if (!conn)
+    {
+        return false;
+    }
+
+    // All the handles given by the server are clients
+    std::shared_ptr<Client> client = std::static_pointer_cast<Client>(std::const_pointer_cast<Conn>(conn));
+    WriteResult result;
+
+    if (conn->peer.isWebSocket)
+    {
+        std::string frame = TcpSocket::BuildWsFrame(TcpSocket::WEBSOCKET_OPCODE_TEXT, data);
+        result = Write(client, frame.data(), frame.size());
     }
     else
     {
-        conn.state = Conn::cStateDeleteLater;
+        result = Write(client, data.data(), data.size());
     }
+    return (result == WRITE_SENT) || (result == WRITE_QUEUED);
 }
 /*****************************************************************************/
-void TcpServer::RemoveClient(int fd)
+TcpServer::BroadcastReport TcpServer::Broadcast(const std::string &data, bool wsOnly)
 {
-    for (auto &c : mClients)
+    BroadcastReport report;
+    Message message(data);
+
+    for (auto &r : mReactors)
     {
-        if (c.peer.socket == fd)
+        std::lock_guard<std::mutex> lock(r->mutex);
+        for (auto &c : r->clients)
         {
-            c.state = Conn::cStateDeleteLater;
+            if (c && (c->peer.isWebSocket || !wsOnly))
+            {
+                Fanout(c, message, report);
+            }
         }
     }
+    return report;
 }
 /*****************************************************************************/
-void TcpServer::UpdateClients()
+TcpServer::BroadcastReport TcpServer::Broadcast(const std::string &data, const std::vector<ConnPtr> &subscribers)
 {
-    bool cleanUp = true;
-    /*************************************************/
-    /* Check to see if the connection has been       */
-    /* closed by the client.                         */
-    /* This clean up process includes removing the   */
-    /* descriptor from the master set and            */
-    /* determining the new maximum descriptor value  */
-    /* based on the bits that are still turned on in */
-    /* the master set.                               */
-    /*************************************************/
+    BroadcastReport report;
+    Message message(data);
 
-    while (cleanUp)
+    for (auto &conn : subscribers)
     {
-        bool haveDeleted = false;
-        for (size_t i = 0; i < mClients.size(); i++)
+        if (conn)
         {
-            Conn conn = mClients[i];
-            if ((conn.state == Conn::cStateDeleteLater) ||
-                 !conn.peer.IsValid())
+            Fanout(std::static_pointer_cast<Client>(std::const_pointer_cast<Conn>(conn)), message, report);
+        }
+    }
+    return report;
+}
+/*****************************************************************************/
+void TcpServer::Fanout(const std::shared_ptr<Client> &client, Message &message, BroadcastReport &report)
+{
+    // A WebSocket is ready once the handshake is done
+    if (!client->IsConnected())
+    {
+        return;
+    }
+
+    const std::shared_ptr<const std::string> &buffer = message.Get(client->peer.isWebSocket);
+
+    switch (Write(client, buffer->data(), buffer->size(), buffer))
+    {
+    case WRITE_SENT:
+        report.sent++;
+        break;
+    case WRITE_QUEUED:
+        report.queued++;
+        break;
+    case WRITE_DROPPED:
+        report.dropped++;
+        break;
+    case WRITE_CLOSED:
+    default:
+        report.closed++;
+        break;
+    }
+}
+/*****************************************************************************/
+/**
+ * @brief Send directly if nothing is waiting, queue what the socket does not accept
+ *
+ * The remaining bytes are copied, unless they belong to a shared buffer that
+ * is then queued as is.
+ */
+TcpServer::WriteResult TcpServer::Write(const std::shared_ptr<Client> &client, const char *data, std::size_t size, const std::shared_ptr<const std::string> &shared)
+{
+    std::lock_guard<std::mutex> lock(client->outputMutex);
+
+    if (client->closed || (client->state == Conn::cStateDeleteLater))
+    {
+        return WRITE_CLOSED;
+    }
+
+    if ((client->outputSize + size) > mMaxOutput)
+    {
+        if (mSlowPolicy == DISCONNECT)
+        {
+            // The reactor sees the hang up and closes the connection
+            TLogNetwork("[TCP] Output queue full, closing the connection");
+            ::shutdown(client->peer.socket, SHUT_RDWR);
+        }
+        return WRITE_DROPPED;
+    }
+
+    std::size_t written = 0U;
+    if (client->outputSize == 0U)
+    {
+        if (HasTimeouts())
+        {
+            client->lastSend = TimerWheel::Now(); // sent, or the write deadline starts
+        }
+
+        ssize_t n = ::send(client->peer.socket, data, size, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (!TcpSocket::AnalyzeSocketError("send()"))
             {
-                mClients.erase(mClients.begin() + i);
+                return WRITE_CLOSED;
+            }
+            n = 0;
+        }
+        written = static_cast<std::size_t>(n);
+        if (written == size)
+        {
+            return WRITE_SENT;
+        }
+    }
 
-                // Signal the disconnection
-                // In case of the websocket, only warn upper layers if the handshake process has been done
-                if (conn.IsConnected())
-                {
-                    mPool.enqueue_work([=]() {
-                        mEventHandler.ClientClosed(conn);
-                    });
-                }
+    if (shared)
+    {
+        if (client->output.empty())
+        {
+            client->outputOffset = written;
+        }
+        client->output.push_back(shared);
+    }
+    else
+    {
+        client->output.push_back(std::make_shared<const std::string>(data + written, size - written));
+    }
+    client->outputSize += size - written;
 
-                // Remove the socket from epoll
-                if (epoll_ctl(mEpollFd, EPOLL_CTL_DEL, conn.peer.socket, nullptr) == -1)
-                {
-                    perror("Cannot remove socket from epoll");
-                }
+    if (!client->waitWritable)
+    {
+        WatchWritable(*client, true);
+    }
 
-                // Finally close it
-                TcpSocket::Close(conn.peer);
+    if (!client->aboveHigh && (client->outputSize > mHighWatermark))
+    {
+        client->aboveHigh = true;
+        ConnPtr handle = client;
+        client->events->post([this, handle]() {
+            mEventHandler.HighWatermark(handle);
+        });
+    }
+    return WRITE_QUEUED;
+}
+/*****************************************************************************/
+void TcpServer::Flush(Reactor &reactor, const std::shared_ptr<Client> &client)
+{
+    static const std::size_t cMaxIov = 64U;
+    struct iovec iov[cMaxIov];
+
+    std::lock_guard<std::mutex> lock(client->outputMutex);
 
-                haveDeleted = true;
-                break; // we have modified the array so we can't continue, leave the loop!!
+    // Gather the queued buffers, as many as possible in one system call
+    while (client->outputSize > 0U)
+    {
+        std::size_t count = 0U;
+        std::size_t total = 0U;
+        std::size_t offset = client->outputOffset;
+        for (auto it = client->output.begin(); (it != client->output.end()) && (count < cMaxIov); ++it)
+        {
+            iov[count].iov_base = const_cast<char *>((*it)->data() + offset);
+            iov[count].iov_len = (*it)->size() - offset;
+            total += iov[count].iov_len;
+            offset = 0U;
+            count++;
+        }
+
+        ssize_t n = ::writev(client->peer.socket, iov, static_cast<int>(count));
+        if (n < 0)
+        {
+            if (!TcpSocket::AnalyzeSocketError("writev()"))
+            {
+                RemoveClient(reactor, *client);
+                return;
             }
+            break; // socket full, wait for the next EPOLLOUT
+        }
+
+        if ((n > 0) && HasTimeouts())
+        {
+            client->lastSend = TimerWheel::Now();
         }
-        cleanUp = haveDeleted; // continue cleanup
+
+        // Release the buffers that are completely sent
+        std::size_t sent = static_cast<std::size_t>(n);
+        client->outputSize -= sent;
+        while (sent > 0U)
+        {
+            std::size_t remaining = client->output.front()->size() - client->outputOffset;
+            if (sent >= remaining)
+            {
+                sent -= remaining;
+                client->output.pop_front();
+                client->outputOffset = 0U;
+            }
+            else
+            {
+                client->outputOffset += sent;
+                sent = 0U;
+            }
+        }
+
+        if (static_cast<std::size_t>(n) < total)
+        {
+            break; // partial write: the socket buffer is full
+        }
+    }
+
+    if (client->outputSize == 0U)
+    {
+        WatchWritable(*client, false);
+    }
+    else if (!client->waitWritable)
+    {
+        WatchWritable(*client, true); // one-shot notification (io_uring)
+    }
+
+    if (client->aboveHigh && (client->outputSize <= mLowWatermark))
+    {
+        client->aboveHigh = false;
+        ConnPtr handle = client;
+        client->events->post([this, handle]() {
+            mEventHandler.LowWatermark(handle);
+        });
+    }
+}
+/*****************************************************************************/
+void TcpServer::WatchWritable(Client &client, bool enable)
+{
+    if (client.ring != nullptr)
+    {
+        if (enable)
+        {
+            UringWatchWritable(client);
+        }
+        client.waitWritable = enable;
+        return;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = enable ? (EPOLLIN | EPOLLOUT | EPOLLET) : (EPOLLIN | EPOLLET);
+    ev.data.ptr = &client;
+    if (epoll_ctl(client.epollFd, EPOLL_CTL_MOD, client.peer.socket, &ev) == -1)
+    {
+        perror("Cannot modify socket in epoll");
+    }
+    client.waitWritable = enable;
+}
+/*****************************************************************************/
+void TcpServer::RemoveClient(Reactor &reactor, Conn &conn)
+{
+    if (conn.state != Conn::cStateDeleteLater)
+    {
+        conn.state = Conn::cStateDeleteLater;
+        reactor.closing.push_back(conn.peer.socket);
     }
+}
+/*****************************************************************************/
+/**
+ * @brief Earliest date at which the connection expires
+ *
+ * Without any running deadline (only the write timeout is used and nothing
+ * is queued), the date of the next check.
+ */
+std::int64_t TcpServer::NextDeadline(Client &client, std::int64_t now)
+{
+    std::int64_t deadline = std::numeric_limits<std::int64_t>::max();
+    std::lock_guard<std::mutex> lock(client.outputMutex);
 
+    if (mIdleTimeout > 0U)
+    {
+        deadline = std::min(deadline, std::max(client.lastRead, client.lastSend) + mIdleTimeout);
+    }
+    if (mReadTimeout > 0U)
+    {
+        deadline = std::min(deadline, client.lastRead + mReadTimeout);
+    }
+    if (mWriteTimeout > 0U)
+    {
+        deadline = std::min(deadline, (client.outputSize > 0U) ? (client.lastSend + mWriteTimeout) : (now + mWriteTimeout));
+    }
+    return deadline;
 }
+/*****************************************************************************/
+/**
+ * @brief Close the connections whose deadline has expired, reschedule the others
+ *
+ * The activity only updates dates in the connection, the timer is moved
+ * when it expires.
+ */
+void TcpServer::CheckDeadlines(Reactor &reactor)
+{
+    if (reactor.timers.Size() == 0U)
+    {
+        return;
+    }
+
+    std::int64_t now = TimerWheel::Now();
+    reactor.expired.clear();
+    reactor.timers.Expire(now, reactor.expired);
+
+    for (const auto &e : reactor.expired)
+    {
+        if ((static_cast<std::size_t>(e.fd) >= reactor.clients.size()) || !reactor.clients[e.fd])
+        {
+            continue;
+        }
+
+        Client &client = *reactor.clients[e.fd];
+        if ((client.serial != e.serial) || (client.state == Conn::cStateDeleteLater))
+        {
+            continue; // timer of a previous connection on the same descriptor
+        }
 
+        std::int64_t deadline = NextDeadline(client, now);
+        if (deadline <= now)
+        {
+            TLogNetwork("[TCP] Connection timeout");
+            client.closeReason = IEvent::TIMEOUT;
+            RemoveClient(reactor, client);
+        }
+        else
+        {
+            reactor.timers.Schedule(e.fd, e.serial, deadline);
+        }
+    }
+}
+/*****************************************************************************/
+void TcpServer::UpdateClients(Reactor &reactor)
+{
+    /*************************************************/
+    /* Close the connections marked during this      */
+    /* round, a descriptor may appear twice in the   */
+    /* list: its entry is empty the second time      */
+    /*************************************************/
+    for (auto fd : reactor.closing)
+    {
+        if (!reactor.clients[fd])
+        {
+            continue;
+        }
+
+        std::shared_ptr<Client> conn = std::move(reactor.clients[fd]);
+
+        // Signal the disconnection
+        // In case of the websocket, only warn upper layers if the handshake process has been done
+        if (conn->IsConnected())
+        {
+            IEvent::CloseType reason = conn->closeReason;
+            conn->events->post([this, conn, reason]() {
+                mEventHandler.ConnectionClosed(conn, reason);
+            });
+        }
+
+        // No more writes from the handlers, the descriptor can be reused as soon as it is closed
+        std::lock_guard<std::mutex> lock(conn->outputMutex);
+        conn->closed = true;
+        conn->output.clear();
+        conn->outputSize = 0U;
+
+        if (reactor.ring)
+        {
+            // Completes the pending io_uring operations, that hold a reference on the socket
+            ::shutdown(fd, SHUT_RDWR);
+        }
+        else if (epoll_ctl(reactor.epollFd, EPOLL_CTL_DEL, fd, nullptr) == -1)
+        {
+            // Remove the socket from epoll
+            perror("Cannot remove socket from epoll");
+        }
+
+        // Finally close it, the handlers may still hold the connection: its descriptor value is kept
+        Peer peer = conn->peer;
+        TcpSocket::Close(peer);
+    }
+    reactor.closing.clear();
+}
 
 } // namespace tcp
 
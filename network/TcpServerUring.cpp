@@ -0,0 +1,572 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#include "TcpServer.h"
+#include "Log.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// Raw system calls, without liburing; the kernel must support the extended wait arguments (5.11)
+#if defined(IORING_FEAT_EXT_ARG) && defined(__NR_io_uring_setup)
+#define ICL_IO_URING
+#endif
+
+namespace tcp
+{
+
+#ifdef ICL_IO_URING
+
+namespace
+{
+
+const unsigned cEntries = 4096U;                // submission queue size
+const unsigned cBufferCount = 512U;             // receive buffers given to the kernel, per reactor
+const unsigned cBufferSize = TcpSocket::MAXRECV;
+const unsigned cAcceptBatch = 16U;              // accepts kept pending on each listening socket
+const std::int64_t cAcceptBackoff = 100;        // ms before accepting again when out of file descriptors
+const std::uint16_t cBufferGroup = 0U;
+
+// The user data of an operation: type, generation of the connection (to detect a reused descriptor), descriptor
+enum Operation : std::uint64_t
+{
+    OP_STOP = 1U,
+    OP_ACCEPT_TCP,
+    OP_ACCEPT_WS,
+    OP_RECV,
+    OP_POLLOUT,
+    OP_PROVIDE
+};
+
+inline std::uint64_t Tag(Operation op, std::uint64_t serial, int fd)
+{
+    return (static_cast<std::uint64_t>(op) << 56U) | ((serial & 0xFFFFFFU) << 32U) | static_cast<std::uint32_t>(fd);
+}
+
+inline Operation TagOperation(std::uint64_t tag) { return static_cast<Operation>(tag >> 56U); }
+inline std::uint64_t TagGeneration(std::uint64_t tag) { return (tag >> 32U) & 0xFFFFFFU; }
+inline int TagDescriptor(std::uint64_t tag) { return static_cast<int>(tag & 0xFFFFFFFFU); }
+
+int SysSetup(unsigned entries, struct io_uring_params *p)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int SysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, std::size_t argSize)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+int SysRegister(int fd, unsigned opcode, void *arg, unsigned count)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+} // namespace
+
+/*****************************************************************************/
+/**
+ * @brief One io_uring instance, with the receive buffers provided to the kernel
+ *
+ * The completions are read by the reactor thread only. The submissions come
+ * from the reactor thread, and from the threads that queue output (write
+ * notifications), hence the mutex; the reactor submits its operations in one
+ * system call per loop, the other threads immediately.
+ */
+struct TcpServer::Uring
+{
+    Uring() = default;
+    Uring(const Uring &) = delete;
+    Uring &operator=(const Uring &) = delete;
+
+    ~Uring()
+    {
+        if (sqes != MAP_FAILED)
+        {
+            munmap(sqes, sqesSize);
+        }
+        if (ring != MAP_FAILED)
+        {
+            munmap(ring, ringSize);
+        }
+        if (fd >= 0)
+        {
+            ::close(fd); // cancels the pending operations
+        }
+    }
+
+    bool Init(unsigned entries)
+    {
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+
+        fd = SysSetup(entries, &p);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_FAST_POLL | IORING_FEAT_EXT_ARG;
+        if ((p.features & required) != required)
+        {
+            return false;
+        }
+
+        std::size_t sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        std::size_t cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        ringSize = std::max(sqSize, cqSize);
+        ring = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (ring == MAP_FAILED)
+        {
+            return false;
+        }
+
+        sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+        {
+            return false;
+        }
+
+        char *base = static_cast<char *>(ring);
+        sqHead = reinterpret_cast<unsigned *>(base + p.sq_off.head);
+        sqTail = reinterpret_cast<unsigned *>(base + p.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned *>(base + p.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(base + p.sq_off.array);
+        sqEntries = p.sq_entries;
+        tail = *sqTail;
+
+        cqHead = reinterpret_cast<unsigned *>(base + p.cq_off.head);
+        cqTail = reinterpret_cast<unsigned *>(base + p.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned *>(base + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<struct io_uring_cqe *>(base + p.cq_off.cqes);
+
+        return Supports({ IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_POLL_ADD, IORING_OP_PROVIDE_BUFFERS });
+    }
+
+    bool Supports(std::initializer_list<unsigned> ops)
+    {
+        std::vector<char> memory(sizeof(struct io_uring_probe) + 256U * sizeof(struct io_uring_probe_op), 0);
+        struct io_uring_probe *probe = reinterpret_cast<struct io_uring_probe *>(memory.data());
+
+        if (SysRegister(fd, IORING_REGISTER_PROBE, probe, 256U) < 0)
+        {
+            return false;
+        }
+        for (auto op : ops)
+        {
+            if ((op > probe->last_op) || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Next free submission entry, the submission mutex is held
+    struct io_uring_sqe *Sqe()
+    {
+        if ((tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE)) >= sqEntries)
+        {
+            Submit();
+            if ((tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE)) >= sqEntries)
+            {
+                TLogError("[TCP] io_uring submission queue full");
+                return nullptr;
+            }
+        }
+
+        unsigned index = tail & sqMask;
+        struct io_uring_sqe *sqe = &static_cast<struct io_uring_sqe *>(sqes)[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        tail++;
+        return sqe;
+    }
+
+    // Gives the prepared entries to the kernel, the submission mutex is held
+    void Submit()
+    {
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+        unsigned pending = tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        while (pending > 0U)
+        {
+            int ret = SysEnter(fd, pending, 0U, 0U, nullptr, 0U);
+            if ((ret < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            // EBUSY: completions to read first, the entries are submitted at the next call
+            break;
+        }
+    }
+
+    // Waits for at least one completion, or the timeout in ms (-1: infinite)
+    bool Wait(int timeout)
+    {
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        if (timeout >= 0)
+        {
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = static_cast<long long>(timeout % 1000) * 1000000LL;
+            arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+        }
+
+        int ret = SysEnter(fd, 0U, 1U, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        return (ret >= 0) || (errno == ETIME) || (errno == EINTR) || (errno == EBUSY);
+    }
+
+    void Prepare(Operation op, std::uint64_t tag, int target, std::uint32_t value = 0U)
+    {
+        std::lock_guard<std::mutex> lock(submitMutex);
+        struct io_uring_sqe *sqe = Sqe();
+        if (sqe == nullptr)
+        {
+            return;
+        }
+
+        sqe->user_data = tag;
+        switch (op)
+        {
+        case OP_STOP:
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = target;
+            sqe->poll32_events = POLLIN;
+            break;
+        case OP_ACCEPT_TCP:
+        case OP_ACCEPT_WS:
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = target;
+            sqe->accept_flags = SOCK_NONBLOCK; // direct sends from the handlers must never block
+            break;
+        case OP_RECV:
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = target;
+            sqe->len = cBufferSize;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = cBufferGroup;
+            break;
+        case OP_POLLOUT:
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = target;
+            sqe->poll32_events = POLLOUT;
+            break;
+        case OP_PROVIDE:
+            // value is the first buffer, target the number of buffers
+            sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+            sqe->fd = target;
+            sqe->addr = reinterpret_cast<std::uint64_t>(buffers.data() + static_cast<std::size_t>(value) * cBufferSize);
+            sqe->len = cBufferSize;
+            sqe->off = value;
+            sqe->buf_group = cBufferGroup;
+            break;
+        }
+
+        if (std::this_thread::get_id() != owner)
+        {
+            Submit(); // nobody else would do it before the next completion
+        }
+    }
+
+    void SubmitAll()
+    {
+        std::lock_guard<std::mutex> lock(submitMutex);
+        Submit();
+    }
+
+    int fd = -1;
+    std::thread::id owner; // the reactor thread
+    std::mutex submitMutex;
+    std::vector<char> buffers;
+
+    void *ring = MAP_FAILED;
+    std::size_t ringSize = 0U;
+    void *sqes = MAP_FAILED;
+    std::size_t sqesSize = 0U;
+
+    unsigned *sqHead = nullptr;
+    unsigned *sqTail = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned sqMask = 0U;
+    unsigned sqEntries = 0U;
+    unsigned tail = 0U; // prepared entries, published at the submission
+
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned cqMask = 0U;
+    struct io_uring_cqe *cqes = nullptr;
+};
+/*****************************************************************************/
+bool TcpServer::IsUringAvailable()
+{
+    // Refused by old kernels, or disabled (kernel.io_uring_disabled, seccomp)
+    Uring probe;
+    return probe.Init(4U);
+}
+/*****************************************************************************/
+bool TcpServer::SetupUring(Reactor &reactor)
+{
+    std::shared_ptr<Uring> ring = std::make_shared<Uring>();
+
+    if (!ring->Init(cEntries))
+    {
+        TLogError("[TCP] io_uring initialization failure: " + std::string(strerror(errno)));
+        return false;
+    }
+    ring->buffers.resize(static_cast<std::size_t>(cBufferCount) * cBufferSize);
+    reactor.ring = ring;
+
+    // Pipe to quit the thread, as with epoll
+    int pipefd[2];
+    if (pipe(pipefd) != 0)
+    {
+        TLogError("[TCP] Pipe creation error");
+        return false;
+    }
+    reactor.receiveFd = pipefd[0];
+    reactor.sendFd = pipefd[1];
+    fcntl(reactor.sendFd, F_SETFL, O_NONBLOCK);
+
+    return true;
+}
+/*****************************************************************************/
+void TcpServer::UringWatchWritable(Client &client)
+{
+    client.ring->Prepare(OP_POLLOUT, Tag(OP_POLLOUT, client.serial, client.peer.socket), client.peer.socket);
+}
+/*****************************************************************************/
+void TcpServer::RunUring(Reactor &reactor)
+{
+    Uring &ring = *reactor.ring;
+    bool end_server = false;
+    IEvent::CloseType reason = IEvent::CLOSED;
+    std::vector<std::uint64_t> suspended; // accepts stopped by the lack of file descriptors
+    std::int64_t resumeDate = 0;
+
+    ring.owner = std::this_thread::get_id();
+
+    ring.Prepare(OP_PROVIDE, Tag(OP_PROVIDE, 0U, 0), static_cast<int>(cBufferCount), 0U);
+    ring.Prepare(OP_STOP, Tag(OP_STOP, 0U, reactor.receiveFd), reactor.receiveFd);
+
+    // Several accepts pending on each listening socket: the connection bursts are accepted in batches
+    TcpServerBase *listeners[2] = { reactor.tcpListener, reactor.wsListener };
+    for (std::uint32_t i = 0U; i < 2U; i++)
+    {
+        if (listeners[i]->IsValid())
+        {
+            Operation op = (i == 0U) ? OP_ACCEPT_TCP : OP_ACCEPT_WS;
+            for (unsigned j = 0U; j < cAcceptBatch; j++)
+            {
+                ring.Prepare(op, Tag(op, 0U, listeners[i]->GetSocket()), listeners[i]->GetSocket());
+            }
+        }
+    }
+    ring.SubmitAll();
+
+    do
+    {
+        // Wake up for the next connection deadline, if any, or to resume the accepts
+        std::int64_t now = TimerWheel::Now();
+        int timeout = reactor.timers.NextTimeout(now);
+        if (!suspended.empty())
+        {
+            int delay = static_cast<int>(std::max<std::int64_t>(resumeDate - now, 0));
+            timeout = (timeout < 0) ? delay : std::min(timeout, delay);
+        }
+
+        if (!ring.Wait(timeout))
+        {
+            if (!TcpSocket::AnalyzeSocketError("io_uring_enter"))
+            {
+                end_server = true;
+                reason = IEvent::WAIT_SOCK_FAILED;
+            }
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(reactor.mutex);
+
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            const struct io_uring_cqe &cqe = ring.cqes[head & ring.cqMask];
+            std::uint64_t tag = cqe.user_data;
+            std::int32_t res = cqe.res;
+            std::uint32_t flags = cqe.flags;
+            int fd = TagDescriptor(tag);
+
+            // The connection of the operation, if still the same
+            std::shared_ptr<Client> client;
+            if ((fd >= 0) && (static_cast<std::size_t>(fd) < reactor.clients.size()) && reactor.clients[fd] &&
+                ((reactor.clients[fd]->serial & 0xFFFFFFU) == TagGeneration(tag)))
+            {
+                client = reactor.clients[fd];
+            }
+
+            switch (TagOperation(tag))
+            {
+            case OP_STOP:
+                end_server = true;
+                break;
+            case OP_ACCEPT_TCP:
+            case OP_ACCEPT_WS:
+            {
+                bool webSocket = (TagOperation(tag) == OP_ACCEPT_WS);
+                if (res >= 0)
+                {
+                    std::shared_ptr<Client> conn = AddClient(reactor, res, webSocket);
+                    ring.Prepare(OP_RECV, Tag(OP_RECV, conn->serial, res), res);
+
+                    if (!webSocket)
+                    {
+                        // Signal a new client only if not a web socket (need a handshake before considering it is connected)
+                        conn->events->post([this, conn]() {
+                            mEventHandler.NewConnection(conn);
+                        });
+                    }
+                }
+                else if ((res == -EBADF) || (res == -EINVAL) || (res == -ECANCELED))
+                {
+                    break; // listening socket closed
+                }
+                else if ((res == -EMFILE) || (res == -ENFILE))
+                {
+                    // Accepting again at once would fail the same way: wait for connections to be closed
+                    if (suspended.empty())
+                    {
+                        TLogError("[TCP] accept failure: " + std::string(strerror(-res)));
+                        resumeDate = TimerWheel::Now() + cAcceptBackoff;
+                    }
+                    suspended.push_back(tag);
+                    break;
+                }
+                else
+                {
+                    TLogError("[TCP] accept failure: " + std::string(strerror(-res)));
+                }
+                ring.Prepare(TagOperation(tag), tag, fd);
+                break;
+            }
+            case OP_RECV:
+            {
+                bool hasBuffer = (flags & IORING_CQE_F_BUFFER) != 0U;
+                std::uint32_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+
+                if (client && (client->state != Conn::cStateDeleteLater))
+                {
+                    if ((res > 0) && hasBuffer)
+                    {
+                        ReceiveData(client, ring.buffers.data() + static_cast<std::size_t>(bid) * cBufferSize, static_cast<std::size_t>(res));
+                        if (client->state == Conn::cStateDeleteLater)
+                        {
+                            reactor.closing.push_back(fd);
+                        }
+                        else
+                        {
+                            ring.Prepare(OP_RECV, tag, fd);
+                        }
+                    }
+                    else if ((res == -ENOBUFS) || (res == -EAGAIN) || (res == -EINTR))
+                    {
+                        ring.Prepare(OP_RECV, tag, fd); // all buffers in use, they are given back below
+                    }
+                    else
+                    {
+                        RemoveClient(reactor, *client); // closed by the peer, or error
+                    }
+                }
+
+                if (hasBuffer)
+                {
+                    ring.Prepare(OP_PROVIDE, Tag(OP_PROVIDE, 0U, 0), 1, bid);
+                }
+                break;
+            }
+            case OP_POLLOUT:
+                if (client && (client->state != Conn::cStateDeleteLater))
+                {
+                    {
+                        std::lock_guard<std::mutex> outputLock(client->outputMutex);
+                        client->waitWritable = false; // one-shot, Flush() asks again if needed
+                    }
+                    Flush(reactor, client);
+                }
+                break;
+            case OP_PROVIDE:
+                if (res < 0)
+                {
+                    TLogError("[TCP] io_uring buffers failure: " + std::string(strerror(-res)));
+                }
+                break;
+            }
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+
+        CheckDeadlines(reactor);
+        UpdateClients(reactor); // refresh status, manage proper closing if necessary
+
+        if (!suspended.empty() && (TimerWheel::Now() >= resumeDate))
+        {
+            for (auto t : suspended)
+            {
+                ring.Prepare(TagOperation(t), t, TagDescriptor(t));
+            }
+            suspended.clear();
+        }
+        ring.SubmitAll();
+    }
+    while (end_server == false);
+
+    Terminate(reactor, reason);
+}
+
+#else // ICL_IO_URING
+
+struct TcpServer::Uring
+{
+};
+/*****************************************************************************/
+bool TcpServer::IsUringAvailable()
+{
+    return false;
+}
+/*****************************************************************************/
+bool TcpServer::SetupUring(Reactor &reactor)
+{
+    (void) reactor;
+    return false;
+}
+/*****************************************************************************/
+void TcpServer::UringWatchWritable(Client &client)
+{
+    (void) client;
+}
+/*****************************************************************************/
+void TcpServer::RunUring(Reactor &reactor)
+{
+    (void) reactor;
+}
+
+#endif // ICL_IO_URING
+
+} // namespace tcp
+
+//=============================================================================
+// End of file TcpServerUring.cpp
+//=============================================================================
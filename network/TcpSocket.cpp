@@ -10,6 +10,7 @@
 #include <errno.h>  // errno, just like it says.
 #include <fcntl.h>  // symbolic names for socket flags.
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <sstream>
@@ -287,6 +288,13 @@ bool TcpSocket::Write(const std::string &input, const Peer &peer, uint32_t &writ
     return ret;
 }
 /*****************************************************************************/
+bool TcpSocket::Write(const std::string &input, const Peer &peer)
+{
+    uint32_t written;
+    bool success = Write(input, peer, written);
+    return success && (input.size() == written);
+}
+/*****************************************************************************/
 bool TcpSocket::ProceedWsHandshake()
 {
     bool success = false;
@@ -308,6 +316,11 @@ bool TcpSocket::ProceedWsHandshake()
     return success;
 }
 /*****************************************************************************/
+void TcpSocket::AppendData(const char *data, std::size_t size)
+{
+    mBuff.append(data, size);
+}
+/*****************************************************************************/
 bool TcpSocket::Recv(size_t max)
 {
     return Recv(mBuff, mPeer, max);
@@ -348,8 +361,11 @@ bool TcpSocket::Recv(std::string &output, const Peer &peer, size_t max)
         long n;
         do
         {
-            char buff[MAXRECV];
-            n = ::recv(peer.socket, &buff[0], count, 0);
+            // Straight into our protocol buffer, sized with the pending data
+            std::size_t offset = output.size();
+            output.resize(offset + count);
+            n = ::recv(peer.socket, &output[offset], count, 0);
+            output.resize(offset + static_cast<std::size_t>(std::max(n, 0L)));
 
             if (n < 0)
             {
@@ -358,7 +374,6 @@ bool TcpSocket::Recv(std::string &output, const Peer &peer, size_t max)
             }
             else if (n > 0)
             {
-                output.insert(output.size(), &buff[0], static_cast<size_t>(n)); // append data into our procol buffer
                 count -= n;
                 ret = true;
             }
@@ -771,13 +786,27 @@ bool TcpSocket::DecodeWsData(Conn &conn)
 /*****************************************************************************/
 TcpSocket::WS_RESULT TcpSocket::DecodeWsData(std::string &buf, std::string &payload)
 {
-    // Return true if data reception is complete
-    WS_RESULT res = WS_CLOSE;
+    std::size_t consumed;
+    WS_RESULT res = DecodeWsFrame(buf.data(), buf.size(), payload, consumed);
 
-    // Having buf unsigned char * is important, as it is used below in arithmetic
-    uint64_t i, len, mask_len = 0, header_len = 0, data_len = 0;
+    // One frame per call: the rest of an incomplete frame is not kept
+    return (res == WS_INCOMPLETE) ? WS_PARTIAL : res;
+}
+/*****************************************************************************/
+/**
+ * @brief Decode the WebSocket frame at the beginning of data
+ *
+ * The data is a view on the receive buffer, it is not modified: the payload is
+ * unmasked while it is appended to the message.
+ *
+ * @param consumed size of the frame in data, 0 if the frame is incomplete (WS_INCOMPLETE)
+ */
+TcpSocket::WS_RESULT TcpSocket::DecodeWsFrame(const char *data, std::size_t size, std::string &payload, std::size_t &consumed)
+{
+    std::uint64_t len, mask_len = 0, header_len = 0, data_len = 0;
+    const std::uint8_t *buf = reinterpret_cast<const std::uint8_t *>(data);
 
-    std::uint32_t buf_len = static_cast<std::uint32_t>(buf.size());
+    consumed = 0U;
 
     /* Extracted from the RFC 6455 Chapter 5-2
      *
@@ -794,42 +823,46 @@ TcpSocket::WS_RESULT TcpSocket::DecodeWsData(std::string &buf, std::string &payl
     "Application data".  The length of the "Extension data" may be
     zero, in which case the payload length is the length of the
     "Application data". */
-    if (buf_len >= 2)
+    if (size < 2U)
     {
-        len = buf[1] & 127;
-        mask_len = buf[1] & 128 ? 4 : 0;
-        if (len < 126 && buf_len >= mask_len)
-        {
-            data_len = len;
-            header_len = 2 + mask_len;
-        }
-        else if (len == 126 && buf_len >= 4 + mask_len)
+        return WS_INCOMPLETE;
+    }
+
+    len = buf[1] & 127U;
+    mask_len = (buf[1] & 128U) ? 4U : 0U;
+    if (len < 126U)
+    {
+        header_len = 2U + mask_len;
+        data_len = len;
+    }
+    else if (len == 126U)
+    {
+        header_len = 4U + mask_len;
+        if (size >= header_len)
         {
-            header_len = 4 + mask_len;
-            uint8_t byte1 = static_cast<uint8_t>(buf[2]);
-            uint8_t byte2 = static_cast<uint8_t>(buf[3]);
-            data_len = (static_cast<uint64_t>(byte1) << 8) + byte2;
+            data_len = (static_cast<std::uint64_t>(buf[2]) << 8U) + buf[3];
         }
-        else if (buf_len >= 10 + mask_len)
+    }
+    else
+    {
+        header_len = 10U + mask_len;
+        if (size >= header_len)
         {
-            header_len = 10 + mask_len;
-            data_len = (uint64_t) (((uint64_t) htonl(* (uint32_t *) &buf[2])) << 32) + htonl(* (uint32_t *) &buf[6]);
+            for (std::uint32_t i = 0U; i < 8U; i++)
+            {
+                data_len = (data_len << 8U) + buf[2U + i];
+            }
         }
     }
 
-    // frame_len = header_len + data_len;
-    // Apply mask if necessary
-    char *mask_ptr = (&buf[0] + header_len) - mask_len; // pointer to the mask located in the header
-    if (mask_len > 0)
+    if ((size < header_len) || ((size - header_len) < data_len))
     {
-        for (i = 0; i < data_len; i++)
-        {
-            buf[i + header_len] ^= mask_ptr[i % 4];
-        }
+        return WS_INCOMPLETE;
     }
+    consumed = static_cast<std::size_t>(header_len + data_len);
 
-    std::uint8_t opcode = static_cast<uint8_t>(buf[0]) & 0xFU;
-    bool FIN = (static_cast<uint8_t>(buf[0]) & 0x80U) == 0x80U;
+    std::uint8_t opcode = buf[0] & 0xFU;
+    bool FIN = (buf[0] & 0x80U) == 0x80U;
 //    TLogNetwork("received opcode: " + WsOpcodeToString(opcode));
 
     /*
@@ -842,36 +875,52 @@ TcpSocket::WS_RESULT TcpSocket::DecodeWsData(std::string &buf, std::string &payl
       that is set.
 
       */
-    if(opcode == TcpSocket::WEBSOCKET_OPCODE_PING)
+    WS_RESULT res;
+    if (opcode == TcpSocket::WEBSOCKET_OPCODE_PING)
     {
         res = WS_SEND_PONG;
-
     }
     else if (opcode == TcpSocket::WEBSOCKET_OPCODE_CONNECTION_CLOSE)
     {
         res = WS_CLOSE;
     }
+    else if (opcode == TcpSocket::WEBSOCKET_OPCODE_PONG)
+    {
+        res = WS_PARTIAL; // nothing to deliver
+    }
     else
     {
         if ((opcode == TcpSocket::WEBSOCKET_OPCODE_TEXT) ||
             (opcode == TcpSocket::WEBSOCKET_OPCODE_BINARY))
         {
-            payload = buf.substr(header_len, data_len);
-        }
-        else if(opcode == TcpSocket::WEBSOCKET_OPCODE_CONTINUATION)
-        {
-            payload += buf.substr(header_len, data_len);
+            payload.clear(); // new message
         }
 
-        if (FIN)
-        {
-            // We can deliver data to the consumer
-            res = WS_DATA;
-        }
-        else
+        if ((opcode == TcpSocket::WEBSOCKET_OPCODE_TEXT) ||
+            (opcode == TcpSocket::WEBSOCKET_OPCODE_BINARY) ||
+            (opcode == TcpSocket::WEBSOCKET_OPCODE_CONTINUATION))
         {
-            res = WS_PARTIAL;
+            // Apply mask if necessary, straight into the message
+            std::size_t offset = payload.size();
+            const std::uint8_t *mask = buf + header_len - mask_len;
+            const std::uint8_t *src = buf + header_len;
+            payload.resize(offset + static_cast<std::size_t>(data_len));
+            char *dst = &payload[offset];
+            if (mask_len > 0U)
+            {
+                for (std::uint64_t i = 0U; i < data_len; i++)
+                {
+                    dst[i] = static_cast<char>(src[i] ^ mask[i % 4U]);
+                }
+            }
+            else
+            {
+                memcpy(dst, src, static_cast<std::size_t>(data_len));
+            }
         }
+
+        // We can deliver data to the consumer when the message is complete
+        res = FIN ? WS_DATA : WS_PARTIAL;
     }
 
     return res;
@@ -879,7 +928,12 @@ TcpSocket::WS_RESULT TcpSocket::DecodeWsData(std::string &buf, std::string &payl
 /*****************************************************************************/
 void TcpSocket::DeliverData(Conn &conn)
 {
-    conn.payload = mBuff;
+    DeliverData(conn.payload);
+}
+/*****************************************************************************/
+void TcpSocket::DeliverData(std::string &output)
+{
+    output = std::move(mBuff);
     mBuff.clear();
 }
 /*****************************************************************************/
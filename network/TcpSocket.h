@@ -9,6 +9,8 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <memory>
+#include <atomic>
 
 #ifdef USE_LINUX_OS
 
@@ -119,6 +121,11 @@ struct Peer
 /*****************************************************************************/
 /**
  * @brief Connection state with the server, holds incoming data
+ *
+ * The server shares the connection objects with the event handlers through
+ * ConnPtr handles. The state can be read from any thread; the payload is the
+ * message being received and belongs to the server thread, a complete message
+ * is moved to the handler.
  */
 struct Conn
 {
@@ -146,8 +153,24 @@ struct Conn
 
     }
 
+    Conn(const Conn &other)
+        : peer(other.peer)
+        , state(other.state.load())
+        , payload(other.payload)
+    {
+
+    }
+
+    inline Conn & operator =(const Conn &rhs)
+    {
+        peer = rhs.peer;
+        state = rhs.state.load();
+        payload = rhs.payload;
+        return *this;
+    }
+
     bool IsClosed() const { return state == cStateClosed; }
-    bool IsConnected()
+    bool IsConnected() const
     {
         bool connected = false;
         if (peer.IsValid())
@@ -194,9 +217,15 @@ struct Conn
     }
 
     Peer peer;
-    std::uint8_t state;
+    std::atomic<std::uint8_t> state;
     std::string payload;
 };
+
+/**
+ * @brief Handle given to the event handlers, the connection object lives as
+ * long as a handle is kept
+ */
+typedef std::shared_ptr<const Conn> ConnPtr;
 /*****************************************************************************/
 class TcpSocket : public ISocket
 {
@@ -212,7 +241,7 @@ public:
     // Larger values will read larger chunks of data at one time (without fragmentation)
     static const std::int32_t MAXRECV = 16*1024;
 
-    enum WS_RESULT { WS_SEND_PONG, WS_PARTIAL, WS_DATA, WS_CLOSE };
+    enum WS_RESULT { WS_SEND_PONG, WS_PARTIAL, WS_DATA, WS_CLOSE, WS_INCOMPLETE };
 
     TcpSocket();
     TcpSocket(const Peer &peer);
@@ -246,6 +275,8 @@ public:
     bool ProceedWsHandshake();
     bool DecodeWsData(Conn &conn);
     void DeliverData(Conn &conn);
+    void DeliverData(std::string &output);
+    void AppendData(const char *data, std::size_t size); // received by other means than Recv()
     bool IsValid();
     bool DataWaiting(std::uint32_t timeout); // in ms
 
@@ -261,8 +292,10 @@ public:
     static void Close(Peer &peer);
     static std::string BuildWsFrame(std::uint8_t opcode, const std::string &data);
     static WS_RESULT DecodeWsData(std::string &buf, std::string &payload);
+    static WS_RESULT DecodeWsFrame(const char *data, std::size_t size, std::string &payload, std::size_t &consumed);
     static bool Recv(std::string &output, const Peer &peer, size_t max = 0);
     static bool Write(const std::string &input, const Peer &peer, uint32_t &written);
+    static bool Write(const std::string &input, const Peer &peer); // true if everything is written
     static bool Send(const std::string &input, const Peer &peer);
 
     //Convert a struct sockaddr address to a string, IPv4 and IPv6
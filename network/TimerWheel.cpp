@@ -0,0 +1,124 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#include "TimerWheel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace tcp
+{
+
+/*****************************************************************************/
+TimerWheel::TimerWheel(std::uint32_t slots, std::uint32_t tickMs)
+    : mSlots((slots > 0U) ? slots : 1U)
+    , mTickMs((tickMs > 0U) ? tickMs : 1U)
+    , mCurrent(0U)
+    , mEarliest(0U)
+    , mCount(0U)
+    , mStarted(false)
+{
+
+}
+/*****************************************************************************/
+std::int64_t TimerWheel::Now()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+/*****************************************************************************/
+std::uint64_t TimerWheel::TickOf(std::int64_t date) const
+{
+    return (date > 0) ? (static_cast<std::uint64_t>(date) / mTickMs) : 0U;
+}
+/*****************************************************************************/
+void TimerWheel::Schedule(int fd, std::uint64_t serial, std::int64_t deadline)
+{
+    if (!mStarted)
+    {
+        mCurrent = TickOf(Now());
+        mStarted = true;
+    }
+
+    // Rounded up: a timer never fires before its deadline
+    std::uint64_t tick = TickOf(deadline);
+    if ((deadline > 0) && ((static_cast<std::uint64_t>(deadline) % mTickMs) != 0U))
+    {
+        tick++;
+    }
+    tick = std::max(tick, mCurrent);
+    mEarliest = (mCount == 0U) ? tick : std::min(mEarliest, tick);
+
+    mSlots[tick % mSlots.size()].push_back({ fd, serial, tick });
+    mCount++;
+}
+/*****************************************************************************/
+void TimerWheel::Expire(std::int64_t now, std::vector<Entry> &expired)
+{
+    std::uint64_t nowTick = TickOf(now);
+
+    if ((mCount == 0U) || (nowTick < mCurrent))
+    {
+        mCurrent = std::max(mCurrent, nowTick);
+        return;
+    }
+
+    // After a long pause, one turn covers all the slots
+    std::uint64_t steps = std::min<std::uint64_t>(nowTick - mCurrent + 1U, mSlots.size());
+
+    for (std::uint64_t i = 0U; i < steps; i++)
+    {
+        std::vector<Entry> &slot = mSlots[(mCurrent + i) % mSlots.size()];
+
+        std::size_t j = 0U;
+        while (j < slot.size())
+        {
+            if (slot[j].tick <= nowTick)
+            {
+                expired.push_back(slot[j]);
+                slot[j] = slot.back();
+                slot.pop_back();
+                mCount--;
+            }
+            else
+            {
+                j++; // next turn
+            }
+        }
+    }
+    mCurrent = nowTick + 1U;
+
+    // The remaining timers are somewhere after now, unknown without a scan
+    mEarliest = std::max(mEarliest, mCurrent);
+}
+/*****************************************************************************/
+int TimerWheel::NextTimeout(std::int64_t now) const
+{
+    if (mCount == 0U)
+    {
+        return -1;
+    }
+
+    std::int64_t delay = static_cast<std::int64_t>(mEarliest * mTickMs) - now;
+    delay = std::max<std::int64_t>(delay, 0);
+    return static_cast<int>(std::min<std::int64_t>(delay, std::numeric_limits<int>::max()));
+}
+/*****************************************************************************/
+void TimerWheel::Clear()
+{
+    for (auto &slot : mSlots)
+    {
+        slot.clear();
+    }
+    mCount = 0U;
+    mStarted = false;
+}
+
+} // namespace tcp
+
+//=============================================================================
+// End of file TimerWheel.cpp
+//=============================================================================
@@ -0,0 +1,78 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstdint>
+#include <vector>
+
+namespace tcp
+{
+
+/*****************************************************************************/
+/**
+ * @brief Hashed timer wheel
+ *
+ * Deadlines are rounded up to the tick and stored in the slot (tick modulo
+ * number of slots): scheduling is O(1), expiring a tick only looks at one
+ * slot; a deadline more than one turn away stays in its slot for the next
+ * turns. The wheel keeps a lower bound of the earliest tick: exact until that
+ * tick has been expired, then the next tick while timers remain, so the wait
+ * delay is O(1) whatever the number of timers, and the owner wakes up at each
+ * tick once the first timer has expired. There is no cancellation: the owner
+ * identifies its timers with a serial number and ignores the expired entries
+ * that are not current anymore.
+ *
+ * Not thread safe, used by one reactor thread. Times are in milliseconds of
+ * the steady clock (see Now()).
+ */
+class TimerWheel
+{
+public:
+    struct Entry
+    {
+        int fd;
+        std::uint64_t serial;
+        std::uint64_t tick;
+    };
+
+    TimerWheel(std::uint32_t slots = 1024U, std::uint32_t tickMs = 50U);
+
+    static std::int64_t Now();
+
+    void Schedule(int fd, std::uint64_t serial, std::int64_t deadline);
+
+    /**
+     * @brief Move the timers that have expired at the date now into expired
+     */
+    void Expire(std::int64_t now, std::vector<Entry> &expired);
+
+    /**
+     * @brief Delay until the next timer, suitable for epoll_wait() (-1: no timer)
+     */
+    int NextTimeout(std::int64_t now) const;
+
+    void Clear();
+    std::size_t Size() const { return mCount; }
+
+private:
+    std::vector<std::vector<Entry>> mSlots;
+    std::uint64_t mTickMs;
+    std::uint64_t mCurrent; // next tick to expire
+    std::uint64_t mEarliest; // no timer before this tick
+    std::size_t mCount;
+    bool mStarted;
+
+    std::uint64_t TickOf(std::int64_t date) const;
+};
+
+} // namespace tcp
+
+#endif // TIMER_WHEEL_H
+
+//=============================================================================
+// End of file TimerWheel.h
+//=============================================================================
@@ -19,8 +19,9 @@
 #include <sys/sendfile.h>
 #endif
 
-HttpFileServer::HttpFileServer(const std::string &rootDir)
+HttpFileServer::HttpFileServer(const std::string &rootDir, const SendFunction &send)
     : mRootDir(rootDir)
+    , mSend(send)
 {
     mSessionSecret = Util::GenerateRandomString(60);
     TLogInfo("[HTTP] Current session secret key: " + mSessionSecret);
@@ -31,16 +32,22 @@ HttpFileServer::~HttpFileServer()
 
 }
 
-tcp::TcpServer::IEvent::~IEvent(){
-
-}
-
 void HttpFileServer::SetLocalhostOnly(bool enable)
 {
     mLocalHostOnly = enable;
 }
 
-void HttpFileServer::NewConnection(const tcp::Conn &conn) {
+bool HttpFileServer::Send(const tcp::ConnPtr &conn, const std::string &data)
+{
+    bool success = mSend(conn, data);
+    if (!success)
+    {
+        TLogWarning("[HTTP] Response dropped, connection closed or output queue full");
+    }
+    return success;
+}
+
+void HttpFileServer::NewConnection(const tcp::ConnPtr &conn) {
     (void) conn;
 }
 
@@ -150,8 +157,9 @@ bool HttpFileServer::CheckJWT(const std::string &header, const std::string &payl
     return success;
 }
 
-void HttpFileServer::DeletePartialConn(const tcp::Conn &conn)
+void HttpFileServer::DeletePartialConn(const tcp::ConnPtr &conn)
 {
+    std::lock_guard<std::mutex> lock(mPartialsMutex);
     int index = -1;
 
     for (uint32_t i = 0; i < mPartials.size(); i++)
@@ -173,7 +181,7 @@ static const std::string cSupportedMethods[] = { "GET", "POST" };
 
 
 
-bool HttpFileServer::GetFile(const tcp::Conn &conn, HttpRequest &request)
+bool HttpFileServer::GetFile(const tcp::ConnPtr &conn, HttpRequest &request)
 {
     bool success = false;
     std::string resource = request.query;
@@ -239,9 +247,10 @@ bool HttpFileServer::GetFile(const tcp::Conn &conn, HttpRequest &request)
             {
                  ss << "Content-length: " << compressed_size << "\r\n";
                  ss << "Content-Encoding: deflate\r\n\r\n";
+                 ss.write(output.data(), compressed_size);
 
-                 tcp::TcpSocket::Write(ss.str(), conn.peer);
-                 tcp::TcpSocket::Write(std::string(output.data(), compressed_size), conn.peer);
+                 // One message: the header is never sent without its body
+                 (void) Send(conn, ss.str());
             }
             success = true;
 
@@ -268,7 +277,7 @@ bool HttpFileServer::GetFile(const tcp::Conn &conn, HttpRequest &request)
     return success;
 }
 
-void HttpFileServer::SendHttpJson(const tcp::Conn &conn, const std::string &data)
+bool HttpFileServer::SendHttpJson(const tcp::ConnPtr &conn, const std::string &data)
 {
     std::stringstream ss;
 
@@ -277,27 +286,27 @@ void HttpFileServer::SendHttpJson(const tcp::Conn &conn, const std::string &data
     ss << "Content-length: " << data.size() << "\r\n\r\n";
     ss << data;
 
-    tcp::TcpSocket::Write(ss.str(), conn.peer);
+    return Send(conn, ss.str());
 }
 
 
-void HttpFileServer::ReadData(const tcp::Conn &conn)
+void HttpFileServer::ReadData(const tcp::ConnPtr &conn, std::string &&payload)
 {
-    if (conn.payload.size() == 0)
+    if (payload.size() == 0)
     {
         return;
     }
 
-    if (conn.peer.isWebSocket)
+    if (conn->peer.isWebSocket)
     {
-        WsReadData(conn);
+        WsReadData(conn, std::move(payload));
         return;
     }
 
     HttpRequest request;
 
     bool process = true;
-    bool valid = HttpProtocol::ParseRequestHeader(conn.payload, request);
+    bool valid = HttpProtocol::ParseRequestHeader(payload, request);
 
     if (valid)
     {
@@ -321,6 +330,7 @@ void HttpFileServer::ReadData(const tcp::Conn &conn)
                     chunked.data.append(request.body);
                     chunked.current_size += request.body.length();
 
+                    std::lock_guard<std::mutex> lock(mPartialsMutex);
                     mPartials.push_back(chunked);
                     process = false; // wait for full data
                 }
@@ -331,27 +341,30 @@ void HttpFileServer::ReadData(const tcp::Conn &conn)
     {
         process = false;
         bool found = false;
-        for (auto & el: mPartials)
         {
-            if (el.conn == conn)
+            // The partial transfers of all the connections are in the same list
+            std::lock_guard<std::mutex> lock(mPartialsMutex);
+            for (auto & el: mPartials)
             {
-                found = true;
-                el.data.append(conn.payload);
-                el.current_size += conn.payload.length();
-                el.counter++;
+                if (el.conn == conn)
+                {
+                    found = true;
+                    el.data.append(payload);
+                    el.current_size += payload.length();
+                    el.counter++;
 
-                TLogNetwork("[HTTP] Chunked part: " + std::to_string(el.counter) + " remaining: " + std::to_string(el.total_size - el.current_size));
+                    TLogNetwork("[HTTP] Chunked part: " + std::to_string(el.counter) + " remaining: " + std::to_string(el.total_size - el.current_size));
 
-                if (el.current_size >= el.total_size)
-                {
-                    TLogNetwork("[HTTP] Chunked finished");
+                    if (el.current_size >= el.total_size)
+                    {
+                        TLogNetwork("[HTTP] Chunked finished");
 
-                    request = el.request;
-                    request.body = el.data; // finally, all data is here, replace buffer
+                        request = el.request;
+                        request.body = el.data; // finally, all data is here, replace buffer
 
-                    process = true;
-                    // Always remove pending chunked data
-                    DeletePartialConn(conn);
+                        process = true;
+                    }
+                    break;
                 }
             }
         }
@@ -360,6 +373,11 @@ void HttpFileServer::ReadData(const tcp::Conn &conn)
         {
             TLogNetwork("[HTTP] Chunked not found!");
         }
+        else if (process)
+        {
+            // Always remove pending chunked data
+            DeletePartialConn(conn);
+        }
     }
 
     if (mLocalHostOnly)
@@ -388,16 +406,16 @@ void HttpFileServer::ReadData(const tcp::Conn &conn)
     }
 }
 
-void HttpFileServer::Send403(const tcp::Conn &conn)
+bool HttpFileServer::Send403(const tcp::ConnPtr &conn)
 {
     std::stringstream ss;
 
     ss << "HTTP/1.1 403 Forbidden\r\n\r\n";
 
-    tcp::TcpSocket::Write(ss.str(), conn.peer);
+    return Send(conn, ss.str());
 }
 
-void HttpFileServer::Send404(const tcp::Conn &conn, const HttpRequest &header)
+bool HttpFileServer::Send404(const tcp::ConnPtr &conn, const HttpRequest &header)
 {
     std::stringstream ss;
     std::string html = R"({ "result": false, "message": "404 Not Found" })";
@@ -407,12 +425,12 @@ void HttpFileServer::Send404(const tcp::Conn &conn, const HttpRequest &header)
     ss << "Content-length: " << html.size() << "\r\n\r\n";
     ss << html << std::flush;
 
-    tcp::TcpSocket::Write(ss.str(), conn.peer);
-
     TLogWarning("Resource not found: " + header.query);
+
+    return Send(conn, ss.str());
 }
 
-void HttpFileServer::ClientClosed(const tcp::Conn &conn)
+void HttpFileServer::ClientClosed(const tcp::ConnPtr &conn)
 {
     DeletePartialConn(conn);
 }
@@ -422,13 +440,14 @@ void HttpFileServer::ServerTerminated(tcp::TcpServer::IEvent::CloseType type)
     (void) type;
 }
 
-void HttpFileServer::WsReadData(const tcp::Conn &conn)
+void HttpFileServer::WsReadData(const tcp::ConnPtr &conn, std::string &&payload)
 {
     (void) conn;
+    (void) payload;
     // do nothing in this default implementation
 }
 
-void HttpFileServer::ReadDataPath(const tcp::Conn &conn, const HttpRequest &request)
+void HttpFileServer::ReadDataPath(const tcp::ConnPtr &conn, const HttpRequest &request)
 {
     (void) conn;
     (void) request;
@@ -10,6 +10,8 @@
 #include <string>
 #include <regex>
 #include <sstream>
+#include <mutex>
+#include <functional>
 
 #include "TcpSocket.h"
 #include "TcpServer.h"
@@ -19,7 +21,7 @@
 struct ChunkedData
 {
     HttpRequest request;
-    tcp::Conn conn;
+    tcp::ConnPtr conn;
     std::string data;
     uint32_t current_size;
     uint32_t total_size;
@@ -35,38 +37,52 @@ struct ChunkedData
 
 };
 
+/**
+ * @brief Static files and REST API over HTTP, as the event handler of a TcpServer
+ *
+ * The responses are written with the send function given at construction,
+ * normally TcpServer::Send() of the server that delivers the events: the
+ * accepted sockets are non-blocking, the server queues what the socket does
+ * not accept immediately.
+ */
 class HttpFileServer : public tcp::TcpServer::IEvent
 {
 
 public:
-    HttpFileServer(const std::string &rootDir);
+    // Same contract as TcpServer::Send(): false if the connection is closed or the message dropped
+    using SendFunction = std::function<bool (const tcp::ConnPtr &conn, const std::string &data)>;
+
+    HttpFileServer(const std::string &rootDir, const SendFunction &send);
     ~HttpFileServer();
 
-    virtual void NewConnection(const tcp::Conn &conn);
-    virtual void ReadData(const tcp::Conn &conn);
-    virtual void ClientClosed(const tcp::Conn &conn);
+    virtual void NewConnection(const tcp::ConnPtr &conn);
+    virtual void ReadData(const tcp::ConnPtr &conn, std::string &&payload);
+    virtual void ClientClosed(const tcp::ConnPtr &conn);
     virtual void ServerTerminated(tcp::TcpServer::IEvent::CloseType type);
 
-    virtual void WsReadData(const tcp::Conn &conn);
-    virtual void ReadDataPath(const tcp::Conn &conn, const HttpRequest &header);
+    virtual void WsReadData(const tcp::ConnPtr &conn, std::string &&payload);
+    virtual void ReadDataPath(const tcp::ConnPtr &conn, const HttpRequest &header);
 
     std::string Match(const std::string &msg, const std::string &patternString);
-    void Send404(const tcp::Conn &conn, const HttpRequest &header);
-    void Send403(const tcp::Conn &conn);
+    bool Send404(const tcp::ConnPtr &conn, const HttpRequest &header);
+    bool Send403(const tcp::ConnPtr &conn);
     void SetLocalhostOnly(bool enable);
-    void SendHttpJson(const tcp::Conn &conn, const std::string &data);
+    bool SendHttpJson(const tcp::ConnPtr &conn, const std::string &data);
     std::string GenerateJWT(const std::string &payload);
     bool CheckJWT(const std::string &header, const std::string &payload, const std::string &hash, JsonValue &json);
 
 private:
     std::string mRootDir;
+    SendFunction mSend;
     std::string mSessionSecret;
     bool mLocalHostOnly = false;
 
     std::vector<ChunkedData> mPartials;
+    std::mutex mPartialsMutex; // the events of different connections run in parallel
 
-    void DeletePartialConn(const tcp::Conn &conn);
-    bool GetFile(const tcp::Conn &conn, HttpRequest &request);
+    void DeletePartialConn(const tcp::ConnPtr &conn);
+    bool Send(const tcp::ConnPtr &conn, const std::string &data);
+    bool GetFile(const tcp::ConnPtr &conn, HttpRequest &request);
 };
 
 
@@ -2,11 +2,23 @@
 #include <QtTest>
 #include <QCoreApplication>
 #include <cstdint>
+#include <cmath>
+#include <optional>
+#include <thread>
+#include <atomic>
 
 #include "tst_json.h"
 #include "Util.h"
 #include "JsonReader.h"
 #include "JsonWriter.h"
+#include "JsonScan.h"
+#include "JsonStreamReader.h"
+#include "Cbor.h"
+#include "JsonPath.h"
+#include "JsonLines.h"
+#include "JsonBind.h"
+#include "JsonSnapshot.h"
+#include "JsonMergePatch.h"
 
 JsonTest::JsonTest()
 {
@@ -152,6 +164,939 @@ void JsonTest::GenerateFile()
 
 void JsonTest::ComplexFile()
 {
-    // FIXME: here test the JSON parser compatibility with some complex input and non-valid ones.
+    JsonValue json;
+
+    std::string path = Util::ExecutablePath() + "/../../tests/input/complex.json";
+
+    if (!JsonReader::ParseFile(json, path))
+    {
+        std::stringstream ss;
+        ss << "Cannot open file " << path;
+        QFAIL(ss.str().c_str());
+    }
+
+    QCOMPARE(json.FindValue("links:backward").IsArray(), true);
+    QCOMPARE(json.FindValue("links:forward").GetArray().Size(), 10U);
+    QCOMPARE(json.FindValue("links:int").GetInteger(), 2147483647);
+
+    // Escaped characters and unicode sequences (with a surrogate pair)
+    QCOMPARE(JsonReader::ParseString(json, R"({ "s": "a\"b\\c\u00e9\ud83d\ude00" })"), true);
+    QCOMPARE(json.FindValue("s").GetString(), std::string("a\"b\\c\xC3\xA9\xF0\x9F\x98\x80"));
+
+    // The source buffer does not need to be null terminated
+    std::string_view partial("[1, 2, 3]]]]", 9U);
+    QCOMPARE(JsonReader::ParseString(json, partial), true);
+    QCOMPARE(json.GetArray().Size(), 3U);
+
+    // Non-valid documents
+    const char *invalid[] = { "", "{", "[1, 2", "{\"a\" 1}", "{\"a\": 1,}", "[1,]", "[}", "{]",
+                              "{\"a\": tru}", "[-]", "[\"abc", "{\"a\": 1} x", "{a: 1}" };
+
+    for (const char *doc : invalid)
+    {
+        if (JsonReader::ParseString(json, doc))
+        {
+            std::stringstream ss;
+            ss << "Document must be rejected: " << doc;
+            QFAIL(ss.str().c_str());
+        }
+    }
+}
+
+
+void JsonTest::ArenaDocument()
+{
+    JsonValue copy;
+
+    {
+        JsonArena arena;
+        JsonValue json(arena.GetAllocator());
+
+        QCOMPARE(JsonReader::ParseString(json, R"({ "name": "a rather long string value", "list": [1, 2.5, true, null] })"), true);
+        const JsonValue &doc = json;
+        QCOMPARE(doc.GetArray().Size(), 0U); // const access: the value is left untouched
+        QCOMPARE(doc.IsObject(), true);
+
+        // Values added to the document are created in the arena
+        json.GetObj().AddValue("added", JsonValue(std::string("another rather long string value")));
+        copy = json; // the copy lives on the heap
+    } // the whole tree is freed here
+
+    QCOMPARE(copy.FindValue("name").GetString(), std::string("a rather long string value"));
+    QCOMPARE(copy.FindValue("added").GetString(), std::string("another rather long string value"));
+    QCOMPARE(copy.FindValue("list").GetArray().Size(), 4U);
+}
+/*****************************************************************************/
+void JsonTest::MoveAndFind()
+{
+    JsonValue json;
+    QCOMPARE(JsonReader::ParseString(json, R"({ "users": [ { "name": "bob", "age": 42 }, { "name": "alice" } ] })"), true);
+
+    // Pointer access, no copy
+    const JsonValue *age = json.Find("users:0:age");
+    QVERIFY(age != nullptr);
+    QCOMPARE(age->GetInteger(), 42);
+    QCOMPARE(json.Find("users:1:name")->GetStringView(), std::string_view("alice"));
+    QVERIFY(json.Find("users:2") == nullptr);
+    QVERIFY(json.Find("users:0:missing") == nullptr);
+    QCOMPARE(json.FindValue("users:0:missing").IsValid(), false);
+
+    // From an array, the first segment is an index
+    const JsonArray &users = json.Find("users")->GetArray();
+    QCOMPARE(users.Find("1:name")->GetString(), std::string("alice"));
+    QVERIFY(users.Find("name") == nullptr);
+    QVERIFY(users.Find("99999999999:name") == nullptr);
+
+    // In place modification through the pointer
+    *json.Find("users:0:age") = JsonValue(43);
+    QCOMPARE(json.FindValue("users:0:age").GetInteger(), 43);
+
+    // Build a document by moving sub-trees
+    JsonArray list;
+    list.AddValue(JsonValue(std::string("one")));
+    list.AddValue(JsonValue(std::string("two")));
+
+    JsonObject obj;
+    obj.AddValue("list", JsonValue(std::move(list)));
+    QCOMPARE(obj.Find("list:1")->GetString(), std::string("two"));
+
+    JsonValue moved(std::move(obj));
+    QCOMPARE(moved.IsObject(), true);
+    QCOMPARE(moved.GetObj().GetSize(), 1U);
+    QCOMPARE(moved.ReplaceValue("list:0", JsonValue(std::string("zero"))), true);
+    QCOMPARE(moved.FindValue("list:0").GetString(), std::string("zero"));
+}
+/*****************************************************************************/
+void JsonTest::CompiledPaths()
+{
+    JsonValue json;
+    QCOMPARE(JsonReader::ParseString(json, R"({ "device": { "id": "d1", "sensors": [ { "temp": 21 }, { "hum": 40 } ] }, "10": true })"), true);
+
+    const JsonPath temp("device:sensors:0:temp");
+    QCOMPARE(temp.Size(), std::size_t(4U));
+    QCOMPARE(temp[2].isIndex, true);
+    QCOMPARE(temp.ToString(), std::string("device:sensors:0:temp"));
+    QCOMPARE(json.Find(temp)->GetInteger(), 21);
+
+    // Key of the first object entry in an array, numeric key in an object
+    QCOMPARE(json.Find(JsonPath("device:sensors:hum"))->GetInteger(), 40);
+    QCOMPARE(json.Find(JsonPath("10"))->GetBool(), true);
+    QVERIFY(json.Find(JsonPath("device:sensors:5")) == nullptr);
+    QVERIFY(json.Find(JsonPath("device:sensors:99999999999")) == nullptr);
+    QVERIFY(json.Find(JsonPath()) == &json);
+
+    // Same path, starting from an object or an array
+    QCOMPARE(json.GetObj().Find(JsonPath("device:id"))->GetString(), std::string("d1"));
+    const JsonArray &sensors = json.Find(JsonPath("device:sensors"))->GetArray();
+    QCOMPARE(sensors.Find(JsonPath("1:hum"))->GetInteger(), 40);
+    QVERIFY(sensors.Find(JsonPath("hum")) == nullptr);
+
+    QCOMPARE(json.ReplaceValue(temp, JsonValue(22)), true);
+    QCOMPARE(json.FindValue("device:sensors:0:temp").GetInteger(), 22);
+
+    // Batch extraction, shared prefixes and duplicates
+    JsonQuery query;
+    std::size_t id = query.Add("device:id");
+    std::size_t t = query.Add(temp);
+    std::size_t missing = query.Add("device:missing");
+    std::size_t hum = query.Add("device:sensors:1:hum");
+    std::size_t again = query.Add("device:id");
+    QCOMPARE(query.Size(), std::size_t(5U));
+
+    std::vector<const JsonValue *> values;
+    QCOMPARE(query.Extract(json, values), std::size_t(4U));
+    QCOMPARE(values.size(), std::size_t(5U));
+    QCOMPARE(values[id]->GetString(), std::string("d1"));
+    QCOMPARE(values[t]->GetInteger(), 22);
+    QVERIFY(values[missing] == nullptr);
+    QCOMPARE(values[hum]->GetInteger(), 40);
+    QVERIFY(values[again] == values[id]);
+}
+/*****************************************************************************/
+void JsonTest::Numbers()
+{
+    JsonValue json;
+    QCOMPARE(JsonReader::ParseString(json, R"([0, -0, 9223372036854775807, -9223372036854775808, 9223372036854775808,
+        18446744073709551615, 18446744073709551616, -9223372036854775809, 0.1, 1e400, -2.5E-3, 1e-400])"), true);
+    const JsonArray &a = json.GetArray();
+
+    QCOMPARE(a.Find(0U)->IsInteger(), true);
+    QCOMPARE(a.Find(1U)->GetInteger64(), std::int64_t(0));
+    QCOMPARE(a.Find(2U)->GetInteger64(), INT64_MAX);
+    QCOMPARE(a.Find(3U)->GetInteger64(), INT64_MIN);
+    QCOMPARE(a.Find(4U)->IsUnsigned(), true);
+    QCOMPARE(a.Find(4U)->GetUnsigned64(), std::uint64_t(9223372036854775808ULL));
+    QCOMPARE(a.Find(5U)->GetUnsigned64(), UINT64_MAX);
+    QCOMPARE(a.Find(6U)->GetDouble(), 18446744073709551616.0);
+    QCOMPARE(a.Find(7U)->GetDouble(), -9223372036854775809.0);
+    QCOMPARE(a.Find(8U)->GetDouble(), 0.1);
+    QCOMPARE(std::isinf(a.Find(9U)->GetDouble()), true);
+    QCOMPARE(a.Find(10U)->GetDouble(), -2.5e-3);
+    QCOMPARE(a.Find(11U)->GetDouble(), 0.0);
+
+    // Shortest round trip, integral doubles keep their type, no Json for infinity
+    QCOMPARE(json.ToString(), std::string("[0,0,9223372036854775807,-9223372036854775808,9223372036854775808,"
+        "18446744073709551615,18446744073709551616.0,-9223372036854775808.0,0.1,null,-0.0025,0.0]"));
+
+    const double samples[] = { 0.1, 1.0 / 3.0, 5e-324, 1.7976931348623157e308, -123456.789, 4.35, 1e21, 2.0 };
+    for (double d : samples)
+    {
+        JsonValue back;
+        QCOMPARE(JsonReader::ParseString(back, JsonValue(d).ToString()), true);
+        QCOMPARE(back.IsDouble(), true);
+        QCOMPARE(back.GetDouble(), d);
+    }
+
+    JsonValue big(UINT64_MAX);
+    JsonValue decoded;
+    QCOMPARE(CBor::Decoder::Decode(big.ToCBor(), decoded), CBor::Decoder::CBOR_OK);
+    QCOMPARE(decoded.GetUnsigned64(), UINT64_MAX);
+
+    QCOMPARE(JsonReader::ParseString(json, "[1.5e]"), false);
+    QCOMPARE(JsonReader::ParseString(json, "[-]"), false);
+    QCOMPARE(JsonReader::ParseString(json, "[1.]"), false);
+
+    // Strict grammar: digits around the dot and in the exponent, no leading zero
+    const char *invalid[] = { "[-.5]", "[.5]", "[01]", "[-01]", "[1.e3]", "[1e+]", "[1E]", "[+1]", "[00.5]", "[-]" };
+    for (const char *text : invalid)
+    {
+        QCOMPARE(JsonReader::ParseString(json, text), false);
+    }
+    QCOMPARE(JsonReader::ParseString(json, "[0, -0, 0.5, -0.5e-3, 10E+2, 1e0]"), true);
+    QCOMPARE(json.ToString(), std::string("[0,0,0.5,-5e-04,1000.0,1.0]"));
+}
+/*****************************************************************************/
+void JsonTest::ObjectStorage()
+{
+    // Insertion order is kept, a duplicated key replaces the value in place
+    JsonObject small;
+    small.AddValue("zeta", JsonValue(1));
+    small.AddValue("alpha", JsonValue(2));
+    small.AddValue("mid", JsonValue(3));
+    small.AddValue("zeta", JsonValue(4));
+    QCOMPARE(small.GetSize(), 3U);
+    QCOMPARE(small.GetKeys(), std::vector<std::string>({ "zeta", "alpha", "mid" }));
+    QCOMPARE(small.ToString(), std::string(R"({"zeta":4,"alpha":2,"mid":3})"));
+    QCOMPARE(small.FindMember(std::string_view("alphabet", 5U))->GetInteger(), 2);
+    QVERIFY(small.FindMember("alp") == nullptr);
+
+    // Above the threshold, lookups go through the hash index
+    JsonArena arena;
+    JsonValue doc(arena.GetAllocator());
+    JsonObject &big = doc.GetObj();
+    const std::uint32_t count = 1000U;
+    for (std::uint32_t i = 0U; i < count; i++)
+    {
+        big.AddValue("key" + std::to_string(i), JsonValue(i));
+    }
+    big.AddValue("key7", JsonValue(std::string("seven")));
+    QCOMPARE(big.GetSize(), count);
+    for (std::uint32_t i = 0U; i < count; i++)
+    {
+        const JsonValue *value = big.FindMember("key" + std::to_string(i));
+        QVERIFY(value != nullptr);
+        if (i != 7U)
+        {
+            QCOMPARE(value->GetInteger(), static_cast<std::int32_t>(i));
+        }
+    }
+    QCOMPARE(big.FindMember("key7")->GetString(), std::string("seven"));
+    QVERIFY(big.FindMember("key1000") == nullptr);
+    QCOMPARE(big.GetKeys()[999], std::string("key999"));
+
+    // Copies and parsed documents keep the index
+    JsonObject copy(big);
+    QCOMPARE(copy.FindMember("key500")->GetInteger(), 500);
+    QCOMPARE(copy.ReplaceValue("key500", JsonValue(5)), true);
+    QCOMPARE(copy.FindMember("key500")->GetInteger(), 5);
+    QCOMPARE(big.FindMember("key500")->GetInteger(), 500);
+
+    JsonValue parsed;
+    QCOMPARE(JsonReader::ParseString(parsed, doc.ToString()), true);
+    QCOMPARE(parsed.ToString(), doc.ToString());
+    QCOMPARE(parsed.FindValue("key999").GetInteger(), 999);
+}
+/*****************************************************************************/
+class LinesCollector : public JsonLinesReader::IHandler
+{
+public:
+    std::vector<std::uint64_t> lines;
+    std::vector<std::int64_t> ids;
+    std::vector<std::uint64_t> errors;
+    std::vector<JsonValue> kept;
+    bool keep = false;
+    bool skipErrors = true;
+    std::size_t stopAfter = SIZE_MAX;
+
+    bool Line(std::uint64_t line, JsonValue &value) override
+    {
+        lines.push_back(line);
+        ids.push_back(value.FindValue("id").GetInteger64());
+        if (keep)
+        {
+            kept.emplace_back(std::move(value), JsonValue::allocator_type()); // moved out of the batch arena
+        }
+        return lines.size() < stopAfter;
+    }
+
+    bool Error(std::uint64_t line, JsonReader::ParseStatus status) override
+    {
+        (void) status;
+        errors.push_back(line);
+        return skipErrors;
+    }
+};
+/*****************************************************************************/
+void JsonTest::JsonLines()
+{
+    // Blank lines, CRLF and a last line without line feed
+    std::string text;
+    JsonLinesWriter writer(text);
+    const std::int64_t count = 5000;
+    for (std::int64_t i = 0; i < count; i++)
+    {
+        JsonObject record;
+        record.AddValue("id", JsonValue(i));
+        record.AddValue("name", JsonValue(std::string("sensor ") + std::to_string(i)));
+        writer.Write(record);
+        if ((i % 1000) == 0)
+        {
+            text += "  \r\n";
+        }
+    }
+    QCOMPARE(writer.GetLineCount(), std::uint64_t(count));
+    text += R"({"id":-1})";
+
+    // Small chunks: many batches in flight, the order must be kept
+    LinesCollector collector;
+    collector.keep = true;
+    JsonLinesReader reader(collector, 4U);
+    reader.SetChunkSize(1024U);
+    QCOMPARE(reader.ParseBuffer(text), JsonReader::JSON_PARSE_OK);
+    QCOMPARE(collector.ids.size(), std::size_t(count + 1));
+    // The kept values outlive their batches
+    QCOMPARE(collector.kept.size(), std::size_t(count + 1));
+    QCOMPARE(collector.kept[0].FindValue("name").GetString(), std::string("sensor 0"));
+    QCOMPARE(collector.kept[count - 1].FindValue("name").GetString(), std::string("sensor 4999"));
+    QCOMPARE(collector.kept[count].FindValue("id").GetInteger(), -1);
+    for (std::int64_t i = 0; i < count; i++)
+    {
+        QCOMPARE(collector.ids[i], i);
+    }
+    QCOMPARE(collector.ids.back(), std::int64_t(-1));
+    QCOMPARE(collector.lines[1], std::uint64_t(3)); // after the blank line
+    QCOMPARE(reader.GetLineCount(), std::uint64_t(count + 5 + 1));
+
+    // Same input pushed in odd pieces, lines are split between calls
+    LinesCollector pushed;
+    JsonLinesReader feeder(pushed, 3U);
+    feeder.SetChunkSize(700U);
+    for (std::size_t pos = 0U; pos < text.size(); pos += 333U)
+    {
+        QCOMPARE(feeder.Feed(text.data() + pos, std::min<std::size_t>(333U, text.size() - pos)), JsonReader::JSON_PARSE_OK);
+    }
+    QCOMPARE(feeder.Finish(), JsonReader::JSON_PARSE_OK);
+    QCOMPARE(pushed.ids, collector.ids);
+    QCOMPARE(pushed.lines, collector.lines);
+
+    // Memory mapped file
+    {
+        std::ofstream f("lines.ndjson", std::ios_base::out | std::ios_base::binary);
+        f << text;
+    }
+    LinesCollector mapped;
+    JsonLinesReader fileReader(mapped);
+    QCOMPARE(fileReader.ParseFile("lines.ndjson"), JsonReader::JSON_PARSE_OK);
+    QCOMPARE(mapped.ids, collector.ids);
+    QCOMPARE(fileReader.ParseFile("does_not_exist.ndjson"), JsonReader::JSON_PARSE_IO_ERROR);
+
+    // Invalid lines: skipped or fatal, stop from the handler
+    std::string broken = "{\"id\":1}\n{\"id\":\n{\"id\":3}\n";
+    LinesCollector skipping;
+    JsonLinesReader skipReader(skipping, 2U);
+    QCOMPARE(skipReader.ParseBuffer(broken), JsonReader::JSON_PARSE_OK);
+    QCOMPARE(skipping.ids, std::vector<std::int64_t>({ 1, 3 }));
+    QCOMPARE(skipping.errors, std::vector<std::uint64_t>({ 2U }));
+
+    LinesCollector strict;
+    strict.skipErrors = false;
+    JsonLinesReader strictReader(strict, 2U);
+    QCOMPARE(strictReader.ParseBuffer(broken), JsonReader::JSON_PARSE_BREAKING_BAD);
+    QCOMPARE(strict.ids.size(), std::size_t(1U));
+
+    LinesCollector stopping;
+    stopping.stopAfter = 10U;
+    JsonLinesReader stopReader(stopping, 4U);
+    stopReader.SetChunkSize(512U);
+    QCOMPARE(stopReader.ParseBuffer(text), JsonReader::JSON_PARSE_ABORTED);
+    QCOMPARE(stopping.ids.size(), std::size_t(10U));
+}
+/*****************************************************************************/
+struct BindSensor
+{
+    std::string name;
+    double value = 0.0;
+    std::optional<std::string> unit;
+    std::vector<std::int32_t> samples;
+};
+JSON_BIND(BindSensor, name, value, unit, samples)
+
+struct BindDevice
+{
+    std::uint64_t serial = 0U;
+    std::uint8_t channel = 0U;
+    bool enabled = false;
+    std::vector<BindSensor> sensors;
+    std::optional<BindSensor> main;
+    JsonValue extra;
+};
+JSON_BIND(BindDevice, serial, channel, enabled, sensors, main, extra)
+/*****************************************************************************/
+void JsonTest::BindStructs()
+{
+    const char *text = R"({ "serial": 18446744073709551615, "ignored": { "deep": [1, {"x": [true, null]}, "s"] },
+        "channel": 7, "enabled": true, "extra": { "free": [1, 2] },
+        "sensors": [ { "name": "temp", "value": 21.5, "unit": "degC", "samples": [1, -2, 3] },
+                     { "name": "hum", "value": 40, "unit": null, "samples": [] } ] })";
+
+    BindDevice device;
+    QCOMPARE(JsonBind::Decode(text, device), JsonReader::JSON_PARSE_OK);
+    QCOMPARE(device.serial, UINT64_MAX);
+    QCOMPARE(device.channel, std::uint8_t(7U));
+    QCOMPARE(device.enabled, true);
+    QCOMPARE(device.sensors.size(), std::size_t(2U));
+    QCOMPARE(device.sensors[0].name, std::string("temp"));
+    QCOMPARE(device.sensors[0].value, 21.5);
+    QCOMPARE(device.sensors[0].unit.value(), std::string("degC"));
+    QCOMPARE(device.sensors[0].samples, std::vector<std::int32_t>({ 1, -2, 3 }));
+    QCOMPARE(device.sensors[1].value, 40.0);
+    QCOMPARE(device.sensors[1].unit.has_value(), false);
+    QCOMPARE(device.main.has_value(), false);
+    QCOMPARE(device.extra.FindValue("free:1").GetInteger(), 2);
+
+    // Encoding: member order, empty optional members are omitted
+    QCOMPARE(JsonBind::ToString(device), std::string(R"({"serial":18446744073709551615,"channel":7,"enabled":true,)"
+        R"("sensors":[{"name":"temp","value":21.5,"unit":"degC","samples":[1,-2,3]},{"name":"hum","value":40.0,"samples":[]}],)"
+        R"("extra":{"free":[1,2]}})"));
+
+    BindDevice copy;
+    QCOMPARE(JsonBind::Decode(JsonBind::ToString(device), copy), JsonReader::JSON_PARSE_OK);
+    QCOMPARE(JsonBind::ToString(copy), JsonBind::ToString(device));
+
+    // Type and syntax errors, with the location
+    std::size_t offset = 0U;
+    BindDevice bad;
+    QCOMPARE(JsonBind::Decode(R"({"channel": 300})", bad, offset), JsonReader::JSON_PARSE_TYPE_MISMATCH);
+    QCOMPARE(JsonBind::Decode(R"({"channel": "7"})", bad), JsonReader::JSON_PARSE_TYPE_MISMATCH);
+    QCOMPARE(JsonBind::Decode(R"({"channel": 1.5})", bad), JsonReader::JSON_PARSE_TYPE_MISMATCH);
+    QCOMPARE(JsonBind::Decode(R"({"enabled": null})", bad), JsonReader::JSON_PARSE_TYPE_MISMATCH);
+    QCOMPARE(JsonBind::Decode(R"({"sensors": [{"name": "a"},]})", bad), JsonReader::JSON_PARSE_UNEXPECTED_CHARACTER);
+    QCOMPARE(JsonBind::Decode(R"({"serial": 1 "channel": 2})", bad, offset), JsonReader::JSON_PARSE_UNEXPECTED_CHARACTER);
+    QCOMPARE(offset, std::size_t(13U));
+    QCOMPARE(JsonBind::Decode(R"({"ignored": [1, 2})", bad), JsonReader::JSON_PARSE_UNEXPECTED_CHARACTER);
+    QCOMPARE(JsonBind::Decode(R"({"serial": 1} x)", bad), JsonReader::JSON_PARSE_UNEXPECTED_CHARACTER);
+    QCOMPARE(JsonBind::Decode(R"({"serial": 1)", bad), JsonReader::JSON_PARSE_BREAKING_BAD);
+
+    // Top level containers and scalars
+    std::vector<BindSensor> list;
+    QCOMPARE(JsonBind::Decode(R"([{"name":"a"},{"name":"b","value":-1e2}])", list), JsonReader::JSON_PARSE_OK);
+    QCOMPARE(list[1].value, -100.0);
+    std::vector<bool> flags;
+    QCOMPARE(JsonBind::Decode("[true, false]", flags), JsonReader::JSON_PARSE_OK);
+    QCOMPARE(JsonBind::ToString(flags), std::string("[true,false]"));
+}
+/*****************************************************************************/
+void JsonTest::KeyInterning()
+{
+    const char *text = R"([{"measurement_identifier": 1, "name": "a", "tags": {"measurement_identifier": "x"}},
+        {"name": "b", "measurement_identifier": 2}, {"measurement_identifier": 3, "": 0}])";
+
+    JsonArena arena;
+    arena.SetKeyInterning(true);
+    JsonValue json(arena.GetAllocator());
+    QCOMPARE(JsonReader::ParseString(json, text), true);
+    QCOMPARE(arena.GetInternedCount(), std::size_t(1U)); // short keys are stored inline
+
+    // Same key text, one copy shared by all the records
+    const JsonArray &records = json.GetArray();
+    const JsonObject &first = records.begin()[0].GetObj();
+    const JsonObject &second = records.begin()[1].GetObj();
+    QCOMPARE(first.begin()->first.IsShared(), true);
+    QCOMPARE(first.begin()->first.data(), (second.begin() + 1)->first.data());
+    QCOMPARE(first.begin()->first.data(), first.Find("tags")->GetObj().begin()->first.data());
+    QCOMPARE(json.Find("1:name")->GetString(), std::string("b"));
+    QCOMPARE(json.Find("2:measurement_identifier")->GetInteger(), 3);
+    QCOMPARE(json.ToString(), std::string(R"([{"measurement_identifier":1,"name":"a","tags":{"measurement_identifier":"x"}},)"
+        R"({"name":"b","measurement_identifier":2},{"measurement_identifier":3,"":0}])"));
+
+    // Copied out of the arena, the keys have their own text
+    JsonValue copy(json);
+    const JsonKey &key = copy.GetArray().begin()[0].GetObj().begin()->first;
+    QCOMPARE(key.IsShared(), false);
+    QCOMPARE(key == "measurement_identifier", true);
+    QCOMPARE((copy.GetArray().begin()[1].GetObj().begin()->first == "name"), true);
+    QCOMPARE(copy.ToString(), json.ToString());
+
+    // Copied inside the arena, the keys are still shared
+    JsonValue inside(json, arena.GetAllocator());
+    QCOMPARE(inside.GetArray().begin()[2].GetObj().begin()->first.data(), first.begin()->first.data());
+
+    // Without interning, each member owns its key
+    JsonArena plain;
+    JsonValue other(plain.GetAllocator());
+    QCOMPARE(JsonReader::ParseString(other, text), true);
+    QCOMPARE(plain.GetInternedCount(), std::size_t(0U));
+    QCOMPARE(other.GetArray().begin()[0].GetObj().begin()->first.IsShared(), false);
+    QVERIFY(other.GetArray().begin()[0].GetObj().begin()->first.data() != other.GetArray().begin()[2].GetObj().begin()->first.data());
+
+    // Released and reused, the arena interns the keys again
+    JsonArena reused;
+    reused.SetKeyInterning(true);
+    {
+        JsonValue doc(reused.GetAllocator());
+        QCOMPARE(JsonReader::ParseString(doc, text), true);
+    }
+    reused.release();
+    QCOMPARE(reused.GetInternedCount(), std::size_t(0U));
+    {
+        JsonValue doc(reused.GetAllocator());
+        QCOMPARE(JsonReader::ParseString(doc, text), true);
+        QCOMPARE(reused.GetInternedCount(), std::size_t(1U));
+        QCOMPARE(doc.Find("2:measurement_identifier")->GetInteger(), 3);
+    }
+}
+/*****************************************************************************/
+void JsonTest::Snapshots()
+{
+    JsonValue json;
+    QCOMPARE(JsonReader::ParseString(json, R"({"network": {"port": 80, "hosts": ["a", "b"]},
+        "log": {"level": "info"}, "big": 18446744073709551615, "ratio": 0.5, "on": true, "none": null})"), true);
+
+    JsonSnapshot config(json);
+    QCOMPARE(config.ToString(), json.ToString());
+    QCOMPARE(config.Find(JsonPath("network:hosts:1")).GetStringView(), std::string_view("b"));
+    QCOMPARE(config.GetMember("big").GetUnsigned64(), UINT64_MAX);
+    QCOMPARE(config.GetKey(1U), std::string_view("log"));
+    QCOMPARE(config.Find(JsonPath("network:missing")).IsValid(), false);
+
+    // Copies and children share the nodes
+    JsonSnapshot copy = config;
+    QCOMPARE(copy.IsSame(config), true);
+    QCOMPARE(copy.GetMember("log").IsSame(config.GetMember("log")), true);
+
+    // New version: only the nodes along the path are new
+    JsonSnapshot next = config.Set(JsonPath("network:port"), JsonSnapshot(JsonValue(8080)));
+    QCOMPARE(next.Find(JsonPath("network:port")).GetInteger64(), std::int64_t(8080));
+    QCOMPARE(config.Find(JsonPath("network:port")).GetInteger64(), std::int64_t(80));
+    QCOMPARE(next.GetMember("log").IsSame(config.GetMember("log")), true);
+    QCOMPARE(next.Find(JsonPath("network:hosts")).IsSame(config.Find(JsonPath("network:hosts"))), true);
+    QCOMPARE(next.GetMember("network").IsSame(config.GetMember("network")), false);
+
+    // Creation of members and array entries, invalid paths
+    next = next.Set(JsonPath("network:hosts:2"), JsonSnapshot(JsonValue("c")));
+    next = next.Set(JsonPath("cache:size"), JsonSnapshot(JsonValue(10)));
+    QCOMPARE(next.Find(JsonPath("network:hosts")).Size(), std::uint32_t(3U));
+    QCOMPARE(next.Find(JsonPath("cache:size")).GetInteger64(), std::int64_t(10));
+    QCOMPARE(next.Set(JsonPath("network:hosts:5"), JsonSnapshot(JsonValue(1))).IsValid(), false);
+    QCOMPARE(next.Set(JsonPath("ratio:x"), JsonSnapshot(JsonValue(1))).IsValid(), false);
+
+    // Big objects use the sorted index
+    JsonSnapshot big;
+    for (std::int32_t i = 0; i < 40; i++)
+    {
+        big = big.Set(JsonPath("k" + std::to_string(39 - i)), JsonSnapshot(JsonValue(i)));
+    }
+    QCOMPARE(big.Size(), std::uint32_t(40U));
+    QCOMPARE(big.GetMember("k0").GetInteger64(), std::int64_t(39));
+    QCOMPARE(big.GetKey(0U), std::string_view("k39"));
+    QCOMPARE(big.GetMember("k40").IsValid(), false);
+
+    // Back to a mutable tree
+    JsonValue thawed = next.ToValue();
+    thawed.GetObj().AddValue("extra", JsonValue(1));
+    QCOMPARE(thawed.Find("network:hosts:2")->GetString(), std::string("c"));
+    QCOMPARE(next.GetMember("extra").IsValid(), false);
+
+    // Readers always see a consistent version while a writer publishes new ones
+    JsonValue initial;
+    initial.GetObj().AddValue("a", JsonValue(0));
+    initial.GetObj().AddValue("b", JsonValue(0));
+    JsonPublisher publisher{JsonSnapshot(initial)};
+    std::atomic<bool> stop(false);
+    std::atomic<std::uint32_t> errors(0U);
+    std::vector<std::thread> readers;
+    for (std::uint32_t i = 0U; i < 4U; i++)
+    {
+        readers.emplace_back([&publisher, &stop, &errors]() {
+            while (!stop.load())
+            {
+                JsonSnapshot current = publisher.Get();
+                if (current.GetMember("a").GetInteger64() != current.GetMember("b").GetInteger64())
+                {
+                    errors++;
+                }
+            }
+        });
+    }
+    for (std::int32_t i = 1; i <= 2000; i++)
+    {
+        publisher.Update([i](const JsonSnapshot &current) {
+            return current.Set(JsonPath("a"), JsonSnapshot(JsonValue(i))).Set(JsonPath("b"), JsonSnapshot(JsonValue(i)));
+        });
+    }
+    stop = true;
+    for (std::thread &t : readers)
+    {
+        t.join();
+    }
+    QCOMPARE(errors.load(), std::uint32_t(0U));
+    QCOMPARE(publisher.Get().GetMember("b").GetInteger64(), std::int64_t(2000));
+    QCOMPARE(publisher.Publish(JsonSnapshot()).GetMember("a").GetInteger64(), std::int64_t(2000));
+    QCOMPARE(publisher.Get().IsValid(), false);
+}
+/*****************************************************************************/
+void JsonTest::MergePatch()
+{
+    // RFC 7386 appendix A: target, patch, result
+    const char *cases[][3] = {
+        { R"({"a":"b"})", R"({"a":"c"})", R"({"a":"c"})" },
+        { R"({"a":"b"})", R"({"b":"c"})", R"({"a":"b","b":"c"})" },
+        { R"({"a":"b"})", R"({"a":null})", R"({})" },
+        { R"({"a":"b","b":"c"})", R"({"a":null})", R"({"b":"c"})" },
+        { R"({"a":["b"]})", R"({"a":"c"})", R"({"a":"c"})" },
+        { R"({"a":"c"})", R"({"a":["b"]})", R"({"a":["b"]})" },
+        { R"({"a":{"b":"c"}})", R"({"a":{"b":"d","c":null}})", R"({"a":{"b":"d"}})" },
+        { R"({"a":[{"b":"c"}]})", R"({"a":[1]})", R"({"a":[1]})" },
+        { R"(["a","b"])", R"(["c","d"])", R"(["c","d"])" },
+        { R"({"a":"b"})", R"(["c"])", R"(["c"])" },
+        { R"({"a":"foo"})", R"(null)", R"(null)" },
+        { R"({"a":"foo"})", R"("bar")", R"("bar")" },
+        { R"({"e":null})", R"({"a":1})", R"({"e":null,"a":1})" },
+        { R"([1,2])", R"({"a":"b","c":null})", R"({"a":"b"})" },
+        { R"({})", R"({"a":{"bb":{"ccc":null}}})", R"({"a":{"bb":{}}})" }
+    };
+
+    for (const auto &c : cases)
+    {
+        JsonValue target;
+        JsonValue patch;
+        QCOMPARE(JsonReader::ParseString(target, c[0]), true);
+        QCOMPARE(JsonReader::ParseString(patch, c[1]), true);
+        JsonMergePatch::Apply(target, patch);
+        QCOMPARE(target.ToString(), std::string(c[2]));
+    }
+
+    // Diff: only the changes, and applying it gives back the new version
+    JsonValue before;
+    JsonValue after;
+    QCOMPARE(JsonReader::ParseString(before, R"({"id": 3, "name": "probe", "values": [1, 2],
+        "config": {"rate": 10, "unit": "s", "deep": {"x": 1}}, "old": true})"), true);
+    QCOMPARE(JsonReader::ParseString(after, R"({"config": {"deep": {"x": 1}, "rate": 20, "unit": "s", "mode": "fast"},
+        "values": [1, 2, 3], "name": "probe", "id": 3})"), true);
+
+    JsonValue patch;
+    QCOMPARE(JsonMergePatch::Diff(before, after, patch), true);
+    QCOMPARE(patch.ToString(), std::string(R"({"old":null,"config":{"rate":20,"mode":"fast"},"values":[1,2,3]})"));
+    JsonMergePatch::Apply(before, patch);
+    QCOMPARE(before == after, true);
+
+    // No change: empty patch
+    QCOMPARE(JsonMergePatch::Diff(before, after, patch), false);
+    QCOMPARE(patch.ToString(), std::string("{}"));
+    QCOMPARE(JsonMergePatch::Diff(JsonValue(1), JsonValue(1), patch), false);
+
+    // Scalars and arrays are replaced
+    QCOMPARE(JsonMergePatch::Diff(JsonValue(1), JsonValue(1.0), patch), true);
+    QCOMPARE(patch.ToString(), std::string("1.0"));
+
+    // Deletion in a big object keeps the hash index consistent
+    JsonValue big;
+    for (std::int32_t i = 0; i < 40; i++)
+    {
+        big.GetObj().AddValue("k" + std::to_string(i), JsonValue(i));
+    }
+    QCOMPARE(big.GetObj().DeleteMember("k3"), true);
+    QCOMPARE(big.GetObj().DeleteMember("k3"), false);
+    QCOMPARE(big.GetObj().FindMember("k39")->GetInteger(), 39);
+    QCOMPARE(big.GetObj().GetSize(), std::uint32_t(39U));
+}
+/*****************************************************************************/
+void JsonTest::ScanLevels()
+{
+    // Special characters at every position relative to the 16/32 bytes blocks
+    std::string data(100, 'a');
+    const char specials[] = { '"', '\\', '\n', '\x01', '\x1F' };
+    const JsonScan::Level levels[] = { JsonScan::SCALAR, JsonScan::SSE2, JsonScan::AVX2 };
+
+    for (JsonScan::Level level : levels)
+    {
+        if (!JsonScan::SetLevel(level))
+        {
+            continue; // not supported by this CPU
+        }
+
+        for (std::size_t pos = 0U; pos < data.size(); pos++)
+        {
+            for (char c : specials)
+            {
+                std::string str = data;
+                str[pos] = c;
+                const char *begin = str.data();
+                QCOMPARE(JsonScan::FindStringSpecial(begin, begin + str.size()), begin + pos);
+                // Must not read past the end
+                QCOMPARE(JsonScan::FindStringSpecial(begin, begin + pos), begin + pos);
+            }
+            // UTF-8 bytes are regular characters
+            std::string utf8 = data;
+            utf8[pos] = '\xC3';
+            QCOMPARE(JsonScan::FindStringSpecial(utf8.data(), utf8.data() + utf8.size()), utf8.data() + utf8.size());
+
+            std::string spaces(pos, ' ');
+            spaces += "\t\r\n x";
+            QCOMPARE(JsonScan::SkipWhitespace(spaces.data(), spaces.data() + spaces.size()), spaces.data() + spaces.size() - 1U);
+        }
+
+        JsonValue json;
+        QCOMPARE(JsonReader::ParseString(json, "  {  \"key\"  :  \"a string long enough to use the vector path \\u00e9\\n\"  }  "), true);
+        QCOMPARE(json.FindValue("key").GetString(), std::string("a string long enough to use the vector path \xC3\xA9\n"));
+    }
+    JsonScan::SetLevel(JsonScan::GetBestLevel());
+}
+/*****************************************************************************/
+class StreamCollector : public JsonStreamReader::IHandler
+{
+public:
+    std::uint32_t events = 0U;
+    std::vector<std::string> paths;
+    std::vector<JsonValue> subtrees;
+
+    bool StartObject() { events++; return true; }
+    bool EndObject() { events++; return true; }
+    bool StartArray() { events++; return true; }
+    bool EndArray() { events++; return true; }
+    bool Key(std::string_view) { events++; return true; }
+    bool String(std::string_view) { events++; return true; }
+    bool Integer(std::int64_t) { events++; return true; }
+    bool Double(double) { events++; return true; }
+    bool Bool(bool) { events++; return true; }
+    bool Null() { events++; return true; }
+
+    bool Subtree(const std::string &keyPath, JsonValue &value)
+    {
+        paths.push_back(keyPath);
+        subtrees.emplace_back(std::move(value), JsonValue::allocator_type()); // moved out of the reader's arena
+        return true;
+    }
+};
+
+void JsonTest::StreamReader()
+{
+    std::string doc = Util::FileToString(Util::ExecutablePath() + "/../../tests/input/complex.json");
+    JsonValue reference;
+    QCOMPARE(JsonReader::ParseString(reference, doc), true);
+
+    // Whole document materialized, fed with every chunk size: tokens are split everywhere
+    for (std::size_t chunk = 1U; chunk <= 64U; chunk++)
+    {
+        StreamCollector handler;
+        JsonStreamReader reader(handler);
+        reader.Select("");
+        for (std::size_t pos = 0U; pos < doc.size(); pos += chunk)
+        {
+            QCOMPARE(reader.Feed(doc.data() + pos, std::min(chunk, doc.size() - pos)), JsonReader::JSON_PARSE_OK);
+        }
+        QCOMPARE(reader.Finish(), JsonReader::JSON_PARSE_OK);
+        QCOMPARE(handler.subtrees.size(), std::size_t(1U));
+        QCOMPARE(handler.subtrees[0].ToString(), reference.ToString());
+        QCOMPARE(handler.events, 0U);
+        QCOMPARE(reader.GetOffset(), std::uint64_t(doc.size()));
+    }
+
+    // Events only, and selection of array entries
+    {
+        std::string records = R"({ "count": 3, "records": [ { "id": 1 }, { "id": 2, "tags": ["a", "b"] }, { "id": 3 } ] })";
+        StreamCollector handler;
+        JsonStreamReader reader(handler);
+        reader.Select("records:*");
+        QCOMPARE(reader.Feed(records.data(), records.size()), JsonReader::JSON_PARSE_OK);
+        QCOMPARE(reader.Finish(), JsonReader::JSON_PARSE_OK);
+        // { "count" 3 "records" [ ] }
+        QCOMPARE(handler.events, 7U);
+        QCOMPARE(handler.paths.size(), std::size_t(3U));
+        QCOMPARE(handler.paths[1], std::string("records:1"));
+        QCOMPARE(handler.subtrees[1].FindValue("tags:1").GetString(), std::string("b"));
+        QCOMPARE(handler.subtrees[2].FindValue("id").GetInteger(), 3);
+    }
+
+    // Non-valid documents, fed one byte at a time
+    const char *invalid[] = { "", "{", "[1, 2", "{\"a\" 1}", "[1,]", "[}", "{\"a\": tru}", "[-]", "[\"abc", "{\"a\": 1} x", "{a: 1}" };
+    for (const char *text : invalid)
+    {
+        StreamCollector handler;
+        JsonStreamReader reader(handler);
+        JsonReader::ParseStatus status = JsonReader::JSON_PARSE_OK;
+        for (const char *p = text; (*p != 0) && (status == JsonReader::JSON_PARSE_OK); p++)
+        {
+            status = reader.Feed(p, 1U);
+        }
+        if (status == JsonReader::JSON_PARSE_OK)
+        {
+            status = reader.Finish();
+        }
+        if (status == JsonReader::JSON_PARSE_OK)
+        {
+            std::stringstream ss;
+            ss << "Document must be rejected: " << text;
+            QFAIL(ss.str().c_str());
+        }
+    }
+}
+/*****************************************************************************/
+void JsonTest::Writer()
+{
+    JsonValue json;
+    QCOMPARE(JsonReader::ParseString(json, R"({ "b": [1, true, null, {}, []], "a": "q\"b\\s\n\u0001\u00e9" })"), true);
+
+    // Compact: keys in insertion order, all the special characters are escaped
+    std::string compact = json.ToString();
+    QCOMPARE(compact, std::string(R"({"b":[1,true,null,{},[]],"a":"q\"b\\s\n\u0001)") + "\xC3\xA9" + R"("})");
+
+    JsonValue copy;
+    QCOMPARE(JsonReader::ParseString(copy, compact), true);
+    QCOMPARE(copy.ToString(), compact);
+
+    // Pretty
+    JsonValue small;
+    QCOMPARE(JsonReader::ParseString(small, R"({"list":[1,2],"empty":{}})"), true);
+    QCOMPARE(small.ToString(0), std::string("{\n    \"list\":[\n        1,\n        2\n    ],\n    \"empty\":{}\n}"));
+
+    // Element by element, without tree
+    std::string text;
+    {
+        JsonWriter writer(text);
+        writer.StartArray();
+        writer.StartObject();
+        writer.Key("id");
+        writer.Integer(-9223372036854775807LL - 1);
+        writer.Key("name");
+        writer.String("tab\t");
+        writer.EndObject();
+        writer.Bool(false);
+        writer.EndArray();
+    }
+    QCOMPARE(text, std::string(R"([{"id":-9223372036854775808,"name":"tab\t"},false])"));
+
+    // Stream output, larger than the writer buffer
+    JsonArray big;
+    for (std::uint32_t i = 0U; i < 20000U; i++)
+    {
+        big.AddValue(JsonValue(std::string("entry number ") + std::to_string(i)));
+    }
+    std::stringstream ss;
+    {
+        JsonWriter writer(ss, JsonWriter::PRETTY);
+        writer.Write(big);
+        QCOMPARE(writer.Flush(), true);
+    }
+    QCOMPARE(ss.str(), big.ToString(0));
 }
+/*****************************************************************************/
+static std::string FromHex(const std::string &hex)
+{
+    std::string data;
+    for (std::size_t i = 0U; (i + 1U) < hex.size(); i += 2U)
+    {
+        data.push_back(static_cast<char>(std::stoul(hex.substr(i, 2U), nullptr, 16)));
+    }
+    return data;
+}
+
+class CborCollector : public CBor::Decoder::IHandler
+{
+public:
+    std::vector<std::string> items;
+
+    bool Item(JsonValue &value)
+    {
+        items.push_back(value.ToString());
+        return true;
+    }
+};
+
+void JsonTest::CborCodec()
+{
+    // Encoding examples of RFC 8949 appendix A: JSON text, CBOR
+    const char *vectors[][2] = {
+        { "0", "00" }, { "23", "17" }, { "24", "1818" }, { "1000", "1903e8" }, { "1000000", "1a000f4240" },
+        { "1000000000000", "1b000000e8d4a51000" }, { "-1", "20" }, { "-1000", "3903e7" },
+        { "true", "f5" }, { "null", "f6" }, { "\"IETF\"", "6449455446" }, { "[]", "80" }, { "[1,2,3]", "83010203" },
+        { "{\"a\":1,\"b\":[2,3]}", "a26161016162820203" }, { "1.5", "f93e00" }, { "100000.0", "fa47c35000" },
+        { "1.1", "fb3ff199999999999a" }, { "-4.0", "f9c400" }
+    };
+
+    for (const auto &vector : vectors)
+    {
+        JsonValue json;
+        QCOMPARE(JsonReader::ParseString(json, vector[0]), true);
+        std::string cbor = json.ToCBor();
+        QCOMPARE(cbor, FromHex(vector[1]));
+
+        JsonValue decoded;
+        QCOMPARE(CBor::Decoder::Decode(cbor, decoded), CBor::Decoder::CBOR_OK);
+        QCOMPARE(decoded.ToString(), json.ToString());
+    }
 
+    // Smallest half precision subnormal
+    JsonValue subnormal(5.960464477539063e-8);
+    QCOMPARE(subnormal.ToCBor(), FromHex("f90001"));
+    JsonValue decodedSubnormal;
+    QCOMPARE(CBor::Decoder::Decode(FromHex("f90001"), decodedSubnormal), CBor::Decoder::CBOR_OK);
+    QCOMPARE(decodedSubnormal.GetDouble(), 5.960464477539063e-8);
+
+    // Indefinite lengths, byte strings, integer keys and tags
+    const char *decoding[][2] = {
+        { "9f018202039f0405ffff", "[1,[2,3],[4,5]]" },
+        { "7f657374726561646d696e67ff", "\"streaming\"" },
+        { "bf6346756ef563416d7421ff", "{\"Fun\":true,\"Amt\":-2}" },
+        { "4401020304", "\"AQIDBA\"" },
+        { "a1016161", "{\"1\":\"a\"}" },
+        { "c11a514b67b0", "1363896240" },
+        { "f7", "null" }
+    };
+
+    for (const auto &vector : decoding)
+    {
+        JsonValue decoded;
+        QCOMPARE(CBor::Decoder::Decode(FromHex(vector[0]), decoded), CBor::Decoder::CBOR_OK);
+        QCOMPARE(decoded.ToString(), std::string(vector[1]));
+    }
+
+    // Whole document, streamed one byte at a time as a sequence of two items
+    JsonValue reference;
+    QCOMPARE(JsonReader::ParseFile(reference, Util::ExecutablePath() + "/../../tests/input/complex.json"), true);
+    std::string sequence = reference.ToCBor() + FromHex("83010203");
+
+    CborCollector handler;
+    CBor::Decoder decoder(handler);
+    for (char c : sequence)
+    {
+        QCOMPARE(decoder.Feed(&c, 1U), CBor::Decoder::CBOR_OK);
+    }
+    QCOMPARE(decoder.Finish(), CBor::Decoder::CBOR_OK);
+    QCOMPARE(handler.items.size(), std::size_t(2U));
+    QCOMPARE(handler.items[0], reference.ToString());
+    QCOMPARE(handler.items[1], std::string("[1,2,3]"));
+
+    // Non-valid data
+    const char *invalid[] = { "", "830102", "1c", "ff", "8301ff02", "a1f5f5", "a20102", "5f01ff", "1900" };
+    for (const char *hex : invalid)
+    {
+        JsonValue decoded;
+        if (CBor::Decoder::Decode(FromHex(hex), decoded) == CBor::Decoder::CBOR_OK)
+        {
+            std::stringstream ss;
+            ss << "CBOR data must be rejected: " << hex;
+            QFAIL(ss.str().c_str());
+        }
+    }
+}
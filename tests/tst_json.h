@@ -18,6 +18,20 @@ private Q_SLOTS:
     void ModifyValue();
     void GenerateFile();
     void ComplexFile();
+    void ArenaDocument();
+    void MoveAndFind();
+    void ScanLevels();
+    void StreamReader();
+    void Writer();
+    void CborCodec();
+    void CompiledPaths();
+    void Numbers();
+    void ObjectStorage();
+    void JsonLines();
+    void BindStructs();
+    void KeyInterning();
+    void Snapshots();
+    void MergePatch();
 
 private:
 
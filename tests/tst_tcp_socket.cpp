@@ -1,6 +1,10 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <algorithm>
 
 #include "TcpClient.h"
 #include "TcpServer.h"
@@ -15,19 +19,18 @@ class EchoServer : public tcp::TcpServer::IEvent
 
 public:
 
-    virtual void NewConnection(const tcp::Conn &conn)
+    virtual void NewConnection(const tcp::ConnPtr &conn)
 	{
         (void) conn;
 	}
 
-    virtual void ReadData(const tcp::Conn &conn)
+    virtual void ReadData(const tcp::ConnPtr &conn, std::string &&payload)
 	{
 		// echo the data received
-        tcp::TcpSocket peer(conn.peer);
-        peer.Send(conn.payload);
+        tcp::TcpSocket::Send(payload, conn->peer);
 	}
 
-    virtual void ClientClosed(const tcp::Conn &conn)
+    virtual void ClientClosed(const tcp::ConnPtr &conn)
 	{
         (void) conn;
 	}
@@ -39,6 +42,21 @@ public:
 
 };
 
+/**
+ * @brief Echo server that remembers the largest message received
+ */
+class SizeServer : public EchoServer
+{
+public:
+    std::atomic<std::size_t> largest{0U};
+
+    virtual void ReadData(const tcp::ConnPtr &conn, std::string &&payload)
+    {
+        largest = std::max(largest.load(), payload.size());
+        EchoServer::ReadData(conn, std::move(payload));
+    }
+};
+
 static bool echoTestSuccess = false;
 
 void ClientThread()
@@ -53,19 +71,12 @@ void ClientThread()
     std::this_thread::sleep_for(std::chrono::seconds(1U));
     if (client.Send(data))
     {
-        if (client.DataWaiting(2U))
+        if (client.RecvWithTimeout(buff, 1024U, 2000U))
         {
-            if (client.Recv(buff))
+            std::cout << "TEST Received: " << buff << std::endl;
+            if (data == buff)
             {
-                std::cout << "TEST Received: " << buff << std::endl;
-                if (data == buff)
-                {
-                    echoTestSuccess = true;
-                }
-            }
-            else
-            {
-                std::cout << "TEST Read error" << std::endl;
+                echoTestSuccess = true;
             }
         }
         else
@@ -189,3 +200,332 @@ void TcpSocketTest::SimpleTcpEchoServer()
 
     QCOMPARE(echoTestSuccess, true);
 }
+
+void TcpSocketTest::MultiReactorEchoServer()
+{
+    EchoServer echo;
+    std::atomic<std::uint32_t> echoed(0U);
+    std::vector<std::thread> clients;
+    static const std::uint32_t cClients = 8U;
+
+    tcp::TcpServer server(echo);
+    server.SetReactors(4U);
+
+    tcp::TcpSocket::Initialize();
+    QCOMPARE(server.Start(10, true, 61618), true);
+
+    // Each client sends its own message, whatever the reactor that serves it
+    for (std::uint32_t i = 0U; i < cClients; i++)
+    {
+        clients.push_back(std::thread([i, &echoed]() {
+            tcp::TcpClient client;
+            std::string buff;
+            std::string data = "Hello from client " + std::to_string(i);
+
+            client.Initialize();
+            if (client.Connect("127.0.0.1", 61618) && client.Send(data))
+            {
+                if (client.RecvWithTimeout(buff, 1024U, 2000U) && (buff == data))
+                {
+                    echoed++;
+                }
+            }
+            client.Close();
+        }));
+    }
+
+    for (auto &c : clients)
+    {
+        c.join();
+    }
+    server.Stop();
+
+    QCOMPARE(echoed.load(), cClients);
+}
+
+/**
+ * @brief Keeps the connection handle and counts the output queue events
+ */
+class SlowConsumerServer : public EchoServer
+{
+
+public:
+    virtual void NewConnection(const tcp::ConnPtr &conn)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mConn = conn;
+    }
+
+    virtual void HighWatermark(const tcp::ConnPtr &conn)
+    {
+        (void) conn;
+        high++;
+    }
+
+    virtual void LowWatermark(const tcp::ConnPtr &conn)
+    {
+        (void) conn;
+        low++;
+    }
+
+    tcp::ConnPtr GetConn()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mConn;
+    }
+
+    std::atomic<std::uint32_t> high{0U};
+    std::atomic<std::uint32_t> low{0U};
+
+private:
+    std::mutex mMutex;
+    tcp::ConnPtr mConn;
+};
+
+void TcpSocketTest::SlowConsumer()
+{
+    SlowConsumerServer events;
+    tcp::TcpServer server(events);
+    tcp::TcpClient client;
+
+    server.SetOutputLimits(16U * 1024U, 64U * 1024U, 256U * 1024U, tcp::TcpServer::DROP_MESSAGES);
+    tcp::TcpSocket::Initialize();
+    QCOMPARE(server.Start(10, true, 61620), true);
+
+    client.Initialize();
+    QCOMPARE(client.Connect("127.0.0.1", 61620), true);
+
+    tcp::ConnPtr conn;
+    for (std::uint32_t i = 0U; (i < 200U) && !conn; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        conn = events.GetConn();
+    }
+    QVERIFY(conn);
+
+    // The client does not read: Send() never blocks, the queue fills up and the messages are dropped
+    std::string chunk(8U * 1024U, 'x');
+    std::uint64_t accepted = 0U;
+    bool dropped = false;
+    for (std::uint32_t i = 0U; (i < 100000U) && !dropped; i++)
+    {
+        if (server.Send(conn, chunk))
+        {
+            accepted += chunk.size();
+        }
+        else
+        {
+            dropped = true;
+        }
+    }
+    QCOMPARE(dropped, true);
+
+    for (std::uint32_t i = 0U; (i < 200U) && (events.high == 0U); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    QCOMPARE(events.high.load(), 1U);
+
+    // Now read everything: the queue is flushed and the low watermark is reported
+    std::uint64_t received = 0U;
+    std::string buff;
+    while ((received < accepted) && client.RecvWithTimeout(buff, 0U, 2000U))
+    {
+        received += buff.size();
+        buff.clear();
+    }
+    QCOMPARE(received, accepted);
+
+    for (std::uint32_t i = 0U; (i < 200U) && (events.low == 0U); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    QCOMPARE(events.low.load(), 1U);
+    QCOMPARE(conn->IsConnected(), true);
+
+    client.Close();
+    server.Stop();
+}
+
+/**
+ * @brief Counts the connections ready to receive
+ */
+class CountingServer : public EchoServer
+{
+
+public:
+    virtual void NewConnection(const tcp::ConnPtr &conn)
+    {
+        (void) conn;
+        connected++;
+    }
+
+    std::atomic<std::uint32_t> connected{0U};
+};
+
+void TcpSocketTest::Broadcast()
+{
+    CountingServer events;
+    tcp::TcpServer server(events);
+    tcp::TcpClient clients[4] = { tcp::TcpClient(false), tcp::TcpClient(false), tcp::TcpClient(true), tcp::TcpClient(true) };
+
+    tcp::TcpSocket::Initialize();
+    QCOMPARE(server.Start(10, true, 61621, 61622), true);
+
+    for (std::uint32_t i = 0U; i < 4U; i++)
+    {
+        clients[i].Initialize();
+        QCOMPARE(clients[i].Connect("127.0.0.1", (i < 2U) ? 61621 : 61622), true);
+    }
+
+    for (std::uint32_t i = 0U; (i < 200U) && (events.connected < 4U); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    QCOMPARE(events.connected.load(), 4U);
+
+    // Everybody, then the WebSocket clients only
+    const char *messages[2] = { "everybody", "dashboards" };
+    for (std::uint32_t m = 0U; m < 2U; m++)
+    {
+        tcp::TcpServer::BroadcastReport report = server.Broadcast(messages[m], m == 1U);
+        QCOMPARE(report.sent + report.queued, (m == 0U) ? 4U : 2U);
+        QCOMPARE(report.dropped + report.closed, 0U);
+
+        for (std::uint32_t i = (m == 0U) ? 0U : 2U; i < 4U; i++)
+        {
+            std::string buff;
+            QCOMPARE(clients[i].RecvWithTimeout(buff, 0U, 2000U), true);
+            QCOMPARE(buff, std::string(messages[m]));
+        }
+    }
+
+    for (auto &c : clients)
+    {
+        c.Close();
+    }
+    server.Stop();
+}
+
+/**
+ * @brief Counts the connections closed by a deadline
+ */
+class TimeoutServer : public EchoServer
+{
+
+public:
+    virtual void ConnectionClosed(const tcp::ConnPtr &conn, tcp::TcpServer::IEvent::CloseType type)
+    {
+        (void) conn;
+        if (type == tcp::TcpServer::IEvent::TIMEOUT)
+        {
+            timeouts++;
+        }
+        else
+        {
+            closed++;
+        }
+    }
+
+    std::atomic<std::uint32_t> timeouts{0U};
+    std::atomic<std::uint32_t> closed{0U};
+};
+
+void TcpSocketTest::IdleTimeout()
+{
+    TimeoutServer events;
+    tcp::TcpServer server(events);
+    tcp::TcpClient silent;
+    tcp::TcpClient talker;
+
+    server.SetTimeouts(300U, 0U, 0U);
+    tcp::TcpSocket::Initialize();
+    QCOMPARE(server.Start(10, true, 61623), true);
+
+    silent.Initialize();
+    talker.Initialize();
+    QCOMPARE(silent.Connect("127.0.0.1", 61623), true);
+    QCOMPARE(talker.Connect("127.0.0.1", 61623), true);
+
+    // The talker is active more often than the idle timeout, the silent client is closed
+    for (std::uint32_t i = 0U; i < 10U; i++)
+    {
+        std::string buff;
+        QCOMPARE(talker.Send("ping"), true);
+        QCOMPARE(talker.RecvWithTimeout(buff, 0U, 2000U), true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    QCOMPARE(events.timeouts.load(), 1U);
+    QCOMPARE(events.closed.load(), 0U);
+
+    // Then the talker stops talking
+    for (std::uint32_t i = 0U; (i < 200U) && (events.timeouts < 2U); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    QCOMPARE(events.timeouts.load(), 2U);
+
+    silent.Close();
+    talker.Close();
+    server.Stop();
+}
+
+void TcpSocketTest::Backends()
+{
+    const tcp::TcpServer::Backend backends[2] = { tcp::TcpServer::BACKEND_EPOLL, tcp::TcpServer::BACKEND_IO_URING };
+
+    tcp::TcpSocket::Initialize();
+
+    // Same behaviour whatever the event loop; io_uring falls back to epoll on older kernels
+    for (auto backend : backends)
+    {
+        SizeServer echo;
+        tcp::TcpServer server(echo);
+        server.SetReactors(2U);
+        server.SetBackend(backend);
+        QCOMPARE(server.Start(10, true, 61624, 61625), true);
+        if (backend == tcp::TcpServer::BACKEND_EPOLL)
+        {
+            QCOMPARE(server.GetBackend(), tcp::TcpServer::BACKEND_EPOLL);
+        }
+
+        tcp::TcpClient clients[2] = { tcp::TcpClient(false), tcp::TcpClient(true) };
+        for (std::uint32_t i = 0U; i < 2U; i++)
+        {
+            std::string buff;
+            // More than one receive buffer
+            std::string data(40000U, 'a' + static_cast<char>(i));
+
+            clients[i].Initialize();
+            QCOMPARE(clients[i].Connect("127.0.0.1", (i == 0U) ? 61624 : 61625), true);
+            QCOMPARE(clients[i].Send("hello"), true);
+            QCOMPARE(clients[i].RecvWithTimeout(buff, 0U, 2000U), true);
+            QCOMPARE(buff, std::string("hello"));
+
+            if (i == 0U)
+            {
+                std::string received;
+                QCOMPARE(clients[i].Send(data), true);
+                while ((received.size() < data.size()) && clients[i].RecvWithTimeout(buff, 0U, 2000U))
+                {
+                    received += buff;
+                    buff.clear();
+                }
+                QCOMPARE(received, data);
+            }
+            else
+            {
+                // The WebSocket frame spans several reads, it is delivered whole
+                QCOMPARE(clients[i].Send(data), true);
+                for (std::uint32_t wait = 0U; (wait < 200U) && (echo.largest < data.size()); wait++)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+                QCOMPARE(echo.largest.load(), data.size());
+            }
+            clients[i].Close();
+        }
+        server.Stop();
+    }
+}
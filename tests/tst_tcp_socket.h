@@ -15,6 +15,11 @@ public:
 
 private Q_SLOTS:
     void SimpleTcpEchoServer();
+    void MultiReactorEchoServer();
+    void SlowConsumer();
+    void Broadcast();
+    void IdleTimeout();
+    void Backends();
 
 private:
 
@@ -10,6 +10,7 @@
 #include "tst_utilities.h"
 #include "Util.h"
 #include "Zip.h"
+#include "Strand.h"
 
 std::uint32_t Obs::gCounter = 0U;
 
@@ -327,3 +328,84 @@ void Utilities::TestZip()
     QCOMPARE(zip.Open(Util::ExecutablePath() + "/../../bin/aicontest/ai.zip", true), true);
 
 }
+
+
+void Utilities::Strands()
+{
+    static const std::uint32_t cNbStrands = 8U;
+    static const std::uint32_t cNbTasks = 2000U;
+
+    struct Sequence
+    {
+        std::shared_ptr<strand> s;
+        std::vector<std::uint32_t> order;   // written only by the tasks of the strand
+        std::atomic<bool> running{false};
+        std::atomic<std::uint32_t> overlaps{0U};
+    };
+
+    thread_pool pool(64U, 4U);
+    std::vector<std::unique_ptr<Sequence>> sequences;
+    std::atomic<std::uint32_t> done(0U);
+
+    for (std::uint32_t i = 0U; i < cNbStrands; i++)
+    {
+        sequences.emplace_back(new Sequence());
+        sequences.back()->s = std::make_shared<strand>(pool);
+    }
+
+    // Posted from two threads to each strand, the order is checked per thread
+    auto producer = [&](std::uint32_t first) {
+        for (std::uint32_t t = first; t < cNbTasks; t += 2U)
+        {
+            for (auto &seq : sequences)
+            {
+                Sequence *q = seq.get();
+                q->s->post([q, t, &done]() {
+                    if (q->running.exchange(true))
+                    {
+                        q->overlaps++;
+                    }
+                    q->order.push_back(t);
+                    q->running = false;
+                    done++;
+                });
+            }
+        }
+    };
+
+    std::thread even(producer, 0U);
+    std::thread odd(producer, 1U);
+    even.join();
+    odd.join();
+
+    while (done < (cNbStrands * cNbTasks))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    for (auto &seq : sequences)
+    {
+        QCOMPARE(seq->overlaps.load(), 0U);
+        QCOMPARE(static_cast<std::uint32_t>(seq->order.size()), cNbTasks);
+
+        std::uint32_t lastEven = 0U;
+        std::uint32_t lastOdd = 1U;
+        bool firstEven = true;
+        bool firstOdd = true;
+        for (auto t : seq->order)
+        {
+            if ((t % 2U) == 0U)
+            {
+                QVERIFY(firstEven || (t == (lastEven + 2U)));
+                firstEven = false;
+                lastEven = t;
+            }
+            else
+            {
+                QVERIFY(firstOdd || (t == (lastOdd + 2U)));
+                firstOdd = false;
+                lastOdd = t;
+            }
+        }
+    }
+}
@@ -55,6 +55,7 @@ private Q_SLOTS:
     void TestByteStream();
     void TestUtilFunctions();
     void TestZip();
+    void Strands();
 
 private:
     Subj mySubject;
@@ -44,10 +44,11 @@ public:
 
     using Proc = std::function<void(void)>;
 
+    // The function object is moved into the queue, it can own the data it works on
     template<typename F, typename... Args>
     void enqueue_work(F&& f, Args&&... args)
     {
-        m_workQueue.Push([=]() { f(args...); });
+        m_workQueue.Push([f = std::forward<F>(f), args...]() mutable { f(args...); });
     }
 
     template<typename F, typename... Args>
@@ -0,0 +1,169 @@
+/**
+ * MIT License
+ * Copyright (c) 2019 Anthony Rabine
+ */
+
+#ifndef STRAND_H
+#define STRAND_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "Pool.h"
+
+/*****************************************************************************/
+/**
+ * @brief Serial executor on top of a thread_pool
+ *
+ * The functions posted to one strand run in the posting order and never at the
+ * same time, on any worker of the pool; the functions of different strands run
+ * in parallel. Posting does not take any lock: the functions are linked in a
+ * lock-free queue and the strand is given to the pool only when it was idle,
+ * then it runs a batch of functions per pool job.
+ *
+ * A strand is always owned by a std::shared_ptr, a scheduled job keeps it alive:
+ *
+ *     std::shared_ptr<strand> s = std::make_shared<strand>(pool);
+ *     s->post([]() { first(); });
+ *     s->post([]() { second(); }); // after first() has returned
+ */
+class strand : public std::enable_shared_from_this<strand>
+{
+public:
+    using Proc = thread_pool::Proc;
+
+    explicit strand(thread_pool &pool)
+        : m_pool(pool)
+        , m_head(&m_stub)
+        , m_tail(&m_stub)
+        , m_pending(0U)
+    {
+
+    }
+
+    ~strand()
+    {
+        node *n;
+        while ((n = pop()) != nullptr)
+        {
+            delete n;
+        }
+    }
+
+    strand(const strand &) = delete;
+    strand &operator=(const strand &) = delete;
+
+    void post(Proc f)
+    {
+        push(new node(std::move(f)));
+
+        // The first function of an idle strand starts a run on the pool
+        if (m_pending.fetch_add(1U, std::memory_order_acq_rel) == 0U)
+        {
+            schedule();
+        }
+    }
+
+private:
+    // Functions run per pool job, so that a busy strand does not monopolize a worker
+    static const std::size_t cMaxBatch = 32U;
+
+    struct node
+    {
+        explicit node(Proc &&f = nullptr)
+            : fn(std::move(f))
+            , next(nullptr)
+        {
+
+        }
+
+        Proc fn;
+        std::atomic<node *> next;
+    };
+
+    void schedule()
+    {
+        std::shared_ptr<strand> self = shared_from_this();
+        m_pool.enqueue_work([self]() { self->run(); });
+    }
+
+    void run()
+    {
+        for (std::size_t done = 0U; done < cMaxBatch; done++)
+        {
+            node *n;
+            while ((n = pop()) == nullptr)
+            {
+                // A producer is between its two steps, the link is coming
+                std::this_thread::yield();
+            }
+            n->fn();
+            delete n;
+
+            if (m_pending.fetch_sub(1U, std::memory_order_acq_rel) == 1U)
+            {
+                return; // idle, the next post() schedules a new run
+            }
+        }
+        schedule();
+    }
+
+    // Multiple producers (intrusive MPSC queue, D. Vyukov)
+    void push(node *n)
+    {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        node *prev = m_head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    // Single consumer: the run in progress
+    node *pop()
+    {
+        node *tail = m_tail;
+        node *next = tail->next.load(std::memory_order_acquire);
+
+        if (tail == &m_stub)
+        {
+            if (next == nullptr)
+            {
+                return nullptr;
+            }
+            m_tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next != nullptr)
+        {
+            m_tail = next;
+            return tail;
+        }
+
+        if (tail != m_head.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+
+        // Last node: put the stub behind it to be able to unlink it
+        push(&m_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next != nullptr)
+        {
+            m_tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    thread_pool &m_pool;
+    std::atomic<node *> m_head; // last pushed
+    node *m_tail;               // next to pop
+    node m_stub;
+    std::atomic<std::size_t> m_pending; // posted and not finished
+};
+
+#endif // STRAND_H
+
+//=============================================================================
+// End of file Strand.h
+//=============================================================================
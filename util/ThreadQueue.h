@@ -26,6 +26,13 @@ public:
         mCondVar.notify_one();
     }
 
+    void Push(Data &&data)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueue.push(std::move(data));
+        mCondVar.notify_one();
+    }
+
     bool Empty() const
     {
         std::lock_guard<std::mutex> lock(mMutex);
@@ -40,7 +47,7 @@ public:
             return false;
         }
 
-        popped_value = mQueue.front();
+        popped_value = std::move(mQueue.front());
         mQueue.pop();
         return true;
     }
@@ -53,7 +60,7 @@ public:
             mCondVar.wait(lock);
         }
 
-        popped_value = mQueue.front();
+        popped_value = std::move(mQueue.front());
         mQueue.pop();
     }
 
@@ -68,7 +75,7 @@ public:
             }
         }
 
-        popped_value = mQueue.front();
+        popped_value = std::move(mQueue.front());
         mQueue.pop();
         return true;
     }